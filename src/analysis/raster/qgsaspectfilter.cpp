@@ -48,3 +48,7 @@ float QgsAspectFilter::processNineCellWindow(
   }
 }
 
+void QgsAspectFilter::processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  processRowNonVirtual( this, scanLine1, scanLine2, scanLine3, resultLine, xSize );
+}
@@ -0,0 +1,465 @@
+/***************************************************************************
+                          qgskde.cpp  -  description
+                          ----------------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgskde.h"
+#include "qgis.h"
+#include "qgspoint.h"
+#include "qgslogger.h"
+#include "gdal.h"
+#include "cpl_conv.h"
+#include <QFile>
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <QProgressDialog>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <cstring>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
+#define TO8F(x) (x).toUtf8().constData()
+#else
+#define TO8F(x) QFile::encodeName( x ).constData()
+#endif
+
+#define NO_DATA -9999
+
+// number of cells of the stripe buffer of a worker
+static const int STRIPE_CELLS = 1024 * 1024;
+
+/**Precomputed kernel values of a buffer size*/
+struct QgsKdeStamp
+{
+  /**(2 * buffer + 1) rows of (2 * buffer + 1) values*/
+  QVector<double> values;
+  /**Number of cells within the kernel radius left and right of the center, for each row*/
+  QVector<int> halfWidths;
+};
+
+/**Shared state of the worker threads*/
+struct QgsKernelDensityEstimation::Job
+{
+  //points ordered by stripe of their center row
+  QVector<KdePoint> points;
+  QVector<int> stripeFirstPoint;
+  //stamps indexed by buffer size
+  QVector<QgsKdeStamp> stamps;
+  int maxBuffer;
+
+  int columns;
+  int rows;
+  int stripeRows;
+  int stripeCount;
+
+  //GDAL dataset handles must not be accessed concurrently
+  GDALRasterBandH band;
+  QMutex ioMutex;
+
+  QAtomicInt nextStripe;
+  QAtomicInt failed;
+  QAtomicInt canceled;
+
+  //guards stripesDone and wakes up the thread reporting progress
+  QMutex progressMutex;
+  QWaitCondition progressCondition;
+  int stripesDone;
+  int activeWorkers;
+};
+
+QgsKernelDensityEstimation::QgsKernelDensityEstimation( const QgsRectangle& extent, double cellSize, int columns, int rows )
+    : mExtent( extent )
+    , mCellSize( cellSize )
+    , mColumns( columns )
+    , mRows( rows )
+    , mKernelShape( Quartic )
+    , mDecayRatio( 0.0 )
+    , mThreadCount( 0 )
+{
+}
+
+QgsKernelDensityEstimation::~QgsKernelDensityEstimation()
+{
+}
+
+bool QgsKernelDensityEstimation::addPoint( const QgsPoint& point, double radius, double weight )
+{
+  // avoiding any empty points or out of extent points
+  if (( point.x() < mExtent.xMinimum() ) || ( point.y() < mExtent.yMinimum() )
+      || ( point.x() > mExtent.xMaximum() ) || ( point.y() > mExtent.yMaximum() ) )
+  {
+    return false;
+  }
+
+  int buffer = bufferSize( radius, mCellSize );
+  if ( buffer < 1 )
+  {
+    return false;
+  }
+
+  KdePoint kdePoint;
+  kdePoint.column = ( int )(( point.x() - mExtent.xMinimum() ) / mCellSize );
+  kdePoint.row = ( int )(( point.y() - mExtent.yMinimum() ) / mCellSize );
+  kdePoint.buffer = buffer;
+  kdePoint.weight = ( float ) weight;
+  mPoints << kdePoint;
+  return true;
+}
+
+int QgsKernelDensityEstimation::writeRaster( const QString& outputFile, const QString& outputFormat, const QString& crsWkt, QProgressDialog* p )
+{
+  if ( mColumns <= 0 || mRows <= 0 )
+  {
+    return 2;
+  }
+
+  GDALAllRegister();
+
+  GDALDriverH outputDriver = GDALGetDriverByName( outputFormat.toLocal8Bit().data() );
+  if ( outputDriver == 0 )
+  {
+    return 1;
+  }
+
+  GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( outputFile ), mColumns, mRows, 1, GDT_Float32, 0 );
+  if ( outputDataset == NULL )
+  {
+    return 2;
+  }
+
+  double geoTransform[6] = { mExtent.xMinimum(), mCellSize, 0, mExtent.yMinimum(), 0, mCellSize };
+  GDALSetGeoTransform( outputDataset, geoTransform );
+  // Set the projection on the raster destination to match the input layer
+  GDALSetProjection( outputDataset, crsWkt.toLocal8Bit().data() );
+
+  GDALRasterBandH outputBand = GDALGetRasterBand( outputDataset, 1 );
+  GDALSetRasterNoDataValue( outputBand, NO_DATA );
+
+  Job job;
+  job.columns = mColumns;
+  job.rows = mRows;
+  job.band = outputBand;
+  job.stripesDone = 0;
+
+  // stripes of whole blocks, so that no block is written twice
+  int blockXSize, blockYSize;
+  GDALGetBlockSize( outputBand, &blockXSize, &blockYSize );
+  blockYSize = qMax( blockYSize, 1 );
+  int stripeRows = qMax( STRIPE_CELLS / qMax( mColumns, 1 ), 1 );
+  job.stripeRows = qMax(( stripeRows / blockYSize ) * blockYSize, blockYSize );
+  job.stripeCount = ( mRows + job.stripeRows - 1 ) / job.stripeRows;
+
+  // order the points by stripe (counting sort), workers then only visit the points near their stripe
+  job.maxBuffer = 0;
+  job.stripeFirstPoint.fill( 0, job.stripeCount + 1 );
+  for ( int i = 0; i < mPoints.size(); ++i )
+  {
+    const KdePoint& point = mPoints.at( i );
+    job.maxBuffer = qMax( job.maxBuffer, point.buffer );
+    int stripe = qBound( 0, point.row / job.stripeRows, job.stripeCount - 1 );
+    job.stripeFirstPoint[stripe + 1]++;
+  }
+  for ( int i = 0; i < job.stripeCount; ++i )
+  {
+    job.stripeFirstPoint[i + 1] += job.stripeFirstPoint[i];
+  }
+  QVector<int> nextPoint = job.stripeFirstPoint;
+  job.points.resize( mPoints.size() );
+  for ( int i = 0; i < mPoints.size(); ++i )
+  {
+    const KdePoint& point = mPoints.at( i );
+    int stripe = qBound( 0, point.row / job.stripeRows, job.stripeCount - 1 );
+    job.points[nextPoint[stripe]++] = point;
+  }
+
+  // kernel values are computed once for each buffer size
+  job.stamps.resize( job.maxBuffer + 1 );
+  for ( int i = 0; i < job.points.size(); ++i )
+  {
+    int buffer = job.points.at( i ).buffer;
+    QgsKdeStamp& stamp = job.stamps[buffer];
+    if ( !stamp.values.isEmpty() )
+    {
+      continue;
+    }
+    stamp.values = kernelStamp( buffer );
+    stamp.halfWidths.resize( 2 * buffer + 1 );
+    for ( int dy = -buffer; dy <= buffer; ++dy )
+    {
+      // is pixel outside search bandwidth of feature?
+      int halfWidth = buffer;
+      while ( halfWidth * halfWidth + dy * dy > buffer * buffer )
+      {
+        --halfWidth;
+      }
+      stamp.halfWidths[dy + buffer] = halfWidth;
+    }
+  }
+
+  int threads = mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount();
+  threads = qBound( 1, threads, job.stripeCount );
+  job.activeWorkers = threads;
+
+  QgsDebugMsg( QString( "%1 points, %2 stripes of %3 rows on %4 threads" ).arg( job.points.size() ).arg( job.stripeCount ).arg( job.stripeRows ).arg( threads ) );
+
+  if ( p )
+  {
+    p->setMaximum( job.stripeCount );
+  }
+
+  QList< QFuture<void> > workers;
+  for ( int i = 0; i < threads; ++i )
+  {
+    workers << QtConcurrent::run( &QgsKernelDensityEstimation::processStripes, &job );
+  }
+
+  // report progress while the workers are busy
+  job.progressMutex.lock();
+  while ( job.activeWorkers > 0 )
+  {
+    job.progressCondition.wait( &job.progressMutex, 100 );
+    if ( p )
+    {
+      int stripesDone = job.stripesDone;
+      job.progressMutex.unlock();
+      p->setValue( stripesDone );
+      if ( p->wasCanceled() )
+      {
+        job.canceled = 1;
+      }
+      job.progressMutex.lock();
+    }
+  }
+  job.progressMutex.unlock();
+
+  for ( int i = 0; i < workers.size(); ++i )
+  {
+    workers[i].waitForFinished();
+  }
+
+  if ( p )
+  {
+    p->setValue( job.stripeCount );
+  }
+
+  GDALClose( outputDataset );
+
+  if ( job.canceled )
+  {
+    return 4;
+  }
+  if ( job.failed )
+  {
+    return 3;
+  }
+  return 0;
+}
+
+void QgsKernelDensityEstimation::processStripes( Job* job )
+{
+  int columns = job->columns;
+  QVector<double> density;
+  QVector<char> reached;
+  QVector<float> output;
+
+  while ( !job->failed && !job->canceled )
+  {
+    int stripe = job->nextStripe.fetchAndAddOrdered( 1 );
+    if ( stripe >= job->stripeCount )
+    {
+      break;
+    }
+
+    int firstRow = stripe * job->stripeRows;
+    int lastRow = qMin( firstRow + job->stripeRows, job->rows ) - 1;
+    int nRows = lastRow - firstRow + 1;
+    density.fill( 0.0, columns * nRows );
+    reached.fill( 0, columns * nRows );
+
+    // stripes which may contain the center of points reaching this stripe
+    int firstStripe = qMax( firstRow - job->maxBuffer, 0 ) / job->stripeRows;
+    int lastStripe = qMin(( lastRow + job->maxBuffer ) / job->stripeRows, job->stripeCount - 1 );
+
+    for ( int i = job->stripeFirstPoint.at( firstStripe ); i < job->stripeFirstPoint.at( lastStripe + 1 ); ++i )
+    {
+      const KdePoint& point = job->points.at( i );
+      int buffer = point.buffer;
+      if ( point.row + buffer < firstRow || point.row - buffer > lastRow )
+      {
+        continue;
+      }
+
+      const QgsKdeStamp& stamp = job->stamps.at( buffer );
+      int stampSize = 2 * buffer + 1;
+      int dyFirst = qMax( -buffer, firstRow - point.row );
+      int dyLast = qMin( buffer, lastRow - point.row );
+      double weight = point.weight;
+
+      for ( int dy = dyFirst; dy <= dyLast; ++dy )
+      {
+        int halfWidth = stamp.halfWidths.at( dy + buffer );
+        int dxFirst = qMax( -halfWidth, -point.column );
+        int dxLast = qMin( halfWidth, columns - 1 - point.column );
+        if ( dxFirst > dxLast )
+        {
+          continue;
+        }
+
+        // centers of the stamp row and the density row
+        const double* stampLine = stamp.values.constData() + ( qgssize )( dy + buffer ) * stampSize + buffer;
+        qgssize offset = ( qgssize )( point.row + dy - firstRow ) * columns + point.column;
+        double* densityLine = density.data() + offset;
+        for ( int dx = dxFirst; dx <= dxLast; ++dx )
+        {
+          densityLine[dx] += weight * stampLine[dx];
+        }
+        memset( reached.data() + offset + dxFirst, 1, dxLast - dxFirst + 1 );
+      }
+    }
+
+    output.resize( columns * nRows );
+    for ( int i = 0; i < output.size(); ++i )
+    {
+      output[i] = reached.at( i ) ? density.at( i ) : NO_DATA;
+    }
+
+    CPLErr err;
+    {
+      QMutexLocker locker( &job->ioMutex );
+      err = GDALRasterIO( job->band, GF_Write, 0, firstRow, columns, nRows, output.data(), columns, nRows, GDT_Float32, 0, 0 );
+    }
+    if ( err != CE_None )
+    {
+      job->failed = 1;
+      break;
+    }
+
+    QMutexLocker locker( &job->progressMutex );
+    job->stripesDone++;
+    job->progressCondition.wakeAll();
+  }
+
+  QMutexLocker locker( &job->progressMutex );
+  job->activeWorkers--;
+  job->progressCondition.wakeAll();
+}
+
+QVector<double> QgsKernelDensityEstimation::kernelStamp( int buffer ) const
+{
+  int stampSize = 2 * buffer + 1;
+  QVector<double> stamp( stampSize * stampSize, 0.0 );
+  for ( int dy = -buffer; dy <= buffer; ++dy )
+  {
+    for ( int dx = -buffer; dx <= buffer; ++dx )
+    {
+      double distance = sqrt(( double )( dx * dx + dy * dy ) );
+      if ( distance > buffer )
+      {
+        continue;
+      }
+      stamp[( dy + buffer ) * stampSize + dx + buffer] = kernelValue( mKernelShape, distance, buffer, mDecayRatio );
+    }
+  }
+  return stamp;
+}
+
+int QgsKernelDensityEstimation::bufferSize( double radius, double cellSize )
+{
+  // Calculate the buffer size in pixels
+
+  int buffer = radius / cellSize;
+  if ( radius - ( cellSize * buffer ) > 0.5 )
+  {
+    ++buffer;
+  }
+  return buffer;
+}
+
+double QgsKernelDensityEstimation::kernelValue( KernelShape shape, double distance, int bandwidth, double decayRatio )
+{
+  /* The kernel functions below are taken from "Kernel Smoothing" by Wand and Jones (1995), p. 175
+   *
+   * Each kernel is multiplied by a normalizing constant "k", which normalizes the kernel area
+   * to 1 for a given bandwidth size.
+   *
+   * k is calculated by polar double integration of the kernel function
+   * between a radius of 0 to the specified bandwidth and equating the area to 1. */
+
+  switch ( shape )
+  {
+    case Triangular:
+    {
+      // Normalizing constant. In this case it's calculated a little different
+      // due to the inclusion of the non-standard "decay" parameter
+      if ( decayRatio >= 0 )
+      {
+        double k = 3. / (( 1. + 2. * decayRatio ) * M_PI * pow(( double )bandwidth, 2 ) );
+
+        // Derived from Wand and Jones (1995), p. 175 (with addition of decay parameter)
+        return k * ( 1. - ( 1. - decayRatio ) * ( distance / ( double )bandwidth ) );
+      }
+      else
+      {
+        // Non-standard or mathematically valid negative decay ("coolmap")
+        return ( 1. - ( 1. - decayRatio ) * ( distance / ( double )bandwidth ) );
+      }
+    }
+
+    case Uniform:
+    {
+      // Normalizing constant
+      double k = 2. / ( M_PI * ( double )bandwidth );
+
+      // Derived from Wand and Jones (1995), p. 175
+      return k * ( 0.5 / ( double )bandwidth );
+    }
+
+    case Quartic:
+    {
+      // Normalizing constant
+      double k = 16. / ( 5. * M_PI * pow(( double )bandwidth, 2 ) );
+
+      // Derived from Wand and Jones (1995), p. 175
+      return k * ( 15. / 16. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
+    }
+
+    case Triweight:
+    {
+      // Normalizing constant
+      double k = 128. / ( 35. * M_PI * pow(( double )bandwidth, 2 ) );
+
+      // Derived from Wand and Jones (1995), p. 175
+      return k * ( 35. / 32. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
+    }
+
+    case Epanechnikov:
+    {
+      // Normalizing constant
+      double k = 8. / ( 3. * M_PI * pow(( double )bandwidth, 2 ) );
+
+      // Derived from Wand and Jones (1995), p. 175
+      return k * ( 3. / 4. ) * ( 1. - pow( distance / ( double )bandwidth, 2 ) );
+    }
+  }
+  return 0;
+}
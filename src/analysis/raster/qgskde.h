@@ -0,0 +1,120 @@
+/***************************************************************************
+                          qgskde.h  -  description
+                          --------------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSKDE_H
+#define QGSKDE_H
+
+#include "qgsrectangle.h"
+#include <QString>
+#include <QVector>
+
+class QgsPoint;
+class QProgressDialog;
+
+/**Kernel density estimation (heatmap) of weighted points into a raster.
+
+  The points are added first, then the raster is computed in horizontal stripes: every worker thread accumulates
+  the precomputed kernel stamps of the points reaching a stripe into its own buffer and writes the stripe to the
+  output file, so that the whole raster is never held in memory.
+  @note added in 2.6 */
+class ANALYSIS_EXPORT QgsKernelDensityEstimation
+{
+  public:
+    /**Kernel shapes, in the order of the heatmap plugin*/
+    enum KernelShape
+    {
+      Quartic,
+      Triangular,
+      Uniform,
+      Triweight,
+      Epanechnikov
+    };
+
+    /**@param extent extent of the raster. The first row of the raster is at the minimum y of the extent
+      @param cellSize size of the square cells in map units
+      @param columns number of raster columns
+      @param rows number of raster rows*/
+    QgsKernelDensityEstimation( const QgsRectangle& extent, double cellSize, int columns, int rows );
+    ~QgsKernelDensityEstimation();
+
+    KernelShape kernelShape() const { return mKernelShape; }
+    void setKernelShape( KernelShape shape ) { mKernelShape = shape; }
+
+    /**Decay ratio of the triangular kernel*/
+    double decayRatio() const { return mDecayRatio; }
+    void setDecayRatio( double ratio ) { mDecayRatio = ratio; }
+
+    /**Number of worker threads, 0 (the default) uses QThread::idealThreadCount()*/
+    int threadCount() const { return mThreadCount; }
+    void setThreadCount( int count ) { mThreadCount = count; }
+
+    /**Adds a point. Points outside of the extent or with a kernel radius of less than one cell are ignored
+      @param point position in map units
+      @param radius kernel radius (bandwidth) in map units
+      @param weight weight of the point
+      @return true if the point was added*/
+    bool addPoint( const QgsPoint& point, double radius, double weight = 1.0 );
+
+    /**Returns the number of points added*/
+    int pointCount() const { return mPoints.size(); }
+
+    /**Computes the density raster and writes it to a new file. Cells out of reach of all points are set to -9999 (nodata)
+      @param outputFile file name of the raster
+      @param outputFormat GDAL driver name
+      @param crsWkt projection of the raster as WKT
+      @param p progress dialog that receives update and that is checked for abort. 0 if no progress bar is needed.
+      @return 0 in case of success, 1 if the driver is not available, 2 if the raster cannot be created,
+      3 in case of a write error and 4 if canceled*/
+    int writeRaster( const QString& outputFile, const QString& outputFormat, const QString& crsWkt, QProgressDialog* p = 0 );
+
+    /**Returns the radius in cells of a kernel (buffer size)*/
+    static int bufferSize( double radius, double cellSize );
+
+    /**Returns the value of a kernel at a distance (in cells) from the point
+      @param shape kernel shape
+      @param distance distance from the point in cells
+      @param bandwidth kernel radius in cells
+      @param decayRatio decay ratio of the triangular kernel*/
+    static double kernelValue( KernelShape shape, double distance, int bandwidth, double decayRatio );
+
+  private:
+    /**A point in cell coordinates with its kernel radius in cells*/
+    struct KdePoint
+    {
+      int column;
+      int row;
+      int buffer;
+      float weight;
+    };
+
+    struct Job;
+    static void processStripes( Job* job );
+
+    /**Returns kernel values for a square of (2 * buffer + 1) cells around the point, row by row*/
+    QVector<double> kernelStamp( int buffer ) const;
+
+    QgsRectangle mExtent;
+    double mCellSize;
+    int mColumns;
+    int mRows;
+    KernelShape mKernelShape;
+    double mDecayRatio;
+    int mThreadCount;
+    QVector<KdePoint> mPoints;
+};
+
+#endif // QGSKDE_H
@@ -19,6 +19,10 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -28,7 +32,7 @@
 
 QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile ), mOutputFile( outputFile ), mOutputFormat( outputFormat ), mCellSizeX( -1 ), mCellSizeY( -1 ),
-    mInputNodataValue( -1 ), mOutputNodataValue( -1 ), mZFactor( 1.0 )
+    mInputNodataValue( -1 ), mOutputNodataValue( -1 ), mZFactor( 1.0 ), mThreadCount( 1 ), mTileRows( 256 )
 {
 
 }
@@ -96,6 +100,46 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
+  int threads = mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount();
+  bool completed;
+  if ( threads > 1 )
+  {
+    completed = processRasterTiled( rasterBand, outputRasterBand, xSize, ySize, threads, p );
+  }
+  else
+  {
+    completed = processRasterSerial( rasterBand, outputRasterBand, xSize, ySize, p );
+  }
+
+  GDALClose( inputDataset );
+
+  if ( !completed )
+  {
+    //delete the dataset without closing (because it is faster)
+    GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
+    return 7;
+  }
+  GDALClose( outputDataset );
+
+  return 0;
+}
+
+void QgsNineCellFilter::processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  for ( int j = 0; j < xSize; ++j )
+  {
+    float* x11 = j > 0 ? &scanLine1[j-1] : &mInputNodataValue;
+    float* x12 = j > 0 ? &scanLine2[j-1] : &mInputNodataValue;
+    float* x13 = j > 0 ? &scanLine3[j-1] : &mInputNodataValue;
+    float* x31 = j < xSize - 1 ? &scanLine1[j+1] : &mInputNodataValue;
+    float* x32 = j < xSize - 1 ? &scanLine2[j+1] : &mInputNodataValue;
+    float* x33 = j < xSize - 1 ? &scanLine3[j+1] : &mInputNodataValue;
+    resultLine[j] = processNineCellWindow( x11, &scanLine1[j], x31, x12, &scanLine2[j], x32, x13, &scanLine3[j], x33 );
+  }
+}
+
+bool QgsNineCellFilter::processRasterSerial( GDALRasterBandH rasterBand, GDALRasterBandH outputRasterBand, int xSize, int ySize, QProgressDialog* p )
+{
   //keep only three scanlines in memory at a time
   float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
   float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
@@ -132,11 +176,11 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     }
     else
     {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
+      //normally fetch only scanLine3 and recycle scanline 1 if we move forward one row
+      float* recycled = scanLine1;
       scanLine1 = scanLine2;
       scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      scanLine3 = recycled;
     }
 
     if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
@@ -151,24 +195,7 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
       GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 );
     }
 
-    for ( int j = 0; j < xSize; ++j )
-    {
-      if ( j == 0 )
-      {
-        resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
-                                               &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
-                                               &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
-      }
-      else
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
-                                               &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
-      }
-    }
+    processRow( scanLine1, scanLine2, scanLine3, resultLine, xSize );
 
     GDALRasterIO( outputRasterBand, GF_Write, 0, i, xSize, 1, resultLine, xSize, 1, GDT_Float32, 0, 0 );
   }
@@ -183,17 +210,167 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   CPLFree( scanLine2 );
   CPLFree( scanLine3 );
 
-  GDALClose( inputDataset );
+  return !( p && p->wasCanceled() );
+}
 
-  if ( p && p->wasCanceled() )
+struct QgsNineCellFilter::TileContext
+{
+  GDALRasterBandH inputBand;
+  GDALRasterBandH outputBand;
+  int xSize;
+  int ySize;
+  int tileRows;
+  int tileCount;
+
+  //GDAL dataset handles must not be accessed concurrently
+  QMutex ioMutex;
+
+  QAtomicInt nextTile;
+  QAtomicInt canceled;
+
+  //guards rowsDone and wakes up the thread reporting progress
+  QMutex progressMutex;
+  QWaitCondition progressCondition;
+  int rowsDone;
+  int activeWorkers;
+};
+
+bool QgsNineCellFilter::processRasterTiled( GDALRasterBandH rasterBand, GDALRasterBandH outputRasterBand, int xSize, int ySize, int threads, QProgressDialog* p )
+{
+  //align tiles to the output blocks, so that compressed blocks are written once
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( outputRasterBand, &blockXSize, &blockYSize );
+  int tileRows = qMax( mTileRows, 1 );
+  if ( blockYSize > 1 && tileRows % blockYSize != 0 )
   {
-    //delete the dataset without closing (because it is faster)
-    GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
-    return 7;
+    tileRows = ( tileRows / blockYSize + 1 ) * blockYSize;
   }
-  GDALClose( outputDataset );
 
-  return 0;
+  TileContext context;
+  context.inputBand = rasterBand;
+  context.outputBand = outputRasterBand;
+  context.xSize = xSize;
+  context.ySize = ySize;
+  context.tileRows = tileRows;
+  context.tileCount = ( ySize + tileRows - 1 ) / tileRows;
+  context.rowsDone = 0;
+
+  threads = qMin( threads, context.tileCount );
+  context.activeWorkers = threads;
+
+  if ( p )
+  {
+    p->setMaximum( ySize );
+    p->setValue( 0 );
+  }
+
+  QList< QFuture<void> > workers;
+  for ( int i = 0; i < threads; ++i )
+  {
+    workers << QtConcurrent::run( this, &QgsNineCellFilter::processTiles, &context );
+  }
+
+  //report progress and poll for cancelation while the workers are busy
+  context.progressMutex.lock();
+  while ( context.activeWorkers > 0 )
+  {
+    context.progressCondition.wait( &context.progressMutex, 100 );
+    if ( p )
+    {
+      int rowsDone = context.rowsDone;
+      context.progressMutex.unlock();
+      p->setValue( rowsDone );
+      if ( p->wasCanceled() )
+      {
+        context.canceled = 1;
+      }
+      context.progressMutex.lock();
+    }
+  }
+  context.progressMutex.unlock();
+
+  for ( int i = 0; i < workers.size(); ++i )
+  {
+    workers[i].waitForFinished();
+  }
+
+  if ( context.canceled )
+  {
+    return false;
+  }
+
+  if ( p )
+  {
+    p->setValue( ySize );
+  }
+  return true;
+}
+
+void QgsNineCellFilter::processTiles( TileContext* context )
+{
+  int xSize = context->xSize;
+  //tile rows plus one halo row above and below
+  float* inputBlock = ( float * ) CPLMalloc( sizeof( float ) * xSize * ( context->tileRows + 2 ) );
+  float* resultBlock = ( float * ) CPLMalloc( sizeof( float ) * xSize * context->tileRows );
+
+  while ( !context->canceled )
+  {
+    int tile = context->nextTile.fetchAndAddOrdered( 1 );
+    if ( tile >= context->tileCount )
+    {
+      break;
+    }
+
+    int firstRow = tile * context->tileRows;
+    int nRows = qMin( context->tileRows, context->ySize - firstRow );
+
+    //values outside the layer extent are sent to the processing method as (input) nodata values
+    int readFirst = qMax( firstRow - 1, 0 );
+    int readLast = qMin( firstRow + nRows, context->ySize - 1 );
+    float* readStart = inputBlock + ( readFirst - firstRow + 1 ) * xSize;
+    if ( readFirst == firstRow )
+    {
+      for ( int a = 0; a < xSize; ++a )
+      {
+        inputBlock[a] = mInputNodataValue;
+      }
+    }
+    if ( readLast < firstRow + nRows )
+    {
+      float* belowLine = inputBlock + ( nRows + 1 ) * xSize;
+      for ( int a = 0; a < xSize; ++a )
+      {
+        belowLine[a] = mInputNodataValue;
+      }
+    }
+
+    {
+      QMutexLocker locker( &context->ioMutex );
+      GDALRasterIO( context->inputBand, GF_Read, 0, readFirst, xSize, readLast - readFirst + 1, readStart, xSize, readLast - readFirst + 1, GDT_Float32, 0, 0 );
+    }
+
+    for ( int i = 0; i < nRows; ++i )
+    {
+      processRow( inputBlock + i * xSize, inputBlock + ( i + 1 ) * xSize, inputBlock + ( i + 2 ) * xSize, resultBlock + i * xSize, xSize );
+    }
+
+    {
+      QMutexLocker locker( &context->ioMutex );
+      GDALRasterIO( context->outputBand, GF_Write, 0, firstRow, xSize, nRows, resultBlock, xSize, nRows, GDT_Float32, 0, 0 );
+    }
+
+    QMutexLocker locker( &context->progressMutex );
+    context->rowsDone += nRows;
+    context->progressCondition.wakeAll();
+  }
+
+  CPLFree( inputBlock );
+  CPLFree( resultBlock );
+
+  QMutexLocker locker( &context->progressMutex );
+  context->activeWorkers--;
+  context->progressCondition.wakeAll();
 }
 
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
@@ -247,7 +424,12 @@ GDALDatasetH QgsNineCellFilter::openOutputFile( GDALDatasetH inputDataset, GDALD
 
   //open output file
   char **papszOptions = NULL;
+  foreach ( QString option, mCreationOptions )
+  {
+    papszOptions = CSLAddString( papszOptions, option.toLocal8Bit().data() );
+  }
   GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( mOutputFile ), xSize, ySize, 1, GDT_Float32, papszOptions );
+  CSLDestroy( papszOptions );
   if ( outputDataset == NULL )
   {
     return outputDataset;
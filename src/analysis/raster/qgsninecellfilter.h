@@ -19,6 +19,7 @@
 #define QGSNINECELLFILTER_H
 
 #include <QString>
+#include <QStringList>
 #include "gdal.h"
 
 class QProgressDialog;
@@ -51,12 +52,34 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     double outputNodataValue() const { return mOutputNodataValue; }
     void setOutputNodataValue( double value ) { mOutputNodataValue = value; }
 
+    /**Number of threads used by processRaster. 1 (the default) processes the raster scanline by scanline
+      on the calling thread, 0 uses QThread::idealThreadCount()
+      @note added in 2.6*/
+    int threadCount() const { return mThreadCount; }
+    void setThreadCount( int count ) { mThreadCount = count; }
+
+    /**Number of rows in a tile processed by one worker thread. The value is rounded up to a multiple of the output block height
+      @note added in 2.6*/
+    int tileRows() const { return mTileRows; }
+    void setTileRows( int rows ) { mTileRows = rows; }
+
+    /**GDAL creation options for the output dataset (e.g. TILED=YES, COMPRESS=DEFLATE for GTiff)
+      @note added in 2.6*/
+    QStringList creationOptions() const { return mCreationOptions; }
+    void setCreationOptions( const QStringList& options ) { mCreationOptions = options; }
+
     /**Calculates output value from nine input values. The input values and the output value can be equal to the
       nodata value if not present or outside of the border. Must be implemented by subclasses*/
     virtual float processNineCellWindow( float* x11, float* x21, float* x31,
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /**Calculates a complete output row from the row above, the row itself and the row below. The default implementation
+      calls processNineCellWindow for each cell. Subclasses may reimplement it with processRowNonVirtual to avoid
+      a virtual call per cell. Must be thread safe if threadCount() is not 1
+      @note added in 2.6*/
+    virtual void processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize );
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -70,8 +93,44 @@ class ANALYSIS_EXPORT QgsNineCellFilter
       @return the output dataset or NULL in case of error*/
     GDALDatasetH openOutputFile( GDALDatasetH inputDataset, GDALDriverH outputDriver );
 
+    /**Processes the raster scanline by scanline on the calling thread*/
+    bool processRasterSerial( GDALRasterBandH rasterBand, GDALRasterBandH outputRasterBand, int xSize, int ySize, QProgressDialog* p );
+    /**Splits the raster into tiles of rows (plus one halo row above and below) which are processed by a pool of threads*/
+    bool processRasterTiled( GDALRasterBandH rasterBand, GDALRasterBandH outputRasterBand, int xSize, int ySize, int threads, QProgressDialog* p );
+
+    struct TileContext;
+    /**Worker function for processRasterTiled. Fetches and processes tiles until all are done or the job is canceled*/
+    void processTiles( TileContext* context );
+
   protected:
 
+    /**Processes a row like processRow, but calls FILTER::processNineCellWindow without virtual dispatch so that the
+      compiler can inline the kernel into the row loop*/
+    template <class FILTER> void processRowNonVirtual( FILTER* filter, float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+    {
+      if ( xSize < 1 )
+      {
+        return;
+      }
+      if ( xSize == 1 )
+      {
+        resultLine[0] = filter->FILTER::processNineCellWindow( &mInputNodataValue, &scanLine1[0], &mInputNodataValue, &mInputNodataValue, &scanLine2[0],
+                        &mInputNodataValue, &mInputNodataValue, &scanLine3[0], &mInputNodataValue );
+        return;
+      }
+
+      resultLine[0] = filter->FILTER::processNineCellWindow( &mInputNodataValue, &scanLine1[0], &scanLine1[1], &mInputNodataValue, &scanLine2[0],
+                      &scanLine2[1], &mInputNodataValue, &scanLine3[0], &scanLine3[1] );
+      for ( int j = 1; j < xSize - 1; ++j )
+      {
+        resultLine[j] = filter->FILTER::processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
+                        &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
+      }
+      int j = xSize - 1;
+      resultLine[j] = filter->FILTER::processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
+                      &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
+    }
+
     QString mInputFile;
     QString mOutputFile;
     QString mOutputFormat;
@@ -84,6 +143,10 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     float mOutputNodataValue;
     /**Scale factor for z-value if x-/y- units are different to z-units (111120 for degree->meters and 370400 for degree->feet)*/
     double mZFactor;
+
+    int mThreadCount;
+    int mTileRows;
+    QStringList mCreationOptions;
 };
 
 #endif // QGSNINECELLFILTER_H
@@ -32,6 +32,10 @@ class ANALYSIS_EXPORT QgsSlopeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 );
+
+    /**Processes a complete row. Calls processNineCellWindow of this class directly (without virtual dispatch)
+      @note added in 2.6*/
+    void processRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize );
 };
 
 #endif // QGSSLOPEFILTER_H
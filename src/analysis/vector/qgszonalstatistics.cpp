@@ -23,6 +23,15 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QFuture>
+#include <QMutex>
+#include <QPair>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <limits>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -30,12 +39,434 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+// number of features read from the vector layer and written back at once
+static const int FEATURE_BATCH_SIZE = 4096;
+// maximal number of features sharing a raster window
+static const int MAX_CHUNK_ZONES = 64;
+// maximal number of cells read at once
+static const int MAX_WINDOW_CELLS = 1024 * 1024;
+// height in cells of the bands used to sort features spatially
+static const int SORT_BAND_ROWS = 64;
+
+/**Polygon edge in raster cell coordinates (columns from the left, rows from the top)*/
+struct QgsZonalStatisticsEdge
+{
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+  double yMin;
+  double yMax;
+  /**+1 or -1, so that the coverage of exterior rings is positive and the coverage of holes negative*/
+  double sign;
+};
+
+static bool edgeYMinLessThan( const QgsZonalStatisticsEdge& e1, const QgsZonalStatisticsEdge& e2 )
+{
+  return e1.yMin < e2.yMin;
+}
+
+/**Statistics of raster values weighted by the fraction of the cells covered by a zone*/
+class QgsZonalStatisticsAccumulator
+{
+  public:
+    QgsZonalStatisticsAccumulator()
+        : count( 0 )
+        , sum( 0 )
+        , mean( 0 )
+        , sumOfSquares( 0 )
+        , minimum( std::numeric_limits<double>::max() )
+        , maximum( -std::numeric_limits<double>::max() )
+        , median( 0 )
+        , majority( 0 )
+        , collectValues( false )
+    {}
+
+    void reset()
+    {
+      bool collect = collectValues;
+      *this = QgsZonalStatisticsAccumulator();
+      collectValues = collect;
+    }
+
+    void add( double value, double weight )
+    {
+      count += weight;
+      sum += value * weight;
+      //weighted incremental variance (West 1979)
+      double delta = value - mean;
+      mean += delta * weight / count;
+      sumOfSquares += weight * delta * ( value - mean );
+      if ( value < minimum )
+      {
+        minimum = value;
+      }
+      if ( value > maximum )
+      {
+        maximum = value;
+      }
+      if ( collectValues )
+      {
+        values << qMakePair( value, weight );
+      }
+    }
+
+    /**Calculates median and majority from the collected values*/
+    void finish()
+    {
+      if ( values.isEmpty() )
+      {
+        return;
+      }
+      qSort( values.begin(), values.end() );
+      double epsilon = 1E-9 * count;
+
+      //weighted median, the average of the two middle values if they split the weights in halves
+      double half = count / 2.0;
+      double cumulated = 0;
+      for ( int i = 0; i < values.size(); ++i )
+      {
+        cumulated += values[i].second;
+        if ( cumulated >= half - epsilon )
+        {
+          median = qAbs( cumulated - half ) <= epsilon && i + 1 < values.size() ? ( values[i].first + values[i + 1].first ) / 2.0 : values[i].first;
+          break;
+        }
+      }
+
+      //value with the largest weight, the smallest one in case of a tie
+      double majorityWeight = -1;
+      int i = 0;
+      while ( i < values.size() )
+      {
+        double value = values[i].first;
+        double weight = 0;
+        for ( ; i < values.size() && values[i].first == value; ++i )
+        {
+          weight += values[i].second;
+        }
+        if ( weight > majorityWeight + epsilon )
+        {
+          majority = value;
+          majorityWeight = weight;
+        }
+      }
+      values.clear();
+    }
+
+    double count;
+    double sum;
+    double mean;
+    /**Weighted sum of squared differences from the mean*/
+    double sumOfSquares;
+    double minimum;
+    double maximum;
+    double median;
+    double majority;
+    /**Values and weights are only kept if median or majority are requested*/
+    bool collectValues;
+    QVector< QPair<double, double> > values;
+};
+
+/**A feature and its statistics*/
+struct QgsZonalStatistics::Zone
+{
+  QgsFeatureId id;
+  QgsGeometry geometry;
+  //window of the raster covering the feature
+  int offsetX;
+  int offsetY;
+  int nCellsX;
+  int nCellsY;
+  QVector<QgsZonalStatisticsEdge> edges;
+  QgsZonalStatisticsAccumulator stats;
+};
+
+/**Shared state of the worker threads processing a batch of features*/
+struct QgsZonalStatistics::Job
+{
+  QString rasterFile;
+  int rasterBand;
+  double originX;
+  double originY;
+  double cellSizeX;
+  double cellSizeY;
+  bool hasNoData;
+  double noData;
+  bool exactCoverage;
+  bool collectValues;
+
+  //groups of neighbouring features sharing a raster window
+  QVector< QVector<Zone*> > chunks;
+  QAtomicInt nextChunk;
+  QAtomicInt failed;
+  QAtomicInt canceled;
+
+  //GDAL handles must not be shared between threads, every worker takes its own and returns it for the next batch
+  QMutex datasetMutex;
+  QList<GDALDatasetH> datasets;
+
+  //guards zonesDone and wakes up the thread reporting progress
+  QMutex progressMutex;
+  QWaitCondition progressCondition;
+  int zonesDone;
+  int activeWorkers;
+};
+
+/**Returns the edges of all rings of a (multi)polygon in cell coordinates, sorted by their minimum y*/
+static void polygonEdges( const QgsGeometry& geometry, double originX, double originY, double cellSizeX, double cellSizeY,
+                          QVector<QgsZonalStatisticsEdge>& edges )
+{
+  edges.clear();
+  QgsMultiPolygon polygons = geometry.asMultiPolygon();
+  if ( polygons.isEmpty() )
+  {
+    polygons << geometry.asPolygon();
+  }
+
+  foreach ( const QgsPolygon& polygon, polygons )
+  {
+    for ( int ringIdx = 0; ringIdx < polygon.size(); ++ringIdx )
+    {
+      const QgsPolyline& ring = polygon[ringIdx];
+      int firstEdge = edges.size();
+      double area = 0;
+      for ( int i = 0; i < ring.size(); ++i )
+      {
+        const QgsPoint& p0 = ring[i];
+        const QgsPoint& p1 = ring[( i + 1 ) % ring.size()];
+        QgsZonalStatisticsEdge edge;
+        edge.x0 = ( p0.x() - originX ) / cellSizeX;
+        edge.y0 = ( originY - p0.y() ) / cellSizeY;
+        edge.x1 = ( p1.x() - originX ) / cellSizeX;
+        edge.y1 = ( originY - p1.y() ) / cellSizeY;
+        area += edge.x0 * edge.y1 - edge.x1 * edge.y0;
+        if ( edge.y0 == edge.y1 )
+        {
+          //horizontal edges do not cross rows
+          continue;
+        }
+        edge.yMin = qMin( edge.y0, edge.y1 );
+        edge.yMax = qMax( edge.y0, edge.y1 );
+        edges << edge;
+      }
+
+      //ring orientation is not normalized, the accumulated coverage must be positive for exterior rings nevertheless
+      double sign = area > 0 ? -1.0 : 1.0;
+      if ( ringIdx > 0 )
+      {
+        sign = -sign;
+      }
+      for ( int i = firstEdge; i < edges.size(); ++i )
+      {
+        edges[i].sign = sign;
+      }
+    }
+  }
+  qSort( edges.begin(), edges.end(), edgeYMinLessThan );
+}
+
+/**Sets the weight of the cells with their center inside the polygon to 1 (scanline even-odd fill)*/
+static void rasterizeCellCenters( const QVector<QgsZonalStatisticsEdge>& edges, int windowX, int windowY, int width, int height, double* weights )
+{
+  QVector<const QgsZonalStatisticsEdge*> activeEdges;
+  QVector<double> crossings;
+  int nextEdge = 0;
+
+  for ( int row = 0; row < height; ++row )
+  {
+    double y = windowY + row + 0.5;
+    while ( nextEdge < edges.size() && edges[nextEdge].yMin <= y )
+    {
+      activeEdges << &edges[nextEdge++];
+    }
+
+    crossings.resize( 0 );
+    int i = 0;
+    while ( i < activeEdges.size() )
+    {
+      const QgsZonalStatisticsEdge* edge = activeEdges[i];
+      if ( edge->yMax <= y )
+      {
+        activeEdges[i] = activeEdges.last();
+        activeEdges.pop_back();
+        continue;
+      }
+      crossings << edge->x0 + ( y - edge->y0 ) * ( edge->x1 - edge->x0 ) / ( edge->y1 - edge->y0 );
+      ++i;
+    }
+    qSort( crossings );
+
+    double* line = weights + ( qgssize ) row * width;
+    for ( int j = 0; j + 1 < crossings.size(); j += 2 )
+    {
+      //cells with their center strictly between two crossings
+      double first = floor( crossings[j] - windowX - 0.5 ) + 1;
+      double last = ceil( crossings[j + 1] - windowX - 0.5 );
+      int firstCol = ( int ) qBound( 0.0, first, ( double ) width );
+      int lastCol = ( int ) qBound( 0.0, last, ( double ) width );
+      for ( int col = firstCol; col < lastCol; ++col )
+      {
+        line[col] = 1.0;
+      }
+    }
+  }
+}
+
+/**Adds the signed area between a segment (in window coordinates, 0 <= x <= width) and the right border of the window
+  to the accumulation buffer: partially to the cells the segment crosses, the rest to the cell right of them*/
+static void accumulateSegment( double* accumulation, int stride, int height, double x0, double y0, double x1, double y1, double sign )
+{
+  if ( y0 == y1 )
+  {
+    return;
+  }
+  double dir = sign;
+  if ( y0 > y1 )
+  {
+    qSwap( x0, x1 );
+    qSwap( y0, y1 );
+    dir = -sign;
+  }
+  double dxdy = ( x1 - x0 ) / ( y1 - y0 );
+  double yStart = qMax( y0, 0.0 );
+  double yEnd = qMin( y1, ( double ) height );
+  if ( yStart >= yEnd )
+  {
+    return;
+  }
+
+  double x = x0 + ( yStart - y0 ) * dxdy;
+  for ( int row = ( int ) floor( yStart ); row < height && row < yEnd; ++row )
+  {
+    double yNext = qMin( row + 1.0, yEnd );
+    double dy = yNext - yStart;
+    double xNext = x + dxdy * dy;
+    double d = dy * dir;
+    double* line = accumulation + ( qgssize ) row * stride;
+
+    double xLeft = qMin( x, xNext );
+    double xRight = qMax( x, xNext );
+    double xLeftFloor = floor( xLeft );
+    int colLeft = ( int ) xLeftFloor;
+    double xRightCeil = ceil( xRight );
+    int colRight = ( int ) xRightCeil;
+
+    if ( colRight <= colLeft + 1 )
+    {
+      //within one cell, the covered part of the cell depends on the average x
+      double xMidFraction = 0.5 * ( x + xNext ) - xLeftFloor;
+      line[colLeft] += d - d * xMidFraction;
+      line[colLeft + 1] += d * xMidFraction;
+    }
+    else
+    {
+      //over several cells, triangles in the first and last cell and trapezoids between
+      double s = 1.0 / ( xRight - xLeft );
+      double xLeftFraction = xLeft - xLeftFloor;
+      double aFirst = 0.5 * s * ( 1 - xLeftFraction ) * ( 1 - xLeftFraction );
+      double xRightFraction = xRight - xRightCeil + 1;
+      double aLast = 0.5 * s * xRightFraction * xRightFraction;
+      line[colLeft] += d * aFirst;
+      if ( colRight == colLeft + 2 )
+      {
+        line[colLeft + 1] += d * ( 1 - aFirst - aLast );
+      }
+      else
+      {
+        double a1 = s * ( 1.5 - xLeftFraction );
+        line[colLeft + 1] += d * ( a1 - aFirst );
+        for ( int col = colLeft + 2; col < colRight - 1; ++col )
+        {
+          line[col] += d * s;
+        }
+        double a2 = a1 + ( colRight - colLeft - 3 ) * s;
+        line[colRight - 1] += d * ( 1 - a2 - aLast );
+      }
+      line[colRight] += d * aLast;
+    }
+
+    x = xNext;
+    yStart = yNext;
+  }
+}
+
+/**Calculates the fraction of every cell covered by the polygon analytically. The signed areas of the edges are accumulated
+  and summed up along the rows, the same way font rasterizers compute anti-aliased coverage*/
+static void rasterizeCoverage( const QVector<QgsZonalStatisticsEdge>& edges, int windowX, int windowY, int width, int height,
+                               double* weights, QVector<double>& accumulation )
+{
+  int stride = width + 2;
+  accumulation.fill( 0.0, stride * height );
+
+  foreach ( const QgsZonalStatisticsEdge& edge, edges )
+  {
+    if ( edge.yMin >= windowY + height )
+    {
+      break;
+    }
+    if ( edge.yMax <= windowY )
+    {
+      continue;
+    }
+
+    double x0 = edge.x0 - windowX;
+    double y0 = edge.y0 - windowY;
+    double x1 = edge.x1 - windowX;
+    double y1 = edge.y1 - windowY;
+
+    //parts left and right of the window are projected onto its borders, which does not change the coverage inside.
+    //The edge is split where it crosses the borders first, so that the projected parts are still straight
+    double t[2];
+    int nCrossings = 0;
+    if (( x0 < 0 ) != ( x1 < 0 ) && x0 != x1 )
+    {
+      t[nCrossings++] = -x0 / ( x1 - x0 );
+    }
+    if (( x0 < width ) != ( x1 < width ) && x0 != x1 )
+    {
+      t[nCrossings++] = ( width - x0 ) / ( x1 - x0 );
+    }
+    if ( nCrossings == 2 && t[0] > t[1] )
+    {
+      qSwap( t[0], t[1] );
+    }
+
+    double xStart = x0;
+    double yStart = y0;
+    for ( int i = 0; i <= nCrossings; ++i )
+    {
+      double xEnd = i < nCrossings ? x0 + t[i] * ( x1 - x0 ) : x1;
+      double yEnd = i < nCrossings ? y0 + t[i] * ( y1 - y0 ) : y1;
+      accumulateSegment( accumulation.data(), stride, height, qBound( 0.0, xStart, ( double ) width ), yStart,
+                         qBound( 0.0, xEnd, ( double ) width ), yEnd, edge.sign );
+      xStart = xEnd;
+      yStart = yEnd;
+    }
+  }
+
+  for ( int row = 0; row < height; ++row )
+  {
+    const double* line = accumulation.constData() + ( qgssize ) row * stride;
+    double* weightLine = weights + ( qgssize ) row * width;
+    double coverage = 0;
+    for ( int col = 0; col < width; ++col )
+    {
+      coverage += line[col];
+      //remove rounding noise, overlapping multipolygon parts may exceed 1
+      weightLine[col] = coverage < 1E-9 ? 0.0 : ( coverage > 1.0 - 1E-9 ? 1.0 : coverage );
+    }
+  }
+}
+
 QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
     , mPolygonLayer( polygonLayer )
     , mAttributePrefix( attributePrefix )
-    , mInputNodataValue( -1 )
+    , mStatistics( Count | Sum | Mean )
+    , mExactCoverage( false )
+    , mThreadCount( 0 )
 {
 
 }
@@ -43,6 +474,9 @@ QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QStr
 QgsZonalStatistics::QgsZonalStatistics()
     : mRasterBand( 0 )
     , mPolygonLayer( 0 )
+    , mStatistics( Count | Sum | Mean )
+    , mExactCoverage( false )
+    , mThreadCount( 0 )
 {
 
 }
@@ -85,7 +519,8 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     GDALClose( inputDataset );
     return 5;
   }
-  mInputNodataValue = GDALGetRasterNoDataValue( rasterBand, NULL );
+  int hasNoData = 0;
+  double inputNodataValue = GDALGetRasterNoDataValue( rasterBand, &hasNoData );
 
   //get geometry info about raster layer
   int nCellsXGDAL = GDALGetRasterXSize( inputDataset );
@@ -109,27 +544,30 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   QgsRectangle rasterBBox( geoTransform[0], geoTransform[3] - ( nCellsYGDAL * cellsizeY ),
                            geoTransform[0] + ( nCellsXGDAL * cellsizeX ), geoTransform[3] );
 
-  //add the new count, sum, mean fields to the provider
-  QList<QgsField> newFieldList;
-  QString countFieldName = getUniqueFieldName( mAttributePrefix + "count" );
-  QString sumFieldName = getUniqueFieldName( mAttributePrefix + "sum" );
-  QString meanFieldName = getUniqueFieldName( mAttributePrefix + "mean" );
-  QgsField countField( countFieldName, QVariant::Double, "double precision" );
-  QgsField sumField( sumFieldName, QVariant::Double, "double precision" );
-  QgsField meanField( meanFieldName, QVariant::Double, "double precision" );
-  newFieldList.push_back( countField );
-  newFieldList.push_back( sumField );
-  newFieldList.push_back( meanField );
-  vectorProvider->addAttributes( newFieldList );
-
-  //index of the new fields
-  int countIndex = vectorProvider->fieldNameIndex( countFieldName );
-  int sumIndex = vectorProvider->fieldNameIndex( sumFieldName );
-  int meanIndex = vectorProvider->fieldNameIndex( meanFieldName );
-
-  if ( countIndex == -1 || sumIndex == -1 || meanIndex == -1 )
+  //add a field for each statistic to the provider. They are added one by one, so that truncated shapefile names stay unique
+  const Statistic statisticList[] = { Count, Sum, Mean, Median, StDev, Min, Max, Majority };
+  const char* statisticNames[] = { "count", "sum", "mean", "median", "stdev", "min", "max", "majority" };
+  QList<Statistic> fieldStatistics;
+  QList<int> fieldIndexes;
+  for ( int i = 0; i < 8; ++i )
   {
-    return 8;
+    if ( !( mStatistics & statisticList[i] ) )
+    {
+      continue;
+    }
+    QString fieldName = getUniqueFieldName( mAttributePrefix + statisticNames[i] );
+    QList<QgsField> newFieldList;
+    newFieldList.push_back( QgsField( fieldName, QVariant::Double, "double precision" ) );
+    vectorProvider->addAttributes( newFieldList );
+
+    int fieldIndex = vectorProvider->fieldNameIndex( fieldName );
+    if ( fieldIndex == -1 )
+    {
+      GDALClose( inputDataset );
+      return 8;
+    }
+    fieldStatistics << statisticList[i];
+    fieldIndexes << fieldIndex;
   }
 
   //progress dialog
@@ -139,90 +577,228 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     p->setMaximum( featureCount );
   }
 
+  Job job;
+  job.rasterFile = mRasterFilePath;
+  job.rasterBand = mRasterBand;
+  job.originX = rasterBBox.xMinimum();
+  job.originY = rasterBBox.yMaximum();
+  job.cellSizeX = cellsizeX;
+  job.cellSizeY = cellsizeY;
+  job.hasNoData = hasNoData;
+  job.noData = inputNodataValue;
+  job.exactCoverage = mExactCoverage;
+  job.collectValues = mStatistics & ( Median | Majority );
+  //the dataset opened here is reused by one of the workers
+  job.datasets << inputDataset;
+
+  int threads = mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount();
 
-  //iterate over each polygon
+  //iterate over the polygons in batches
   QgsFeatureRequest request;
   request.setSubsetOfAttributes( QgsAttributeList() );
   QgsFeatureIterator fi = vectorProvider->getFeatures( request );
   QgsFeature f;
-  double count = 0;
-  double sum = 0;
-  double mean = 0;
   int featureCounter = 0;
+  bool moreFeatures = true;
 
-  while ( fi.nextFeature( f ) )
+  while ( moreFeatures && !job.canceled && !job.failed )
   {
-    if ( p )
+    QVector<Zone> zones;
+    zones.reserve( FEATURE_BATCH_SIZE );
+    int batchFeatures = 0;
+    while ( batchFeatures < FEATURE_BATCH_SIZE && ( moreFeatures = fi.nextFeature( f ) ) )
     {
-      p->setValue( featureCounter );
-    }
+      ++batchFeatures;
 
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
+      QgsGeometry* featureGeometry = f.geometry();
+      if ( !featureGeometry )
+      {
+        continue;
+      }
 
-    QgsGeometry* featureGeometry = f.geometry();
-    if ( !featureGeometry )
-    {
-      ++featureCounter;
-      continue;
-    }
+      QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
+      if ( featureRect.isEmpty() )
+      {
+        continue;
+      }
 
-    QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
-    if ( featureRect.isEmpty() )
-    {
-      ++featureCounter;
-      continue;
+      int offsetX, offsetY, nCellsX, nCellsY;
+      if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+      {
+        continue;
+      }
+
+      //avoid access to cells outside of the raster (may occur because of rounding)
+      if (( offsetX + nCellsX ) > nCellsXGDAL )
+      {
+        nCellsX = nCellsXGDAL - offsetX;
+      }
+      if (( offsetY + nCellsY ) > nCellsYGDAL )
+      {
+        nCellsY = nCellsYGDAL - offsetY;
+      }
+      if ( nCellsX <= 0 || nCellsY <= 0 )
+      {
+        continue;
+      }
+
+      zones.resize( zones.size() + 1 );
+      Zone& zone = zones.last();
+      zone.id = f.id();
+      zone.geometry = *featureGeometry;
+      zone.offsetX = offsetX;
+      zone.offsetY = offsetY;
+      zone.nCellsX = nCellsX;
+      zone.nCellsY = nCellsY;
+      zone.stats.collectValues = job.collectValues;
     }
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+    //group neighbouring features, so that their raster window is read once
+    QVector< QPair<qint64, Zone*> > sortedZones;
+    sortedZones.reserve( zones.size() );
+    for ( int i = 0; i < zones.size(); ++i )
     {
-      ++featureCounter;
-      continue;
+      qint64 key = ( qint64 )( zones[i].offsetY / SORT_BAND_ROWS ) * nCellsXGDAL + zones[i].offsetX + zones[i].nCellsX / 2;
+      sortedZones << qMakePair( key, &zones[i] );
     }
+    qSort( sortedZones );
 
-    //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
+    job.chunks.clear();
+    QVector<Zone*> chunk;
+    int xMin = 0, xMax = 0, yMin = 0, yMax = 0;
+    qint64 chunkZoneCells = 0;
+    for ( int i = 0; i < sortedZones.size(); ++i )
     {
-      nCellsX = nCellsXGDAL - offsetX;
+      Zone* zone = sortedZones[i].second;
+      qint64 zoneCells = ( qint64 ) zone->nCellsX * zone->nCellsY;
+      if ( !chunk.isEmpty() )
+      {
+        int newXMin = qMin( xMin, zone->offsetX );
+        int newXMax = qMax( xMax, zone->offsetX + zone->nCellsX );
+        int newYMin = qMin( yMin, zone->offsetY );
+        int newYMax = qMax( yMax, zone->offsetY + zone->nCellsY );
+        qint64 windowCells = ( qint64 )( newXMax - newXMin ) * ( newYMax - newYMin );
+        //don't read much more than the features need
+        if ( chunk.size() < MAX_CHUNK_ZONES && windowCells <= MAX_WINDOW_CELLS && windowCells <= 4 * ( chunkZoneCells + zoneCells ) )
+        {
+          chunk << zone;
+          chunkZoneCells += zoneCells;
+          xMin = newXMin;
+          xMax = newXMax;
+          yMin = newYMin;
+          yMax = newYMax;
+          continue;
+        }
+        job.chunks << chunk;
+        chunk.clear();
+      }
+      chunk << zone;
+      chunkZoneCells = zoneCells;
+      xMin = zone->offsetX;
+      xMax = zone->offsetX + zone->nCellsX;
+      yMin = zone->offsetY;
+      yMax = zone->offsetY + zone->nCellsY;
     }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
+    if ( !chunk.isEmpty() )
     {
-      nCellsY = nCellsYGDAL - offsetY;
+      job.chunks << chunk;
     }
 
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, sum, count );
-
-    if ( count <= 1 )
+    if ( !job.chunks.isEmpty() )
     {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, sum, count );
-    }
+      job.nextChunk = 0;
+      job.zonesDone = 0;
+      int workerCount = qBound( 1, threads, job.chunks.size() );
+      job.activeWorkers = workerCount;
 
+      QList< QFuture<void> > workers;
+      for ( int i = 0; i < workerCount; ++i )
+      {
+        workers << QtConcurrent::run( &QgsZonalStatistics::processZones, &job );
+      }
 
-    if ( count == 0 )
-    {
-      mean = 0;
+      //report progress while the workers are busy
+      job.progressMutex.lock();
+      while ( job.activeWorkers > 0 )
+      {
+        job.progressCondition.wait( &job.progressMutex, 100 );
+        if ( p )
+        {
+          int zonesDone = job.zonesDone;
+          job.progressMutex.unlock();
+          p->setValue( featureCounter + ( int )(( qint64 ) batchFeatures * zonesDone / zones.size() ) );
+          if ( p->wasCanceled() )
+          {
+            job.canceled = 1;
+          }
+          job.progressMutex.lock();
+        }
+      }
+      job.progressMutex.unlock();
+
+      for ( int i = 0; i < workers.size(); ++i )
+      {
+        workers[i].waitForFinished();
+      }
     }
-    else
+    featureCounter += batchFeatures;
+
+    if ( job.canceled || job.failed )
     {
-      mean = sum / count;
+      break;
     }
 
-    //write the statistics value to the vector data provider
+    //write the statistics values of the batch to the vector data provider
     QgsChangedAttributesMap changeMap;
-    QgsAttributeMap changeAttributeMap;
-    changeAttributeMap.insert( countIndex, QVariant( count ) );
-    changeAttributeMap.insert( sumIndex, QVariant( sum ) );
-    changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-    changeMap.insert( f.id(), changeAttributeMap );
-    vectorProvider->changeAttributeValues( changeMap );
+    for ( int i = 0; i < zones.size(); ++i )
+    {
+      const QgsZonalStatisticsAccumulator& stats = zones[i].stats;
+      QgsAttributeMap changeAttributeMap;
+      for ( int j = 0; j < fieldStatistics.size(); ++j )
+      {
+        QVariant value;
+        switch ( fieldStatistics[j] )
+        {
+          case Count:
+            value = QVariant( stats.count );
+            break;
+          case Sum:
+            value = QVariant( stats.sum );
+            break;
+          case Mean:
+            value = QVariant( stats.count == 0 ? 0.0 : stats.sum / stats.count );
+            break;
+          case Median:
+            value = stats.count == 0 ? QVariant( QVariant::Double ) : QVariant( stats.median );
+            break;
+          case StDev:
+            value = stats.count == 0 ? QVariant( QVariant::Double ) : QVariant( sqrt( stats.sumOfSquares / stats.count ) );
+            break;
+          case Min:
+            value = stats.count == 0 ? QVariant( QVariant::Double ) : QVariant( stats.minimum );
+            break;
+          case Max:
+            value = stats.count == 0 ? QVariant( QVariant::Double ) : QVariant( stats.maximum );
+            break;
+          case Majority:
+            value = stats.count == 0 ? QVariant( QVariant::Double ) : QVariant( stats.majority );
+            break;
+          default:
+            break;
+        }
+        changeAttributeMap.insert( fieldIndexes[j], value );
+      }
+      changeMap.insert( zones[i].id, changeAttributeMap );
+    }
+    if ( !changeMap.isEmpty() )
+    {
+      vectorProvider->changeAttributeValues( changeMap );
+    }
 
-    ++featureCounter;
+    if ( p )
+    {
+      p->setValue( featureCounter );
+    }
   }
 
   if ( p )
@@ -230,144 +806,201 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
     p->setValue( featureCount );
   }
 
-  GDALClose( inputDataset );
+  foreach ( GDALDatasetH dataset, job.datasets )
+  {
+    GDALClose( dataset );
+  }
   mPolygonLayer->updateFields();
 
-  if ( p && p->wasCanceled() )
+  if ( job.canceled || ( p && p->wasCanceled() ) )
   {
     return 9;
   }
-
-  return 0;
-}
-
-int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
-    int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const
-{
-  //get intersecting bbox
-  QgsRectangle intersectBox = rasterBBox.intersect( &featureBBox );
-  if ( intersectBox.isEmpty() )
+  if ( job.failed )
   {
-    nCellsX = 0; nCellsY = 0; offsetX = 0; offsetY = 0;
-    return 0;
+    return 3;
   }
 
-  //get offset in pixels in x- and y- direction
-  offsetX = ( int )(( intersectBox.xMinimum() - rasterBBox.xMinimum() ) / cellSizeX );
-  offsetY = ( int )(( rasterBBox.yMaximum() - intersectBox.yMaximum() ) / cellSizeY );
-
-  int maxColumn = ( int )(( intersectBox.xMaximum() - rasterBBox.xMinimum() ) / cellSizeX ) + 1;
-  int maxRow = ( int )(( rasterBBox.yMaximum() - intersectBox.yMinimum() ) / cellSizeY ) + 1;
-
-  nCellsX = maxColumn - offsetX;
-  nCellsY = maxRow - offsetY;
-
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
+void QgsZonalStatistics::processZones( Job* job )
 {
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  count = 0;
-  sum = 0;
-
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
+  GDALDatasetH dataset = 0;
   {
-    return;
+    QMutexLocker locker( &job->datasetMutex );
+    if ( !job->datasets.isEmpty() )
+    {
+      dataset = job->datasets.takeLast();
+    }
   }
-
-  GEOSContextHandle_t geosctxt = QgsGeometry::getGEOSHandler();
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare_r( geosctxt, poly->asGeos() );
-  if ( !polyGeosPrepared )
+  if ( !dataset )
   {
-    return;
+    dataset = GDALOpen( TO8F( job->rasterFile ), GA_ReadOnly );
+  }
+  GDALRasterBandH band = dataset ? GDALGetRasterBand( dataset, job->rasterBand ) : 0;
+  if ( !band )
+  {
+    job->failed = 1;
   }
 
-  GEOSCoordSequence* cellCenterCoords = 0;
-  GEOSGeometry* currentCellCenter = 0;
-
-  for ( int i = 0; i < nCellsY; ++i )
+  while ( !job->failed && !job->canceled )
   {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
+    int chunk = job->nextChunk.fetchAndAddOrdered( 1 );
+    if ( chunk >= job->chunks.size() )
     {
-      continue;
+      break;
+    }
+    const QVector<Zone*>& zones = job->chunks.at( chunk );
+
+    foreach ( Zone* zone, zones )
+    {
+      polygonEdges( zone->geometry, job->originX, job->originY, job->cellSizeX, job->cellSizeY, zone->edges );
     }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
+    if ( !accumulateZones( job, band, zones, job->exactCoverage ) )
     {
-      GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-      cellCenterCoords = GEOSCoordSeq_create_r( geosctxt, 1, 2 );
-      GEOSCoordSeq_setX_r( geosctxt, cellCenterCoords, 0, cellCenterX );
-      GEOSCoordSeq_setY_r( geosctxt, cellCenterCoords, 0, cellCenterY );
-      currentCellCenter = GEOSGeom_createPoint_r( geosctxt, cellCenterCoords );
+      job->failed = 1;
+      break;
+    }
 
-      if ( scanLine[j] != mInputNodataValue ) //don't consider nodata values
+    if ( !job->exactCoverage )
+    {
+      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+      QVector<Zone*> smallZones;
+      foreach ( Zone* zone, zones )
       {
-        if ( GEOSPreparedContains_r( geosctxt, polyGeosPrepared, currentCellCenter ) )
+        if ( zone->stats.count <= 1 )
         {
-          if ( !qIsNaN( scanLine[j] ) )
-          {
-            sum += scanLine[j];
-          }
-          ++count;
+          zone->stats.reset();
+          smallZones << zone;
         }
       }
-      cellCenterX += cellSizeX;
+      if ( !smallZones.isEmpty() && !accumulateZones( job, band, smallZones, true ) )
+      {
+        job->failed = 1;
+        break;
+      }
     }
-    cellCenterY -= cellSizeY;
+
+    foreach ( Zone* zone, zones )
+    {
+      zone->stats.finish();
+      zone->edges.clear();
+    }
+
+    QMutexLocker locker( &job->progressMutex );
+    job->zonesDone += zones.size();
+    job->progressCondition.wakeAll();
   }
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy_r( geosctxt, polyGeosPrepared );
+
+  if ( dataset )
+  {
+    QMutexLocker locker( &job->datasetMutex );
+    job->datasets << dataset;
+  }
+
+  QMutexLocker locker( &job->progressMutex );
+  job->activeWorkers--;
+  job->progressCondition.wakeAll();
 }
 
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count )
+bool QgsZonalStatistics::accumulateZones( Job* job, void* band, const QVector<Zone*>& zones, bool exact )
 {
-  sum = 0;
-  count = 0;
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = 0;
+  //common window of the zones
+  int xMin = std::numeric_limits<int>::max();
+  int xMax = 0;
+  int yMin = std::numeric_limits<int>::max();
+  int yMax = 0;
+  foreach ( const Zone* zone, zones )
+  {
+    xMin = qMin( xMin, zone->offsetX );
+    xMax = qMax( xMax, zone->offsetX + zone->nCellsX );
+    yMin = qMin( yMin, zone->offsetY );
+    yMax = qMax( yMax, zone->offsetY + zone->nCellsY );
+  }
+  int width = xMax - xMin;
+  if ( width <= 0 || yMax <= yMin )
+  {
+    return true;
+  }
 
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
-  double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
+  //windows of large polygons are read in stripes
+  int stripeRows = qMax( MAX_WINDOW_CELLS / width, 1 );
+  QVector<double> values;
+  QVector<double> weights;
+  QVector<double> accumulation;
 
-  for ( int row = 0; row < nCellsY; ++row )
+  for ( int stripeY = yMin; stripeY < yMax; stripeY += stripeRows )
   {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
-    for ( int col = 0; col < nCellsX; ++col )
+    int rows = qMin( stripeRows, yMax - stripeY );
+    values.resize( width * rows );
+    if ( GDALRasterIO( band, GF_Read, xMin, stripeY, width, rows, values.data(), width, rows, GDT_Float64, 0, 0 ) != CE_None )
+    {
+      return false;
+    }
+
+    foreach ( Zone* zone, zones )
     {
-      GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 );
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
+      int firstRow = qMax( zone->offsetY, stripeY );
+      int lastRow = qMin( zone->offsetY + zone->nCellsY, stripeY + rows );
+      if ( firstRow >= lastRow )
+      {
+        continue;
+      }
+      int zoneRows = lastRow - firstRow;
+
+      weights.fill( 0.0, zone->nCellsX * zoneRows );
+      if ( exact )
+      {
+        rasterizeCoverage( zone->edges, zone->offsetX, firstRow, zone->nCellsX, zoneRows, weights.data(), accumulation );
+      }
+      else
       {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
+        rasterizeCellCenters( zone->edges, zone->offsetX, firstRow, zone->nCellsX, zoneRows, weights.data() );
+      }
+
+      for ( int row = 0; row < zoneRows; ++row )
+      {
+        const double* weightLine = weights.constData() + ( qgssize ) row * zone->nCellsX;
+        const double* valueLine = values.constData() + ( qgssize )( firstRow + row - stripeY ) * width + ( zone->offsetX - xMin );
+        for ( int col = 0; col < zone->nCellsX; ++col )
         {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
+          double weight = weightLine[col];
+          double value = valueLine[col];
+          if ( weight <= 0 || qIsNaN( value ) || ( job->hasNoData && value == job->noData ) ) //don't consider nodata values
           {
-            weight = intersectionArea / pixelArea;
-            count += weight;
-            sum += *pixelData * weight;
+            continue;
           }
-          delete intersectGeometry;
+          zone->stats.add( value, weight );
         }
       }
-      currentX += cellSizeX;
     }
-    currentY -= cellSizeY;
   }
-  CPLFree( pixelData );
+  return true;
+}
+
+int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
+    int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const
+{
+  //get intersecting bbox
+  QgsRectangle intersectBox = rasterBBox.intersect( &featureBBox );
+  if ( intersectBox.isEmpty() )
+  {
+    nCellsX = 0; nCellsY = 0; offsetX = 0; offsetY = 0;
+    return 0;
+  }
+
+  //get offset in pixels in x- and y- direction
+  offsetX = ( int )(( intersectBox.xMinimum() - rasterBBox.xMinimum() ) / cellSizeX );
+  offsetY = ( int )(( rasterBBox.yMaximum() - intersectBox.yMaximum() ) / cellSizeY );
+
+  int maxColumn = ( int )(( intersectBox.xMaximum() - rasterBBox.xMinimum() ) / cellSizeX ) + 1;
+  int maxRow = ( int )(( rasterBBox.yMaximum() - intersectBox.yMinimum() ) / cellSizeY ) + 1;
+
+  nCellsX = maxColumn - offsetX;
+  nCellsY = maxRow - offsetY;
+
+  return 0;
 }
 
 QString QgsZonalStatistics::getUniqueFieldName( QString fieldName )
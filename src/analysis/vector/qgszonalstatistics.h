@@ -20,18 +20,59 @@
 
 #include "qgsrectangle.h"
 #include <QString>
+#include <QVector>
 
 class QgsGeometry;
 class QgsVectorLayer;
 class QProgressDialog;
 
-/**A class that calculates raster statistics (count, sum, mean) for a polygon or multipolygon layer and appends the results as attributes*/
+/**A class that calculates raster statistics (count, sum, mean and optionally median, standard deviation, minimum, maximum
+  and majority) for a polygon or multipolygon layer and appends the results as attributes.
+
+  The polygons are rasterised with a scanline algorithm. Raster windows are read once for groups of neighbouring
+  features and the features are processed by several threads concurrently*/
 class ANALYSIS_EXPORT QgsZonalStatistics
 {
   public:
+    /**Statistics which can be calculated
+      @note added in 2.6 */
+    enum Statistic
+    {
+      Count = 1,
+      Sum = 2,
+      Mean = 4,
+      Median = 8,
+      StDev = 16,
+      Min = 32,
+      Max = 64,
+      Majority = 128,
+      All = Count | Sum | Mean | Median | StDev | Min | Max | Majority
+    };
+    Q_DECLARE_FLAGS( Statistics, Statistic )
+
     QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix = "", int rasterBand = 1 );
     ~QgsZonalStatistics();
 
+    /**Sets the statistics to calculate (count, sum and mean by default). An attribute is added for each of them
+      @note added in 2.6 */
+    void setStatistics( Statistics stats ) { mStatistics = stats; }
+    /**@note added in 2.6 */
+    Statistics statistics() const { return mStatistics; }
+
+    /**If true, every cell is weighted by the fraction of its area covered by the polygon. Otherwise (the default)
+      the cells with their center inside the polygon are considered, falling back to the covered fraction for
+      polygons containing at most one cell center
+      @note added in 2.6 */
+    void setExactCoverage( bool exact ) { mExactCoverage = exact; }
+    /**@note added in 2.6 */
+    bool exactCoverage() const { return mExactCoverage; }
+
+    /**Sets the number of threads processing features, 0 (the default) uses QThread::idealThreadCount()
+      @note added in 2.6 */
+    void setThreadCount( int count ) { mThreadCount = count; }
+    /**@note added in 2.6 */
+    int threadCount() const { return mThreadCount; }
+
     /**Starts the calculation
       @return 0 in case of success*/
     int calculateStatistics( QProgressDialog* p );
@@ -43,16 +84,13 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /**Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    void statisticsFromMiddlePointTest_improved( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
-
-    /**Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, double& sum, double& count );
+    struct Zone;
+    struct Job;
+    /**Worker thread function, processes groups of neighbouring features until none is left*/
+    static void processZones( Job* job );
+    /**Accumulates the raster values covered by the zones, reading their common raster window once
+      @return false if the raster could not be read*/
+    static bool accumulateZones( Job* job, void* band, const QVector<Zone*>& zones, bool exact );
 
     QString getUniqueFieldName( QString fieldName );
 
@@ -61,8 +99,11 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int mRasterBand;
     QgsVectorLayer* mPolygonLayer;
     QString mAttributePrefix;
-    /**The nodata value of the input layer*/
-    float mInputNodataValue;
+    Statistics mStatistics;
+    bool mExactCoverage;
+    int mThreadCount;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS( QgsZonalStatistics::Statistics )
+
 #endif // QGSZONALSTATISTICS_H
@@ -0,0 +1,154 @@
+/***************************************************************************
+                            main.cpp
+                            build raster pyramids (overviews) from the command line
+                            -------------------
+   begin                : October 2014
+   copyright            : (C) 2014 by The QGIS Project
+   email                : qgis-developer at lists dot osgeo dot org
+***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsapplication.h"
+#include "qgsconfig.h"
+#include "qgsproviderregistry.h"
+#include "qgsraster.h"
+#include "qgsrasterdataprovider.h"
+#include "qgsrasterpyramid.h"
+
+#include <QStringList>
+
+#include <iostream>
+
+static void usage( const char *name )
+{
+  std::cerr << "Usage: " << name << " [options] raster\n"
+            << "Builds pyramids (overviews) of a raster with the QGIS GDAL provider.\n\n"
+            << "Options:\n"
+            << "  -l, --levels 2,4,8    overview levels (default: all levels down to 32 pixels)\n"
+            << "  -r, --resampling M    NEAREST (default), AVERAGE, GAUSS, CUBIC or MODE\n"
+            << "  -f, --format F        external (default, .ovr), internal or erdas (.aux)\n"
+            << "  -t, --threads N       number of threads or ALL_CPUS (default), NEAREST and AVERAGE only\n"
+            << "  -o, --option K=V      GDAL configuration option, e.g. COMPRESS_OVERVIEW=DEFLATE (repeatable)\n";
+}
+
+int main( int argc, char ** argv )
+{
+  QgsApplication a( argc, argv, false );
+
+  if ( !QgsApplication::isRunningFromBuildDir() )
+  {
+    char* prefixPath = getenv( "QGIS_PREFIX_PATH" );
+    QgsApplication::setPrefixPath( prefixPath ? prefixPath : CMAKE_INSTALL_PREFIX, TRUE );
+  }
+  QgsApplication::initQgis();
+
+  QStringList args = QCoreApplication::arguments();
+  QString rasterFile;
+  QList<int> levels;
+  QString resampling = "NEAREST";
+  QgsRaster::RasterPyramidsFormat format = QgsRaster::PyramidsGTiff;
+  QString threads = "ALL_CPUS";
+  QStringList configOptions;
+
+  for ( int i = 1; i < args.size(); ++i )
+  {
+    QString arg = args[i];
+    bool hasValue = i + 1 < args.size();
+    if (( arg == "-l" || arg == "--levels" ) && hasValue )
+    {
+      foreach ( QString level, args[++i].split( ",", QString::SkipEmptyParts ) )
+      {
+        bool ok;
+        levels << level.toInt( &ok );
+        if ( !ok || levels.last() < 2 )
+        {
+          std::cerr << "Invalid level " << level.toLocal8Bit().data() << std::endl;
+          return 1;
+        }
+      }
+    }
+    else if (( arg == "-r" || arg == "--resampling" ) && hasValue )
+    {
+      resampling = args[++i].toUpper();
+    }
+    else if (( arg == "-f" || arg == "--format" ) && hasValue )
+    {
+      QString formatName = args[++i].toLower();
+      if ( formatName == "external" )
+        format = QgsRaster::PyramidsGTiff;
+      else if ( formatName == "internal" )
+        format = QgsRaster::PyramidsInternal;
+      else if ( formatName == "erdas" )
+        format = QgsRaster::PyramidsErdas;
+      else
+      {
+        usage( argv[0] );
+        return 1;
+      }
+    }
+    else if (( arg == "-t" || arg == "--threads" ) && hasValue )
+    {
+      threads = args[++i];
+    }
+    else if (( arg == "-o" || arg == "--option" ) && hasValue )
+    {
+      QString option = args[++i];
+      if ( !option.contains( "=" ) )
+      {
+        usage( argv[0] );
+        return 1;
+      }
+      configOptions << option;
+    }
+    else if ( !arg.startsWith( "-" ) && rasterFile.isEmpty() )
+    {
+      rasterFile = arg;
+    }
+    else
+    {
+      usage( argv[0] );
+      return 1;
+    }
+  }
+
+  if ( rasterFile.isEmpty() )
+  {
+    usage( argv[0] );
+    return 1;
+  }
+  configOptions << QString( "GDAL_NUM_THREADS=%1" ).arg( threads );
+
+  QgsRasterDataProvider *provider = dynamic_cast<QgsRasterDataProvider*>( QgsProviderRegistry::instance()->provider( "gdal", rasterFile ) );
+  if ( !provider || !provider->isValid() )
+  {
+    std::cerr << "Cannot open raster " << rasterFile.toLocal8Bit().data() << std::endl;
+    delete provider;
+    return 1;
+  }
+
+  QList<QgsRasterPyramid> pyramids = provider->buildPyramidList( levels );
+  for ( int i = 0; i < pyramids.size(); ++i )
+  {
+    pyramids[i].build = true;
+  }
+
+  std::cout << "Building " << pyramids.size() << " pyramid levels of " << rasterFile.toLocal8Bit().data() << std::endl;
+  QString result = provider->buildPyramids( pyramids, resampling, format, configOptions );
+  delete provider;
+
+  if ( !result.isEmpty() )
+  {
+    std::cerr << "Building pyramids failed: " << result.toLocal8Bit().data() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Pyramids built." << std::endl;
+  return 0;
+}
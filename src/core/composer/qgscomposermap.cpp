@@ -24,6 +24,7 @@
 #include "qgslogger.h"
 #include "qgsmaprenderer.h"
 #include "qgsmaprenderercustompainterjob.h"
+#include "qgsmaprendererparalleljob.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsmaptopixel.h"
 #include "qgsproject.h"
@@ -219,6 +220,16 @@ void QgsComposerMap::draw( QPainter *painter, const QgsRectangle& extent, const
   jobMapSettings.setFlag( QgsMapSettings::UseAdvancedEffects, mComposition->useAdvancedEffects() ); // respect the composition's useAdvancedEffects flag
 
   // render
+  if ( mComposition->isParallelRenderingEnabled() && painter->device() && painter->device()->devType() == QInternal::Image )
+  {
+    //raster output, the job renders the layers to separate images in parallel and composes them
+    QgsMapRendererParallelJob job( jobMapSettings );
+    job.start();
+    job.waitForFinished();
+    painter->drawImage( 0, 0, job.renderedImage() );
+    return;
+  }
+
   QgsMapRendererCustomPainterJob job( jobMapSettings, painter );
   // Render the map in this thread. This is done because of problems
   // with printing to printer on Windows (printing to PDF is fine though).
@@ -87,6 +87,7 @@ void QgsComposition::init()
   mGenerateWorldFile = false;
   mWorldFileMap = 0;
   mUseAdvancedEffects = true;
+  mParallelRenderingEnabled = false;
   mSnapToGrid = false;
   mGridVisible = false;
   mSnapGridResolution = 0;
@@ -327,6 +327,14 @@ class CORE_EXPORT QgsComposition : public QGraphicsScene
       @note: added in version 1.9*/
     void setUseAdvancedEffects( const bool effectsEnabled );
 
+    /**Returns true if the layers of composer maps are rendered in parallel for raster output
+      @note added in 2.6*/
+    bool isParallelRenderingEnabled() const { return mParallelRenderingEnabled; }
+    /**Enables rendering the layers of composer maps in parallel (QgsMapRendererParallelJob) if the composition
+      is printed as raster. Vector output is always rendered in the calling thread. False by default
+      @note added in 2.6*/
+    void setParallelRenderingEnabled( bool enabled ) { mParallelRenderingEnabled = enabled; }
+
     /**Returns pointer to map renderer of qgis map canvas*/
     //! @deprecated since 2.4 - use mapSettings() instead. May return null if not initialized with QgsMapRenderer
     Q_DECL_DEPRECATED QgsMapRenderer* mapRenderer() {return mMapRenderer;}
@@ -659,6 +667,9 @@ class CORE_EXPORT QgsComposition : public QGraphicsScene
     /**Flag if advanced visual effects such as blend modes should be used. True by default*/
     bool mUseAdvancedEffects;
 
+    /**Flag if composer map layers are rendered in parallel for raster output. False by default*/
+    bool mParallelRenderingEnabled;
+
     /**Parameters for snap to grid function*/
     bool mSnapToGrid;
     bool mGridVisible;
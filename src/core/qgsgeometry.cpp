@@ -3360,6 +3360,13 @@ QgsRectangle QgsGeometry::boundingBox()
 
 bool QgsGeometry::intersects( const QgsRectangle& r ) const
 {
+  //the bounding box decides without GEOS for geometries completely inside or outside of the rectangle
+  QgsRectangle box = const_cast<QgsGeometry*>( this )->boundingBox();
+  if ( !box.intersects( r ) )
+    return false;
+  if ( r.contains( box ) )
+    return true;
+
   QgsGeometry* g = fromRect( r );
   bool res = intersects( g );
   delete g;
@@ -315,7 +315,7 @@ class CORE_EXPORT QgsGeometry
     /**Returns the bounding box of this feature*/
     QgsRectangle boundingBox();
 
-    /** Test for intersection with a rectangle (uses GEOS) */
+    /** Test for intersection with a rectangle (uses GEOS if the bounding box is partially inside the rectangle) */
     bool intersects( const QgsRectangle& r ) const;
 
     /** Test for intersection with a geometry (uses GEOS) */
@@ -59,6 +59,7 @@ QgsMapRenderer::QgsMapRenderer()
   mOutputUnits = QgsMapRenderer::Millimeters;
 
   mLabelingEngine = NULL;
+  mLabelingTime = 0;
 }
 
 QgsMapRenderer::~QgsMapRenderer()
@@ -257,6 +258,8 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   }
 
   mDrawing = true;
+  mLayerRenderingTimes.clear();
+  mLabelingTime = 0;
 
   const QgsCoordinateTransform *ct;
 
@@ -478,6 +481,9 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
         mRenderContext.painter()->scale( 1.0 / rasterScaleFactor, 1.0 / rasterScaleFactor );
       }
 
+      QTime layerTime;
+      layerTime.start();
+
       if ( !ml->draw( mRenderContext ) )
       {
         emit drawError( ml );
@@ -496,6 +502,8 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
         }
       }
 
+      mLayerRenderingTimes[ ml->id()] += layerTime.elapsed();
+
       if ( scaleRaster )
       {
         mRenderContext.setMapToPixel( bk_mapToPixel );
@@ -546,6 +554,9 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
   // Reset the composition mode before rendering the labels
   mRenderContext.painter()->setCompositionMode( QPainter::CompositionMode_SourceOver );
 
+  QTime labelingTime;
+  labelingTime.start();
+
   if ( !mOverview )
   {
     // render all labels for vector layers in the stack, starting at the base
@@ -607,6 +618,7 @@ void QgsMapRenderer::render( QPainter* painter, double* forceWidthScale )
     mLabelingEngine->drawLabeling( mRenderContext );
     mLabelingEngine->exit();
   }
+  mLabelingTime = labelingTime.elapsed();
 
   QgsDebugMsg( "Rendering completed in (seconds): " + QString( "%1" ).arg( renderTime.elapsed() / 1000.0 ) );
 
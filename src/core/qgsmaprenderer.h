@@ -16,6 +16,7 @@
 #ifndef QGSMAPRENDER_H
 #define QGSMAPRENDER_H
 
+#include <QMap>
 #include <QMutex>
 #include <QSize>
 #include <QStringList>
@@ -324,6 +325,14 @@ class CORE_EXPORT QgsMapRenderer : public QObject
     //! @note added in 2.4
     const QgsMapSettings& mapSettings();
 
+    //! Returns the drawing times in milliseconds of the layers rendered by the last call of render(), by layer id
+    //! @note added in 2.6
+    const QMap<QString, int>& layerRenderingTimes() const { return mLayerRenderingTimes; }
+
+    //! Returns the time in milliseconds spent on labeling in the last call of render()
+    //! @note added in 2.6
+    int labelingTime() const { return mLabelingTime; }
+
   signals:
 
     //! @deprecated in 2.4 - not emitted anymore
@@ -438,6 +447,11 @@ class CORE_EXPORT QgsMapRenderer : public QObject
 
     QHash< QString, QgsLayerCoordinateTransform > mLayerCoordinateTransformInfo;
 
+    //! drawing times of the layers in the last render() call
+    QMap<QString, int> mLayerRenderingTimes;
+
+    //! labeling time of the last render() call
+    int mLabelingTime;
 };
 
 #endif
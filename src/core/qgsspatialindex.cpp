@@ -88,7 +88,8 @@ class QgsSpatialIndexData : public QSharedData
       initTree();
 
       // copy R-tree data one by one (is there a faster way??)
-      double low[]  = { DBL_MIN, DBL_MIN };
+      // DBL_MIN is the smallest positive double, entries with negative coordinates need -DBL_MAX
+      double low[]  = { -DBL_MAX, -DBL_MAX };
       double high[] = { DBL_MAX, DBL_MAX };
       SpatialIndex::Region query( low, high, 2 );
       QgsSpatialIndexCopyVisitor visitor( mRTree );
@@ -28,7 +28,7 @@
 
 #include <QProgressDialog>
 
-#define FEATURE_BUFFER_SIZE 200
+#define FEATURE_BUFFER_SIZE 1000
 
 typedef QgsVectorLayerImport::ImportError createEmptyLayer_t(
   const QString &uri,
@@ -34,6 +34,9 @@
 #include "qgsnetworkaccessmanager.h"
 #include "qgsmaplayerregistry.h"
 #include "qgsserverlogger.h"
+#include "qgsserverprofiler.h"
+#include "qgsserverrequestcontext.h"
+#include "qgsservertilecache.h"
 
 #include <QDomDocument>
 #include <QNetworkDiskCache>
@@ -83,45 +86,45 @@ void dummyMessageHandler( QtMsgType type, const char *msg )
 void printRequestInfos()
 {
   QgsMessageLog::logMessage( "********************new request***************", "Server", QgsMessageLog::INFO );
-  if ( getenv( "REMOTE_ADDR" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "REMOTE_ADDR" ) != NULL )
   {
-    QgsMessageLog::logMessage( "remote ip: " + QString( getenv( "REMOTE_ADDR" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "remote ip: " + QString( QgsServerRequestContext::getEnv( "REMOTE_ADDR" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "REMOTE_HOST" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "REMOTE_HOST" ) != NULL )
   {
-    QgsMessageLog::logMessage( "remote ip: " + QString( getenv( "REMOTE_ADDR" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "remote ip: " + QString( QgsServerRequestContext::getEnv( "REMOTE_ADDR" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "REMOTE_USER" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "REMOTE_USER" ) != NULL )
   {
-    QgsMessageLog::logMessage( "remote user: " + QString( getenv( "REMOTE_USER" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "remote user: " + QString( QgsServerRequestContext::getEnv( "REMOTE_USER" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "REMOTE_IDENT" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "REMOTE_IDENT" ) != NULL )
   {
-    QgsMessageLog::logMessage( "REMOTE_IDENT: " + QString( getenv( "REMOTE_IDENT" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "REMOTE_IDENT: " + QString( QgsServerRequestContext::getEnv( "REMOTE_IDENT" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "CONTENT_TYPE" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "CONTENT_TYPE" ) != NULL )
   {
-    QgsMessageLog::logMessage( "CONTENT_TYPE: " + QString( getenv( "CONTENT_TYPE" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "CONTENT_TYPE: " + QString( QgsServerRequestContext::getEnv( "CONTENT_TYPE" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "AUTH_TYPE" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "AUTH_TYPE" ) != NULL )
   {
-    QgsMessageLog::logMessage( "AUTH_TYPE: " + QString( getenv( "AUTH_TYPE" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "AUTH_TYPE: " + QString( QgsServerRequestContext::getEnv( "AUTH_TYPE" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "HTTP_USER_AGENT" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "HTTP_USER_AGENT" ) != NULL )
   {
-    QgsMessageLog::logMessage( "HTTP_USER_AGENT: " + QString( getenv( "HTTP_USER_AGENT" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "HTTP_USER_AGENT: " + QString( QgsServerRequestContext::getEnv( "HTTP_USER_AGENT" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "HTTP_PROXY" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "HTTP_PROXY" ) != NULL )
   {
-    QgsMessageLog::logMessage( "HTTP_PROXY: " + QString( getenv( "HTTP_PROXY" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "HTTP_PROXY: " + QString( QgsServerRequestContext::getEnv( "HTTP_PROXY" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "HTTPS_PROXY" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "HTTPS_PROXY" ) != NULL )
   {
-    QgsMessageLog::logMessage( "HTTPS_PROXY: " + QString( getenv( "HTTPS_PROXY" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "HTTPS_PROXY: " + QString( QgsServerRequestContext::getEnv( "HTTPS_PROXY" ) ), "Server", QgsMessageLog::INFO );
   }
-  if ( getenv( "NO_PROXY" ) != NULL )
+  if ( QgsServerRequestContext::getEnv( "NO_PROXY" ) != NULL )
   {
-    QgsMessageLog::logMessage( "NO_PROXY: " + QString( getenv( "NO_PROXY" ) ), "Server", QgsMessageLog::INFO );
+    QgsMessageLog::logMessage( "NO_PROXY: " + QString( QgsServerRequestContext::getEnv( "NO_PROXY" ) ), "Server", QgsMessageLog::INFO );
   }
 }
 
@@ -193,7 +196,7 @@ void setupNetworkAccessManager()
 QgsRequestHandler* createRequestHandler()
 {
   QgsRequestHandler* requestHandler = 0;
-  char* requestMethod = getenv( "REQUEST_METHOD" );
+  const char* requestMethod = QgsServerRequestContext::getEnv( "REQUEST_METHOD" );
   if ( requestMethod != NULL )
   {
     if ( strcmp( requestMethod, "POST" ) == 0 )
@@ -216,7 +219,7 @@ QgsRequestHandler* createRequestHandler()
 QString configPath( const QString& defaultConfigPath, const QMap<QString, QString>& parameters )
 {
   QString cfPath( defaultConfigPath );
-  QString projectFile = getenv( "QGIS_PROJECT_FILE" );
+  QString projectFile = QgsServerRequestContext::getEnv( "QGIS_PROJECT_FILE" );
   if ( !projectFile.isEmpty() )
   {
     cfPath = projectFile;
@@ -237,6 +240,133 @@ QString configPath( const QString& defaultConfigPath, const QMap<QString, QStrin
 }
 
 
+static void executeRequest( const QString& defaultConfigFilePath, QgsCapabilitiesCache* capabilitiesCache, QgsMapRenderer* theMapRenderer, int logLevel )
+{
+  QgsMapLayerRegistry::instance()->removeAllMapLayers();
+  QCoreApplication::processEvents();
+  //no parser is in use between requests
+  QgsConfigCache::instance()->updateReloadedProjects();
+
+  QTime time; //used for measuring request time if loglevel < 1
+  if ( logLevel < 1 )
+  {
+    time.start();
+    printRequestInfos();
+  }
+
+  //Request handler
+  QScopedPointer<QgsRequestHandler> theRequestHandler( createRequestHandler() );
+  QMap<QString, QString> parameterMap;
+  try
+  {
+    parameterMap = theRequestHandler->parseInput();
+  }
+  catch ( QgsMapServiceException& e )
+  {
+    QgsMessageLog::logMessage( "Parse input exception: " + e.message(), "Server", QgsMessageLog::CRITICAL );
+    theRequestHandler->sendServiceException( e );
+    return;
+  }
+
+  printRequestParameters( parameterMap, logLevel );
+  QMap<QString, QString>::const_iterator paramIt;
+
+  //Config file path
+  QString configFilePath = configPath( defaultConfigFilePath, parameterMap );
+
+  //Service parameter
+  QString serviceString;
+  paramIt = parameterMap.find( "SERVICE" );
+  if ( paramIt == parameterMap.constEnd() )
+  {
+    QgsMessageLog::logMessage( "Exception: SERVICE parameter is missing", "Server", QgsMessageLog::CRITICAL );
+    theRequestHandler->sendServiceException( QgsMapServiceException( "ServiceNotSpecified", "Service not specified. The SERVICE parameter is mandatory" ) );
+    return;
+  }
+  else
+  {
+    serviceString = paramIt.value();
+  }
+
+  //WMTS GetTile is served as a (tile cached) WMS GetMap
+  if ( serviceString == "WMTS" )
+  {
+    QString errorMessage;
+    if ( parameterMap.value( "REQUEST" ).compare( "GetTile", Qt::CaseInsensitive ) != 0 )
+    {
+      theRequestHandler->sendServiceException( QgsMapServiceException( "OperationNotSupported", "Only the GetTile operation is supported for WMTS" ) );
+      return;
+    }
+    if ( !QgsServerTileCache::getTileToGetMap( parameterMap, errorMessage ) )
+    {
+      theRequestHandler->sendServiceException( QgsMapServiceException( "InvalidParameterValue", errorMessage ) );
+      return;
+    }
+    serviceString = "WMS";
+  }
+  QgsServerProfiler::instance()->setRequestType( serviceString, parameterMap.value( "REQUEST" ) );
+
+  if ( serviceString == "WCS" )
+  {
+    QgsWCSProjectParser* p = 0;
+    {
+      QgsServerProfilerStage stage( "configuration" );
+      p = QgsConfigCache::instance()->wcsConfiguration( configFilePath );
+    }
+    if ( !p )
+    {
+      theRequestHandler->sendServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
+      return;
+    }
+    QgsWCSServer wcsServer( configFilePath, parameterMap, p, theRequestHandler.take() );
+    wcsServer.executeRequest();
+  }
+  else if ( serviceString == "WFS" )
+  {
+    QgsWFSProjectParser* p = 0;
+    {
+      QgsServerProfilerStage stage( "configuration" );
+      p = QgsConfigCache::instance()->wfsConfiguration( configFilePath );
+    }
+    if ( !p )
+    {
+      theRequestHandler->sendServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
+      return;
+    }
+    QgsWFSServer wfsServer( configFilePath, parameterMap, p, theRequestHandler.take() );
+    wfsServer.executeRequest();
+  }
+  else    //WMS else
+  {
+    QgsWMSConfigParser* p = 0;
+    {
+      QgsServerProfilerStage stage( "configuration" );
+      p = QgsConfigCache::instance()->wmsConfiguration( configFilePath, parameterMap );
+    }
+    if ( !p )
+    {
+      theRequestHandler->sendServiceException( QgsMapServiceException( "WMS configuration error", "There was an error reading the project file or the SLD configuration" ) );
+      return;
+    }
+    QgsWMSServer wmsServer( configFilePath, parameterMap, p, theRequestHandler.take(), theMapRenderer, capabilitiesCache );
+    wmsServer.executeRequest();
+  }
+
+  if ( logLevel < 1 )
+  {
+    QgsMessageLog::logMessage( "Request finished in " + QString::number( time.elapsed() ) + " ms", "Server", QgsMessageLog::INFO );
+  }
+}
+
+/**Executes the request of the FastCGI environment*/
+void handleRequest( const QString& defaultConfigFilePath, QgsCapabilitiesCache* capabilitiesCache, QgsMapRenderer* theMapRenderer, int logLevel )
+{
+  QgsServerProfiler* profiler = QgsServerProfiler::instance();
+  profiler->startRequest();
+  executeRequest( defaultConfigFilePath, capabilitiesCache, theMapRenderer, logLevel );
+  profiler->endRequest();
+}
+
 int main( int argc, char * argv[] )
 {
 #ifndef _MSC_VER
@@ -312,91 +442,12 @@ int main( int argc, char * argv[] )
 #endif
 
   int logLevel = QgsServerLogger::instance()->logLevel();
-  QTime time; //used for measuring request time if loglevel < 1
 
+  //the services use the map layer registry, the project and the layer, config and CRS caches, which are not
+  //thread safe. Requests are executed one at a time, several processes are needed to use several cores
   while ( fcgi_accept() >= 0 )
   {
-    QgsMapLayerRegistry::instance()->removeAllMapLayers();
-    qgsapp.processEvents();
-
-    if ( logLevel < 1 )
-    {
-      time.start();
-      printRequestInfos();
-    }
-
-    //Request handler
-    QScopedPointer<QgsRequestHandler> theRequestHandler( createRequestHandler() );
-    QMap<QString, QString> parameterMap;
-    try
-    {
-      parameterMap = theRequestHandler->parseInput();
-    }
-    catch ( QgsMapServiceException& e )
-    {
-      QgsMessageLog::logMessage( "Parse input exception: " + e.message(), "Server", QgsMessageLog::CRITICAL );
-      theRequestHandler->sendServiceException( e );
-      continue;
-    }
-
-    printRequestParameters( parameterMap, logLevel );
-    QMap<QString, QString>::const_iterator paramIt;
-
-    //Config file path
-    QString configFilePath = configPath( defaultConfigFilePath, parameterMap );
-
-    //Service parameter
-    QString serviceString;
-    paramIt = parameterMap.find( "SERVICE" );
-    if ( paramIt == parameterMap.constEnd() )
-    {
-      QgsMessageLog::logMessage( "Exception: SERVICE parameter is missing", "Server", QgsMessageLog::CRITICAL );
-      theRequestHandler->sendServiceException( QgsMapServiceException( "ServiceNotSpecified", "Service not specified. The SERVICE parameter is mandatory" ) );
-      continue;
-    }
-    else
-    {
-      serviceString = paramIt.value();
-    }
-
-    if ( serviceString == "WCS" )
-    {
-      QgsWCSProjectParser* p = QgsConfigCache::instance()->wcsConfiguration( configFilePath );
-      if ( !p )
-      {
-        theRequestHandler->sendServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
-        continue;
-      }
-      QgsWCSServer wcsServer( configFilePath, parameterMap, p, theRequestHandler.take() );
-      wcsServer.executeRequest();
-    }
-    else if ( serviceString == "WFS" )
-    {
-      QgsWFSProjectParser* p = QgsConfigCache::instance()->wfsConfiguration( configFilePath );
-      if ( !p )
-      {
-        theRequestHandler->sendServiceException( QgsMapServiceException( "Project file error", "Error reading the project file" ) );
-        continue;
-      }
-      QgsWFSServer wfsServer( configFilePath, parameterMap, p, theRequestHandler.take() );
-      wfsServer.executeRequest();
-    }
-    else    //WMS else
-    {
-      QgsWMSConfigParser* p = QgsConfigCache::instance()->wmsConfiguration( configFilePath, parameterMap );
-      if ( !p )
-      {
-        theRequestHandler->sendServiceException( QgsMapServiceException( "WMS configuration error", "There was an error reading the project file or the SLD configuration" ) );
-        continue;
-      }
-      QgsWMSServer wmsServer( configFilePath, parameterMap, p, theRequestHandler.take(), theMapRenderer.data(), &capabilitiesCache );
-      wmsServer.executeRequest();
-    }
-
-    if ( logLevel < 1 )
-    {
-      QgsMessageLog::logMessage( "Request finished in " + QString::number( time.elapsed() ) + " ms", "Server", QgsMessageLog::INFO );
-    }
+    handleRequest( defaultConfigFilePath, &capabilitiesCache, theMapRenderer.data(), logLevel );
   }
 
   return 0;
@@ -17,53 +17,142 @@
 
 #include "qgscapabilitiescache.h"
 #include "qgslogger.h"
-#include <QCoreApplication>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+#include <stdlib.h>
 
 QgsCapabilitiesCache::QgsCapabilitiesCache()
 {
-  QObject::connect( &mFileSystemWatcher, SIGNAL( fileChanged( const QString& ) ), this, SLOT( removeChangedEntry( const QString& ) ) );
+  char* directoryEnv = getenv( "QGIS_SERVER_CAPABILITIES_CACHE_DIR" );
+  if ( directoryEnv && QDir().mkpath( QString( directoryEnv ) ) )
+  {
+    mDirectory = QDir( QString( directoryEnv ) ).absolutePath();
+  }
 }
 
 QgsCapabilitiesCache::~QgsCapabilitiesCache()
 {
 }
 
-const QDomDocument* QgsCapabilitiesCache::searchCapabilitiesDocument( QString configFilePath, QString version )
+const QByteArray* QgsCapabilitiesCache::searchCapabilitiesDocument( const QString& configFilePath, const QString& version )
 {
-  QCoreApplication::processEvents(); //get updates from file system watcher
+  QFileInfo configFileInfo( configFilePath );
 
-  if ( mCachedCapabilities.contains( configFilePath ) && mCachedCapabilities[ configFilePath ].contains( version ) )
+  QHash< QString, QHash< QString, CacheEntry > >::iterator capIt = mCachedCapabilities.find( configFilePath );
+  if ( capIt != mCachedCapabilities.end() )
   {
-    return &mCachedCapabilities[configFilePath][version];
+    QHash< QString, CacheEntry >::iterator versionIt = capIt.value().find( version );
+    if ( versionIt != capIt.value().end() )
+    {
+      if ( versionIt.value().isCurrent( configFileInfo ) )
+      {
+        return &versionIt.value().document;
+      }
+
+      QgsDebugMsg( "Remove capabilities cache entry because file changed" );
+      mCachedCapabilities.erase( capIt );
+    }
   }
-  else
+
+  //written by another server process?
+  CacheEntry entry;
+  if ( !readDiskEntry( configFilePath, version, entry ) || !entry.isCurrent( configFileInfo ) )
   {
     return 0;
   }
+
+  QgsDebugMsg( "Read capabilities document from cache directory" );
+  mCachedCapabilities[ configFilePath ].insert( version, entry );
+  return &mCachedCapabilities[ configFilePath ][ version ].document;
 }
 
-void QgsCapabilitiesCache::insertCapabilitiesDocument( QString configFilePath, QString version, const QDomDocument* doc )
+void QgsCapabilitiesCache::insertCapabilitiesDocument( const QString& configFilePath, const QString& version, const QDomDocument* doc,
+    const QDateTime& fileLastModified, qint64 fileSize )
 {
-  if ( mCachedCapabilities.size() > 40 )
+  if ( mCachedCapabilities.size() > 40 && !mCachedCapabilities.contains( configFilePath ) )
   {
     //remove another cache entry to avoid memory problems
-    QHash<QString, QHash<QString, QDomDocument> >::iterator capIt = mCachedCapabilities.begin();
-    mFileSystemWatcher.removePath( capIt.key() );
-    mCachedCapabilities.erase( capIt );
+    mCachedCapabilities.erase( mCachedCapabilities.begin() );
+  }
+
+  //not the current file, which may have changed since the project has been parsed
+  CacheEntry entry;
+  entry.fileLastModified = fileLastModified;
+  entry.fileSize = fileSize;
+  entry.document = doc->toByteArray();
+
+  mCachedCapabilities[ configFilePath ].insert( version, entry );
+  writeDiskEntry( configFilePath, version, entry );
+}
+
+bool QgsCapabilitiesCache::CacheEntry::isCurrent( const QFileInfo& configFileInfo ) const
+{
+  return fileLastModified.toMSecsSinceEpoch() == configFileInfo.lastModified().toMSecsSinceEpoch() && fileSize == configFileInfo.size();
+}
+
+QString QgsCapabilitiesCache::diskPath( const QString& configFilePath, const QString& version ) const
+{
+  QByteArray key = QCryptographicHash::hash( ( configFilePath + "|" + version ).toUtf8(), QCryptographicHash::Sha1 ).toHex();
+  return mDirectory + "/" + QString::fromAscii( key ) + ".xml";
+}
+
+bool QgsCapabilitiesCache::readDiskEntry( const QString& configFilePath, const QString& version, CacheEntry& entry ) const
+{
+  if ( mDirectory.isEmpty() )
+  {
+    return false;
   }
 
-  if ( !mCachedCapabilities.contains( configFilePath ) )
+  QFile file( diskPath( configFilePath, version ) );
+  if ( !file.open( QIODevice::ReadOnly ) )
   {
-    mFileSystemWatcher.addPath( configFilePath );
-    mCachedCapabilities.insert( configFilePath, QHash<QString, QDomDocument>() );
+    return false;
   }
 
-  mCachedCapabilities[ configFilePath ].insert( version, doc->cloneNode().toDocument() );
+  //first line: modification time (milliseconds since the epoch) and size of the configuration file
+  QList<QByteArray> header = file.readLine().trimmed().split( ' ' );
+  if ( header.size() != 2 )
+  {
+    return false;
+  }
+
+  bool timeOk, sizeOk;
+  entry.fileLastModified = QDateTime::fromMSecsSinceEpoch( header.at( 0 ).toLongLong( &timeOk ) );
+  entry.fileSize = header.at( 1 ).toLongLong( &sizeOk );
+  entry.document = file.readAll();
+  return timeOk && sizeOk && !entry.document.isEmpty();
 }
 
-void QgsCapabilitiesCache::removeChangedEntry( const QString& path )
+void QgsCapabilitiesCache::writeDiskEntry( const QString& configFilePath, const QString& version, const CacheEntry& entry ) const
 {
-  QgsDebugMsg( "Remove capabilities cache entry because file changed" );
-  mCachedCapabilities.remove( path );
-  mFileSystemWatcher.removePath( path );
+  if ( mDirectory.isEmpty() )
+  {
+    return;
+  }
+
+  QString path = diskPath( configFilePath, version );
+
+  //write to a temporary file first, other server processes may read the document at the same time
+  QTemporaryFile file( path + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( !file.open() )
+  {
+    QgsDebugMsg( "Could not write capabilities document " + path );
+    return;
+  }
+  file.write( QByteArray::number( entry.fileLastModified.toMSecsSinceEpoch() ) + " " + QByteArray::number( entry.fileSize ) + "\n" );
+  file.write( entry.document );
+  file.close();
+
+  QFile::remove( path );
+  if ( !file.rename( path ) )
+  {
+    file.remove();
+  }
 }
@@ -18,31 +18,55 @@
 #ifndef QGSCAPABILITIESCACHE_H
 #define QGSCAPABILITIESCACHE_H
 
-#include <QDomDocument>
-#include <QFileSystemWatcher>
+#include <QByteArray>
+#include <QDateTime>
 #include <QHash>
-#include <QObject>
+#include <QString>
 
-/**A cache for capabilities xml documents (by configuration file path)*/
-class QgsCapabilitiesCache: public QObject
+class QDomDocument;
+class QFileInfo;
+
+/**A cache for capabilities xml documents (by configuration file path).
+
+  The documents are stored serialised, so that they are sent without DOM serialisation. If the environment variable
+  QGIS_SERVER_CAPABILITIES_CACHE_DIR is set, they are also written to this directory and read by newly started
+  server processes, which then don't need to create the documents from the project. An entry is valid as long as
+  the modification time and size of the configuration file don't change*/
+class QgsCapabilitiesCache
 {
-    Q_OBJECT
   public:
     QgsCapabilitiesCache();
     ~QgsCapabilitiesCache();
 
-    /**Returns cached capabilities document (or 0 if document for configuration file not in cache)*/
-    const QDomDocument* searchCapabilitiesDocument( QString configFilePath, QString version );
-    /**Inserts new capabilities document (creates a copy of the document, does not take ownership)*/
-    void insertCapabilitiesDocument( QString configFilePath, QString version, const QDomDocument* doc );
+    /**Returns cached serialised capabilities document (or 0 if document for configuration file not in cache)*/
+    const QByteArray* searchCapabilitiesDocument( const QString& configFilePath, const QString& version );
+    /**Inserts new capabilities document (serialises the document, does not take ownership)
+      @param fileLastModified modification time of the configuration file the document has been created from
+      @param fileSize size of the configuration file the document has been created from*/
+    void insertCapabilitiesDocument( const QString& configFilePath, const QString& version, const QDomDocument* doc,
+                                     const QDateTime& fileLastModified, qint64 fileSize );
 
   private:
-    QHash< QString, QHash< QString, QDomDocument > > mCachedCapabilities;
-    QFileSystemWatcher mFileSystemWatcher;
+    struct CacheEntry
+    {
+      /**True if the entry has been created from the current version of the file (compared in milliseconds)*/
+      bool isCurrent( const QFileInfo& configFileInfo ) const;
+
+      /**Modification time and size of the configuration file the document has been created from*/
+      QDateTime fileLastModified;
+      qint64 fileSize;
+      QByteArray document;
+    };
+
+    /**Path of the file storing the document in the cache directory*/
+    QString diskPath( const QString& configFilePath, const QString& version ) const;
+    /**Reads a document from the cache directory. Returns false if there is no valid document*/
+    bool readDiskEntry( const QString& configFilePath, const QString& version, CacheEntry& entry ) const;
+    void writeDiskEntry( const QString& configFilePath, const QString& version, const CacheEntry& entry ) const;
 
-  private slots:
-    /**Removes changed entry from this cache*/
-    void removeChangedEntry( const QString &path );
+    QHash< QString, QHash< QString, CacheEntry > > mCachedCapabilities;
+    /**Cache directory, empty if the documents are only kept in memory*/
+    QString mDirectory;
 };
 
 #endif // QGSCAPABILITIESCACHE_H
@@ -16,14 +16,41 @@
  ***************************************************************************/
 
 #include "qgsconfigcache.h"
+#include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsmslayercache.h"
+#include "qgsserverprojectparser.h"
 #include "qgswcsprojectparser.h"
 #include "qgswfsprojectparser.h"
 #include "qgswmsprojectparser.h"
 #include "qgssldconfigparser.h"
 
 #include <QFile>
+#include <QFileInfo>
+#include <QtConcurrentRun>
+
+//maximum number of cached configuration files
+static const int MAX_CACHED_CONFIGS = 100;
+
+QgsConfigCacheEntry::QgsConfigCacheEntry()
+    : projectParser( 0 )
+    , sldDocument( 0 )
+    , wmsParser( 0 )
+    , wfsParser( 0 )
+    , wcsParser( 0 )
+    , fileSize( 0 )
+{
+}
+
+QgsConfigCacheEntry::~QgsConfigCacheEntry()
+{
+  //the service parsers use the project parser
+  delete wmsParser;
+  delete wfsParser;
+  delete wcsParser;
+  delete projectParser;
+  delete sldDocument;
+}
 
 QgsConfigCache* QgsConfigCache::instance()
 {
@@ -33,80 +60,218 @@ QgsConfigCache* QgsConfigCache::instance()
 
 QgsConfigCache::QgsConfigCache()
 {
-  QObject::connect( &mFileSystemWatcher, SIGNAL( fileChanged( const QString& ) ), this, SLOT( removeChangedEntry( const QString& ) ) );
+  QObject::connect( &mFileSystemWatcher, SIGNAL( fileChanged( const QString& ) ), this, SLOT( reloadChangedEntry( const QString& ) ) );
 }
 
 QgsConfigCache::~QgsConfigCache()
 {
+  QHash<QString, QFuture<QgsConfigCacheEntry*> >::iterator reloadIt = mReloads.begin();
+  for ( ; reloadIt != mReloads.end(); ++reloadIt )
+  {
+    reloadIt.value().waitForFinished();
+    delete reloadIt.value().result();
+  }
+  qDeleteAll( mEntries );
 }
 
 QgsWCSProjectParser* QgsConfigCache::wcsConfiguration( const QString& filePath )
 {
-  QgsWCSProjectParser* p = mWCSConfigCache.object( filePath );
-  if ( !p )
+  QgsConfigCacheEntry* e = entry( filePath );
+  if ( !e || !e->projectParser )
   {
-    QDomDocument* doc = xmlDocument( filePath );
-    if ( !doc )
-    {
-      return 0;
-    }
-    p = new QgsWCSProjectParser( doc, filePath );
-    mWCSConfigCache.insert( filePath, p );
-    mFileSystemWatcher.addPath( filePath );
+    return 0;
   }
 
-  QgsMSLayerCache::instance()->setProjectMaxLayers( p->wcsLayers().size() );
-  return p;
+  if ( !e->wcsParser )
+  {
+    e->wcsParser = new QgsWCSProjectParser( e->projectParser );
+  }
+
+  QgsMSLayerCache::instance()->setProjectMaxLayers( e->wcsParser->wcsLayers().size() );
+  return e->wcsParser;
 }
 
 QgsWFSProjectParser* QgsConfigCache::wfsConfiguration( const QString& filePath )
 {
-  QgsWFSProjectParser* p = mWFSConfigCache.object( filePath );
-  if ( !p )
+  QgsConfigCacheEntry* e = entry( filePath );
+  if ( !e || !e->projectParser )
   {
-    QDomDocument* doc = xmlDocument( filePath );
-    if ( !doc )
-    {
-      return 0;
-    }
+    return 0;
+  }
 
-    p = new QgsWFSProjectParser( doc, filePath );
-    mWFSConfigCache.insert( filePath, p );
-    mFileSystemWatcher.addPath( filePath );
+  if ( !e->wfsParser )
+  {
+    e->wfsParser = new QgsWFSProjectParser( e->projectParser );
   }
 
-  QgsMSLayerCache::instance()->setProjectMaxLayers( p->wfsLayers().size() );
-  return p;
+  QgsMSLayerCache::instance()->setProjectMaxLayers( e->wfsParser->wfsLayers().size() );
+  return e->wfsParser;
 }
 
 QgsWMSConfigParser* QgsConfigCache::wmsConfiguration( const QString& filePath, const QMap<QString, QString>& parameterMap )
 {
-  QgsWMSConfigParser* p = mWMSConfigCache.object( filePath );
-  if ( !p )
+  QgsConfigCacheEntry* e = entry( filePath );
+  if ( !e )
+  {
+    return 0;
+  }
+
+  if ( !e->wmsParser )
+  {
+    //sld or QGIS project file?
+    if ( e->projectParser )
+    {
+      e->wmsParser = new QgsWMSProjectParser( e->projectParser );
+    }
+    else
+    {
+      e->wmsParser = new QgsSLDConfigParser( e->sldDocument, parameterMap );
+      e->sldDocument = 0; //owned by the sld parser
+    }
+  }
+
+  QgsMSLayerCache::instance()->setProjectMaxLayers( e->wmsParser->nLayers() );
+  return e->wmsParser;
+}
+
+bool QgsConfigCache::configFileVersion( const QString& filePath, QDateTime& lastModified, qint64& size ) const
+{
+  const QgsConfigCacheEntry* e = mEntries.value( filePath, 0 );
+  if ( !e )
+  {
+    return false;
+  }
+  lastModified = e->fileLastModified;
+  size = e->fileSize;
+  return true;
+}
+
+void QgsConfigCache::updateReloadedProjects()
+{
+  QStringList finishedReloads;
+  QHash<QString, QFuture<QgsConfigCacheEntry*> >::const_iterator reloadIt = mReloads.constBegin();
+  for ( ; reloadIt != mReloads.constEnd(); ++reloadIt )
   {
-    QDomDocument* doc = xmlDocument( filePath );
-    if ( !doc )
+    if ( reloadIt.value().isFinished() )
     {
-      return 0;
+      finishedReloads << reloadIt.key();
     }
+  }
 
-    //sld or QGIS project file?
-    //is it an sld document or a qgis project file?
-    QDomElement documentElem = doc->documentElement();
-    if ( documentElem.tagName() == "StyledLayerDescriptor" )
+  foreach ( const QString& path, finishedReloads )
+  {
+    QgsConfigCacheEntry* newEntry = mReloads.take( path ).result();
+    QgsConfigCacheEntry* oldEntry = mEntries.take( path );
+
+    if ( newEntry )
     {
-      p = new QgsSLDConfigParser( doc, parameterMap );
+      QgsDebugMsg( "Replacing reloaded configuration " + path );
+      if ( oldEntry && oldEntry->projectParser && newEntry->projectParser )
+      {
+        removeChangedLayers( path, oldEntry->projectParser, newEntry->projectParser );
+      }
+      else
+      {
+        QgsMSLayerCache::instance()->removeProjectLayers( path );
+      }
+      mEntries.insert( path, newEntry );
     }
     else
     {
-      p = new QgsWMSProjectParser( doc, filePath );
+      //file removed or not valid anymore
+      QgsMSLayerCache::instance()->removeProjectLayers( path );
+    }
+    delete oldEntry;
+
+    //editors often replace the file, which removes it from the watcher
+    if ( QFile::exists( path ) && !mFileSystemWatcher.files().contains( path ) )
+    {
+      mFileSystemWatcher.addPath( path );
+    }
+
+    if ( mChangedDuringReload.remove( path ) )
+    {
+      reloadChangedEntry( path );
+    }
+  }
+}
+
+QgsConfigCacheEntry* QgsConfigCache::entry( const QString& filePath )
+{
+  QgsConfigCacheEntry* e = mEntries.value( filePath, 0 );
+  if ( e )
+  {
+    return e;
+  }
+
+  e = loadEntry( filePath );
+  if ( !e )
+  {
+    return 0;
+  }
+
+  if ( mEntries.size() >= MAX_CACHED_CONFIGS )
+  {
+    //remove another cache entry to avoid memory problems
+    QHash<QString, QgsConfigCacheEntry*>::iterator entryIt = mEntries.begin();
+    mFileSystemWatcher.removePath( entryIt.key() );
+    QgsMSLayerCache::instance()->removeProjectLayers( entryIt.key() );
+    delete entryIt.value();
+    mEntries.erase( entryIt );
+  }
+
+  mEntries.insert( filePath, e );
+  mFileSystemWatcher.addPath( filePath );
+  return e;
+}
+
+QgsConfigCacheEntry* QgsConfigCache::loadEntry( const QString& filePath )
+{
+  //before reading, so that a change during reading makes the entry outdated
+  QFileInfo fileInfo( filePath );
+  QDateTime fileLastModified = fileInfo.lastModified();
+  qint64 fileSize = fileInfo.size();
+
+  QDomDocument* doc = xmlDocument( filePath );
+  if ( !doc )
+  {
+    return 0;
+  }
+
+  QgsConfigCacheEntry* e = new QgsConfigCacheEntry();
+  e->fileLastModified = fileLastModified;
+  e->fileSize = fileSize;
+  //is it an sld document or a qgis project file?
+  if ( doc->documentElement().tagName() == "StyledLayerDescriptor" )
+  {
+    e->sldDocument = doc;
+  }
+  else
+  {
+    e->projectParser = new QgsServerProjectParser( doc, filePath );
+  }
+  return e;
+}
+
+void QgsConfigCache::removeChangedLayers( const QString& filePath, const QgsServerProjectParser* oldProject, const QgsServerProjectParser* newProject )
+{
+  const QHash< QString, QByteArray >& newChecksums = newProject->projectLayerChecksums();
+  QSet<QString> changedLayers;
+
+  QHash< QString, QByteArray >::const_iterator layerIt = oldProject->projectLayerChecksums().constBegin();
+  for ( ; layerIt != oldProject->projectLayerChecksums().constEnd(); ++layerIt )
+  {
+    if ( newChecksums.value( layerIt.key() ) != layerIt.value() )
+    {
+      changedLayers.insert( layerIt.key() );
     }
-    mWMSConfigCache.insert( filePath, p );
-    mFileSystemWatcher.addPath( filePath );
   }
 
-  QgsMSLayerCache::instance()->setProjectMaxLayers( p->nLayers() );
-  return p;
+  QgsDebugMsg( QString( "%1 of %2 layers changed in %3" ).arg( changedLayers.size() ).arg( oldProject->projectLayerChecksums().size() ).arg( filePath ) );
+  if ( !changedLayers.isEmpty() )
+  {
+    QgsMSLayerCache::instance()->removeProjectLayers( filePath, changedLayers );
+  }
 }
 
 QDomDocument* QgsConfigCache::xmlDocument( const QString& filePath )
@@ -139,10 +304,21 @@ QDomDocument* QgsConfigCache::xmlDocument( const QString& filePath )
   return xmlDoc;
 }
 
-void QgsConfigCache::removeChangedEntry( const QString& path )
+void QgsConfigCache::reloadChangedEntry( const QString& path )
 {
-  mWMSConfigCache.remove( path );
-  mWFSConfigCache.remove( path );
-  mWCSConfigCache.remove( path );
-  mFileSystemWatcher.removePath( path );
+  if ( mReloads.contains( path ) )
+  {
+    mChangedDuringReload.insert( path );
+    return;
+  }
+
+  if ( !mEntries.contains( path ) )
+  {
+    mFileSystemWatcher.removePath( path );
+    return;
+  }
+
+  //the cached entry is used until the new version is parsed
+  QgsDebugMsg( "Reloading changed configuration " + path );
+  mReloads.insert( path, QtConcurrent::run( loadEntry, path ) );
 }
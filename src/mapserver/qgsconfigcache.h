@@ -18,17 +18,44 @@
 #ifndef QGSCONFIGCACHE_H
 #define QGSCONFIGCACHE_H
 
-#include <QCache>
+#include <QDateTime>
 #include <QFileSystemWatcher>
+#include <QFuture>
+#include <QHash>
 #include <QMap>
 #include <QObject>
+#include <QSet>
 
+class QgsServerProjectParser;
 class QgsWCSProjectParser;
 class QgsWFSProjectParser;
 class QgsWMSConfigParser;
 
 class QDomDocument;
 
+/**Parsed configuration file. The WMS, WFS and WCS parsers of a project share the same project parser*/
+struct QgsConfigCacheEntry
+{
+  QgsConfigCacheEntry();
+  ~QgsConfigCacheEntry();
+
+  /**Parsed QGIS project, 0 for SLD files*/
+  QgsServerProjectParser* projectParser;
+  /**Document of an SLD file, owned by the WMS parser once it has been created*/
+  QDomDocument* sldDocument;
+  QgsWMSConfigParser* wmsParser;
+  QgsWFSProjectParser* wfsParser;
+  QgsWCSProjectParser* wcsParser;
+  /**Modification time and size of the file when it was parsed*/
+  QDateTime fileLastModified;
+  qint64 fileSize;
+};
+
+/**A singleton cache of the parsed configuration files.
+
+  If a project file changes, the new version is parsed in a background thread while requests continue to use the
+  previous version. The reloaded project replaces the cached one in updateReloadedProjects(). Layers whose definition
+  did not change are kept in QgsMSLayerCache and reused*/
 class QgsConfigCache: public QObject
 {
     Q_OBJECT
@@ -40,23 +67,45 @@ class QgsConfigCache: public QObject
     QgsWFSProjectParser* wfsConfiguration( const QString& filePath );
     QgsWMSConfigParser* wmsConfiguration( const QString& filePath, const QMap<QString, QString>& parameterMap = ( QMap< QString, QString >() ) );
 
+    /**Returns the modification time and size of a configuration file when the cached version was parsed.
+      Documents created from the cached configuration (e.g. capabilities) are valid for this version of the file
+      @return false if the file is not cached*/
+    bool configFileVersion( const QString& filePath, QDateTime& lastModified, qint64& size ) const;
+
+    /**Replaces the cached configurations whose background reload has finished. Deletes the parsers of the
+      previous versions, so it must be called between requests*/
+    void updateReloadedProjects();
+
   private:
     QgsConfigCache();
     static QgsConfigCache* mInstance;
 
-    /**Check for configuration file updates (remove entry from cache if file changes)*/
+    /**Check for configuration file updates (reload entry if file changes)*/
     QFileSystemWatcher mFileSystemWatcher;
 
     /**Returns xml document for project file / sld or 0 in case of errors*/
-    QDomDocument* xmlDocument( const QString& filePath );
+    static QDomDocument* xmlDocument( const QString& filePath );
+
+    /**Parses a configuration file. Does not create layers or other QObjects, so it can run in a background thread
+      @return a new entry without service parsers or 0 in case of errors*/
+    static QgsConfigCacheEntry* loadEntry( const QString& filePath );
+
+    /**Returns the cache entry for a file, parsing the file if it is not cached yet*/
+    QgsConfigCacheEntry* entry( const QString& filePath );
+
+    /**Removes the layers which changed between two versions of a project from the layer cache*/
+    static void removeChangedLayers( const QString& filePath, const QgsServerProjectParser* oldProject, const QgsServerProjectParser* newProject );
+
+    QHash<QString, QgsConfigCacheEntry*> mEntries;
 
-    QCache<QString, QgsWMSConfigParser> mWMSConfigCache;
-    QCache<QString, QgsWFSProjectParser> mWFSConfigCache;
-    QCache<QString, QgsWCSProjectParser> mWCSConfigCache;
+    /**Background reloads by file path*/
+    QHash<QString, QFuture<QgsConfigCacheEntry*> > mReloads;
+    /**Files changed again while they were reloaded*/
+    QSet<QString> mChangedDuringReload;
 
   private slots:
-    /**Removes changed entry from this cache*/
-    void removeChangedEntry( const QString& path );
+    /**Starts the reload of a changed configuration file*/
+    void reloadChangedEntry( const QString& path );
 };
 
 #endif // QGSCONFIGCACHE_H
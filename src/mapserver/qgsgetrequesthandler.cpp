@@ -15,6 +15,7 @@
 #include "qgsgetrequesthandler.h"
 #include "qgslogger.h"
 #include "qgsremotedatasourcebuilder.h"
+#include "qgsserverrequestcontext.h"
 #include <QStringList>
 #include <QUrl>
 #include <stdlib.h>
@@ -29,7 +30,7 @@ QMap<QString, QString> QgsGetRequestHandler::parseInput()
   QString queryString;
   QMap<QString, QString> parameters;
 
-  const char* qs = getenv( "QUERY_STRING" );
+  const char* qs = QgsServerRequestContext::getEnv( "QUERY_STRING" );
   if ( qs )
   {
     queryString = QString( qs );
@@ -20,6 +20,7 @@
 #include "qgshttptransaction.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverrequestcontext.h"
 #include <QBuffer>
 #include <QByteArray>
 #include <QDomDocument>
@@ -28,11 +29,21 @@
 #include <QTextStream>
 #include <QStringList>
 #include <QUrl>
-#include <fcgi_stdio.h>
 
-QgsHttpRequestHandler::QgsHttpRequestHandler(): QgsRequestHandler()
-{
+#include <stdlib.h>
+
+//median cut is done on a histogram with 5 bits per color channel for images with more colors
+static const int MAX_MEDIAN_CUT_COLORS = 4096;
 
+QgsHttpRequestHandler::QgsHttpRequestHandler(): QgsRequestHandler(), mPngQuality( -1 )
+{
+  //zlib compression level (0-9) of PNG images. QImageWriter maps the quality 0-100 to the levels 9-0
+  bool conversionOk = false;
+  int compressionLevel = QString( getenv( "QGIS_SERVER_PNG_COMPRESSION" ) ).toInt( &conversionOk );
+  if ( conversionOk && compressionLevel >= 0 && compressionLevel <= 9 )
+  {
+    mPngQuality = 100 - ( compressionLevel * 91 + 8 ) / 9;
+  }
 }
 
 QgsHttpRequestHandler::~QgsHttpRequestHandler()
@@ -56,17 +67,11 @@ void QgsHttpRequestHandler::sendHttpResponse( QByteArray* ba, const QString& for
   QgsDebugMsg( "Byte array looks good, returning response..." );
   QgsDebugMsg( QString( "Content size: %1" ).arg( ba->size() ) );
   QgsDebugMsg( QString( "Content format: %1" ).arg( format ) );
-  printf( "Content-Type: " );
-  printf( format.toLocal8Bit() );
-  printf( "\n" );
-  printf( "Content-Length: %d\n", ba->size() );
-  printf( "\n" );
-  size_t result = fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
-#ifdef QGISDEBUG
-  QgsDebugMsg( QString( "Sent %1 bytes" ).arg( result ) );
-#else
-  Q_UNUSED( result );
-#endif
+  QgsServerRequestContext::write( "Content-Type: " + format.toLocal8Bit() + "\n" );
+  QgsServerRequestContext::write( "Content-Length: " + QByteArray::number( ba->size() ) + "\n" );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( *ba );
+  QgsDebugMsg( QString( "Sent %1 bytes" ).arg( ba->size() ) );
 }
 
 QString QgsHttpRequestHandler::formatToMimeType( const QString& format ) const
@@ -96,60 +101,70 @@ void QgsHttpRequestHandler::sendGetMapResponse( const QString& service, QImage*
   QgsDebugMsg( "Sending getmap response..." );
   if ( img )
   {
-    bool png16Bit = ( mFormatString.compare( "image/png; mode=16bit", Qt::CaseInsensitive ) == 0 );
-    bool png8Bit = ( mFormatString.compare( "image/png; mode=8bit", Qt::CaseInsensitive ) == 0 );
-    bool png1Bit = ( mFormatString.compare( "image/png; mode=1bit", Qt::CaseInsensitive ) == 0 );
-    bool isBase64 = mFormatString.endsWith( ";base64", Qt::CaseInsensitive );
-    if ( mFormat != "PNG" && mFormat != "JPG" && !png16Bit && !png8Bit && !png1Bit )
+    QByteArray ba = encodeGetMapImage( img, imageQuality );
+    if ( ba.isEmpty() )
     {
       QgsDebugMsg( "service exception - incorrect image format requested..." );
       sendServiceException( QgsMapServiceException( "InvalidFormat", "Output format '" + mFormatString + "' is not supported in the GetMap request" ) );
       return;
     }
+    sendEncodedGetMapResponse( &ba );
+  }
+}
 
-    //store the image in a QByteArray and send it directly
-    QByteArray ba;
-    QBuffer buffer( &ba );
-    buffer.open( QIODevice::WriteOnly );
+QByteArray QgsHttpRequestHandler::encodeGetMapImage( QImage* img, int imageQuality ) const
+{
+  bool png16Bit = ( mFormatString.compare( "image/png; mode=16bit", Qt::CaseInsensitive ) == 0 );
+  bool png8Bit = ( mFormatString.compare( "image/png; mode=8bit", Qt::CaseInsensitive ) == 0 );
+  bool png1Bit = ( mFormatString.compare( "image/png; mode=1bit", Qt::CaseInsensitive ) == 0 );
+  bool isBase64 = mFormatString.endsWith( ";base64", Qt::CaseInsensitive );
+  if ( !img || ( mFormat != "PNG" && mFormat != "JPG" && !png16Bit && !png8Bit && !png1Bit ) )
+  {
+    return QByteArray();
+  }
 
-    // Do not use imageQuality for PNG images
-    // For now, QImage expects quality to be a range 0-9 for PNG
-    if ( mFormat == "PNG" )
-    {
-      imageQuality = -1;
-    }
+  //store the image in a QByteArray
+  QByteArray ba;
+  QBuffer buffer( &ba );
+  buffer.open( QIODevice::WriteOnly );
 
-    if ( png8Bit )
-    {
-      QVector<QRgb> colorTable;
-      medianCut( colorTable, 256, *img );
-      QImage palettedImg = img->convertToFormat( QImage::Format_Indexed8, colorTable, Qt::ColorOnly | Qt::ThresholdDither |
-                           Qt::ThresholdAlphaDither | Qt::NoOpaqueDetection );
-      palettedImg.save( &buffer, "PNG", imageQuality );
-    }
-    else if ( png16Bit )
-    {
-      QImage palettedImg = img->convertToFormat( QImage::Format_ARGB4444_Premultiplied );
-      palettedImg.save( &buffer, "PNG", imageQuality );
-    }
-    else if ( png1Bit )
-    {
-      QImage palettedImg = img->convertToFormat( QImage::Format_Mono, Qt::MonoOnly | Qt::ThresholdDither |
-                           Qt::ThresholdAlphaDither | Qt::NoOpaqueDetection );
-      palettedImg.save( &buffer, "PNG", imageQuality );
-    }
-    else
-    {
-      img->save( &buffer, mFormat.toLocal8Bit().data(), imageQuality );
-    }
+  // Do not use imageQuality for PNG images, the quality sets the compression level
+  if ( mFormat == "PNG" )
+  {
+    imageQuality = mPngQuality;
+  }
 
-    if ( isBase64 )
-    {
-      ba = ba.toBase64();
-    }
+  if ( png8Bit )
+  {
+    QImage palettedImg = palettedImage( *img, 256 );
+    palettedImg.save( &buffer, "PNG", imageQuality );
+  }
+  else if ( png16Bit )
+  {
+    QImage palettedImg = img->convertToFormat( QImage::Format_ARGB4444_Premultiplied );
+    palettedImg.save( &buffer, "PNG", imageQuality );
+  }
+  else if ( png1Bit )
+  {
+    QImage palettedImg = img->convertToFormat( QImage::Format_Mono, Qt::MonoOnly | Qt::ThresholdDither |
+                         Qt::ThresholdAlphaDither | Qt::NoOpaqueDetection );
+    palettedImg.save( &buffer, "PNG", imageQuality );
+  }
+  else
+  {
+    img->save( &buffer, mFormat.toLocal8Bit().data(), imageQuality );
+  }
 
-    sendHttpResponse( &ba, formatToMimeType( mFormat ) );
+  if ( isBase64 )
+  {
+    ba = ba.toBase64();
   }
+  return ba;
+}
+
+void QgsHttpRequestHandler::sendEncodedGetMapResponse( QByteArray* ba ) const
+{
+  sendHttpResponse( ba, formatToMimeType( mFormat ) );
 }
 
 void QgsHttpRequestHandler::sendGetCapabilitiesResponse( const QDomDocument& doc ) const
@@ -158,6 +173,12 @@ void QgsHttpRequestHandler::sendGetCapabilitiesResponse( const QDomDocument& doc
   sendHttpResponse( &ba, "text/xml" );
 }
 
+void QgsHttpRequestHandler::sendSerializedGetCapabilitiesResponse( const QByteArray& ba ) const
+{
+  QByteArray response = ba;
+  sendHttpResponse( &response, "text/xml" );
+}
+
 void QgsHttpRequestHandler::sendGetStyleResponse( const QDomDocument& doc ) const
 {
   QByteArray ba = doc.toByteArray();
@@ -337,11 +358,9 @@ bool QgsHttpRequestHandler::startGetFeatureResponse( QByteArray* ba, const QStri
   else
     format = "text/xml";
 
-  printf( "Content-Type: " );
-  printf( format.toLocal8Bit() );
-  printf( "\n" );
-  printf( "\n" );
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsServerRequestContext::write( "Content-Type: " + format.toLocal8Bit() + "\n" );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( *ba );
   return true;
 }
 
@@ -356,7 +375,7 @@ void QgsHttpRequestHandler::sendGetFeatureResponse( QByteArray* ba ) const
   {
     return;
   }
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsServerRequestContext::write( *ba );
 }
 
 void QgsHttpRequestHandler::endGetFeatureResponse( QByteArray* ba ) const
@@ -366,7 +385,7 @@ void QgsHttpRequestHandler::endGetFeatureResponse( QByteArray* ba ) const
     return;
   }
 
-  fwrite( ba->data(), ba->size(), 1, FCGI_stdout );
+  QgsServerRequestContext::write( *ba );
 }
 
 void QgsHttpRequestHandler::sendGetCoverageResponse( QByteArray* ba ) const
@@ -470,51 +489,97 @@ void QgsHttpRequestHandler::requestStringToParameterMap( const QString& request,
 
 QString QgsHttpRequestHandler::readPostBody() const
 {
-  char* lengthString = NULL;
-  int length = 0;
-  char* input = NULL;
-  QString inputString;
-  QString lengthQString;
-
-  lengthString = getenv( "CONTENT_LENGTH" );
-  if ( lengthString != NULL )
-  {
-    bool conversionSuccess = false;
-    lengthQString = QString( lengthString );
-    length = lengthQString.toInt( &conversionSuccess );
-    QgsDebugMsg( "length is: " + lengthQString );
-    if ( conversionSuccess )
+  return QString::fromLocal8Bit( QgsServerRequestContext::body() );
+}
+
+QImage QgsHttpRequestHandler::palettedImage( const QImage& inputImage, int nColors )
+{
+  //the color table contains colors which are not premultiplied
+  QImage image = inputImage.format() == QImage::Format_ARGB32 ? inputImage : inputImage.convertToFormat( QImage::Format_ARGB32 );
+  int width = image.width();
+  int height = image.height();
+
+  QHash<QRgb, int> inputColors;
+  imageColors( inputColors, image );
+
+  QVector<QRgb> colorTable;
+  if ( inputColors.size() > MAX_MEDIAN_CUT_COLORS )
+  {
+    //the colors of a bin are represented by its center
+    QHash<QRgb, int> reducedColors;
+    QHash<QRgb, int>::const_iterator colorIt = inputColors.constBegin();
+    for ( ; colorIt != inputColors.constEnd(); ++colorIt )
     {
-      input = ( char* )malloc( length + 1 );
-      memset( input, 0, length + 1 );
-      for ( int i = 0; i < length; ++i )
-      {
-        input[i] = getchar();
-      }
-      //fgets(input, length+1, stdin);
-      if ( input != NULL )
-      {
-        inputString = QString::fromLocal8Bit( input );
-      }
-      else
+      reducedColors[( colorIt.key() & 0xfff8f8f8 ) | 0x00040404] += colorIt.value();
+    }
+    medianCut( colorTable, nColors, reducedColors );
+  }
+  else
+  {
+    medianCut( colorTable, nColors, inputColors );
+  }
+
+  //map every color of the image once to the closest palette color instead of every pixel
+  QHash<QRgb, uchar> colorIndexes;
+  colorIndexes.reserve( inputColors.size() );
+  QHash<QRgb, int>::const_iterator colorIt = inputColors.constBegin();
+  for ( ; colorIt != inputColors.constEnd(); ++colorIt )
+  {
+    colorIndexes.insert( colorIt.key(), closestColorIndex( colorTable, colorIt.key() ) );
+  }
+
+  QImage palettedImage( width, height, QImage::Format_Indexed8 );
+  palettedImage.setColorTable( colorTable );
+  palettedImage.setDotsPerMeterX( image.dotsPerMeterX() );
+  palettedImage.setDotsPerMeterY( image.dotsPerMeterY() );
+
+  //neighbouring pixels mostly have the same color
+  QRgb lastColor = 0;
+  uchar lastIndex = colorIndexes.value( lastColor );
+  for ( int i = 0; i < height; ++i )
+  {
+    const QRgb* inputScanLine = ( const QRgb* )( image.constScanLine( i ) );
+    uchar* outputScanLine = palettedImage.scanLine( i );
+    for ( int j = 0; j < width; ++j )
+    {
+      if ( inputScanLine[j] != lastColor )
       {
-        QgsDebugMsg( "input is NULL " );
+        lastColor = inputScanLine[j];
+        lastIndex = colorIndexes.value( lastColor );
       }
-      free( input );
+      outputScanLine[j] = lastIndex;
     }
-    else
+  }
+  return palettedImage;
+}
+
+uchar QgsHttpRequestHandler::closestColorIndex( const QVector<QRgb>& colorTable, QRgb color )
+{
+  int closestIndex = 0;
+  int closestDistance = INT_MAX;
+  for ( int i = 0; i < colorTable.size(); ++i )
+  {
+    QRgb tableColor = colorTable.at( i );
+    int dr = qRed( tableColor ) - qRed( color );
+    int dg = qGreen( tableColor ) - qGreen( color );
+    int db = qBlue( tableColor ) - qBlue( color );
+    int da = qAlpha( tableColor ) - qAlpha( color );
+    int distance = dr * dr + dg * dg + db * db + da * da;
+    if ( distance < closestDistance )
     {
-      QgsDebugMsg( "could not convert CONTENT_LENGTH to int" );
+      closestDistance = distance;
+      closestIndex = i;
+      if ( distance == 0 )
+      {
+        break;
+      }
     }
   }
-  return inputString;
+  return ( uchar ) closestIndex;
 }
 
-void QgsHttpRequestHandler::medianCut( QVector<QRgb>& colorTable, int nColors, const QImage& inputImage )
+void QgsHttpRequestHandler::medianCut( QVector<QRgb>& colorTable, int nColors, const QHash<QRgb, int>& inputColors )
 {
-  QHash<QRgb, int> inputColors;
-  imageColors( inputColors, inputImage );
-
   if ( inputColors.size() <= nColors ) //all the colors in the image can be mapped to one palette color
   {
     colorTable.resize( inputColors.size() );
@@ -34,7 +34,10 @@ class QgsHttpRequestHandler: public QgsRequestHandler
     ~QgsHttpRequestHandler();
 
     virtual void sendGetMapResponse( const QString& service, QImage* img, int imageQuality ) const;
+    virtual QByteArray encodeGetMapImage( QImage* img, int imageQuality ) const;
+    virtual void sendEncodedGetMapResponse( QByteArray* ba ) const;
     virtual void sendGetCapabilitiesResponse( const QDomDocument& doc ) const;
+    virtual void sendSerializedGetCapabilitiesResponse( const QByteArray& ba ) const;
     virtual void sendGetFeatureInfoResponse( const QDomDocument& infoDoc, const QString& infoFormat ) const;
     virtual void sendServiceException( const QgsMapServiceException& ex ) const;
     virtual void sendGetStyleResponse( const QDomDocument& doc ) const;
@@ -55,7 +58,12 @@ class QgsHttpRequestHandler: public QgsRequestHandler
     QString readPostBody() const;
 
   private:
-    static void medianCut( QVector<QRgb>& colorTable, int nColors, const QImage& inputImage );
+    /**Converts an image to 8 bit with a palette of nColors colors found by median cut*/
+    static QImage palettedImage( const QImage& inputImage, int nColors );
+    /**Returns the index of the table color closest to color*/
+    static uchar closestColorIndex( const QVector<QRgb>& colorTable, QRgb color );
+    /**Calculates a color table of nColors colors for a color histogram (color / number of pixels)*/
+    static void medianCut( QVector<QRgb>& colorTable, int nColors, const QHash<QRgb, int>& inputColors );
     static void imageColors( QHash<QRgb, int>& colors, const QImage& image );
     static void splitColorBox( QgsColorBox& colorBox, QgsColorBoxMap& colorBoxMap,
                                QMap<int, QgsColorBox>::iterator colorBoxMapIt );
@@ -66,6 +74,9 @@ class QgsHttpRequestHandler: public QgsRequestHandler
     static bool alphaCompare( const QPair<QRgb, int>& c1, const QPair<QRgb, int>& c2 );
     /**Calculates a representative color for a box (pixel weighted average)*/
     static QRgb boxColor( const QgsColorBox& box, int boxPixels );
+
+    /**Quality passed to QImageWriter for PNG images (QGIS_SERVER_PNG_COMPRESSION), -1 for the default compression*/
+    int mPngQuality;
 };
 
 #endif
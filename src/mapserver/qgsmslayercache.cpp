@@ -40,7 +40,6 @@ QgsMSLayerCache::QgsMSLayerCache()
       mDefaultMaxLayers = maxLayerInt;
     }
   }
-  QObject::connect( &mFileSystemWatcher, SIGNAL( fileChanged( const QString& ) ), this, SLOT( removeProjectFileLayers( const QString& ) ) );
 }
 
 QgsMSLayerCache::~QgsMSLayerCache()
@@ -76,21 +75,6 @@ void QgsMSLayerCache::insertLayer( const QString& url, const QString& layerName,
   newEntry.configFile = configFile;
 
   mEntries.insert( urlLayerPair, newEntry );
-
-  //update config file map
-  if ( !configFile.isEmpty() )
-  {
-    QHash< QString, int >::iterator configIt = mConfigFiles.find( configFile );
-    if ( configIt == mConfigFiles.end() )
-    {
-      mConfigFiles.insert( configFile, 1 );
-      mFileSystemWatcher.addPath( configFile );
-    }
-    else
-    {
-      mConfigFiles[configFile] = configIt.value() + 1; //increment reference counter
-    }
-  }
 }
 
 QgsMapLayer* QgsMSLayerCache::searchLayer( const QString& url, const QString& layerName )
@@ -110,14 +94,15 @@ QgsMapLayer* QgsMSLayerCache::searchLayer( const QString& url, const QString& la
   }
 }
 
-void QgsMSLayerCache::removeProjectFileLayers( const QString& project )
+void QgsMSLayerCache::removeProjectLayers( const QString& project, const QSet<QString>& layerIds )
 {
   QList< QPair< QString, QString > > removeEntries;
 
   QHash<QPair<QString, QString>, QgsMSLayerCacheEntry>::iterator entryIt = mEntries.begin();
   for ( ; entryIt != mEntries.end(); ++entryIt )
   {
-    if ( entryIt.value().configFile == project )
+    //project layers are inserted with the layer id as layer name
+    if ( entryIt.value().configFile == project && ( layerIds.isEmpty() || layerIds.contains( entryIt.key().second ) ) )
     {
       removeEntries.push_back( entryIt.key() );
       freeEntryRessources( entryIt.value() );
@@ -186,19 +171,4 @@ void QgsMSLayerCache::freeEntryRessources( QgsMSLayerCacheEntry& entry )
       QgsDebugMsg( removeFile.errorString() );
     }
   }
-
-  //counter
-  if ( !entry.configFile.isEmpty() )
-  {
-    int configFileCount = mConfigFiles[entry.configFile];
-    if ( configFileCount < 2 )
-    {
-      mConfigFiles.remove( entry.configFile );
-      mFileSystemWatcher.removePath( entry.configFile );
-    }
-    else
-    {
-      mConfigFiles[entry.configFile] = configFileCount - 1;
-    }
-  }
 }
@@ -19,10 +19,10 @@
 #define QGSMSLAYERCACHE_H
 
 #include <time.h>
-#include <QFileSystemWatcher>
 #include <QHash>
 #include <QObject>
 #include <QPair>
+#include <QSet>
 #include <QString>
 
 class QgsMapLayer;
@@ -60,6 +60,11 @@ class QgsMSLayerCache: public QObject
 
     void setProjectMaxLayers( int n ) { mProjectMaxLayers = n; }
 
+    /**Removes the layers of a project file (e.g. if the project file has changed)
+      @param project path of the project file
+      @param layerIds ids of the layers to remove. If empty, all the layers of the project are removed*/
+    void removeProjectLayers( const QString& project, const QSet<QString>& layerIds = QSet<QString>() );
+
   protected:
     /**Protected singleton constructor*/
     QgsMSLayerCache();
@@ -78,22 +83,11 @@ class QgsMSLayerCache: public QObject
       layer names*/
     QHash<QPair<QString, QString>, QgsMSLayerCacheEntry> mEntries;
 
-    /**Config files used in the cache (with reference counter)*/
-    QHash< QString, int > mConfigFiles;
-
-    /**Check for configuration file updates (remove layers from cache if configuration file changes)*/
-    QFileSystemWatcher mFileSystemWatcher;
-
     /**Maximum number of layers in the cache*/
     int mDefaultMaxLayers;
 
     /**Maximum number of layers in the cache, overrides DEFAULT_MAX_N_LAYERS if larger*/
     int mProjectMaxLayers;
-
-  private slots:
-
-    /**Removes entries from a project (e.g. if a project file has changed)*/
-    void removeProjectFileLayers( const QString& project );
 };
 
 #endif
@@ -19,6 +19,7 @@
 #ifndef QGSWMSREQUESTHANDLER
 #define QGSWMSREQUESTHANDLER
 
+#include <QByteArray>
 #include <QMap>
 #include <QString>
 class QDomDocument;
@@ -36,7 +37,14 @@ class QgsRequestHandler
     virtual QMap<QString, QString> parseInput() = 0;
     /**Sends the map image back to the client*/
     virtual void sendGetMapResponse( const QString& service, QImage* img, int imageQuality ) const = 0;
+    /**Encodes the map image like sendGetMapResponse (e.g. for caching).
+      @return the encoded image or an empty array if the format is not supported by the handler*/
+    virtual QByteArray encodeGetMapImage( QImage* img, int imageQuality ) const { Q_UNUSED( img ); Q_UNUSED( imageQuality ); return QByteArray(); }
+    /**Sends a map image encoded with encodeGetMapImage back to the client*/
+    virtual void sendEncodedGetMapResponse( QByteArray* ba ) const { Q_UNUSED( ba ); }
     virtual void sendGetCapabilitiesResponse( const QDomDocument& doc ) const = 0;
+    /**Sends a capabilities document already serialised with QDomDocument::toByteArray (e.g. by the capabilities cache)*/
+    virtual void sendSerializedGetCapabilitiesResponse( const QByteArray& ba ) const = 0;
     virtual void sendGetFeatureInfoResponse( const QDomDocument& infoDoc, const QString& infoFormat ) const = 0;
     virtual void sendServiceException( const QgsMapServiceException& ex ) const = 0;
     virtual void sendGetStyleResponse( const QDomDocument& doc ) const = 0;
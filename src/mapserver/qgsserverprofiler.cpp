@@ -0,0 +1,259 @@
+/***************************************************************************
+                              qgsserverprofiler.cpp
+                              ---------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsserverprofiler.h"
+#include "qgsmaprenderer.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QStringList>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <stdlib.h>
+
+//number of samples per request type and stage / layer used for the percentiles
+static const int MAX_SAMPLES = 1000;
+
+static QString jsonString( const QString& str )
+{
+  QString escaped = str;
+  escaped.replace( "\\", "\\\\" ).replace( "\"", "\\\"" ).replace( "\n", "\\n" ).replace( "\r", "\\r" ).replace( "\t", "\\t" );
+  return "\"" + escaped + "\"";
+}
+
+static QString jsonTimes( const QList< QPair<QString, int> >& times )
+{
+  QStringList members;
+  QList< QPair<QString, int> >::const_iterator timeIt = times.constBegin();
+  for ( ; timeIt != times.constEnd(); ++timeIt )
+  {
+    members << jsonString( timeIt->first ) + ":" + QString::number( timeIt->second );
+  }
+  return "{" + members.join( "," ) + "}";
+}
+
+QgsServerProfiler* QgsServerProfiler::instance()
+{
+  static QgsServerProfiler mInstance;
+  return &mInstance;
+}
+
+QgsServerProfiler::QgsServerProfiler()
+    : mMetricsInterval( 100 )
+    , mRequestsSinceMetrics( 0 )
+    , mRequestRunning( false )
+{
+  char* logFileEnv = getenv( "QGIS_SERVER_PROFILE_FILE" );
+  if ( logFileEnv )
+  {
+    mLogFile.setFileName( logFileEnv );
+    mLogFile.open( QIODevice::WriteOnly | QIODevice::Append );
+  }
+
+  char* metricsFileEnv = getenv( "QGIS_SERVER_PROFILE_METRICS_FILE" );
+  if ( metricsFileEnv )
+  {
+    //every server process aggregates its own requests, a shared file would only hold the metrics of the last writer
+    mMetricsFilePath = QString( metricsFileEnv ) + "." + QString::number( QCoreApplication::applicationPid() );
+  }
+
+  bool conversionOk = false;
+  int interval = QString( getenv( "QGIS_SERVER_PROFILE_METRICS_INTERVAL" ) ).toInt( &conversionOk );
+  if ( conversionOk && interval > 0 )
+  {
+    mMetricsInterval = interval;
+  }
+}
+
+QgsServerProfiler::~QgsServerProfiler()
+{
+  if ( mRequestsSinceMetrics > 0 )
+  {
+    writeMetrics();
+  }
+}
+
+void QgsServerProfiler::startRequest()
+{
+  if ( !isEnabled() )
+  {
+    return;
+  }
+
+  mRequestRunning = true;
+  mRequestTime.start();
+  mService.clear();
+  mRequest.clear();
+  mStageTimes.clear();
+  mLayerTimes.clear();
+}
+
+void QgsServerProfiler::setRequestType( const QString& service, const QString& request )
+{
+  mService = service.toUpper();
+  mRequest = request;
+}
+
+void QgsServerProfiler::endRequest()
+{
+  if ( !mRequestRunning )
+  {
+    return;
+  }
+  mRequestRunning = false;
+
+  int totalTime = mRequestTime.elapsed();
+  if ( mLogFile.isOpen() )
+  {
+    QString record = QString( "{\"time\":%1,\"service\":%2,\"request\":%3,\"total\":%4,\"stages\":%5,\"layers\":%6}\n" )
+                     .arg( jsonString( QDateTime::currentDateTime().toString( Qt::ISODate ) ) )
+                     .arg( jsonString( mService ) )
+                     .arg( jsonString( mRequest ) )
+                     .arg( totalTime )
+                     .arg( jsonTimes( mStageTimes ) )
+                     .arg( jsonTimes( mLayerTimes ) );
+    mLogFile.write( record.toUtf8() );
+    mLogFile.flush();
+  }
+
+  if ( mMetricsFilePath.isEmpty() )
+  {
+    return;
+  }
+
+  QString requestKey = mService + "/" + mRequest;
+  addSample( requestKey + "/total", totalTime );
+  QList< QPair<QString, int> >::const_iterator timeIt = mStageTimes.constBegin();
+  for ( ; timeIt != mStageTimes.constEnd(); ++timeIt )
+  {
+    addSample( requestKey + "/stage/" + timeIt->first, timeIt->second );
+  }
+  for ( timeIt = mLayerTimes.constBegin(); timeIt != mLayerTimes.constEnd(); ++timeIt )
+  {
+    addSample( requestKey + "/layer/" + timeIt->first, timeIt->second );
+  }
+
+  if ( ++mRequestsSinceMetrics >= mMetricsInterval )
+  {
+    writeMetrics();
+    mRequestsSinceMetrics = 0;
+  }
+}
+
+void QgsServerProfiler::addStageTime( const QString& stage, int ms )
+{
+  if ( mRequestRunning )
+  {
+    mStageTimes.append( qMakePair( stage, ms ) );
+  }
+}
+
+void QgsServerProfiler::addRenderingTimes( const QgsMapRenderer* renderer )
+{
+  if ( !mRequestRunning || !renderer )
+  {
+    return;
+  }
+
+  const QMap<QString, int>& layerTimes = renderer->layerRenderingTimes();
+  QMap<QString, int>::const_iterator layerIt = layerTimes.constBegin();
+  for ( ; layerIt != layerTimes.constEnd(); ++layerIt )
+  {
+    mLayerTimes.append( qMakePair( layerIt.key(), layerIt.value() ) );
+  }
+
+  //labeling is part of the rendering, report it only as its own stage
+  int labelingTime = renderer->labelingTime();
+  for ( int i = mStageTimes.size() - 1; i >= 0; --i )
+  {
+    if ( mStageTimes.at( i ).first == "render" )
+    {
+      mStageTimes[i].second = qMax( 0, mStageTimes.at( i ).second - labelingTime );
+      break;
+    }
+  }
+  mStageTimes.append( qMakePair( QString( "labeling" ), labelingTime ) );
+}
+
+void QgsServerProfiler::addSample( const QString& key, int ms )
+{
+  QList<int>& samples = mSamples[key];
+  if ( samples.size() >= MAX_SAMPLES )
+  {
+    samples.removeFirst();
+  }
+  samples.append( ms );
+  ++mSampleCounts[key];
+}
+
+void QgsServerProfiler::writeMetrics() const
+{
+  QStringList entries;
+  QHash< QString, QList<int> >::const_iterator sampleIt = mSamples.constBegin();
+  for ( ; sampleIt != mSamples.constEnd(); ++sampleIt )
+  {
+    QList<int> sorted = sampleIt.value();
+    if ( sorted.isEmpty() )
+    {
+      continue;
+    }
+    std::sort( sorted.begin(), sorted.end() );
+
+    double sum = 0;
+    foreach ( int ms, sorted )
+    {
+      sum += ms;
+    }
+
+    int n = sorted.size();
+    entries << QString( "%1:{\"count\":%2,\"mean\":%3,\"p50\":%4,\"p90\":%5,\"p99\":%6}" )
+    .arg( jsonString( sampleIt.key() ) )
+    .arg( mSampleCounts.value( sampleIt.key() ) )
+    .arg( sum / n, 0, 'f', 1 )
+    .arg( sorted.at(( n - 1 ) * 50 / 100 ) )
+    .arg( sorted.at(( n - 1 ) * 90 / 100 ) )
+    .arg( sorted.at(( n - 1 ) * 99 / 100 ) );
+  }
+  entries.sort();
+
+  //replace the file atomically, it may be read at any time
+  QTemporaryFile file( mMetricsFilePath + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( !file.open() )
+  {
+    return;
+  }
+  file.write( ( "{\n" + entries.join( ",\n" ) + "\n}\n" ).toUtf8() );
+  file.close();
+  QFile::remove( mMetricsFilePath );
+  if ( !file.rename( mMetricsFilePath ) )
+  {
+    file.remove();
+  }
+}
+
+QgsServerProfilerStage::QgsServerProfilerStage( const QString& stage )
+    : mStage( stage )
+{
+  mTime.start();
+}
+
+QgsServerProfilerStage::~QgsServerProfilerStage()
+{
+  QgsServerProfiler::instance()->addStageTime( mStage, mTime.elapsed() );
+}
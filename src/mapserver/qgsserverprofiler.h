@@ -0,0 +1,100 @@
+/***************************************************************************
+                              qgsserverprofiler.h
+                              -------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSERVERPROFILER_H
+#define QGSSERVERPROFILER_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QTime>
+
+class QgsMapRenderer;
+
+/**A singleton collecting the timings of the server requests.
+
+  Profiling is enabled by the environment variable QGIS_SERVER_PROFILE_FILE. For every request, a JSON object
+  with the service, the request type, the total time and the times of the stages (e.g. configuration, layers,
+  render, labeling, encode) and of the rendered layers is appended to this file (one object per line). The render
+  stage does not include the labeling time.
+
+  If QGIS_SERVER_PROFILE_METRICS_FILE is set, the timings are also aggregated per request type and stage / layer.
+  Every server process writes its own file, the path with the process id appended (e.g. metrics.json.1234).
+  The file is rewritten every QGIS_SERVER_PROFILE_METRICS_INTERVAL requests (default 100) with the number of samples,
+  the mean and the 50/90/99 percentiles of the last 1000 samples in milliseconds*/
+class QgsServerProfiler
+{
+  public:
+    static QgsServerProfiler* instance();
+    ~QgsServerProfiler();
+
+    bool isEnabled() const { return mLogFile.isOpen() || !mMetricsFilePath.isEmpty(); }
+
+    /**Starts the profile of a new request*/
+    void startRequest();
+    /**Sets service and request type of the current request (e.g. WMS, GetMap)*/
+    void setRequestType( const QString& service, const QString& request );
+    /**Writes the profile of the current request*/
+    void endRequest();
+
+    /**Adds the time of a stage of the current request*/
+    void addStageTime( const QString& stage, int ms );
+    /**Adds the layer drawing and labeling times of the last rendering of a map renderer. The labeling time
+      is subtracted from the render stage added before*/
+    void addRenderingTimes( const QgsMapRenderer* renderer );
+
+  private:
+    QgsServerProfiler();
+
+    /**Adds a sample to the aggregated metrics*/
+    void addSample( const QString& key, int ms );
+    void writeMetrics() const;
+
+    /**Profile output (JSON lines), not open if disabled*/
+    QFile mLogFile;
+    QString mMetricsFilePath;
+    int mMetricsInterval;
+    int mRequestsSinceMetrics;
+
+    bool mRequestRunning;
+    QTime mRequestTime;
+    QString mService;
+    QString mRequest;
+    QList< QPair<QString, int> > mStageTimes;
+    QList< QPair<QString, int> > mLayerTimes;
+
+    /**Last samples by request type and stage / layer*/
+    QHash< QString, QList<int> > mSamples;
+    /**Number of samples by request type and stage / layer*/
+    QHash< QString, qint64 > mSampleCounts;
+};
+
+/**Adds the time between construction and destruction to a stage of the current request*/
+class QgsServerProfilerStage
+{
+  public:
+    QgsServerProfilerStage( const QString& stage );
+    ~QgsServerProfilerStage();
+
+  private:
+    QString mStage;
+    QTime mTime;
+};
+
+#endif // QGSSERVERPROFILER_H
@@ -25,9 +25,11 @@
 #include "qgsmslayercache.h"
 #include "qgsrasterlayer.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <QFileInfo>
 #include <QStringList>
+#include <QTextStream>
 #include <QUrl>
 
 QgsServerProjectParser::QgsServerProjectParser( QDomDocument* xmlDoc, const QString& filePath )
@@ -46,6 +48,12 @@ QgsServerProjectParser::QgsServerProjectParser( QDomDocument* xmlDoc, const QStr
       mProjectLayerElements.push_back( currentElement );
       mProjectLayerElementsByName.insert( layerName( currentElement ), currentElement );
       mProjectLayerElementsById.insert( layerId( currentElement ), currentElement );
+
+      //checksum of the layer definition (before the data sources are made absolute) to find changed layers on reload
+      QString layerXml;
+      QTextStream layerXmlStream( &layerXml );
+      currentElement.save( layerXmlStream, 0 );
+      mProjectLayerChecksums.insert( layerId( currentElement ), QCryptographicHash::hash( layerXml.toUtf8(), QCryptographicHash::Sha1 ) );
     }
 
     QDomElement legendElement = mXMLDoc->documentElement().firstChildElement( "legend" );
@@ -87,6 +87,8 @@ class QgsServerProjectParser
 
     const QHash< QString, QDomElement >& projectLayerElementsByName() const { return mProjectLayerElementsByName; }
     const QHash< QString, QDomElement >& projectLayerElementsById() const { return mProjectLayerElementsById; }
+    /**Returns checksums of the <maplayer> elements by layer id, to find the layers changed between two versions of the project*/
+    const QHash< QString, QByteArray >& projectLayerChecksums() const { return mProjectLayerChecksums; }
 
     void layerFromLegendLayer( const QDomElement& legendLayerElem, QMap< int, QgsMapLayer*>& layers, bool useCache = true ) const;
 
@@ -139,6 +141,9 @@ class QgsServerProjectParser
     /**Project layer elements, accessible by layer name*/
     QHash< QString, QDomElement > mProjectLayerElementsByName;
 
+    /**Checksums of the project layer elements, accessible by layer id*/
+    QHash< QString, QByteArray > mProjectLayerChecksums;
+
     /**List of all legend group elements*/
     QList<QDomElement> mLegendGroupElements;
 
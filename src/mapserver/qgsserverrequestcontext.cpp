@@ -0,0 +1,66 @@
+/***************************************************************************
+                              qgsserverrequestcontext.cpp
+                              ---------------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsserverrequestcontext.h"
+#include "qgslogger.h"
+
+#include <stdlib.h>
+#include <fcgi_stdio.h>
+
+static int contentLength( const char* lengthString )
+{
+  if ( !lengthString )
+  {
+    return 0;
+  }
+  bool conversionSuccess = false;
+  int length = QString( lengthString ).toInt( &conversionSuccess );
+  if ( !conversionSuccess )
+  {
+    QgsDebugMsg( "could not convert CONTENT_LENGTH to int" );
+    return 0;
+  }
+  return qMax( length, 0 );
+}
+
+const char* QgsServerRequestContext::getEnv( const char* name )
+{
+  return getenv( name );
+}
+
+QByteArray QgsServerRequestContext::body()
+{
+  int length = contentLength( getenv( "CONTENT_LENGTH" ) );
+  QgsDebugMsg( QString( "length is: %1" ).arg( length ) );
+  QByteArray input( length, 0 );
+  for ( int i = 0; i < length; ++i )
+  {
+    int c = getchar();
+    if ( c == EOF )
+    {
+      input.resize( i );
+      break;
+    }
+    input[i] = ( char ) c;
+  }
+  return input;
+}
+
+void QgsServerRequestContext::write( const QByteArray& data )
+{
+  fwrite( data.constData(), data.size(), 1, FCGI_stdout );
+}
@@ -0,0 +1,37 @@
+/***************************************************************************
+                              qgsserverrequestcontext.h
+                              -------------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSERVERREQUESTCONTEXT_H
+#define QGSSERVERREQUESTCONTEXT_H
+
+#include <QByteArray>
+
+/**CGI variables, body and response of the current FastCGI request (FCGI_Accept loop).
+  The request handlers and services access the request through these methods only*/
+class QgsServerRequestContext
+{
+  public:
+    /**Returns a CGI variable of the current request*/
+    static const char* getEnv( const char* name );
+    /**Returns the body (CONTENT_LENGTH bytes) of the current request*/
+    static QByteArray body();
+    /**Writes data to the response of the current request. The output is written as it is produced,
+      so large responses (e.g. WFS GetFeature) are not held in memory*/
+    static void write( const QByteArray& data );
+};
+
+#endif // QGSSERVERREQUESTCONTEXT_H
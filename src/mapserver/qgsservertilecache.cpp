@@ -0,0 +1,298 @@
+/***************************************************************************
+                              qgsservertilecache.cpp
+                              ----------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsservertilecache.h"
+#include "qgslogger.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMultiMap>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+#include <QtConcurrentRun>
+
+#include <stdlib.h>
+#include <time.h>
+#if defined(_MSC_VER)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+//half of the extent of the GoogleMapsCompatible tile matrix set
+static const double WEB_MERCATOR_HALF_EXTENT = 20037508.342789244;
+
+QgsServerTileCache* QgsServerTileCache::instance()
+{
+  static QgsServerTileCache mInstance;
+  return &mInstance;
+}
+
+QgsServerTileCache::QgsServerTileCache()
+    : mMaxSize( 512 * 1024 * 1024 )
+    , mMaxAge( 0 )
+    , mCurrentSize( -1 )
+    , mTrimming( false )
+    , mSizeChange( 0 )
+    , mMetaTileSize( 4 )
+{
+  char* directoryEnv = getenv( "QGIS_SERVER_TILE_CACHE_DIR" );
+  if ( directoryEnv && QDir().mkpath( QString( directoryEnv ) ) )
+  {
+    mDirectory = QDir( QString( directoryEnv ) ).absolutePath();
+  }
+
+  bool conversionOk = false;
+  qint64 maxSize = QString( getenv( "QGIS_SERVER_TILE_CACHE_SIZE" ) ).toLongLong( &conversionOk );
+  if ( conversionOk && maxSize > 0 )
+  {
+    mMaxSize = maxSize * 1024 * 1024;
+  }
+
+  int maxAge = QString( getenv( "QGIS_SERVER_TILE_CACHE_MAX_AGE" ) ).toInt( &conversionOk );
+  if ( conversionOk && maxAge > 0 )
+  {
+    mMaxAge = maxAge;
+  }
+
+  int metaTileSize = QString( getenv( "QGIS_SERVER_METATILE" ) ).toInt( &conversionOk );
+  if ( conversionOk && metaTileSize > 0 )
+  {
+    mMetaTileSize = metaTileSize;
+  }
+}
+
+QgsServerTileCache::~QgsServerTileCache()
+{
+  mTrimFuture.waitForFinished();
+}
+
+QString QgsServerTileCache::tilePath( const QString& key ) const
+{
+  //spread the tiles in subdirectories to keep directories small
+  return mDirectory + "/" + key.left( 2 ) + "/" + key;
+}
+
+bool QgsServerTileCache::isExpired( const QFileInfo& info ) const
+{
+  return mMaxAge > 0 && info.lastModified().secsTo( QDateTime::currentDateTime() ) > mMaxAge;
+}
+
+QByteArray QgsServerTileCache::tile( const QString& key )
+{
+  if ( !isEnabled() )
+  {
+    return QByteArray();
+  }
+
+  QString path = tilePath( key );
+  QFileInfo info( path );
+  if ( !info.exists() )
+  {
+    return QByteArray();
+  }
+  if ( isExpired( info ) )
+  {
+    //the tile is rendered and written again, the size is corrected by insertTile
+    return QByteArray();
+  }
+
+  QFile file( path );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    return QByteArray();
+  }
+  QByteArray data = file.readAll();
+  file.close();
+
+  //record the use in the access time, which the file system may not update (noatime, relatime).
+  //The modification time is kept, it is the age of the tile
+  struct utimbuf times;
+  times.actime = time( 0 );
+  times.modtime = info.lastModified().toTime_t();
+  utime( QFile::encodeName( path ).constData(), &times );
+
+  return data;
+}
+
+void QgsServerTileCache::insertTile( const QString& key, const QByteArray& data )
+{
+  if ( !isEnabled() || data.isEmpty() )
+  {
+    return;
+  }
+
+  QString path = tilePath( key );
+  QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+  //write to a temporary file first, other server processes may read the cache at the same time
+  QTemporaryFile file( path + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( !file.open() || file.write( data ) != data.size() )
+  {
+    QgsDebugMsg( "Could not write tile " + path );
+    file.remove();
+    return;
+  }
+  file.close();
+
+  QFileInfo oldInfo( path );
+  qint64 oldSize = oldInfo.exists() ? oldInfo.size() : 0;
+  QFile::remove( path );
+  if ( !file.rename( path ) )
+  {
+    file.remove();
+    return;
+  }
+
+  QMutexLocker locker( &mMutex );
+  if ( mCurrentSize >= 0 )
+  {
+    mCurrentSize += data.size() - oldSize;
+  }
+  if ( mTrimming )
+  {
+    mSizeChange += data.size() - oldSize;
+  }
+  bool expiryDue = mMaxAge > 0 && ( mLastTrim.isNull() || mLastTrim.secsTo( QDateTime::currentDateTime() ) > mMaxAge );
+  if ( mCurrentSize < 0 || mCurrentSize > mMaxSize || expiryDue )
+  {
+    startTrim();
+  }
+}
+
+void QgsServerTileCache::startTrim()
+{
+  if ( mTrimming )
+  {
+    return;
+  }
+
+  mTrimming = true;
+  mSizeChange = 0;
+  mLastTrim = QDateTime::currentDateTime();
+  mTrimFuture = QtConcurrent::run( this, &QgsServerTileCache::trim );
+}
+
+void QgsServerTileCache::trim()
+{
+  //the directory is scanned without the mutex, tiles are written by the request handler meanwhile
+  QMultiMap<QDateTime, QPair<QString, qint64> > tiles;
+  qint64 size = 0;
+
+  QDirIterator it( mDirectory, QDir::Files, QDirIterator::Subdirectories );
+  while ( it.hasNext() )
+  {
+    it.next();
+    QFileInfo info = it.fileInfo();
+    if ( isExpired( info ) && QFile::remove( info.absoluteFilePath() ) )
+    {
+      continue;
+    }
+
+    //tiles which have not been read since they were written count from their modification time
+    QDateTime lastUsed = info.lastRead();
+    if ( lastUsed.isNull() || lastUsed < info.lastModified() )
+    {
+      lastUsed = info.lastModified();
+    }
+    tiles.insert( lastUsed, qMakePair( info.absoluteFilePath(), info.size() ) );
+    size += info.size();
+  }
+
+  if ( size > mMaxSize )
+  {
+    QgsDebugMsg( QString( "Tile cache size %1 exceeds %2, removing the least recently used tiles" ).arg( size ).arg( mMaxSize ) );
+    qint64 targetSize = mMaxSize / 10 * 9;
+    QMultiMap<QDateTime, QPair<QString, qint64> >::const_iterator tileIt = tiles.constBegin();
+    for ( ; tileIt != tiles.constEnd() && size > targetSize; ++tileIt )
+    {
+      if ( QFile::remove( tileIt.value().first ) )
+      {
+        size -= tileIt.value().second;
+      }
+    }
+  }
+
+  //tiles written during the scan may be counted twice, the next trim corrects the size
+  QMutexLocker locker( &mMutex );
+  mCurrentSize = size + mSizeChange;
+  mTrimming = false;
+}
+
+bool QgsServerTileCache::getTileToGetMap( QMap<QString, QString>& parameters, QString& errorMessage )
+{
+  QString tileMatrixSet = parameters.value( "TILEMATRIXSET" );
+  if ( tileMatrixSet.compare( "GoogleMapsCompatible", Qt::CaseInsensitive ) != 0 && tileMatrixSet.compare( "EPSG:3857", Qt::CaseInsensitive ) != 0 )
+  {
+    errorMessage = "TileMatrixSet '" + tileMatrixSet + "' is not supported";
+    return false;
+  }
+
+  bool matrixOk, rowOk, colOk;
+  int zoom = parameters.value( "TILEMATRIX" ).section( ":", -1 ).toInt( &matrixOk );
+  int row = parameters.value( "TILEROW" ).toInt( &rowOk );
+  int col = parameters.value( "TILECOL" ).toInt( &colOk );
+  if ( !matrixOk || zoom < 0 || zoom > 30 )
+  {
+    errorMessage = "Invalid TILEMATRIX parameter";
+    return false;
+  }
+  int tiles = 1 << zoom;
+  if ( !rowOk || !colOk || row < 0 || row >= tiles || col < 0 || col >= tiles )
+  {
+    errorMessage = "TILEROW or TILECOL out of range";
+    return false;
+  }
+
+  double tileSize = 2 * WEB_MERCATOR_HALF_EXTENT / tiles;
+  double xMin = -WEB_MERCATOR_HALF_EXTENT + col * tileSize;
+  double yMax = WEB_MERCATOR_HALF_EXTENT - row * tileSize;
+
+  QString style = parameters.value( "STYLE" );
+  if ( style.compare( "default", Qt::CaseInsensitive ) == 0 )
+  {
+    style.clear();
+  }
+
+  QString format = parameters.value( "FORMAT", "image/png" );
+  parameters.insert( "SERVICE", "WMS" );
+  parameters.insert( "REQUEST", "GetMap" );
+  parameters.insert( "VERSION", "1.3.0" );
+  parameters.insert( "LAYERS", parameters.value( "LAYER" ) );
+  parameters.insert( "STYLES", style );
+  parameters.insert( "CRS", "EPSG:3857" );
+  parameters.insert( "BBOX", QString( "%1,%2,%3,%4" ).arg( xMin, 0, 'f', 8 ).arg( yMax - tileSize, 0, 'f', 8 ).arg( xMin + tileSize, 0, 'f', 8 ).arg( yMax, 0, 'f', 8 ) );
+  parameters.insert( "WIDTH", "256" );
+  parameters.insert( "HEIGHT", "256" );
+  parameters.insert( "FORMAT", format );
+  if ( format.contains( "png", Qt::CaseInsensitive ) && !parameters.contains( "TRANSPARENT" ) )
+  {
+    parameters.insert( "TRANSPARENT", "TRUE" );
+  }
+
+  parameters.remove( "LAYER" );
+  parameters.remove( "STYLE" );
+  parameters.remove( "TILEMATRIXSET" );
+  parameters.remove( "TILEMATRIX" );
+  parameters.remove( "TILEROW" );
+  parameters.remove( "TILECOL" );
+  return true;
+}
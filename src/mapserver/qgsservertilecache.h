@@ -0,0 +1,90 @@
+/***************************************************************************
+                              qgsservertilecache.h
+                              --------------------
+  begin                : October 2014
+  copyright            : (C) 2014 by The QGIS Project
+  email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSERVERTILECACHE_H
+#define QGSSERVERTILECACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFuture>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+class QFileInfo;
+
+/**A singleton disk cache for the encoded GetMap tiles of the server.
+
+  The cache is enabled by the environment variable QGIS_SERVER_TILE_CACHE_DIR (the cache directory).
+  QGIS_SERVER_TILE_CACHE_SIZE sets the maximum size in MB (default 512) and QGIS_SERVER_METATILE the number of
+  tiles per side rendered at once (default 4). QGIS_SERVER_TILE_CACHE_MAX_AGE sets the number of seconds after which
+  a tile is rendered again (default: no limit), e.g. for layers whose data changes. Tiles of a previous version of the
+  project are not used, the project file time and size are part of the key, and they are removed with the least recently
+  used tiles. If the cache grows over its maximum size, the least recently used tiles are removed in a background thread.
+  The time of last use is the access time of the tile file, so that it is shared by all server processes*/
+class QgsServerTileCache
+{
+  public:
+    static QgsServerTileCache* instance();
+
+    ~QgsServerTileCache();
+
+    bool isEnabled() const { return !mDirectory.isEmpty(); }
+    /**Number of tiles per side of a metatile*/
+    int metaTileSize() const { return mMetaTileSize; }
+
+    /**Returns the tile stored with the key or an empty array if it is not in the cache or expired*/
+    QByteArray tile( const QString& key );
+    /**Stores a tile*/
+    void insertTile( const QString& key, const QByteArray& data );
+
+    /**Converts the parameters of a WMTS GetTile request to a WMS GetMap request. The tile matrix set
+      GoogleMapsCompatible (EPSG:3857, 256 pixel tiles, TILEMATRIX is the zoom level) is supported
+      @return false and an error message in case of invalid parameters*/
+    static bool getTileToGetMap( QMap<QString, QString>& parameters, QString& errorMessage );
+
+  private:
+    QgsServerTileCache();
+
+    /**Path of the file storing the tile*/
+    QString tilePath( const QString& key ) const;
+    /**True if the tile file was written more than the maximum age ago*/
+    bool isExpired( const QFileInfo& info ) const;
+    /**Starts trim() in a background thread unless it is already running, called with the mutex locked*/
+    void startTrim();
+    /**Determines the cache size, removes the expired tiles and the least recently used tiles until the cache
+      is below 90% of its maximum size*/
+    void trim();
+
+    QMutex mMutex;
+    QString mDirectory;
+    qint64 mMaxSize;
+    /**Maximum age of the tiles in seconds, 0 for no limit*/
+    int mMaxAge;
+    /**Size of the cached tiles, -1 until the cache directory has been scanned*/
+    qint64 mCurrentSize;
+    /**True while trim() is running*/
+    bool mTrimming;
+    /**Size of the tiles written while trim() is running*/
+    qint64 mSizeChange;
+    /**Start of the last trim, expired tiles are removed at least once per maximum age*/
+    QDateTime mLastTrim;
+    QFuture<void> mTrimFuture;
+    int mMetaTileSize;
+};
+
+#endif // QGSSERVERTILECACHE_H
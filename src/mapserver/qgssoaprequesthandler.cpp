@@ -18,6 +18,7 @@
 #include "qgssoaprequesthandler.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverrequestcontext.h"
 #include <QBuffer>
 #include <QDir>
 #include <QDomDocument>
@@ -25,7 +26,6 @@
 #include <QImage>
 #include <QTextStream>
 #include <time.h>
-#include <fcgi_stdio.h>
 
 QgsSOAPRequestHandler::QgsSOAPRequestHandler()
 {
@@ -188,6 +188,14 @@ void QgsSOAPRequestHandler::sendGetMapResponse( const QString& service, QImage*
   }
 }
 
+void QgsSOAPRequestHandler::sendSerializedGetCapabilitiesResponse( const QByteArray& ba ) const
+{
+  //the SOAP response is created from the capabilities elements
+  QDomDocument doc;
+  doc.setContent( ba );
+  sendGetCapabilitiesResponse( doc );
+}
+
 void QgsSOAPRequestHandler::sendGetCapabilitiesResponse( const QDomDocument& doc ) const
 {
   //Parse the QDomDocument Document and create a SOAP response
@@ -680,32 +688,32 @@ int QgsSOAPRequestHandler::sendSOAPWithAttachments( QImage* img ) const
   img->save( &buffer, mFormat.toLocal8Bit().data(), -1 ); // writes image into ba
 
   QByteArray xmlByteArray = xmlResponse.toString().toLocal8Bit();
-  printf( "MIME-Version: 1.0\n" );
-  printf( "Content-Type: Multipart/Related; boundary=\"MIME_boundary\"; type=\"text/xml\"; start=\"<xml@mapservice>\"\n" );
-  printf( "\n" );
-  printf( "--MIME_boundary\r\n" );
-  printf( "Content-Type: text/xml\n" );
-  printf( "Content-ID: <xml@mapservice>\n" );
-  printf( "\n" );
-  printf( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
-  fwrite( xmlByteArray.data(), xmlByteArray.size(), 1, FCGI_stdout );
-  printf( "\n" );
-  printf( "\r\n" );
-  printf( "--MIME_boundary\r\n" );
+  QgsServerRequestContext::write( "MIME-Version: 1.0\n" );
+  QgsServerRequestContext::write( "Content-Type: Multipart/Related; boundary=\"MIME_boundary\"; type=\"text/xml\"; start=\"<xml@mapservice>\"\n" );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( "--MIME_boundary\r\n" );
+  QgsServerRequestContext::write( "Content-Type: text/xml\n" );
+  QgsServerRequestContext::write( "Content-ID: <xml@mapservice>\n" );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
+  QgsServerRequestContext::write( xmlByteArray );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( "\r\n" );
+  QgsServerRequestContext::write( "--MIME_boundary\r\n" );
   if ( mFormat == "JPG" )
   {
-    printf( "Content-Type: image/jpg\n" );
+    QgsServerRequestContext::write( "Content-Type: image/jpg\n" );
   }
   else if ( mFormat == "PNG" )
   {
-    printf( "Content-Type: image/png\n" );
+    QgsServerRequestContext::write( "Content-Type: image/png\n" );
   }
-  printf( "Content-Transfer-Encoding: binary\n" );
-  printf( "Content-ID: <image@mapservice>\n" );
-  printf( "\n" );
-  fwrite( ba.data(), ba.size(), 1, FCGI_stdout );
-  printf( "\r\n" );
-  printf( "--MIME_boundary\r\n" );
+  QgsServerRequestContext::write( "Content-Transfer-Encoding: binary\n" );
+  QgsServerRequestContext::write( "Content-ID: <image@mapservice>\n" );
+  QgsServerRequestContext::write( "\n" );
+  QgsServerRequestContext::write( ba );
+  QgsServerRequestContext::write( "\r\n" );
+  QgsServerRequestContext::write( "--MIME_boundary\r\n" );
 
   return 0;
 }
@@ -31,6 +31,7 @@ class QgsSOAPRequestHandler: public QgsHttpRequestHandler
     QMap<QString, QString> parseInput();
     void sendGetMapResponse( const QString& service, QImage* img ) const;
     void sendGetCapabilitiesResponse( const QDomDocument& doc ) const;
+    void sendSerializedGetCapabilitiesResponse( const QByteArray& ba ) const;
     void sendGetFeatureInfoResponse( const QDomDocument& infoDoc, const QString& infoFormat ) const;
     void sendServiceException( const QgsMapServiceException& ex ) const;
     void sendGetStyleResponse( const QDomDocument& doc ) const;
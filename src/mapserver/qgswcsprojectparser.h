@@ -23,7 +23,8 @@
 class QgsWCSProjectParser
 {
   public:
-    QgsWCSProjectParser( QDomDocument* xmlDoc, const QString& filePath );
+    /**Does not take ownership of the project parser, which may be shared with the WMS and WFS parsers*/
+    QgsWCSProjectParser( QgsServerProjectParser* projectParser );
     ~QgsWCSProjectParser();
 
     void serviceCapabilities( QDomElement& parentElement, QDomDocument& doc ) const;
@@ -35,7 +36,7 @@ class QgsWCSProjectParser
     QList<QgsMapLayer*> mapLayerFromCoverage( const QString& cName, bool useCache = true ) const;
 
   private:
-    QgsServerProjectParser mProjectParser;
+    QgsServerProjectParser* mProjectParser;
 };
 
 #endif // QGSWCSPROJECTPARSER_H
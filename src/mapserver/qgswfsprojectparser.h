@@ -23,7 +23,8 @@
 class QgsWFSProjectParser
 {
   public:
-    QgsWFSProjectParser( QDomDocument* xmlDoc, const QString& filePath );
+    /**Does not take ownership of the project parser, which may be shared with the WMS and WCS parsers*/
+    QgsWFSProjectParser( QgsServerProjectParser* projectParser );
     ~QgsWFSProjectParser();
 
     void serviceCapabilities( QDomElement& parentElement, QDomDocument& doc ) const;
@@ -43,7 +44,7 @@ class QgsWFSProjectParser
     QSet<QString> wfstDeleteLayers() const;
 
   private:
-    QgsServerProjectParser mProjectParser;
+    QgsServerProjectParser* mProjectParser;
 };
 
 #endif // QGSWFSPROJECTPARSER_H
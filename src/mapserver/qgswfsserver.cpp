@@ -33,6 +33,8 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverprofiler.h"
+#include "qgsserverrequestcontext.h"
 #include "qgssymbolv2.h"
 #include "qgslegendmodel.h"
 #include "qgscomposerlegenditem.h"
@@ -64,6 +66,213 @@ static const QString GML_NAMESPACE = "http://www.opengis.net/gml";
 static const QString OGC_NAMESPACE = "http://www.opengis.net/ogc";
 static const QString QGS_NAMESPACE = "http://www.qgis.org/gml";
 
+//features of GetFeature responses are sent in chunks of this size
+static const int GETFEATURE_CHUNK_SIZE = 64 * 1024;
+
+/**Appends a number formatted like qgsDoubleToString*/
+static void appendDouble( QByteArray& out, double value, int prec )
+{
+  QByteArray number = QByteArray::number( value, 'f', prec );
+  if ( number.contains( '.' ) )
+  {
+    int end = number.size();
+    while ( number.at( end - 1 ) == '0' )
+    {
+      --end;
+    }
+    if ( number.at( end - 1 ) == '.' )
+    {
+      --end;
+    }
+    number.truncate( end );
+  }
+  out += number;
+}
+
+/**Appends text escaped for XML content and attribute values*/
+static void appendXmlEscaped( QByteArray& out, const QString& text )
+{
+  QByteArray utf8 = text.toUtf8();
+  const char* data = utf8.constData();
+  for ( int i = 0; i < utf8.size(); ++i )
+  {
+    switch ( data[i] )
+    {
+      case '&':
+        out += "&amp;";
+        break;
+      case '<':
+        out += "&lt;";
+        break;
+      case '>':
+        out += "&gt;";
+        break;
+      case '"':
+        out += "&quot;";
+        break;
+      default:
+        out += data[i];
+    }
+  }
+}
+
+/**Appends the coordinate element of nPoints points as written by QgsOgcUtils::geometryToGML*/
+static void appendGMLCoordinates( QByteArray& out, QgsConstWkbPtr& wkbPtr, int nPoints, bool hasZValue, bool gml3, bool point, int prec )
+{
+  if ( gml3 )
+  {
+    out += point ? "<gml:pos srsDimension=\"2\">" : "<gml:posList srsDimension=\"2\">";
+  }
+  else
+  {
+    out += "<gml:coordinates cs=\",\" ts=\" \">";
+  }
+
+  for ( int idx = 0; idx < nPoints; ++idx )
+  {
+    if ( idx != 0 )
+    {
+      out += " ";
+    }
+    double x, y;
+    wkbPtr >> x >> y;
+    appendDouble( out, x, prec );
+    out += gml3 ? " " : ",";
+    appendDouble( out, y, prec );
+    if ( hasZValue )
+    {
+      wkbPtr += sizeof( double );
+    }
+  }
+
+  if ( gml3 )
+  {
+    out += point ? "</gml:pos>" : "</gml:posList>";
+  }
+  else
+  {
+    out += "</gml:coordinates>";
+  }
+}
+
+/**Appends the rings of a polygon*/
+static void appendGMLRings( QByteArray& out, QgsConstWkbPtr& wkbPtr, int numRings, bool hasZValue, bool gml3, int prec )
+{
+  for ( int idx = 0; idx < numRings; idx++ )
+  {
+    out += idx == 0 ? "<gml:outerBoundaryIs><gml:LinearRing>" : "<gml:innerBoundaryIs><gml:LinearRing>";
+    int nPoints;
+    wkbPtr >> nPoints;
+    appendGMLCoordinates( out, wkbPtr, nPoints, hasZValue, gml3, false, prec );
+    out += idx == 0 ? "</gml:LinearRing></gml:outerBoundaryIs>" : "</gml:LinearRing></gml:innerBoundaryIs>";
+  }
+}
+
+/**Appends a geometry as GML like QgsOgcUtils::geometryToGML does, without building a DOM tree
+  @return false if the geometry cannot be written*/
+static bool appendGMLGeometry( QByteArray& out, QgsGeometry* geometry, bool gml3, int prec, const QByteArray& srsAttribute )
+{
+  if ( !geometry || !geometry->asWkb() )
+    return false;
+
+  bool hasZValue = false;
+  QgsConstWkbPtr wkbPtr( geometry->asWkb() + 1 + sizeof( int ) );
+
+  switch ( geometry->wkbType() )
+  {
+    case QGis::WKBPoint25D:
+    case QGis::WKBPoint:
+    {
+      out += "<gml:Point" + srsAttribute + ">";
+      appendGMLCoordinates( out, wkbPtr, 1, false, gml3, true, prec );
+      out += "</gml:Point>";
+      return true;
+    }
+    case QGis::WKBMultiPoint25D:
+      hasZValue = true;
+    case QGis::WKBMultiPoint:
+    {
+      out += "<gml:MultiPoint" + srsAttribute + ">";
+      int nPoints;
+      wkbPtr >> nPoints;
+      for ( int idx = 0; idx < nPoints; ++idx )
+      {
+        wkbPtr += 1 + sizeof( int );
+        out += "<gml:pointMember><gml:Point>";
+        appendGMLCoordinates( out, wkbPtr, 1, hasZValue, gml3, true, prec );
+        out += "</gml:Point></gml:pointMember>";
+      }
+      out += "</gml:MultiPoint>";
+      return true;
+    }
+    case QGis::WKBLineString25D:
+      hasZValue = true;
+    case QGis::WKBLineString:
+    {
+      out += "<gml:LineString" + srsAttribute + ">";
+      int nPoints;
+      wkbPtr >> nPoints;
+      appendGMLCoordinates( out, wkbPtr, nPoints, hasZValue, gml3, false, prec );
+      out += "</gml:LineString>";
+      return true;
+    }
+    case QGis::WKBMultiLineString25D:
+      hasZValue = true;
+    case QGis::WKBMultiLineString:
+    {
+      out += "<gml:MultiLineString" + srsAttribute + ">";
+      int nLines;
+      wkbPtr >> nLines;
+      for ( int jdx = 0; jdx < nLines; jdx++ )
+      {
+        wkbPtr += 1 + sizeof( int );
+        int nPoints;
+        wkbPtr >> nPoints;
+        out += "<gml:lineStringMember><gml:LineString>";
+        appendGMLCoordinates( out, wkbPtr, nPoints, hasZValue, gml3, false, prec );
+        out += "</gml:LineString></gml:lineStringMember>";
+      }
+      out += "</gml:MultiLineString>";
+      return true;
+    }
+    case QGis::WKBPolygon25D:
+      hasZValue = true;
+    case QGis::WKBPolygon:
+    {
+      int numRings;
+      wkbPtr >> numRings;
+      if ( numRings == 0 ) // sanity check for zero rings in polygon
+        return false;
+
+      out += "<gml:Polygon" + srsAttribute + ">";
+      appendGMLRings( out, wkbPtr, numRings, hasZValue, gml3, prec );
+      out += "</gml:Polygon>";
+      return true;
+    }
+    case QGis::WKBMultiPolygon25D:
+      hasZValue = true;
+    case QGis::WKBMultiPolygon:
+    {
+      out += "<gml:MultiPolygon" + srsAttribute + ">";
+      int numPolygons;
+      wkbPtr >> numPolygons;
+      for ( int kdx = 0; kdx < numPolygons; kdx++ )
+      {
+        wkbPtr += 1 + sizeof( int );
+        int numRings;
+        wkbPtr >> numRings;
+        out += "<gml:polygonMember><gml:Polygon>";
+        appendGMLRings( out, wkbPtr, numRings, hasZValue, gml3, prec );
+        out += "</gml:Polygon></gml:polygonMember>";
+      }
+      out += "</gml:MultiPolygon>";
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
 QgsWFSServer::QgsWFSServer( const QString& configFilePath, QMap<QString, QString> parameters, QgsWFSProjectParser* cp,
                             QgsRequestHandler* rh ): QgsOWSServer( configFilePath, parameters, rh ), mConfigParser( cp )
 {
@@ -132,6 +341,7 @@ void QgsWFSServer::executeRequest()
     QString outputFormat = mParameters.value( "OUTPUTFORMAT" );
     try
     {
+      QgsServerProfilerStage stage( "getFeature" );
       getFeature( *mRequestHandler, outputFormat );
     }
     catch ( QgsMapServiceException& ex )
@@ -363,6 +573,277 @@ QDomDocument QgsWFSServer::describeFeatureType()
   return doc;
 }
 
+//spatial operators selecting features which intersect the filter geometry
+static bool isIntersectingSpatialOperator( const QString& fnName )
+{
+  return fnName == "bbox" || fnName == "intersects" || fnName == "within" || fnName == "contains"
+         || fnName == "overlaps" || fnName == "crosses" || fnName == "touches" || fnName == "equals";
+}
+
+static QString functionName( const QgsExpression::Node* node )
+{
+  if ( node->nodeType() != QgsExpression::ntFunction )
+    return QString();
+
+  return QgsExpression::Functions()[static_cast<const QgsExpression::NodeFunction*>( node )->fnIndex()]->name();
+}
+
+//bounding box of a spatial operator node created by QgsOgcUtils, e.g. intersects( $geometry, geomFromGML( '...' ) )
+static bool filterRectFromNode( const QgsExpression::Node* node, QgsRectangle& rect )
+{
+  if ( !isIntersectingSpatialOperator( functionName( node ) ) )
+    return false;
+
+  QgsExpression::NodeList* args = static_cast<const QgsExpression::NodeFunction*>( node )->args();
+  if ( !args || args->count() != 2 || functionName( args->list()[0] ) != "$geometry" )
+    return false;
+
+  const QgsExpression::Node* geomNode = args->list()[1];
+  QString geomFunction = functionName( geomNode );
+  if ( geomFunction != "geomFromGML" && geomFunction != "geomFromWKT" )
+    return false;
+
+  QgsExpression::NodeList* geomArgs = static_cast<const QgsExpression::NodeFunction*>( geomNode )->args();
+  if ( !geomArgs || geomArgs->count() != 1 || geomArgs->list()[0]->nodeType() != QgsExpression::ntLiteral )
+    return false;
+
+  QString geomString = static_cast<const QgsExpression::NodeLiteral*>( geomArgs->list()[0] )->value().toString();
+  QgsGeometry* geom = geomFunction == "geomFromGML" ? QgsOgcUtils::geometryFromGML( geomString ) : QgsGeometry::fromWkt( geomString );
+  if ( !geom )
+    return false;
+
+  rect = geom->boundingBox();
+  delete geom;
+  return true;
+}
+
+//combines the bounding boxes of the spatial operators joined with AND at the top of the expression
+static bool filterRectFromExpression( const QgsExpression::Node* node, QgsRectangle& rect )
+{
+  if ( node->nodeType() == QgsExpression::ntBinaryOperator )
+  {
+    const QgsExpression::NodeBinaryOperator* binNode = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+    if ( binNode->op() != QgsExpression::boAnd )
+      return false;
+
+    QgsRectangle leftRect, rightRect;
+    bool leftOk = filterRectFromExpression( binNode->opLeft(), leftRect );
+    bool rightOk = filterRectFromExpression( binNode->opRight(), rightRect );
+    if ( leftOk && rightOk )
+      rect = leftRect.intersect( &rightRect );
+    else if ( leftOk )
+      rect = leftRect;
+    else if ( rightOk )
+      rect = rightRect;
+    return leftOk || rightOk;
+  }
+  return filterRectFromNode( node, rect );
+}
+
+static bool isIntegerField( const QgsField& field )
+{
+  return field.type() == QVariant::Int || field.type() == QVariant::UInt || field.type() == QVariant::LongLong
+         || field.type() == QVariant::ULongLong;
+}
+
+//SQL literal for a comparison with the field. QgsExpression compares numerically if both values are numbers, so
+//strings are only compared for equality if the literal is not a number. Returns a null string if this is not possible
+static QString sqlLiteral( const QgsField& field, const QVariant& value, bool equality )
+{
+  if ( value.isNull() )
+    return QString();
+
+  bool isNumber;
+  double number = value.toDouble( &isNumber );
+  if ( isIntegerField( field ) )
+  {
+    //integer literals are passed exactly, also beyond the precision of doubles (bigint columns)
+    bool isInteger = false;
+    qlonglong integer = 0;
+    if ( value.type() == QVariant::Int || value.type() == QVariant::LongLong )
+    {
+      integer = value.toLongLong();
+      isInteger = true;
+    }
+    else if ( value.type() == QVariant::String )
+    {
+      integer = value.toString().trimmed().toLongLong( &isInteger );
+    }
+    if ( isInteger )
+      return QString::number( integer );
+
+    //the expression compares with a double literal in double precision, the database exactly
+    return isNumber && qAbs( number ) < 9007199254740992.0 ? qgsDoubleToString( number, 17 ) : QString();
+  }
+  if ( field.type() == QVariant::Double )
+  {
+    return isNumber ? qgsDoubleToString( number, 17 ) : QString();
+  }
+  if ( field.type() != QVariant::String || isNumber || !equality )
+    return QString();
+
+  //backslashes are escape characters in PostgreSQL strings if standard_conforming_strings is off
+  QString str = value.toString();
+  if ( str.contains( '\\' ) )
+    return QString();
+  return "'" + str.replace( "'", "''" ) + "'";
+}
+
+static QString sqlColumn( const QgsExpression::Node* node, const QgsFields& fields, int& fieldIndex )
+{
+  if ( node->nodeType() != QgsExpression::ntColumnRef )
+    return QString();
+
+  QString name = static_cast<const QgsExpression::NodeColumnRef*>( node )->name();
+  fieldIndex = fields.indexFromName( name );
+  if ( fieldIndex < 0 )
+    return QString();
+
+  return "\"" + name.replace( "\"", "\"\"" ) + "\"";
+}
+
+//where clause selecting at least the features matching the expression, null if no part of it can be translated
+static QString sqlFromExpression( const QgsExpression::Node* node, const QgsFields& fields )
+{
+  if ( node->nodeType() == QgsExpression::ntBinaryOperator )
+  {
+    const QgsExpression::NodeBinaryOperator* binNode = static_cast<const QgsExpression::NodeBinaryOperator*>( node );
+    QgsExpression::BinaryOperator op = binNode->op();
+    if ( op == QgsExpression::boAnd || op == QgsExpression::boOr )
+    {
+      QString left = sqlFromExpression( binNode->opLeft(), fields );
+      QString right = sqlFromExpression( binNode->opRight(), fields );
+      if ( !left.isNull() && !right.isNull() )
+        return QString( "(%1 %2 %3)" ).arg( left ).arg( op == QgsExpression::boAnd ? "AND" : "OR" ).arg( right );
+
+      //a part of a conjunction is enough, the expression is evaluated for the returned features
+      return op == QgsExpression::boAnd ? ( left.isNull() ? right : left ) : QString();
+    }
+
+    const QgsExpression::Node* columnNode = binNode->opLeft();
+    const QgsExpression::Node* valueNode = binNode->opRight();
+    if ( columnNode->nodeType() != QgsExpression::ntColumnRef )
+    {
+      qSwap( columnNode, valueNode );
+      //mirror the comparison
+      switch ( op )
+      {
+        case QgsExpression::boLT: op = QgsExpression::boGT; break;
+        case QgsExpression::boGT: op = QgsExpression::boLT; break;
+        case QgsExpression::boLE: op = QgsExpression::boGE; break;
+        case QgsExpression::boGE: op = QgsExpression::boLE; break;
+        default: break;
+      }
+    }
+
+    int fieldIndex;
+    QString column = sqlColumn( columnNode, fields, fieldIndex );
+    if ( column.isNull() || valueNode->nodeType() != QgsExpression::ntLiteral )
+      return QString();
+
+    QVariant value = static_cast<const QgsExpression::NodeLiteral*>( valueNode )->value();
+    if ( op == QgsExpression::boIs || op == QgsExpression::boIsNot )
+    {
+      return value.isNull() ? column + ( op == QgsExpression::boIs ? " IS NULL" : " IS NOT NULL" ) : QString();
+    }
+
+    QString opString;
+    switch ( op )
+    {
+      case QgsExpression::boEQ: opString = "="; break;
+      case QgsExpression::boNE: opString = "<>"; break;
+      case QgsExpression::boLT: opString = "<"; break;
+      case QgsExpression::boGT: opString = ">"; break;
+      case QgsExpression::boLE: opString = "<="; break;
+      case QgsExpression::boGE: opString = ">="; break;
+      default: return QString();
+    }
+
+    QString literal = sqlLiteral( fields[fieldIndex], value, op == QgsExpression::boEQ || op == QgsExpression::boNE );
+    return literal.isNull() ? QString() : QString( "%1 %2 %3" ).arg( column ).arg( opString ).arg( literal );
+  }
+  else if ( node->nodeType() == QgsExpression::ntInOperator )
+  {
+    const QgsExpression::NodeInOperator* inNode = static_cast<const QgsExpression::NodeInOperator*>( node );
+    int fieldIndex;
+    QString column = sqlColumn( inNode->node(), fields, fieldIndex );
+    if ( inNode->isNotIn() || column.isNull() )
+      return QString();
+
+    QStringList literals;
+    foreach ( QgsExpression::Node* valueNode, inNode->list()->list() )
+    {
+      if ( valueNode->nodeType() != QgsExpression::ntLiteral )
+        return QString();
+
+      QString literal = sqlLiteral( fields[fieldIndex], static_cast<const QgsExpression::NodeLiteral*>( valueNode )->value(), true );
+      if ( literal.isNull() )
+        return QString();
+      literals << literal;
+    }
+    return literals.isEmpty() ? QString() : QString( "%1 IN (%2)" ).arg( column ).arg( literals.join( "," ) );
+  }
+  return QString();
+}
+
+/**Restores the subset string of a layer when it goes out of scope. The layers are cached and shared by the
+  requests, so a subset string set by applyFilterToRequest is also restored if an exception is thrown.
+  Declare it before the feature iterator of the layer, so that the iterator is closed first*/
+class QgsSubsetStringRestorer
+{
+  public:
+    QgsSubsetStringRestorer( QgsVectorLayer* layer )
+        : mLayer( layer )
+        , mSubsetString( layer->subsetString() )
+    {}
+
+    ~QgsSubsetStringRestorer()
+    {
+      if ( mLayer->subsetString() != mSubsetString )
+        mLayer->setSubsetString( mSubsetString );
+    }
+
+  private:
+    QgsVectorLayer* mLayer;
+    QString mSubsetString;
+};
+
+bool QgsWFSServer::applyFilterToRequest( QgsVectorLayer* layer, const QgsExpression* filter, QgsFeatureRequest& request ) const
+{
+  const QgsExpression::Node* rootNode = filter->rootNode();
+  if ( !rootNode )
+    return false;
+
+  QgsRectangle filterRect;
+  if ( layer->wkbType() != QGis::WKBNoGeometry && filterRectFromExpression( rootNode, filterRect ) )
+  {
+    if ( request.filterType() == QgsFeatureRequest::FilterRect )
+      filterRect = filterRect.intersect( &request.filterRect() );
+    request.setFilterRect( filterRect );
+  }
+
+  //attribute filters are passed to the database as where clause of the subset string
+  QgsVectorDataProvider* provider = layer->dataProvider();
+  if ( !provider || ( provider->name() != "postgres" && provider->name() != "spatialite" ) )
+    return false;
+
+  QString sql = sqlFromExpression( rootNode, provider->fields() );
+  if ( sql.isEmpty() )
+    return false;
+
+  QString originalSubset = layer->subsetString();
+  if ( !originalSubset.isEmpty() )
+    sql = QString( "(%1) AND %2" ).arg( originalSubset ).arg( sql );
+
+  QgsDebugMsg( "WFS filter passed to the provider: " + sql );
+  if ( !layer->setSubsetString( sql ) )
+  {
+    layer->setSubsetString( originalSubset );
+    return false;
+  }
+  return true;
+}
+
 int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format )
 {
   QgsDebugMsg( "Info format is:" + format );
@@ -380,6 +861,9 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
   long maxFeat = 0;
   long maxFeatures = -1;
   long featureCounter = 0;
+  //number of matching features to skip (STARTINDEX)
+  long startIndex = 0;
+  long skippedFeatures = 0;
   int layerPrec = 8;
 
   QDomDocument doc;
@@ -389,7 +873,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
     QDomElement docElem = doc.documentElement();
 
     if ( docElem.hasAttribute( "maxFeatures" ) )
+    {
       maxFeatures = docElem.attribute( "maxFeatures" ).toLong();
+      maxFeat = maxFeatures;
+    }
+    if ( docElem.hasAttribute( "startIndex" ) )
+      startIndex = docElem.attribute( "startIndex" ).toLong();
 
     QDomNodeList queryNodes = docElem.elementsByTagName( "Query" );
     QDomElement queryElem;
@@ -510,6 +999,7 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
           QDomNodeList fidNodes = filterElem.elementsByTagName( "FeatureId" );
           if ( fidNodes.size() > 0 )
           {
+            QgsFeatureIds fids;
             QDomElement fidElem;
             QString fid = "";
             for ( int f = 0; f < fidNodes.size(); f++ )
@@ -522,20 +1012,27 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
                   continue;
                 fid = fid.section( ".", 1, 1 );
               }
+              fids.insert( fid.toLongLong() );
+            }
 
-              //Need to be test for propertyname
-              layer->getFeatures( QgsFeatureRequest()
-                                  .setFilterFid( fid.toInt() )
-                                  .setFlags( QgsFeatureRequest::ExactIntersect | ( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry ) )
-                                  .setSubsetOfAttributes( attrIndexes )
-                                ).nextFeature( feature );
+            //fetch all the requested features with one provider request
+            //Need to be test for propertyname
+            QgsFeatureIterator fidIt = layer->getFeatures( QgsFeatureRequest()
+                                       .setFilterFids( fids )
+                                       .setFlags( QgsFeatureRequest::ExactIntersect | ( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry ) )
+                                       .setSubsetOfAttributes( attrIndexes ) );
+            while ( fidIt.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
+            {
+              if ( skippedFeatures < startIndex )
+              {
+                ++skippedFeatures;
+                continue;
+              }
 
               if ( featureCounter == 0 )
                 startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
               sendGetFeature( request, format, &feature, featCounter, layerPrec, layerCrs, attrIndexes, layerExcludedAttributes );
-
-              fid = "";
               ++featCounter;
               ++featureCounter;
             }
@@ -567,6 +1064,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
             QgsFeatureIterator fit = layer->getFeatures( req );
             while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
             {
+              if ( skippedFeatures < startIndex )
+              {
+                ++skippedFeatures;
+                continue;
+              }
+
               if ( featureCounter == 0 )
                 startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -584,7 +1087,14 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
               {
                 throw QgsMapServiceException( "RequestNotWellFormed", mFilter->parserErrorString() );
               }
-              while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
+              QgsFeatureRequest req;
+              req.setFlags( QgsFeatureRequest::ExactIntersect | ( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry ) );
+              req.setSubsetOfAttributes( attrIndexes );
+              QgsSubsetStringRestorer subsetRestorer( layer );
+              applyFilterToRequest( layer, mFilter, req );
+
+              QgsFeatureIterator filterIt = layer->getFeatures( req );
+              while ( filterIt.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
               {
                 QVariant res = mFilter->evaluate( &feature, fields );
                 if ( mFilter->hasEvalError() )
@@ -593,6 +1103,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
                 }
                 if ( res.toInt() != 0 )
                 {
+                  if ( skippedFeatures < startIndex )
+                  {
+                    ++skippedFeatures;
+                    continue;
+                  }
+
                   if ( featureCounter == 0 )
                     startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -602,12 +1118,19 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
                 }
               }
             }
+            delete mFilter;
           }
         }
         else
         {
           while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
           {
+            if ( skippedFeatures < startIndex )
+            {
+              ++skippedFeatures;
+              continue;
+            }
+
             if ( featureCounter == 0 )
               startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -739,6 +1262,16 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
     maxFeat = mfString.toLong( &mfOk, 10 );
   }
 
+  //read STARTINDEX
+  QMap<QString, QString>::const_iterator siIt = mParameters.find( "STARTINDEX" );
+  if ( siIt != mParameters.end() )
+  {
+    bool siOk;
+    startIndex = siIt.value().toLong( &siOk, 10 );
+    if ( !siOk || startIndex < 0 )
+      startIndex = 0;
+  }
+
   //read PROPERTYNAME
   mWithGeom = true;
   mPropertyName = "*";
@@ -837,16 +1370,27 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
       long featCounter = 0;
       if ( featureIdOk )
       {
+        QgsFeatureIds fids;
         foreach ( const QString &fidStr, featureIdList )
         {
           if ( !fidStr.startsWith( tnStr ) )
             continue;
-          //Need to be test for propertyname
-          layer->getFeatures( QgsFeatureRequest()
-                              .setFilterFid( fidStr.section( ".", 1, 1 ).toInt() )
-                              .setFlags( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry )
-                              .setSubsetOfAttributes( attrIndexes )
-                            ).nextFeature( feature );
+          fids.insert( fidStr.section( ".", 1, 1 ).toLongLong() );
+        }
+
+        //fetch all the requested features with one provider request
+        //Need to be test for propertyname
+        QgsFeatureIterator fidIt = layer->getFeatures( QgsFeatureRequest()
+                                   .setFilterFids( fids )
+                                   .setFlags( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry )
+                                   .setSubsetOfAttributes( attrIndexes ) );
+        while ( fidIt.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
+        {
+          if ( skippedFeatures < startIndex )
+          {
+            ++skippedFeatures;
+            continue;
+          }
 
           if ( featureCounter == 0 )
             startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
@@ -877,7 +1421,6 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
           mWithGeom = false;
         }
         req.setSubsetOfAttributes( attrIndexes );
-        QgsFeatureIterator fit = layer->getFeatures( req );
         QgsExpression *mFilter = new QgsExpression( expFilter );
         if ( mFilter )
         {
@@ -885,6 +1428,10 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
           {
             throw QgsMapServiceException( "RequestNotWellFormed", QString( "Expression filter error message: %1." ).arg( mFilter->parserErrorString() ) );
           }
+          QgsSubsetStringRestorer subsetRestorer( layer );
+          applyFilterToRequest( layer, mFilter, req );
+
+          QgsFeatureIterator fit = layer->getFeatures( req );
           while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
           {
             QVariant res = mFilter->evaluate( &feature, fields );
@@ -894,6 +1441,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
             }
             if ( res.toInt() != 0 )
             {
+              if ( skippedFeatures < startIndex )
+              {
+                ++skippedFeatures;
+                continue;
+              }
+
               if ( featureCounter == 0 )
                 startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -913,6 +1466,7 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
         {
           QDomElement fidElem;
           QString fid = "";
+          QgsFeatureIds fids;
           for ( int f = 0; f < fidNodes.size(); f++ )
           {
             fidElem = fidNodes.at( f ).toElement();
@@ -923,20 +1477,27 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
                 continue;
               fid = fid.section( ".", 1, 1 );
             }
+            fids.insert( fid.toLongLong() );
+          }
 
-            //Need to be test for propertyname
-            layer->getFeatures( QgsFeatureRequest()
-                                .setFilterFid( fid.toInt() )
-                                .setFlags( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry )
-                                .setSubsetOfAttributes( attrIndexes )
-                              ).nextFeature( feature );
+          //fetch all the requested features with one provider request
+          //Need to be test for propertyname
+          QgsFeatureIterator fidIt = layer->getFeatures( QgsFeatureRequest()
+                                     .setFilterFids( fids )
+                                     .setFlags( mWithGeom ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry )
+                                     .setSubsetOfAttributes( attrIndexes ) );
+          while ( fidIt.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
+          {
+            if ( skippedFeatures < startIndex )
+            {
+              ++skippedFeatures;
+              continue;
+            }
 
             if ( featureCounter == 0 )
               startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
             sendGetFeature( request, format, &feature, featCounter, layerPrec, layerCrs, attrIndexes, layerExcludedAttributes );
-
-            fid = "";
             ++featCounter;
             ++featureCounter;
           }
@@ -968,6 +1529,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
           QgsFeatureIterator fit = layer->getFeatures( req );
           while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
           {
+            if ( skippedFeatures < startIndex )
+            {
+              ++skippedFeatures;
+              continue;
+            }
+
             if ( featureCounter == 0 )
               startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -1003,6 +1570,9 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
               mWithGeom = false;
             }
             req.setSubsetOfAttributes( attrIndexes );
+            QgsSubsetStringRestorer subsetRestorer( layer );
+            applyFilterToRequest( layer, mFilter, req );
+
             QgsFeatureIterator fit = layer->getFeatures( req );
             while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
             {
@@ -1013,6 +1583,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
               }
               if ( res.toInt() != 0 )
               {
+                if ( skippedFeatures < startIndex )
+                {
+                  ++skippedFeatures;
+                  continue;
+                }
+
                 if ( featureCounter == 0 )
                   startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -1049,7 +1625,12 @@ int QgsWFSServer::getFeature( QgsRequestHandler& request, const QString& format
         QgsFeatureIterator fit = layer->getFeatures( req );
         while ( fit.nextFeature( feature ) && ( maxFeatures == -1 || featureCounter < maxFeat ) )
         {
-          mErrors << QString( "The feature %2 of layer for the TypeName '%1'" ).arg( tnStr ).arg( featureCounter );
+          if ( skippedFeatures < startIndex )
+          {
+            ++skippedFeatures;
+            continue;
+          }
+
           if ( featureCounter == 0 )
             startGetFeature( request, format, layerPrec, layerCrs, &searchRect );
 
@@ -1205,49 +1786,38 @@ void QgsWFSServer::startGetFeature( QgsRequestHandler& request, const QString& f
   fcString = "";
 }
 
-void QgsWFSServer::sendGetFeature( QgsRequestHandler& request, const QString& format, QgsFeature* feat, int featIdx, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/
+void QgsWFSServer::sendGetFeature( QgsRequestHandler& request, const QString& format, QgsFeature* feat, int featIdx, int prec, QgsCoordinateReferenceSystem& crs, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes ) /*const*/
 {
   if ( !feat->isValid() )
     return;
 
-  QByteArray result;
   if ( format == "GeoJSON" )
   {
-    QString fcString;
-    if ( featIdx == 0 )
-      fcString += "  ";
-    else
-      fcString += " ,";
-    fcString += createFeatureGeoJSON( feat, prec, crs, attrIndexes, excludedAttributes );
-    fcString += "\n";
-
-    result = fcString.toUtf8();
-    request.sendGetFeatureResponse( &result );
-    fcString = "";
+    mFeatureBuffer += featIdx == 0 ? "  " : " ,";
+    writeFeatureGeoJSON( mFeatureBuffer, feat, prec, attrIndexes, excludedAttributes );
+    mFeatureBuffer += "\n";
   }
   else
   {
-    QDomDocument gmlDoc;
-    QDomElement featureElement;
-    if ( format == "GML3" )
-    {
-      featureElement = createFeatureGML3( feat, gmlDoc, prec, crs, attrIndexes, excludedAttributes );
-      gmlDoc.appendChild( featureElement );
-    }
-    else
-    {
-      featureElement = createFeatureGML2( feat, gmlDoc, prec, crs, attrIndexes, excludedAttributes );
-      gmlDoc.appendChild( featureElement );
-    }
+    writeFeatureGML( mFeatureBuffer, feat, format == "GML3", prec, crs, attrIndexes, excludedAttributes );
+  }
 
-    result = gmlDoc.toByteArray();
-    request.sendGetFeatureResponse( &result );
-    gmlDoc.removeChild( featureElement );
+  //send the features in chunks instead of one by one
+  if ( mFeatureBuffer.size() >= GETFEATURE_CHUNK_SIZE )
+  {
+    request.sendGetFeatureResponse( &mFeatureBuffer );
+    mFeatureBuffer.resize( 0 );
   }
 }
 
 void QgsWFSServer::endGetFeature( QgsRequestHandler& request, const QString& format )
 {
+  if ( !mFeatureBuffer.isEmpty() )
+  {
+    request.sendGetFeatureResponse( &mFeatureBuffer );
+    mFeatureBuffer.resize( 0 );
+  }
+
   QByteArray result;
   QString fcString;
   if ( format == "GeoJSON" )
@@ -1661,29 +2231,39 @@ QgsFeatureIds QgsWFSServer::getFeatureIdsFromFilter( QDomElement filterElem, Qgs
   return fids;
 }
 
-QString QgsWFSServer::createFeatureGeoJSON( QgsFeature* feat, int prec, QgsCoordinateReferenceSystem &, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/
+void QgsWFSServer::writeFeatureGeoJSON( QByteArray& out, QgsFeature* feat, int prec, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes ) /*const*/
 {
-  QString fStr = "{\"type\": \"Feature\",\n";
+  out += "{\"type\": \"Feature\",\n";
 
-  fStr += "   \"id\": ";
-  fStr += "\"" + mTypeName + "." + QString::number( feat->id() ) + "\"";
-  fStr += ",\n";
+  out += "   \"id\": \"";
+  out += mTypeName.toUtf8();
+  out += ".";
+  out += QByteArray::number( feat->id() );
+  out += "\",\n";
 
   QgsGeometry* geom = feat->geometry();
   if ( geom && mWithGeom )
   {
     QgsRectangle box = geom->boundingBox();
 
-    fStr += " \"bbox\": [ " + qgsDoubleToString( box.xMinimum(), prec ) + ", " + qgsDoubleToString( box.yMinimum(), prec ) + ", " + qgsDoubleToString( box.xMaximum(), prec ) + ", " + qgsDoubleToString( box.yMaximum(), prec ) + "],\n";
-
-    fStr += "  \"geometry\": ";
-    fStr += geom->exportToGeoJSON( prec );
-    fStr += ",\n";
+    out += " \"bbox\": [ ";
+    appendDouble( out, box.xMinimum(), prec );
+    out += ", ";
+    appendDouble( out, box.yMinimum(), prec );
+    out += ", ";
+    appendDouble( out, box.xMaximum(), prec );
+    out += ", ";
+    appendDouble( out, box.yMaximum(), prec );
+    out += "],\n";
+
+    out += "  \"geometry\": ";
+    out += geom->exportToGeoJSON( prec ).toUtf8();
+    out += ",\n";
   }
 
   //read all attribute values from the feature
-  fStr += "   \"properties\": {\n";
-  QgsAttributes featureAttributes = feat->attributes();
+  out += "   \"properties\": {\n";
+  const QgsAttributes& featureAttributes = feat->attributes();
   const QgsFields* fields = feat->fields();
   int attributeCounter = 0;
   for ( int i = 0; i < attrIndexes.count(); ++i )
@@ -1695,133 +2275,87 @@ QString QgsWFSServer::createFeatureGeoJSON( QgsFeature* feat, int prec, QgsCoord
     {
       continue;
     }
-    QVariant val = featureAttributes[idx];
+    const QVariant& val = featureAttributes[idx];
 
-    if ( attributeCounter == 0 )
-      fStr += "    \"";
-    else
-      fStr += "   ,\"";
-    fStr += attributeName;
-    fStr += "\": ";
-    if ( val.type() == 6 || val.type() == 2 )
+    out += attributeCounter == 0 ? "    \"" : "   ,\"";
+    out += attributeName.toUtf8();
+    out += "\": ";
+    if ( val.type() == QVariant::Int || val.type() == QVariant::Double )
     {
-      fStr +=  val.toString();
+      out += val.toString().toUtf8();
     }
     else
     {
-      fStr += "\"";
-      fStr +=  val.toString().replace( QString( "\"" ), QString( "\\\"" ) );
-      fStr += "\"";
+      out += "\"";
+      out += val.toString().replace( QString( "\"" ), QString( "\\\"" ) ).toUtf8();
+      out += "\"";
     }
-    fStr += "\n";
+    out += "\n";
     ++attributeCounter;
   }
 
-  fStr += "   }\n";
-
-  fStr += "  }";
+  out += "   }\n";
 
-  return fStr;
+  out += "  }";
 }
 
-QDomElement QgsWFSServer::createFeatureGML2( QgsFeature* feat, QDomDocument& doc, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/
+void QgsWFSServer::writeFeatureGML( QByteArray& out, QgsFeature* feat, bool gml3, int prec, const QgsCoordinateReferenceSystem& crs, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes ) /*const*/
 {
-  //gml:FeatureMember
-  QDomElement featureElement = doc.createElement( "gml:featureMember"/*wfs:FeatureMember*/ );
-
-  //qgs:%TYPENAME%
-  QDomElement typeNameElement = doc.createElement( "qgs:" + mTypeName /*qgs:%TYPENAME%*/ );
-  typeNameElement.setAttribute( "fid", mTypeName + "." + QString::number( feat->id() ) );
-  featureElement.appendChild( typeNameElement );
+  //gml:FeatureMember and qgs:%TYPENAME%
+  QByteArray typeNameTag = "qgs:" + mTypeName.toUtf8();
+  out += "<gml:featureMember><";
+  out += typeNameTag;
+  out += gml3 ? " gml:id=\"" : " fid=\"";
+  appendXmlEscaped( out, mTypeName + "." + QString::number( feat->id() ) );
+  out += "\">";
 
   if ( mWithGeom )
   {
     //add geometry column (as gml)
     QgsGeometry* geom = feat->geometry();
-
-    QDomElement geomElem = doc.createElement( "qgs:geometry" );
-    QDomElement gmlElem = QgsOgcUtils::geometryToGML( geom, doc, prec );
-    if ( !gmlElem.isNull() )
-    {
-      QgsRectangle box = geom->boundingBox();
-      QDomElement bbElem = doc.createElement( "gml:boundedBy" );
-      QDomElement boxElem = QgsOgcUtils::rectangleToGMLBox( &box, doc, prec );
-
-      if ( crs.isValid() )
-      {
-        boxElem.setAttribute( "srsName", crs.authid() );
-        gmlElem.setAttribute( "srsName", crs.authid() );
-      }
-
-      bbElem.appendChild( boxElem );
-      typeNameElement.appendChild( bbElem );
-
-      geomElem.appendChild( gmlElem );
-      typeNameElement.appendChild( geomElem );
-    }
-  }
-
-  //read all attribute values from the feature
-  QgsAttributes featureAttributes = feat->attributes();
-  const QgsFields* fields = feat->fields();
-  for ( int i = 0; i < attrIndexes.count(); ++i )
-  {
-    int idx = attrIndexes[i];
-    QString attributeName = fields->at( idx ).name();
-    //skip attribute if it is excluded from WFS publication
-    if ( excludedAttributes.contains( attributeName ) )
+    QByteArray srsAttribute;
+    if ( crs.isValid() )
     {
-      continue;
+      srsAttribute = " srsName=\"" + crs.authid().toUtf8() + "\"";
     }
 
-    QDomElement fieldElem = doc.createElement( "qgs:" + attributeName.replace( QString( " " ), QString( "_" ) ) );
-    QDomText fieldText = doc.createTextNode( featureAttributes[idx].toString() );
-    fieldElem.appendChild( fieldText );
-    typeNameElement.appendChild( fieldElem );
-  }
-
-  return featureElement;
-}
-
-QDomElement QgsWFSServer::createFeatureGML3( QgsFeature* feat, QDomDocument& doc, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/
-{
-  //gml:FeatureMember
-  QDomElement featureElement = doc.createElement( "gml:featureMember"/*wfs:FeatureMember*/ );
-
-  //qgs:%TYPENAME%
-  QDomElement typeNameElement = doc.createElement( "qgs:" + mTypeName /*qgs:%TYPENAME%*/ );
-  typeNameElement.setAttribute( "gml:id", mTypeName + "." + QString::number( feat->id() ) );
-  featureElement.appendChild( typeNameElement );
-
-  if ( mWithGeom )
-  {
-    //add geometry column (as gml)
-    QgsGeometry* geom = feat->geometry();
-
-    QDomElement geomElem = doc.createElement( "qgs:geometry" );
-    QDomElement gmlElem = QgsOgcUtils::geometryToGML( geom, doc, "GML3", prec );
-    if ( !gmlElem.isNull() )
+    mGeometryBuffer.resize( 0 );
+    if ( geom && appendGMLGeometry( mGeometryBuffer, geom, gml3, prec, srsAttribute ) )
     {
       QgsRectangle box = geom->boundingBox();
-      QDomElement bbElem = doc.createElement( "gml:boundedBy" );
-      QDomElement boxElem = QgsOgcUtils::rectangleToGMLEnvelope( &box, doc, prec );
-
-      if ( crs.isValid() )
+      out += "<gml:boundedBy>";
+      if ( gml3 )
       {
-        boxElem.setAttribute( "srsName", crs.authid() );
-        gmlElem.setAttribute( "srsName", crs.authid() );
+        out += "<gml:Envelope" + srsAttribute + "><gml:lowerCorner>";
+        appendDouble( out, box.xMinimum(), prec );
+        out += " ";
+        appendDouble( out, box.yMinimum(), prec );
+        out += "</gml:lowerCorner><gml:upperCorner>";
+        appendDouble( out, box.xMaximum(), prec );
+        out += " ";
+        appendDouble( out, box.yMaximum(), prec );
+        out += "</gml:upperCorner></gml:Envelope>";
       }
-
-      bbElem.appendChild( boxElem );
-      typeNameElement.appendChild( bbElem );
-
-      geomElem.appendChild( gmlElem );
-      typeNameElement.appendChild( geomElem );
+      else
+      {
+        out += "<gml:Box" + srsAttribute + "><gml:coordinates cs=\",\" ts=\" \">";
+        appendDouble( out, box.xMinimum(), prec );
+        out += ",";
+        appendDouble( out, box.yMinimum(), prec );
+        out += " ";
+        appendDouble( out, box.xMaximum(), prec );
+        out += ",";
+        appendDouble( out, box.yMaximum(), prec );
+        out += "</gml:coordinates></gml:Box>";
+      }
+      out += "</gml:boundedBy><qgs:geometry>";
+      out += mGeometryBuffer;
+      out += "</qgs:geometry>";
     }
   }
 
   //read all attribute values from the feature
-  QgsAttributes featureAttributes = feat->attributes();
+  const QgsAttributes& featureAttributes = feat->attributes();
   const QgsFields* fields = feat->fields();
   for ( int i = 0; i < attrIndexes.count(); ++i )
   {
@@ -1833,22 +2367,22 @@ QDomElement QgsWFSServer::createFeatureGML3( QgsFeature* feat, QDomDocument& doc
       continue;
     }
 
-    QDomElement fieldElem = doc.createElement( "qgs:" + attributeName.replace( QString( " " ), QString( "_" ) ) );
-    QDomText fieldText = doc.createTextNode( featureAttributes[idx].toString() );
-    fieldElem.appendChild( fieldText );
-    typeNameElement.appendChild( fieldElem );
+    QByteArray fieldTag = "qgs:" + attributeName.replace( QString( " " ), QString( "_" ) ).toUtf8();
+    out += "<" + fieldTag + ">";
+    appendXmlEscaped( out, featureAttributes[idx].toString() );
+    out += "</" + fieldTag + ">";
   }
 
-  return featureElement;
+  out += "</" + typeNameTag + "></gml:featureMember>\n";
 }
 
 QString QgsWFSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsServerRequestContext::getEnv( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsServerRequestContext::getEnv( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsServerRequestContext::getEnv( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -1862,7 +2396,7 @@ QString QgsWFSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QString( QgsServerRequestContext::getEnv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
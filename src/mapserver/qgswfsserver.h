@@ -18,6 +18,7 @@
 #ifndef QGSWFSSERVER_H
 #define QGSWFSSERVER_H
 
+#include <QByteArray>
 #include <QDomDocument>
 #include <QMap>
 #include <QString>
@@ -40,6 +41,7 @@ class QgsConfigParser;
 class QgsVectorLayer;
 class QgsCoordinateReferenceSystem;
 class QgsField;
+class QgsExpression;
 class QgsFeature;
 class QgsRectangle;
 class QgsGeometry;
@@ -101,23 +103,31 @@ class QgsWFSServer: public QgsOWSServer
 
     QgsWFSProjectParser* mConfigParser;
 
+    /* Serialised features not sent yet */
+    QByteArray mFeatureBuffer;
+    /* Reused buffer for the GML of a geometry */
+    QByteArray mGeometryBuffer;
+
   protected:
 
     void startGetFeature( QgsRequestHandler& request, const QString& format, int prec, QgsCoordinateReferenceSystem& crs, QgsRectangle* rect );
-    void sendGetFeature( QgsRequestHandler& request, const QString& format, QgsFeature* feat, int featIdx, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes );
+    void sendGetFeature( QgsRequestHandler& request, const QString& format, QgsFeature* feat, int featIdx, int prec, QgsCoordinateReferenceSystem& crs, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes );
     void endGetFeature( QgsRequestHandler& request, const QString& format );
 
+    /**Translates the parts of a filter expression the provider can evaluate into the request: spatial operators
+      to a filter rectangle and, for database layers, attribute comparisons to the layer subset string.
+      The expression still has to be evaluated for the returned features
+      @return true if the subset string of the layer has been changed. The caller restores it with a QgsSubsetStringRestorer*/
+    bool applyFilterToRequest( QgsVectorLayer* layer, const QgsExpression* filter, QgsFeatureRequest& request ) const;
+
     //method for transaction
     QgsFeatureIds getFeatureIdsFromFilter( QDomElement filter, QgsVectorLayer* layer );
 
     //methods to write GeoJSON
-    QString createFeatureGeoJSON( QgsFeature* feat, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/;
-
-    //methods to write GML2
-    QDomElement createFeatureGML2( QgsFeature* feat, QDomDocument& doc, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/;
+    void writeFeatureGeoJSON( QByteArray& out, QgsFeature* feat, int prec, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes ) /*const*/;
 
-    //methods to write GML3
-    QDomElement createFeatureGML3( QgsFeature* feat, QDomDocument& doc, int prec, QgsCoordinateReferenceSystem& crs, QgsAttributeList attrIndexes, QSet<QString> excludedAttributes ) /*const*/;
+    //methods to write GML2 and GML3 directly as text
+    void writeFeatureGML( QByteArray& out, QgsFeature* feat, bool gml3, int prec, const QgsCoordinateReferenceSystem& crs, const QgsAttributeList& attrIndexes, const QSet<QString>& excludedAttributes ) /*const*/;
 
     void addTransactionResult( QDomDocument& responseDoc, QDomElement& responseElem, const QString& status, const QString& locator, const QString& message );
 };
@@ -17,6 +17,7 @@
 
 #include "qgswmsserver.h"
 #include "qgscapabilitiescache.h"
+#include "qgsconfigcache.h"
 #include "qgscrscache.h"
 #include "qgsfield.h"
 #include "qgsgeometry.h"
@@ -38,6 +39,9 @@
 #include "qgsvectorlayer.h"
 #include "qgslogger.h"
 #include "qgsmapserviceexception.h"
+#include "qgsserverprofiler.h"
+#include "qgsserverrequestcontext.h"
+#include "qgsservertilecache.h"
 #include "qgssldconfigparser.h"
 #include "qgssymbolv2.h"
 #include "qgsrendererv2.h"
@@ -45,12 +49,15 @@
 #include "qgsogcutils.h"
 #include "qgsfeature.h"
 
+#include <QCryptographicHash>
+#include <QFileInfo>
 #include <QImage>
 #include <QPainter>
 #include <QStringList>
 #include <QTemporaryFile>
 #include <QTextStream>
 #include <QDir>
+#include <QtConcurrentRun>
 
 //for printing
 #include "qgscomposition.h"
@@ -60,6 +67,15 @@
 #include <QUrl>
 #include <QPaintEngine>
 
+#include <cmath>
+#include <stdlib.h>
+
+//GetMap requests up to this width and height are cached as tiles, up to MAX_TILED_TILE_SIZE with TILED=TRUE
+static const int MAX_TILE_SIZE = 512;
+static const int MAX_TILED_TILE_SIZE = 2048;
+//maximum width and height of a metatile, whatever the maximum size of the project
+static const int MAX_METATILE_SIZE = 2048;
+
 QgsWMSServer::QgsWMSServer( const QString& configFilePath, QMap<QString, QString> parameters, QgsWMSConfigParser* cp,
                             QgsRequestHandler* rh, QgsMapRenderer* renderer, QgsCapabilitiesCache* capCache )
     : QgsOWSServer( configFilePath, parameters, rh )
@@ -114,13 +130,14 @@ void QgsWMSServer::executeRequest()
   //GetCapabilities
   if ( request.compare( "GetCapabilities", Qt::CaseInsensitive ) == 0 || getProjectSettings )
   {
-    const QDomDocument* capabilitiesDocument = mCapabilitiesCache->searchCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version );
+    const QByteArray* capabilitiesDocument = mCapabilitiesCache->searchCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version );
     if ( !capabilitiesDocument ) //capabilities xml not in cache. Create a new one
     {
       QgsDebugMsg( "Capabilities document not found in cache" );
       QDomDocument doc;
       try
       {
+        QgsServerProfilerStage stage( "capabilities" );
         doc = getCapabilities( version, getProjectSettings );
       }
       catch ( QgsMapServiceException& ex )
@@ -129,8 +146,20 @@ void QgsWMSServer::executeRequest()
         cleanupAfterRequest();
         return;
       }
-      mCapabilitiesCache->insertCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version, &doc );
-      capabilitiesDocument = mCapabilitiesCache->searchCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version );
+
+      //the document is valid for the version of the project it has been created from
+      QDateTime fileLastModified;
+      qint64 fileSize;
+      if ( QgsConfigCache::instance()->configFileVersion( mConfigFilePath, fileLastModified, fileSize ) )
+      {
+        mCapabilitiesCache->insertCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version, &doc, fileLastModified, fileSize );
+        capabilitiesDocument = mCapabilitiesCache->searchCapabilitiesDocument( mConfigFilePath, getProjectSettings ? "projectSettings" : version );
+      }
+      if ( !capabilitiesDocument )
+      {
+        //the project changed in the meantime
+        mRequestHandler->sendGetCapabilitiesResponse( doc );
+      }
     }
     else
     {
@@ -139,7 +168,7 @@ void QgsWMSServer::executeRequest()
 
     if ( capabilitiesDocument )
     {
-      mRequestHandler->sendGetCapabilitiesResponse( *capabilitiesDocument );
+      mRequestHandler->sendSerializedGetCapabilitiesResponse( *capabilitiesDocument );
     }
   }
   //GetMap
@@ -148,6 +177,11 @@ void QgsWMSServer::executeRequest()
     QImage* result = 0;
     try
     {
+      if ( getCachedMap() )
+      {
+        cleanupAfterRequest();
+        return;
+      }
       result = getMap();
     }
     catch ( QgsMapServiceException& ex )
@@ -161,6 +195,7 @@ void QgsWMSServer::executeRequest()
     if ( result )
     {
       QgsDebugMsg( "Sending GetMap response" );
+      QgsServerProfilerStage stage( "encode" );
       mRequestHandler->sendGetMapResponse( "WMS", result, getImageQuality() );
       QgsDebugMsg( "Response sent" );
     }
@@ -177,6 +212,7 @@ void QgsWMSServer::executeRequest()
     QDomDocument featureInfoDoc;
     try
     {
+      QgsServerProfilerStage stage( "featureInfo" );
       if ( getFeatureInfo( featureInfoDoc, version ) != 0 )
       {
         cleanupAfterRequest();
@@ -276,6 +312,7 @@ void QgsWMSServer::executeRequest()
     QByteArray* printOutput = 0;
     try
     {
+      QgsServerProfilerStage stage( "print" );
       printOutput = getPrint( mRequestHandler->format() );
     }
     catch ( QgsMapServiceException& ex )
@@ -393,7 +430,7 @@ QDomDocument QgsWMSServer::getCapabilities( QString version, bool fullProjectInf
   QDomElement postResourceElement = doc.createElement( "OnlineResource"/*wms:OnlineResource*/ );
   postResourceElement.setAttribute( "xmlns:xlink", "http://www.w3.org/1999/xlink" );
   postResourceElement.setAttribute( "xlink:type", "simple" );
-  postResourceElement.setAttribute( "xlink:href", "http://" + QString( getenv( "SERVER_NAME" ) ) + QString( getenv( "REQUEST_URI" ) ) );
+  postResourceElement.setAttribute( "xlink:href", "http://" + QString( QgsServerRequestContext::getEnv( "SERVER_NAME" ) ) + QString( QgsServerRequestContext::getEnv( "REQUEST_URI" ) ) );
   postElement.appendChild( postResourceElement );
   dcpTypeElement.appendChild( postElement );
 #endif
@@ -880,6 +917,10 @@ QByteArray* QgsWMSServer::getPrint( const QString& formatString )
   QByteArray* ba = 0;
   c->setPlotStyle( QgsComposition::Print );
 
+  //render the layers of the composer maps in parallel for raster output
+  QString parallelRendering = QString( getenv( "QGIS_SERVER_PARALLEL_RENDERING" ) );
+  c->setParallelRenderingEnabled( parallelRendering == "1" || parallelRendering.compare( "true", Qt::CaseInsensitive ) == 0 );
+
   //SVG export without a running X-Server is a problem. See e.g. http://developer.qt.nokia.com/forums/viewthread/2038
   if ( formatString.compare( "svg", Qt::CaseInsensitive ) == 0 )
   {
@@ -968,7 +1009,11 @@ QImage* QgsWMSServer::getMap()
     throw QgsMapServiceException( "Size error", "The requested map size is too large" );
   }
   QStringList layersList, stylesList, layerIdList;
-  QImage* theImage = initializeRendering( layersList, stylesList, layerIdList );
+  QImage* theImage = 0;
+  {
+    QgsServerProfilerStage stage( "layers" );
+    theImage = initializeRendering( layersList, stylesList, layerIdList );
+  }
 
   QPainter thePainter( theImage );
   thePainter.setRenderHint( QPainter::Antialiasing ); //make it look nicer
@@ -983,7 +1028,11 @@ QImage* QgsWMSServer::getMap()
 
   applyOpacities( layersList, bkVectorRenderers, bkRasterRenderers, labelTransparencies, labelBufferTransparencies );
 
-  mMapRenderer->render( &thePainter );
+  {
+    QgsServerProfilerStage stage( "render" );
+    mMapRenderer->render( &thePainter );
+  }
+  QgsServerProfiler::instance()->addRenderingTimes( mMapRenderer );
   if ( mConfigParser )
   {
     //draw configuration format specific overlay items
@@ -1004,6 +1053,197 @@ QImage* QgsWMSServer::getMap()
   return theImage;
 }
 
+bool QgsWMSServer::getCachedMap()
+{
+  QgsServerTileCache* tileCache = QgsServerTileCache::instance();
+  if ( !tileCache->isEnabled() || mParameters.contains( "SLD" ) || mParameters.contains( "SLD_BODY" ) )
+  {
+    return false; //an SLD may change without the request changing
+  }
+
+  //only tile sized requests, larger maps are seldom requested twice with the same extent
+  bool widthOk, heightOk;
+  int width = mParameters.value( "WIDTH" ).toInt( &widthOk );
+  int height = mParameters.value( "HEIGHT" ).toInt( &heightOk );
+  int maxTileSize = mParameters.value( "TILED" ).compare( "true", Qt::CaseInsensitive ) == 0 ? MAX_TILED_TILE_SIZE : MAX_TILE_SIZE;
+  if ( !widthOk || !heightOk || width <= 0 || height <= 0 || width > maxTileSize || height > maxTileSize )
+  {
+    return false;
+  }
+
+  QStringList bbox = mParameters.value( "BBOX" ).split( "," );
+  if ( bbox.size() != 4 )
+  {
+    return false;
+  }
+  double coords[4];
+  for ( int i = 0; i < 4; ++i )
+  {
+    bool conversionSuccess;
+    coords[i] = bbox.at( i ).toDouble( &conversionSuccess );
+    if ( !conversionSuccess )
+    {
+      return false;
+    }
+  }
+
+  //same axis order as configureMapRender
+  QString crs = mParameters.value( "CRS", mParameters.value( "SRS" ) );
+  bool axisInverted = mParameters.value( "VERSION", "1.3.0" ) != "1.1.1" && !crs.isEmpty() && QgsCRSCache::instance()->crsByAuthId( crs ).axisInverted();
+  double minx = axisInverted ? coords[1] : coords[0];
+  double miny = axisInverted ? coords[0] : coords[1];
+  double tileWidth = ( axisInverted ? coords[3] : coords[2] ) - minx;
+  double tileHeight = ( axisInverted ? coords[2] : coords[3] ) - miny;
+  if ( tileWidth <= 0 || tileHeight <= 0 )
+  {
+    return false;
+  }
+
+  //the request has to be a tile of a grid with the origin at 0/0 or at half a tile from 0/0 (within a quarter of a pixel).
+  //The latter are e.g. the tiles of the first zoom level of GoogleMapsCompatible
+  double colOffset, rowOffset;
+  qint64 col, row;
+  if ( !gridPosition( minx / tileWidth, width, col, colOffset ) || !gridPosition( miny / tileHeight, height, row, rowOffset ) )
+  {
+    return false;
+  }
+
+  //tiles are identified by the project version, the parameters except the extent and the tile matrix
+  QFileInfo projectFileInfo( mConfigFilePath );
+  QString keyBase = mConfigFilePath + "|" + QString::number( projectFileInfo.lastModified().toMSecsSinceEpoch() ) + "|" + QString::number( projectFileInfo.size() );
+  QMap<QString, QString>::const_iterator paramIt = mParameters.constBegin();
+  for ( ; paramIt != mParameters.constEnd(); ++paramIt )
+  {
+    if ( paramIt.key() != "BBOX" && paramIt.key() != "WIDTH" && paramIt.key() != "HEIGHT" )
+    {
+      keyBase += "|" + paramIt.key() + "=" + paramIt.value();
+    }
+  }
+  keyBase += QString( "|%1x%2|%3x%4|%5x%6|" ).arg( width ).arg( height ).arg( tileWidth, 0, 'g', 12 ).arg( tileHeight, 0, 'g', 12 ).arg( colOffset ).arg( rowOffset );
+
+  QByteArray requestedTile = tileCache->tile( tileCacheKey( keyBase, col, row ) );
+  if ( !requestedTile.isEmpty() )
+  {
+    QgsDebugMsg( "Found tile in cache" );
+    mRequestHandler->sendEncodedGetMapResponse( &requestedTile );
+    return true;
+  }
+
+  //render the metatile containing the tile at once, so that labels are not cut at the tile borders
+  int metaTileSize = tileCache->metaTileSize();
+  int maxMetaWidth = mConfigParser->maxWidth() != -1 ? qMin( mConfigParser->maxWidth(), MAX_METATILE_SIZE ) : MAX_METATILE_SIZE;
+  int maxMetaHeight = mConfigParser->maxHeight() != -1 ? qMin( mConfigParser->maxHeight(), MAX_METATILE_SIZE ) : MAX_METATILE_SIZE;
+  while ( metaTileSize > 1 && ( metaTileSize * width > maxMetaWidth || metaTileSize * height > maxMetaHeight ) )
+  {
+    metaTileSize--;
+  }
+  qint64 metaCol = ( qint64 ) floor(( double ) col / metaTileSize ) * metaTileSize;
+  qint64 metaRow = ( qint64 ) floor(( double ) row / metaTileSize ) * metaTileSize;
+  double metaMinX = ( metaCol + colOffset ) * tileWidth;
+  double metaMinY = ( metaRow + rowOffset ) * tileHeight;
+  double metaMaxX = ( metaCol + colOffset + metaTileSize ) * tileWidth;
+  double metaMaxY = ( metaRow + rowOffset + metaTileSize ) * tileHeight;
+
+  QMap<QString, QString> originalParameters = mParameters;
+  if ( axisInverted )
+  {
+    mParameters.insert( "BBOX", QString( "%1,%2,%3,%4" ).arg( metaMinY, 0, 'g', 17 ).arg( metaMinX, 0, 'g', 17 ).arg( metaMaxY, 0, 'g', 17 ).arg( metaMaxX, 0, 'g', 17 ) );
+  }
+  else
+  {
+    mParameters.insert( "BBOX", QString( "%1,%2,%3,%4" ).arg( metaMinX, 0, 'g', 17 ).arg( metaMinY, 0, 'g', 17 ).arg( metaMaxX, 0, 'g', 17 ).arg( metaMaxY, 0, 'g', 17 ) );
+  }
+  mParameters.insert( "WIDTH", QString::number( metaTileSize * width ) );
+  mParameters.insert( "HEIGHT", QString::number( metaTileSize * height ) );
+
+  QImage* metaTile = 0;
+  try
+  {
+    metaTile = getMap();
+  }
+  catch ( QgsMapServiceException& ex )
+  {
+    mParameters = originalParameters;
+    throw;
+  }
+  mParameters = originalParameters;
+  if ( !metaTile )
+  {
+    return false;
+  }
+
+  //slice the metatile, the first row of the image is the last tile row
+  QVector<QImage> tileImages( metaTileSize * metaTileSize );
+  for ( int r = 0; r < metaTileSize; ++r )
+  {
+    for ( int c = 0; c < metaTileSize; ++c )
+    {
+      tileImages[r * metaTileSize + c] = metaTile->copy( c * width, ( metaTileSize - 1 - r ) * height, width, height );
+    }
+  }
+  delete metaTile;
+
+  //encode the tiles in parallel
+  int imageQuality = getImageQuality();
+  QList< QFuture<QByteArray> > encodingJobs;
+  for ( int i = 0; i < tileImages.size(); ++i )
+  {
+    encodingJobs << QtConcurrent::run( mRequestHandler, &QgsRequestHandler::encodeGetMapImage, &tileImages[i], imageQuality );
+  }
+  QVector<QByteArray> encodedTiles( tileImages.size() );
+  for ( int i = 0; i < encodingJobs.size(); ++i )
+  {
+    encodedTiles[i] = encodingJobs.at( i ).result();
+  }
+
+  for ( int r = 0; r < metaTileSize; ++r )
+  {
+    for ( int c = 0; c < metaTileSize; ++c )
+    {
+      const QByteArray& tileData = encodedTiles.at( r * metaTileSize + c );
+      bool isRequestedTile = ( metaCol + c == col && metaRow + r == row );
+      if ( tileData.isEmpty() )
+      {
+        if ( isRequestedTile )
+        {
+          //let the request handler report the unsupported format
+          mRequestHandler->sendGetMapResponse( "WMS", &tileImages[r * metaTileSize + c], imageQuality );
+          return true;
+        }
+        continue;
+      }
+      tileCache->insertTile( tileCacheKey( keyBase, metaCol + c, metaRow + r ), tileData );
+      if ( isRequestedTile )
+      {
+        requestedTile = tileData;
+      }
+    }
+  }
+
+  mRequestHandler->sendEncodedGetMapResponse( &requestedTile );
+  return true;
+}
+
+bool QgsWMSServer::gridPosition( double position, int pixels, qint64& index, double& offset )
+{
+  index = qRound64( position );
+  offset = 0.0;
+  if ( qAbs( position - index ) * pixels <= 0.25 )
+  {
+    return true;
+  }
+
+  offset = 0.5;
+  index = qRound64( position - offset );
+  return qAbs( position - offset - index ) * pixels <= 0.25;
+}
+
+QString QgsWMSServer::tileCacheKey( const QString& keyBase, qint64 col, qint64 row )
+{
+  QByteArray key = ( keyBase + QString( "%1,%2" ).arg( col ).arg( row ) ).toUtf8();
+  return QString( QCryptographicHash::hash( key, QCryptographicHash::Sha1 ).toHex() );
+}
+
 int QgsWMSServer::getFeatureInfo( QDomDocument& result, QString version )
 {
   if ( !mMapRenderer || !mConfigParser )
@@ -1692,7 +1932,11 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
     searchRect = layerRect;
   }
 
-  //do a select with searchRect and go through all the features
+  QgsFeatureRendererV2* r2 = layer->rendererV2();
+  if ( !r2 )
+  {
+    return 0;
+  }
 
   QgsFeature feature;
   QgsAttributes featureAttributes;
@@ -1702,6 +1946,29 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
   bool addWktGeometry = mConfigParser && mConfigParser->featureInfoWithWktGeometry();
   const QSet<QString>& excludedAttributes = layer->excludeAttributesWMS();
 
+  //attributes published in the feature info and their (alias) names
+  QgsAttributeList publishedAttributes;
+  QStringList publishedAttributeNames;
+  for ( int i = 0; i < fields.count(); ++i )
+  {
+    //skip attribute if it is explicitly excluded from WMS publication
+    if ( !excludedAttributes.contains( fields[i].name() ) )
+    {
+      publishedAttributes << i;
+      publishedAttributeNames << layer->attributeDisplayName( i );
+    }
+  }
+  QString displayField = layer->displayField();
+  bool addMaptip = !displayField.isEmpty() && layer->fieldNameIndex( displayField ) < 0;
+
+  QgsCoordinateReferenceSystem outputCrs = layer->crs();
+  if ( layer->crs() != mapRender->destinationCrs() && mapRender->hasCrsTransformEnabled() )
+  {
+    outputCrs = mapRender->destinationCrs();
+  }
+
+  //do a select with searchRect and go through all the features
+
   QgsFeatureRequest fReq;
   bool hasGeometry = addWktGeometry || featureBBox;
   fReq.setFlags((( hasGeometry ) ? QgsFeatureRequest::NoFlags : QgsFeatureRequest::NoGeometry ) | QgsFeatureRequest::ExactIntersect );
@@ -1709,31 +1976,35 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
   {
     fReq.setFilterRect( searchRect );
   }
-  QgsFeatureIterator fit = layer->getFeatures( fReq );
 
-  bool featureBBoxInitialized = false;
-  while ( fit.nextFeature( feature ) )
+  //fetch only the published attributes and the ones needed by the renderer. A maptip expression may reference any attribute
+  if ( publishedAttributes.size() < fields.count() && !addMaptip )
   {
-    ++featureCounter;
-    if ( featureCounter > nFeatures )
+    QgsAttributeList requestAttributes = publishedAttributes;
+    foreach ( QString attributeName, r2->usedAttributes() )
     {
-      break;
+      int index = fields.indexFromName( attributeName );
+      if ( index >= 0 && !requestAttributes.contains( index ) )
+      {
+        requestAttributes << index;
+      }
     }
+    fReq.setSubsetOfAttributes( requestAttributes );
+  }
 
-    QgsFeatureRendererV2* r2 = layer->rendererV2();
-    if ( !r2 )
-    {
-      continue;
-    }
+  //the renderer is prepared once for all features of the layer
+  r2->startRender( renderContext, fields );
+  QgsFeatureIterator fit = layer->getFeatures( fReq );
 
+  bool featureBBoxInitialized = false;
+  while ( featureCounter < nFeatures && fit.nextFeature( feature ) )
+  {
     //check if feature is rendered at all
-    r2->startRender( renderContext, layer->pendingFields() );
-    bool renderV2 = r2->willRenderFeature( feature );
-    r2->stopRender( renderContext );
-    if ( !renderV2 )
+    if ( !r2->willRenderFeature( feature ) )
     {
       continue;
     }
+    ++featureCounter;
 
     QgsRectangle box;
     if ( hasGeometry )
@@ -1753,12 +2024,6 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
       }
     }
 
-    QgsCoordinateReferenceSystem outputCrs = layer->crs();
-    if ( layer->crs() != mapRender->destinationCrs() && mapRender->hasCrsTransformEnabled() )
-    {
-      outputCrs = mapRender->destinationCrs();
-    }
-
     if ( infoFormat == "application/vnd.ogc.gml" )
     {
       bool withGeom = layer->wkbType() != QGis::WKBNoGeometry && addWktGeometry;
@@ -1775,36 +2040,29 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
       featureElement.setAttribute( "id", FID_TO_STRING( feature.id() ) );
       layerElement.appendChild( featureElement );
 
-      //read all attribute values from the feature
+      //read the published attribute values from the feature
       featureAttributes = feature.attributes();
-      for ( int i = 0; i < featureAttributes.count(); ++i )
+      for ( int j = 0; j < publishedAttributes.size(); ++j )
       {
-        //skip attribute if it is explicitly excluded from WMS publication
-        if ( excludedAttributes.contains( fields[i].name() ) )
+        int i = publishedAttributes.at( j );
+        if ( i >= featureAttributes.count() )
         {
-          continue;
+          break;
         }
 
-        //replace attribute name if there is an attribute alias?
-        QString attributeName = layer->attributeDisplayName( i );
-
         QDomElement attributeElement = infoDocument.createElement( "Attribute" );
-        attributeElement.setAttribute( "name", attributeName );
+        attributeElement.setAttribute( "name", publishedAttributeNames.at( j ) );
         attributeElement.setAttribute( "value", replaceValueMapAndRelation( layer, i, QgsExpression::replaceExpressionText( featureAttributes[i].toString(), &feature, layer ) ) );
         featureElement.appendChild( attributeElement );
       }
 
       //add maptip attribute based on html/expression (in case there is no maptip attribute)
-      if ( layer->fieldNameIndex( layer->displayField() ) < 0 )
+      if ( addMaptip )
       {
-        QString displayField = layer->displayField();
-        if ( !displayField.isEmpty() )
-        {
-          QDomElement maptipElem = infoDocument.createElement( "Attribute" );
-          maptipElem.setAttribute( "name", "maptip" );
-          maptipElem.setAttribute( "value",  QgsExpression::replaceExpressionText( displayField, &feature, layer ) );
-          featureElement.appendChild( maptipElem );
-        }
+        QDomElement maptipElem = infoDocument.createElement( "Attribute" );
+        maptipElem.setAttribute( "name", "maptip" );
+        maptipElem.setAttribute( "value",  QgsExpression::replaceExpressionText( displayField, &feature, layer ) );
+        featureElement.appendChild( maptipElem );
       }
 
       //append feature bounding box to feature info xml
@@ -1839,6 +2097,7 @@ int QgsWMSServer::featureInfoFromVectorLayer( QgsVectorLayer* layer,
       }
     }
   }
+  r2->stopRender( renderContext );
 
   return 0;
 }
@@ -2425,11 +2684,11 @@ bool QgsWMSServer::checkMaximumWidthHeight() const
 
 QString QgsWMSServer::serviceUrl() const
 {
-  QUrl mapUrl( getenv( "REQUEST_URI" ) );
-  mapUrl.setHost( getenv( "SERVER_NAME" ) );
+  QUrl mapUrl( QgsServerRequestContext::getEnv( "REQUEST_URI" ) );
+  mapUrl.setHost( QgsServerRequestContext::getEnv( "SERVER_NAME" ) );
 
   //Add non-default ports to url
-  QString portString = getenv( "SERVER_PORT" );
+  QString portString = QgsServerRequestContext::getEnv( "SERVER_PORT" );
   if ( !portString.isEmpty() )
   {
     bool portOk;
@@ -2443,7 +2702,7 @@ QString QgsWMSServer::serviceUrl() const
     }
   }
 
-  if ( QString( getenv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
+  if ( QString( QgsServerRequestContext::getEnv( "HTTPS" ) ).compare( "on", Qt::CaseInsensitive ) == 0 )
   {
     mapUrl.setScheme( "https" );
   }
@@ -99,6 +99,21 @@ class QgsWMSServer: public QgsOWSServer
     /**Don't use the default constructor*/
     QgsWMSServer();
 
+    /**Serves a GetMap request aligned to a tile grid from the tile cache. If the tile is not cached, the metatile
+      containing it is rendered and all its tiles are cached
+      @return false if the request cannot be served from the tile cache*/
+    bool getCachedMap();
+    /**Index of a tile in a grid from the position of its lower left corner in tile units. The grid origin is at 0 or
+      half a tile from 0
+      @param position coordinate divided by the tile size
+      @param pixels tile size in pixels, the position has to be within a quarter of a pixel of the grid
+      @param index out: tile index
+      @param offset out: offset of the grid origin in tile units (0 or 0.5)
+      @return false if the position is not on a grid*/
+    static bool gridPosition( double position, int pixels, qint64& index, double& offset );
+    /**Returns the tile cache key of a tile of the grid described by keyBase*/
+    static QString tileCacheKey( const QString& keyBase, qint64 col, qint64 row );
+
     /**Initializes WMS layers and configures mMapRendering.
       @param layersList out: list with WMS layer names
       @param stylesList out: list with WMS style names
@@ -15,11 +15,6 @@
  *                                                                         *
  ***************************************************************************/
 
-// GDAL includes
-#include "gdal_priv.h"
-#include "cpl_string.h"
-#include "cpl_conv.h"
-
 // QGIS Specific includes
 #include <qgisinterface.h>
 #include <qgisgui.h>
@@ -28,6 +23,7 @@
 #include "heatmapgui.h"
 
 #include "qgsgeometry.h"
+#include "qgskde.h"
 #include "qgsvectorlayer.h"
 #include "qgsvectordataprovider.h"
 #include "qgsdistancearea.h"
@@ -42,18 +38,6 @@
 #include <QFileInfo>
 #include <QProgressDialog>
 
-#define NO_DATA -9999
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
-#define TO8F(x) (x).toUtf8().constData()
-#else
-#define TO8F(x) QFile::encodeName( x ).constData()
-#endif
-
 static const QString sName = QObject::tr( "Heatmap" );
 static const QString sDescription = QObject::tr( "Creates a Heatmap raster for the input point vector" );
 static const QString sCategory = QObject::tr( "Raster" );
@@ -129,65 +113,18 @@ void Heatmap::run()
     int columns = d.columns();
     int rows = d.rows();
     double cellsize = d.cellSizeX(); // or d.cellSizeY();  both have the same value
-    mDecay = d.decayRatio();
-    int kernelShape = d.kernelShape();
-
-    // Getting the rasterdataset in place
-    GDALAllRegister();
-
-    GDALDataset *emptyDataset;
-    GDALDriver *myDriver;
-
-    myDriver = GetGDALDriverManager()->GetDriverByName( d.outputFormat().toUtf8() );
-    if ( myDriver == NULL )
-    {
-      mQGisIface->messageBar()->pushMessage( tr( "GDAL driver error" ), tr( "Cannot open the driver for the specified format" ), QgsMessageBar::WARNING, mQGisIface->messageTimeout() );
-      return;
-    }
-
-    double geoTransform[6] = { myBBox.xMinimum(), cellsize, 0, myBBox.yMinimum(), 0, cellsize };
-    emptyDataset = myDriver->Create( d.outputFilename().toUtf8(), columns, rows, 1, GDT_Float32, NULL );
-    emptyDataset->SetGeoTransform( geoTransform );
-    // Set the projection on the raster destination to match the input layer
-    emptyDataset->SetProjection( inputLayer->crs().toWkt().toLocal8Bit().data() );
 
-    GDALRasterBand *poBand;
-    poBand = emptyDataset->GetRasterBand( 1 );
-    poBand->SetNoDataValue( NO_DATA );
-
-    float* line = ( float * ) CPLMalloc( sizeof( float ) * columns );
-    for ( int i = 0; i < columns ; i++ )
-    {
-      line[i] = NO_DATA;
-    }
-    // Write the empty raster
-    for ( int i = 0; i < rows ; i++ )
-    {
-      poBand->RasterIO( GF_Write, 0, i, columns, 1, line, columns, 1, GDT_Float32, 0, 0 );
-    }
-
-    CPLFree( line );
-    //close the dataset
-    GDALClose(( GDALDatasetH ) emptyDataset );
-
-    // open the raster in GA_Update mode
-    GDALDataset *heatmapDS;
-    heatmapDS = ( GDALDataset * ) GDALOpen( TO8F( d.outputFilename() ), GA_Update );
-    if ( !heatmapDS )
-    {
-      mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not open the created raster for updating. The heatmap was not generated." ), QgsMessageBar::WARNING );
-      return;
-    }
-    poBand = heatmapDS->GetRasterBand( 1 );
+    QgsKernelDensityEstimation kde( myBBox, cellsize, columns, rows );
+    kde.setKernelShape(( QgsKernelDensityEstimation::KernelShape ) d.kernelShape() );
+    kde.setDecayRatio( d.decayRatio() );
 
     QgsAttributeList myAttrList;
     int rField = 0;
     int wField = 0;
 
     // Handle different radius options
-    double radius;
+    double radius = 0;
     double radiusToMapUnits = 1;
-    int myBuffer = 0;
     if ( d.variableRadius() )
     {
       rField = d.radiusField();
@@ -203,7 +140,6 @@ void Heatmap::run()
     else
     {
       radius = d.radius(); // radius returned by d.radius() is already in map units
-      myBuffer = bufferSize( radius, cellsize );
     }
 
     if ( d.weighted() )
@@ -223,100 +159,67 @@ void Heatmap::run()
     p.show();
 
     QgsFeature myFeature;
+    bool canceled = false;
 
+    // collect the points, the kernels are computed afterwards
     while ( fit.nextFeature( myFeature ) )
     {
       counter++;
-      p.setValue( counter );
-      QApplication::processEvents();
-      if ( p.wasCanceled() )
+      if ( counter % 1000 == 0 )
       {
-        mQGisIface->messageBar()->pushMessage( tr( "Heatmap generation aborted" ), tr( "QGIS will now load the partially-computed raster" ), QgsMessageBar::INFO, mQGisIface->messageTimeout() );
-        break;
+        p.setValue( counter );
+        QApplication::processEvents();
+        if ( p.wasCanceled() )
+        {
+          canceled = true;
+          break;
+        }
       }
 
-      QgsGeometry* myPointGeometry;
-      myPointGeometry = myFeature.geometry();
-      // convert the geometry to point
-      QgsPoint myPoint;
-      myPoint = myPointGeometry->asPoint();
-      // avoiding any empty points or out of extent points
-      if (( myPoint.x() < myBBox.xMinimum() ) || ( myPoint.y() < myBBox.yMinimum() )
-          || ( myPoint.x() > myBBox.xMaximum() ) || ( myPoint.y() > myBBox.yMaximum() ) )
+      QgsGeometry* myPointGeometry = myFeature.geometry();
+      if ( !myPointGeometry )
       {
         continue;
       }
 
-      // If radius is variable then fetch it and calculate new pixel buffer size
+      // If radius is variable then fetch it
       if ( d.variableRadius() )
       {
         radius = myFeature.attribute( rField ).toDouble() * radiusToMapUnits;
-        myBuffer = bufferSize( radius, cellsize );
       }
 
-      int blockSize = 2 * myBuffer + 1; //Block SIDE would be more appropriate
-      // calculate the pixel position
-      unsigned int xPosition, yPosition;
-      xPosition = (( myPoint.x() - myBBox.xMinimum() ) / cellsize ) - myBuffer;
-      yPosition = (( myPoint.y() - myBBox.yMinimum() ) / cellsize ) - myBuffer;
-
-      // get the data
-      float *dataBuffer = ( float * ) CPLMalloc( sizeof( float ) * blockSize * blockSize );
-      poBand->RasterIO( GF_Read, xPosition, yPosition, blockSize, blockSize,
-                        dataBuffer, blockSize, blockSize, GDT_Float32, 0, 0 );
-
       double weight = 1.0;
       if ( d.weighted() )
       {
         weight = myFeature.attribute( wField ).toDouble();
       }
 
-      for ( int xp = 0; xp <= myBuffer; xp++ )
-      {
-        for ( int yp = 0; yp <= myBuffer; yp++ )
-        {
-          double distance = sqrt( pow( xp, 2.0 ) + pow( yp, 2.0 ) );
-
-          // is pixel outside search bandwidth of feature?
-          if ( distance > myBuffer )
-          {
-            continue;
-          }
-
-          double pixelValue = weight * calculateKernelValue( distance, myBuffer, kernelShape );
-
-          // clearing anamolies along the axes
-          if ( xp == 0 && yp == 0 )
-          {
-            pixelValue /= 4;
-          }
-          else if ( xp == 0 || yp == 0 )
-          {
-            pixelValue /= 2;
-          }
-
-          int pos[4];
-          pos[0] = ( myBuffer + xp ) * blockSize + ( myBuffer + yp );
-          pos[1] = ( myBuffer + xp ) * blockSize + ( myBuffer - yp );
-          pos[2] = ( myBuffer - xp ) * blockSize + ( myBuffer + yp );
-          pos[3] = ( myBuffer - xp ) * blockSize + ( myBuffer - yp );
-          for ( int p = 0; p < 4; p++ )
-          {
-            if ( dataBuffer[ pos[p] ] == NO_DATA )
-            {
-              dataBuffer[ pos[p] ] = 0;
-            }
-            dataBuffer[ pos[p] ] += pixelValue;
-          }
-        }
-      }
+      kde.addPoint( myPointGeometry->asPoint(), radius, weight );
+    }
 
-      poBand->RasterIO( GF_Write, xPosition, yPosition, blockSize, blockSize,
-                        dataBuffer, blockSize, blockSize, GDT_Float32, 0, 0 );
-      CPLFree( dataBuffer );
+    if ( canceled )
+    {
+      mQGisIface->messageBar()->pushMessage( tr( "Heatmap generation aborted" ), tr( "The heatmap was not generated." ), QgsMessageBar::INFO, mQGisIface->messageTimeout() );
+      return;
+    }
+
+    p.setLabelText( tr( "Writing heatmap" ) );
+    int result = kde.writeRaster( d.outputFilename(), d.outputFormat(), inputLayer->crs().toWkt(), &p );
+    switch ( result )
+    {
+      case 1:
+        mQGisIface->messageBar()->pushMessage( tr( "GDAL driver error" ), tr( "Cannot open the driver for the specified format" ), QgsMessageBar::WARNING, mQGisIface->messageTimeout() );
+        return;
+      case 2:
+      case 3:
+        mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not write the raster. The heatmap was not generated." ), QgsMessageBar::WARNING, mQGisIface->messageTimeout() );
+        return;
+      case 4:
+        mQGisIface->messageBar()->pushMessage( tr( "Heatmap generation aborted" ), tr( "QGIS will now load the partially-computed raster" ), QgsMessageBar::INFO, mQGisIface->messageTimeout() );
+        break;
+      default:
+        break;
     }
-    // Finally close the dataset
-    GDALClose(( GDALDatasetH ) heatmapDS );
 
     // Open the file in QGIS window if requested
     if ( d.addToCanvas() )
@@ -345,105 +248,6 @@ double Heatmap::mapUnitsOf( double meters, QgsCoordinateReferenceSystem layerCrs
   return meters / da.measureLine( QgsPoint( 0.0, 0.0 ), QgsPoint( 0.0, 1.0 ) );
 }
 
-int Heatmap::bufferSize( double radius, double cellsize )
-{
-  // Calculate the buffer size in pixels
-
-  int buffer = radius / cellsize;
-  if ( radius - ( cellsize * buffer ) > 0.5 )
-  {
-    ++buffer;
-  }
-  return buffer;
-}
-
-double Heatmap::calculateKernelValue( double distance, int bandwidth, int kernelShape )
-{
-  switch ( kernelShape )
-  {
-    case Heatmap::Triangular:
-      return triangularKernel( distance , bandwidth );
-
-    case Heatmap::Uniform:
-      return uniformKernel( distance, bandwidth );
-
-    case Heatmap::Quartic:
-      return quarticKernel( distance, bandwidth );
-
-    case Heatmap::Triweight:
-      return triweightKernel( distance, bandwidth );
-
-    case Heatmap::Epanechnikov:
-      return epanechnikovKernel( distance, bandwidth );
-  }
-  return 0;
-
-}
-
-/* The kernel functions below are taken from "Kernel Smoothing" by Wand and Jones (1995), p. 175
- *
- * Each kernel is multiplied by a normalizing constant "k", which normalizes the kernel area
- * to 1 for a given bandwidth size.
- *
- * k is calculated by polar double integration of the kernel function
- * between a radius of 0 to the specified bandwidth and equating the area to 1. */
-
-double Heatmap::uniformKernel( double distance, int bandwidth )
-{
-  Q_UNUSED( distance );
-  // Normalizing constant
-  double k = 2. / ( M_PI * ( double )bandwidth );
-
-  // Derived from Wand and Jones (1995), p. 175
-  return k * ( 0.5 / ( double )bandwidth );
-}
-
-double Heatmap::quarticKernel( double distance, int bandwidth )
-{
-  // Normalizing constant
-  double k = 16. / ( 5. * M_PI * pow(( double )bandwidth, 2 ) );
-
-  // Derived from Wand and Jones (1995), p. 175
-  return k * ( 15. / 16. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 2 );
-}
-
-double Heatmap::triweightKernel( double distance, int bandwidth )
-{
-  // Normalizing constant
-  double k = 128. / ( 35. * M_PI * pow(( double )bandwidth, 2 ) );
-
-  // Derived from Wand and Jones (1995), p. 175
-  return k * ( 35. / 32. ) * pow( 1. - pow( distance / ( double )bandwidth, 2 ), 3 );
-}
-
-double Heatmap::epanechnikovKernel( double distance, int bandwidth )
-{
-  // Normalizing constant
-  double k = 8. / ( 3. * M_PI * pow(( double )bandwidth, 2 ) );
-
-  // Derived from Wand and Jones (1995), p. 175
-  return k * ( 3. / 4. ) * ( 1. - pow( distance / ( double )bandwidth, 2 ) );
-}
-
-double Heatmap::triangularKernel( double distance, int bandwidth )
-{
-  // Normalizing constant. In this case it's calculated a little different
-  // due to the inclusion of the non-standard "decay" parameter
-
-  if ( mDecay >= 0 )
-  {
-    double k = 3. / (( 1. + 2. * mDecay ) * M_PI * pow(( double )bandwidth, 2 ) );
-
-    // Derived from Wand and Jones (1995), p. 175 (with addition of decay parameter)
-    return k * ( 1. - ( 1. - mDecay ) * ( distance / ( double )bandwidth ) );
-  }
-  else
-  {
-    // Non-standard or mathematically valid negative decay ("coolmap")
-    return ( 1. - ( 1. - mDecay ) * ( distance / ( double )bandwidth ) );
-  }
-}
-
 // Unload the plugin by cleaning up the GUI
 void Heatmap::unload()
 {
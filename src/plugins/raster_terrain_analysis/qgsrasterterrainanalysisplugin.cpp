@@ -125,6 +125,7 @@ void QgsRasterTerrainAnalysisPlugin::hillshade()
     QString outputFile = d.outputFile();
     QgsHillshadeFilter hillshade( d.inputFile(), outputFile, d.outputFormat(), d.lightAzimuth(), d.lightAngle() );
     hillshade.setZFactor( d.zFactor() );
+    hillshade.setThreadCount( 0 );
     QProgressDialog p( tr( "Calculating hillshade..." ), tr( "Abort" ), 0, 0 );
     p.setWindowModality( Qt::WindowModal );
     hillshade.processRaster( &p );
@@ -164,6 +165,7 @@ void QgsRasterTerrainAnalysisPlugin::slope()
     QString outputFile = d.outputFile();
     QgsSlopeFilter slope( d.inputFile(), outputFile, d.outputFormat() );
     slope.setZFactor( d.zFactor() );
+    slope.setThreadCount( 0 );
     QProgressDialog p( tr( "Calculating slope..." ), tr( "Abort" ), 0, 0 );
     p.setWindowModality( Qt::WindowModal );
     slope.processRaster( &p );
@@ -183,6 +185,7 @@ void QgsRasterTerrainAnalysisPlugin::aspect()
     QString outputFile = d.outputFile();
     QgsAspectFilter aspect( d.inputFile(), outputFile, d.outputFormat() );
     aspect.setZFactor( d.zFactor() );
+    aspect.setThreadCount( 0 );
     QProgressDialog p( tr( "Calculating aspect..." ), tr( "Abort" ), 0, 0 );
     p.setWindowModality( Qt::WindowModal );
     aspect.processRaster( &p );
@@ -202,6 +205,7 @@ void QgsRasterTerrainAnalysisPlugin::ruggedness()
     QString outputFile = d.outputFile();
     QgsRuggednessFilter ruggedness( d.inputFile(), outputFile, d.outputFormat() );
     ruggedness.setZFactor( d.zFactor() );
+    ruggedness.setThreadCount( 0 );
     QProgressDialog p( tr( "Calculating ruggedness..." ), tr( "Abort" ), 0, 0 );
     p.setWindowModality( Qt::WindowModal );
     ruggedness.processRaster( &p );
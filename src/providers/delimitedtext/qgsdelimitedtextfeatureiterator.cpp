@@ -314,6 +314,11 @@ bool QgsDelimitedTextFeatureIterator::nextFeatureInternal( QgsFeature& feature )
 
     // If we are testing subset expression, then need all attributes just in case.
     // Could be more sophisticated, but probably not worth it!
+    //
+    // Only the requested attributes are converted, but the whole record is
+    // still tokenized: a quoted field may contain delimiters and line breaks,
+    // so the fields after the last requested one cannot be skipped without
+    // parsing them, and empty records are only recognised from all fields.
 
     if ( ! mTestSubset && ( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes ) )
     {
@@ -467,6 +472,8 @@ QgsDelimitedTextFeatureSource::QgsDelimitedTextFeatureSource( const QgsDelimited
 {
   mFile = new QgsDelimitedTextFile();
   mFile->setFromUrl( p->mFile->url() );
+  // Reuse the line offsets found scanning the file to jump to records
+  mFile->setLineOffsets( p->mFile->lineOffsets() );
 }
 
 QgsDelimitedTextFeatureSource::~QgsDelimitedTextFeatureSource()
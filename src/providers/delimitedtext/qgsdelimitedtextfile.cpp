@@ -28,12 +28,20 @@
 #include <QRegExp>
 #include <QUrl>
 
+// Size of the blocks read from the file
+static const int READ_BLOCK_SIZE = 1024 * 1024;
+// Interval of the lines whose offset is recorded
+static const int LINE_INDEX_INTERVAL = 64;
 
 QgsDelimitedTextFile::QgsDelimitedTextFile( QString url ) :
     mFileName( QString() ),
     mEncoding( "UTF-8" ),
     mFile( 0 ),
     mStream( 0 ),
+    mCodec( 0 ),
+    mBufferPos( 0 ),
+    mBufferOffset( 0 ),
+    mDataOffset( 0 ),
     mUseWatcher( true ),
     mWatcher( 0 ),
     mDefinitionValid( false ),
@@ -77,6 +85,9 @@ void QgsDelimitedTextFile::close()
     delete mFile;
     mFile = 0;
   }
+  mCodec = 0;
+  mBuffer.clear();
+  mBufferPos = 0;
   if ( mWatcher )
   {
     delete mWatcher;
@@ -103,11 +114,44 @@ bool QgsDelimitedTextFile::open()
     }
     if ( mFile )
     {
-      mStream = new QTextStream( mFile );
-      if ( ! mEncoding.isEmpty() )
+      // Lines are split from blocks read from the file unless the end of line is
+      // not a single byte in the file encoding (eg UTF-16), which is left to QTextStream.
+      QTextCodec *codec = mEncoding.isEmpty() ? QTextCodec::codecForLocale() : QTextCodec::codecForName( mEncoding.toAscii() );
+      mDataOffset = 0;
+      if ( codec && codec->fromUnicode( QString( "\n" ) ) == "\n" )
       {
-        QTextCodec *codec =  QTextCodec::codecForName( mEncoding.toAscii() );
-        mStream->setCodec( codec );
+        // Byte order marks detected by QTextStream
+        QByteArray head = mFile->peek( 4 );
+        if ( head.startsWith( "\xef\xbb\xbf" ) )
+        {
+          codec = QTextCodec::codecForMib( 106 );
+          mDataOffset = 3;
+        }
+        else if ( head.startsWith( "\xfe\xff" ) || head.startsWith( "\xff\xfe" ) || head.startsWith( QByteArray( "\0\0\xfe\xff", 4 ) ) )
+        {
+          codec = 0;
+        }
+      }
+      else
+      {
+        codec = 0;
+      }
+
+      if ( codec )
+      {
+        mCodec = codec;
+        mFile->seek( mDataOffset );
+        mBuffer.clear();
+        mBufferPos = 0;
+        mBufferOffset = mDataOffset;
+      }
+      else
+      {
+        mStream = new QTextStream( mFile );
+        if ( ! mEncoding.isEmpty() )
+        {
+          mStream->setCodec( QTextCodec::codecForName( mEncoding.toAscii() ) );
+        }
       }
       if ( mUseWatcher )
       {
@@ -120,9 +164,17 @@ bool QgsDelimitedTextFile::open()
   return mFile != 0;
 }
 
+void QgsDelimitedTextFile::setScanCounts( long recordCount, int maxFieldCount )
+{
+  if ( ! mFile ) reset();
+  if ( recordCount > mMaxRecordNumber ) mMaxRecordNumber = recordCount;
+  if ( maxFieldCount > mMaxFieldCount ) mMaxFieldCount = maxFieldCount;
+}
+
 void QgsDelimitedTextFile::updateFile()
 {
   close();
+  mLineOffsets.clear();
   emit( fileUpdated() );
 }
 
@@ -130,6 +182,7 @@ void QgsDelimitedTextFile::updateFile()
 void QgsDelimitedTextFile::resetDefinition()
 {
   close();
+  mLineOffsets.clear();
   mFieldNames.clear();
   mMaxFieldCount = 0;
 }
@@ -554,16 +607,15 @@ QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
   if ( ! isValid() || ! open() ) return InvalidDefinition;
 
   // Reset the file pointer
-  mStream->seek( 0 );
-  mLineNumber = 0;
+  rewindFile();
   mRecordNumber = -1;
   mRecordLineNumber = -1;
 
   // Skip header lines
+  QString buffer;
   for ( int i = mSkipLines; i-- > 0; )
   {
-    if ( mStream->readLine().isNull() ) return RecordEOF;
-    mLineNumber++;
+    if ( ! readLine( buffer ) ) return RecordEOF;
   }
   // Read the column names
   Status result = RecordOk;
@@ -579,17 +631,14 @@ QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
 
 QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bool skipBlank )
 {
-  if ( ! mStream )
+  if ( ! mFile )
   {
     Status status = reset();
     if ( status != RecordOk ) return status;
   }
 
-  while ( ! mStream->atEnd() )
+  while ( readLine( buffer ) )
   {
-    buffer = mStream->readLine();
-    if ( buffer.isNull() ) break;
-    mLineNumber++;
     if ( skipBlank && buffer.isEmpty() ) continue;
     return RecordOk;
   }
@@ -598,14 +647,84 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bo
   return RecordEOF;
 }
 
+bool QgsDelimitedTextFile::readLine( QString &buffer )
+{
+  if ( mStream )
+  {
+    if ( mStream->atEnd() ) return false;
+    buffer = mStream->readLine();
+    if ( buffer.isNull() ) return false;
+    mLineNumber++;
+    return true;
+  }
+
+  // Make sure the buffer holds a complete line, or the rest of the file
+  int eol = mBuffer.indexOf( '\n', mBufferPos );
+  while ( eol < 0 && ! mFile->atEnd() )
+  {
+    int scanned = mBuffer.size() - mBufferPos;
+    mBuffer.remove( 0, mBufferPos );
+    mBufferOffset += mBufferPos;
+    mBufferPos = 0;
+    QByteArray block = mFile->read( READ_BLOCK_SIZE );
+    if ( block.isEmpty() ) break;
+    mBuffer.append( block );
+    eol = mBuffer.indexOf( '\n', scanned );
+  }
+  if ( mBufferPos >= mBuffer.size() ) return false;
+
+  if ( mLineNumber % LINE_INDEX_INTERVAL == 0 && mLineNumber / LINE_INDEX_INTERVAL == mLineOffsets.size() )
+  {
+    mLineOffsets.append( mBufferOffset + mBufferPos );
+  }
+
+  // Like QTextStream::readLine the end of line is \n or \r\n
+  int end = eol < 0 ? mBuffer.size() : eol;
+  int length = end - mBufferPos;
+  if ( length > 0 && mBuffer.at( end - 1 ) == '\r' ) length--;
+  buffer = length > 0 ? mCodec->toUnicode( mBuffer.constData() + mBufferPos, length ) : QString( "" );
+  mBufferPos = eol < 0 ? mBuffer.size() : eol + 1;
+  mLineNumber++;
+  return true;
+}
+
+void QgsDelimitedTextFile::rewindFile()
+{
+  if ( mStream )
+  {
+    mStream->seek( 0 );
+  }
+  else
+  {
+    mFile->seek( mDataOffset );
+    mBuffer.clear();
+    mBufferPos = 0;
+    mBufferOffset = mDataOffset;
+  }
+  mLineNumber = 0;
+}
+
 bool QgsDelimitedTextFile::setNextLineNumber( long nextLineNumber )
 {
-  if ( ! mStream ) return false;
+  if ( ! mFile ) return false;
   if ( mLineNumber > nextLineNumber - 1 )
   {
     mRecordNumber = -1;
-    mStream->seek( 0 );
-    mLineNumber = 0;
+    rewindFile();
+  }
+  // Jump to the closest line with a known offset
+  if ( mCodec )
+  {
+    int index = qMin(( nextLineNumber - 1 ) / LINE_INDEX_INTERVAL, ( long ) mLineOffsets.size() - 1 );
+    if ( index > 0 && index * LINE_INDEX_INTERVAL > mLineNumber )
+    {
+      mRecordNumber = -1;
+      mFile->seek( mLineOffsets[index] );
+      mBuffer.clear();
+      mBufferPos = 0;
+      mBufferOffset = mLineOffsets[index];
+      mLineNumber = index * LINE_INDEX_INTERVAL;
+    }
   }
   QString buffer;
   while ( mLineNumber < nextLineNumber - 1 )
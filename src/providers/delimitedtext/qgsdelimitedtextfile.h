@@ -21,11 +21,13 @@
 #include <QStringList>
 #include <QRegExp>
 #include <QUrl>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
 class QFile;
 class QFileSystemWatcher;
+class QTextCodec;
 class QTextStream;
 
 
@@ -260,6 +262,12 @@ class QgsDelimitedTextFile : public QObject
      *  @return maxRecordNumber The maximum record number
      */
     long recordCount() { return mMaxRecordNumber; }
+
+    /** Maximum number of fields found in a record, including records
+     *  with more fields than the header
+     *  @return maxFieldCount The largest number of fields read
+     */
+    int maxFieldCount() { return mMaxFieldCount; }
     /** Reset the file to reread from the beginning
      */
     Status reset();
@@ -295,6 +303,27 @@ class QgsDelimitedTextFile : public QObject
 
     void setUseWatcher( bool useWatcher );
 
+    /** Return the file offsets of every 64th line found while reading the file.
+     *  Only collected when the file is read in blocks rather than through a
+     *  QTextStream (encodings with a single byte end of line).
+     *  @return offsets The byte offsets of lines 1, 65, 129, ...
+     */
+    QVector<qint64> lineOffsets() const { return mLineOffsets; }
+
+    /** Set the line offsets found by another parser of the same file, so that
+     *  records can be located without reading the file up to them.
+     *  @param offsets The offsets returned by lineOffsets()
+     */
+    void setLineOffsets( const QVector<qint64> &offsets ) { mLineOffsets = offsets; }
+
+    /** Set the record and field counts found by an earlier scan of the
+     *  same file, as returned by recordCount() and maxFieldCount().
+     *  Opens the file, as opening it clears the counts.
+     *  @param recordCount The number of records in the file
+     *  @param maxFieldCount The largest number of fields in a record
+     */
+    void setScanCounts( long recordCount, int maxFieldCount );
+
   signals:
     /** Signal sent when the file is updated by another process
      */
@@ -337,6 +366,15 @@ class QgsDelimitedTextFile : public QObject
      */
     bool setNextLineNumber( long nextLineNumber );
 
+    /** Read the next line of the file and increment the line number.
+     *  @return false at the end of the file
+     */
+    bool readLine( QString &buffer );
+
+    /** Move back to the first line of the file
+     */
+    void rewindFile();
+
     /** Utility routine to add a field to a record, accounting for trimming
      *  and discarding, and maximum field count
      */
@@ -348,7 +386,15 @@ class QgsDelimitedTextFile : public QObject
     QString mFileName;
     QString mEncoding;
     QFile *mFile;
+    // Text stream, only used if the end of line is not a single byte in the
+    // file encoding.  Otherwise lines are split from blocks read from mFile
     QTextStream *mStream;
+    QTextCodec *mCodec;
+    QByteArray mBuffer;
+    int mBufferPos;
+    qint64 mBufferOffset;
+    qint64 mDataOffset;
+    QVector<qint64> mLineOffsets;
     bool mUseWatcher;
     QFileSystemWatcher *mWatcher;
 
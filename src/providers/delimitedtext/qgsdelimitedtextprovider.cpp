@@ -18,15 +18,20 @@
 #include "qgsdelimitedtextprovider.h"
 
 #include <QtGlobal>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QDataStream>
 #include <QTextStream>
 #include <QStringList>
 #include <QMessageBox>
+#include <QTemporaryFile>
 #include <QSettings>
 #include <QRegExp>
 #include <QUrl>
+#include <QtConcurrentMap>
 
 #include "qgsapplication.h"
 #include "qgsdataprovider.h"
@@ -52,6 +57,15 @@ static const QString TEXT_PROVIDER_DESCRIPTION = "Delimited text data provider";
 // iterate over records rather than simple iterator and filter.
 
 static const int SUBSET_ID_THRESHOLD_FACTOR = 10;
+// Number of records read before their geometries and values are parsed in
+// parallel during the initial scan of the file
+static const int SCAN_BATCH_SIZE = 10000;
+// The results of the scan of files of at least this size are kept in the
+// settings directory, so that the file is not scanned again when the layer
+// is loaded the next time
+static const qint64 SCAN_CACHE_MIN_FILE_SIZE = 10 * 1024 * 1024;
+// Incremented whenever the content of the scan cache files changes
+static const qint32 SCAN_CACHE_VERSION = 2;
 
 QRegExp QgsDelimitedTextProvider::WktPrefixRegexp( "^\\s*(?:\\d+\\s+|SRID\\=\\d+\\;)", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::WktZMRegexp( "\\s*(?:z|m|zm)(?=\\s*\\()", Qt::CaseInsensitive );
@@ -305,6 +319,93 @@ bool QgsDelimitedTextProvider::createSpatialIndex()
   return true;
 }
 
+QgsDelimitedTextProvider::ScanRecord::ScanRecord()
+    : status( QgsDelimitedTextFile::RecordOk )
+    , recordId( -1 )
+    , geometryEmpty( false )
+    , geometry( 0 )
+    , wktHasPrefix( false )
+    , wktHasZM( false )
+    , pointOk( false )
+{
+}
+
+QgsDelimitedTextProvider::ScanParser::ScanParser( const QgsDelimitedTextProvider *provider, const QList<bool> &isEmpty, const QList<bool> &couldBeInt, const QList<bool> &couldBeDouble )
+    : mProvider( provider )
+    , mIsEmpty( isEmpty )
+    , mCouldBeInt( couldBeInt )
+    , mCouldBeDouble( couldBeDouble )
+    , mWktHasPrefix( provider->mWktHasPrefix )
+    , mWktHasZM( provider->mWktHasZM )
+{
+}
+
+void QgsDelimitedTextProvider::ScanParser::operator()( ScanRecord &record ) const
+{
+  if ( record.status != QgsDelimitedTextFile::RecordOk || recordIsEmpty( record.parts ) )
+    return;
+
+  QStringList &parts = record.parts;
+
+  if ( mProvider->mGeomRep == GeomAsWkt )
+  {
+    int wktFieldIndex = mProvider->mWktFieldIndex;
+    if ( wktFieldIndex >= parts.size() || parts[wktFieldIndex].isEmpty() )
+    {
+      record.geometryEmpty = true;
+    }
+    else
+    {
+      // The static expressions are not used directly, QString::indexOf updates them
+      QString sWkt = parts[wktFieldIndex];
+      QRegExp prefixRegexp( WktPrefixRegexp );
+      QRegExp zmRegexp( WktZMRegexp );
+      record.wktHasPrefix = sWkt.indexOf( prefixRegexp ) >= 0;
+      record.wktHasZM = sWkt.indexOf( zmRegexp ) >= 0;
+      record.geometry = geomFromWkt( sWkt, mWktHasPrefix || record.wktHasPrefix, mWktHasZM || record.wktHasZM );
+    }
+  }
+  else if ( mProvider->mGeomRep == GeomAsXy )
+  {
+    QString sX = mProvider->mXFieldIndex < parts.size() ? parts[mProvider->mXFieldIndex] : "";
+    QString sY = mProvider->mYFieldIndex < parts.size() ? parts[mProvider->mYFieldIndex] : "";
+    if ( sX.isEmpty() && sY.isEmpty() )
+    {
+      record.geometryEmpty = true;
+    }
+    else
+    {
+      record.pointOk = pointFromXY( sX, sY, record.point, mProvider->mDecimalPoint, mProvider->mXyDms );
+    }
+  }
+
+  // Try to convert attribute values to integer and double, unless
+  // earlier records already ruled out the type
+
+  record.couldBeInt.fill( false, parts.size() );
+  record.couldBeDouble.fill( false, parts.size() );
+  for ( int i = 0; i < parts.size(); i++ )
+  {
+    QString &value = parts[i];
+    if ( value.isEmpty() )
+      continue;
+
+    bool known = i < mIsEmpty.size() && ! mIsEmpty[i];
+    if ( ! known || mCouldBeInt[i] )
+    {
+      value.toInt( &record.couldBeInt[i] );
+    }
+    if ( ! known || mCouldBeDouble[i] )
+    {
+      if ( ! mProvider->mDecimalPoint.isEmpty() )
+      {
+        value.replace( mProvider->mDecimalPoint, "." );
+      }
+      value.toDouble( &record.couldBeDouble[i] );
+    }
+  }
+}
+
 // Really want to merge scanFile and rescan into single code.  Currently the reason
 // this is not done is that scanFile is done initially to create field names and, rescan
 // file includes building subset expression and assumes field names/types are already
@@ -379,6 +480,18 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
     return;
   }
 
+  // Use the results of an earlier scan of a large file if neither the file
+  // nor the layer definition have changed since
+
+  QByteArray cacheKey = scanCacheKey();
+  if ( ! cacheKey.isEmpty() && loadScanCache( cacheKey, buildIndexes ) )
+  {
+    connect( mFile, SIGNAL( fileUpdated() ), this, SLOT( onFileUpdated() ) );
+    return;
+  }
+  bool saveCache = buildIndexes && ! cacheKey.isEmpty();
+  QList< QPair<QgsFeatureId, QgsRectangle> > spatialIndexEntries;
+
   // Scan the entire file to determine
   // 1) the number of fields (this is handled by QgsDelimitedTextFile mFile
   // 2) the number of valid features.  Note that the selection of valid features
@@ -388,7 +501,6 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   //
   // Also build subset and spatial indexes.
 
-  QStringList parts;
   long nEmptyRecords = 0;
   long nBadFormatRecords = 0;
   long nIncompatibleGeometry = 0;
@@ -401,113 +513,128 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   QList<bool> couldBeInt;
   QList<bool> couldBeDouble;
 
-  while ( true )
+  // Records are read sequentially, parsed in batches on worker threads and then
+  // accumulated in file order, so that results and messages don't depend on
+  // the number of threads.
+
+  QVector<ScanRecord> batch;
+  bool atEnd = false;
+  while ( ! atEnd )
   {
-    QgsDelimitedTextFile::Status status = mFile->nextRecord( parts );
-    if ( status == QgsDelimitedTextFile::RecordEOF ) break;
-    if ( status != QgsDelimitedTextFile::RecordOk )
-    {
-      nBadFormatRecords++;
-      recordInvalidLine( tr( "Invalid record format at line %1" ) );
-      continue;
-    }
-    // Skip over empty records
-    if ( recordIsEmpty( parts ) )
+    batch.clear();
+    while ( batch.size() < SCAN_BATCH_SIZE )
     {
-      nEmptyRecords++;
-      continue;
+      ScanRecord record;
+      record.status = mFile->nextRecord( record.parts );
+      if ( record.status == QgsDelimitedTextFile::RecordEOF )
+      {
+        atEnd = true;
+        break;
+      }
+      record.recordId = mFile->recordId();
+      batch.append( record );
     }
 
-    // Check geometries are valid
-    bool geomValid = true;
+    ScanParser parser( this, isEmpty, couldBeInt, couldBeDouble );
+    QtConcurrent::blockingMap( batch, parser );
 
-    if ( mGeomRep == GeomAsWkt )
+    for ( int r = 0; r < batch.size(); r++ )
     {
-      if ( mWktFieldIndex >= parts.size() || parts[mWktFieldIndex].isEmpty() )
+      ScanRecord &record = batch[r];
+      if ( record.status != QgsDelimitedTextFile::RecordOk )
       {
-        nEmptyGeometry++;
-        geomValid = false;
+        nBadFormatRecords++;
+        recordInvalidLine( tr( "Invalid record format at line %1" ), record.recordId );
+        continue;
       }
-      else
+      // Skip over empty records
+      if ( recordIsEmpty( record.parts ) )
+      {
+        nEmptyRecords++;
+        continue;
+      }
+
+      // Check geometries are valid
+      bool geomValid = true;
+
+      if ( mGeomRep == GeomAsWkt )
       {
-        // Get the wkt - confirm it is valid, get the type, and
-        // if compatible with the rest of file, add to the extents
-
-        QString sWkt = parts[mWktFieldIndex];
-        QgsGeometry *geom = 0;
-        if ( !mWktHasPrefix && sWkt.indexOf( WktPrefixRegexp ) >= 0 )
-          mWktHasPrefix = true;
-        if ( !mWktHasZM && sWkt.indexOf( WktZMRegexp ) >= 0 )
-          mWktHasZM = true;
-        geom = geomFromWkt( sWkt, mWktHasPrefix, mWktHasZM );
-
-        if ( geom )
+        if ( record.geometryEmpty )
         {
-          QGis::WkbType type = geom->wkbType();
-          if ( type != QGis::WKBNoGeometry )
+          nEmptyGeometry++;
+          geomValid = false;
+        }
+        else
+        {
+          // Confirm the wkt is valid, get the type, and
+          // if compatible with the rest of file, add to the extents
+
+          QgsGeometry *geom = record.geometry;
+          record.geometry = 0;
+          if ( record.wktHasPrefix )
+            mWktHasPrefix = true;
+          if ( record.wktHasZM )
+            mWktHasZM = true;
+
+          if ( geom )
           {
-            if ( mGeometryType == QGis::UnknownGeometry || geom->type() == mGeometryType )
+            QGis::WkbType type = geom->wkbType();
+            if ( type != QGis::WKBNoGeometry )
             {
-              mGeometryType = geom->type();
-              if ( mNumberFeatures == 0 )
+              if ( mGeometryType == QGis::UnknownGeometry || geom->type() == mGeometryType )
               {
-                mNumberFeatures++;
-                mWkbType = type;
-                mExtent = geom->boundingBox();
+                mGeometryType = geom->type();
+                if ( mNumberFeatures == 0 )
+                {
+                  mNumberFeatures++;
+                  mWkbType = type;
+                  mExtent = geom->boundingBox();
+                }
+                else
+                {
+                  mNumberFeatures++;
+                  if ( geom->isMultipart() ) mWkbType = type;
+                  QgsRectangle bbox( geom->boundingBox() );
+                  mExtent.combineExtentWith( &bbox );
+                }
+                if ( buildSpatialIndex )
+                {
+                  QgsFeature f;
+                  f.setFeatureId( record.recordId );
+                  f.setGeometry( geom );
+                  mSpatialIndex->insertFeature( f );
+                  if ( saveCache ) spatialIndexEntries.append( qMakePair(( QgsFeatureId ) record.recordId, geom->boundingBox() ) );
+                  // Feature now has ownership of geometry, so set to null
+                  // here to avoid deleting twice.
+                  geom = 0;
+                }
               }
               else
               {
-                mNumberFeatures++;
-                if ( geom->isMultipart() ) mWkbType = type;
-                QgsRectangle bbox( geom->boundingBox() );
-                mExtent.combineExtentWith( &bbox );
-              }
-              if ( buildSpatialIndex )
-              {
-                QgsFeature f;
-                f.setFeatureId( mFile->recordId() );
-                f.setGeometry( geom );
-                mSpatialIndex->insertFeature( f );
-                // Feature now has ownership of geometry, so set to null
-                // here to avoid deleting twice.
-                geom = 0;
+                nIncompatibleGeometry++;
+                geomValid = false;
               }
             }
-            else
-            {
-              nIncompatibleGeometry++;
-              geomValid = false;
-            }
+            if ( geom ) delete geom;
+          }
+          else
+          {
+            geomValid = false;
+            nInvalidGeometry++;
+            recordInvalidLine( tr( "Invalid WKT at line %1" ), record.recordId );
           }
-          if ( geom ) delete geom;
         }
-        else
+      }
+      else if ( mGeomRep == GeomAsXy )
+      {
+        if ( record.geometryEmpty )
         {
           geomValid = false;
-          nInvalidGeometry++;
-          recordInvalidLine( tr( "Invalid WKT at line %1" ) );
+          nEmptyGeometry++;
         }
-      }
-    }
-    else if ( mGeomRep == GeomAsXy )
-    {
-      // Get the x and y values, first checking to make sure they
-      // aren't null.
-
-      QString sX = mXFieldIndex < parts.size() ? parts[mXFieldIndex] : "";
-      QString sY = mYFieldIndex < parts.size() ? parts[mYFieldIndex] : "";
-      if ( sX.isEmpty() && sY.isEmpty() )
-      {
-        geomValid = false;
-        nEmptyGeometry++;
-      }
-      else
-      {
-        QgsPoint pt;
-        bool ok = pointFromXY( sX, sY, pt, mDecimalPoint, mXyDms );
-
-        if ( ok )
+        else if ( record.pointOk )
         {
+          QgsPoint &pt = record.point;
           if ( mNumberFeatures > 0 )
           {
             mExtent.combineExtentWith( pt.x(), pt.y() );
@@ -523,64 +650,51 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
           if ( buildSpatialIndex )
           {
             QgsFeature f;
-            f.setFeatureId( mFile->recordId() );
+            f.setFeatureId( record.recordId );
             f.setGeometry( QgsGeometry::fromPoint( pt ) );
             mSpatialIndex->insertFeature( f );
+            if ( saveCache ) spatialIndexEntries.append( qMakePair(( QgsFeatureId ) record.recordId, QgsRectangle( pt, pt ) ) );
           }
         }
         else
         {
           geomValid = false;
           nInvalidGeometry++;
-          recordInvalidLine( tr( "Invalid X or Y fields at line %1" ) );
+          recordInvalidLine( tr( "Invalid X or Y fields at line %1" ), record.recordId );
         }
       }
-    }
-    else
-    {
-      mWkbType = QGis::WKBNoGeometry;
-      mNumberFeatures++;
-    }
-
-    if ( ! geomValid ) continue;
+      else
+      {
+        mWkbType = QGis::WKBNoGeometry;
+        mNumberFeatures++;
+      }
 
-    if ( buildSubsetIndex ) mSubsetIndex.append( mFile->recordId() );
+      if ( ! geomValid ) continue;
 
+      if ( buildSubsetIndex ) mSubsetIndex.append( record.recordId );
 
-    // If we are going to use this record, then assess the potential types of each colum
 
-    for ( int i = 0; i < parts.size(); i++ )
-    {
+      // If we are going to use this record, then assess the potential types of each colum
 
-      QString &value = parts[i];
-      if ( value.isEmpty() )
-        continue;
-
-      // try to convert attribute values to integer and double
-
-      while ( couldBeInt.size() <= i )
-      {
-        isEmpty.append( true );
-        couldBeInt.append( false );
-        couldBeDouble.append( false );
-      }
-      if ( isEmpty[i] )
-      {
-        isEmpty[i] = false;
-        couldBeInt[i] = true;
-        couldBeDouble[i] = true;
-      }
-      if ( couldBeInt[i] )
-      {
-        value.toInt( &couldBeInt[i] );
-      }
-      if ( couldBeDouble[i] )
+      for ( int i = 0; i < record.parts.size(); i++ )
       {
-        if ( ! mDecimalPoint.isEmpty() )
+        if ( record.parts[i].isEmpty() )
+          continue;
+
+        while ( couldBeInt.size() <= i )
         {
-          value.replace( mDecimalPoint, "." );
+          isEmpty.append( true );
+          couldBeInt.append( false );
+          couldBeDouble.append( false );
         }
-        value.toDouble( &couldBeDouble[i] );
+        if ( isEmpty[i] )
+        {
+          isEmpty[i] = false;
+          couldBeInt[i] = true;
+          couldBeDouble[i] = true;
+        }
+        couldBeInt[i] = couldBeInt[i] && record.couldBeInt[i];
+        couldBeDouble[i] = couldBeDouble[i] && record.couldBeDouble[i];
       }
     }
   }
@@ -650,8 +764,6 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   if ( nIncompatibleGeometry > 0 )
     warnings.append( tr( "%1 records discarded due to incompatible geometry types" ).arg( nIncompatibleGeometry ) );
 
-  reportErrors( warnings );
-
   // Decide whether to use subset ids to index records rather than simple iteration through all
   // If more than 10% of records are being skipped, then use index.  (Not based on any experimentation,
   // could do with some analysis?)
@@ -669,12 +781,215 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   mValid = mGeometryType != QGis::UnknownGeometry;
   mLayerValid = mValid;
 
+  if ( saveCache ) saveScanCache( cacheKey, warnings, spatialIndexEntries );
+
+  reportErrors( warnings );
+
   // If it is valid, then watch for changes to the file
   connect( mFile, SIGNAL( fileUpdated() ), this, SLOT( onFileUpdated() ) );
 
 
 }
 
+QString QgsDelimitedTextProvider::scanCacheFileName() const
+{
+  QByteArray path = QFileInfo( mFile->fileName() ).absoluteFilePath().toUtf8();
+  return QgsApplication::qgisSettingsDirPath() + "cache/delimitedtext/" +
+         QCryptographicHash::hash( path, QCryptographicHash::Md5 ).toHex();
+}
+
+QByteArray QgsDelimitedTextProvider::scanCacheKey() const
+{
+  QFileInfo info( mFile->fileName() );
+  if ( info.size() < SCAN_CACHE_MIN_FILE_SIZE ) return QByteArray();
+
+  // The key covers everything the results of the scan depend on: the
+  // layer definition, the data file and the optional .csvt file
+
+  QFileInfo csvtInfo( mFile->fileName() + 't' );
+  if ( ! csvtInfo.exists() ) csvtInfo.setFile( mFile->fileName() + 'T' );
+
+  QStringList parts;
+  parts << QString::number( SCAN_CACHE_VERSION )
+  << QString::fromAscii( mFile->url().toEncoded() )
+  << QString::number( mGeomRep )
+  << mWktFieldName << mXFieldName << mYFieldName
+  << QString::number( mGeometryType )
+  << mDecimalPoint
+  << QString::number( mXyDms )
+  << QString::number( mBuildSubsetIndex )
+  << QString::number( mBuildSpatialIndex )
+  << QString::number( info.size() )
+  << QString::number( info.lastModified().toMSecsSinceEpoch() );
+  if ( csvtInfo.exists() )
+  {
+    parts << QString::number( csvtInfo.size() )
+    << QString::number( csvtInfo.lastModified().toMSecsSinceEpoch() );
+  }
+
+  return QCryptographicHash::hash( parts.join( "\n" ).toUtf8(), QCryptographicHash::Md5 );
+}
+
+bool QgsDelimitedTextProvider::loadScanCache( const QByteArray &key, bool buildIndexes )
+{
+  QFile file( scanCacheFileName() );
+  if ( ! file.open( QIODevice::ReadOnly ) ) return false;
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_7 );
+
+  qint32 version;
+  QByteArray cachedKey;
+  in >> version >> cachedKey;
+  if ( in.status() != QDataStream::Ok || version != SCAN_CACHE_VERSION || cachedKey != key )
+  {
+    QgsDebugMsg( "Delimited text scan cache is out of date: " + file.fileName() );
+    return false;
+  }
+
+  QgsFields fields;
+  qint32 nFields;
+  in >> nFields;
+  for ( int i = 0; i < nFields && in.status() == QDataStream::Ok; i++ )
+  {
+    QString name, typeName;
+    qint32 type;
+    in >> name >> type >> typeName;
+    fields.append( QgsField( name, ( QVariant::Type ) type, typeName ) );
+  }
+
+  QList<int> columns;
+  qint32 fieldCount, maxFieldCount, wkbType, geometryType, nExtraInvalidLines;
+  qint64 numberFeatures, recordCount;
+  double xMin, yMin, xMax, yMax;
+  bool wktHasPrefix, wktHasZM, useSubsetIndex;
+  QList<qint64> subsetIndex;
+  QVector<qint64> lineOffsets;
+  QStringList warnings, invalidLines;
+  qint32 nSpatialIndexEntries;
+
+  in >> columns >> fieldCount >> numberFeatures
+  >> recordCount >> maxFieldCount
+  >> xMin >> yMin >> xMax >> yMax
+  >> wkbType >> geometryType >> wktHasPrefix >> wktHasZM
+  >> useSubsetIndex >> subsetIndex >> lineOffsets
+  >> warnings >> invalidLines >> nExtraInvalidLines
+  >> nSpatialIndexEntries;
+
+  if ( in.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( "Delimited text scan cache is invalid: " + file.fileName() );
+    return false;
+  }
+  QgsRectangle extent( xMin, yMin, xMax, yMax );
+
+  if ( buildIndexes && mSpatialIndex )
+  {
+    for ( int i = 0; i < nSpatialIndexEntries && in.status() == QDataStream::Ok; i++ )
+    {
+      qint64 id;
+      in >> id >> xMin >> yMin >> xMax >> yMax;
+      QgsFeature f;
+      f.setFeatureId( id );
+      f.setGeometry( QgsGeometry::fromRect( QgsRectangle( xMin, yMin, xMax, yMax ) ) );
+      mSpatialIndex->insertFeature( f );
+    }
+    if ( in.status() != QDataStream::Ok )
+    {
+      QgsDebugMsg( "Delimited text scan cache is invalid: " + file.fileName() );
+      resetIndexes();
+      return false;
+    }
+    mUseSpatialIndex = true;
+  }
+
+  if ( buildIndexes && useSubsetIndex )
+  {
+    mUseSubsetIndex = true;
+    foreach ( qint64 id, subsetIndex )
+      mSubsetIndex.append(( quintptr ) id );
+  }
+
+  attributeFields = fields;
+  attributeColumns = columns;
+  mFieldCount = fieldCount;
+  mNumberFeatures = numberFeatures;
+  mExtent = extent;
+  mWkbType = ( QGis::WkbType ) wkbType;
+  mGeometryType = ( QGis::GeometryType ) geometryType;
+  mWktHasPrefix = wktHasPrefix;
+  mWktHasZM = wktHasZM;
+  mFile->setLineOffsets( lineOffsets );
+  // The file has not been read, rescanFile() needs the record count
+  mFile->setScanCounts(( long ) recordCount, maxFieldCount );
+
+  mInvalidLines = invalidLines;
+  mNExtraInvalidLines = nExtraInvalidLines;
+
+  QgsDebugMsg( "Loaded delimited text scan results from " + file.fileName() );
+
+  mValid = mGeometryType != QGis::UnknownGeometry;
+  mLayerValid = mValid;
+
+  reportErrors( warnings );
+  return true;
+}
+
+void QgsDelimitedTextProvider::saveScanCache( const QByteArray &key, const QStringList &warnings,
+    const QList< QPair<QgsFeatureId, QgsRectangle> > &spatialIndexEntries )
+{
+  QString fileName = scanCacheFileName();
+  if ( ! QDir().mkpath( QFileInfo( fileName ).absolutePath() ) ) return;
+
+  // Write to a temporary file first, so that another instance loading the
+  // same file never reads a partial cache
+
+  QTemporaryFile file( fileName + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( ! file.open() ) return;
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_7 );
+
+  out << SCAN_CACHE_VERSION << key;
+
+  out << ( qint32 ) attributeFields.count();
+  for ( int i = 0; i < attributeFields.count(); i++ )
+  {
+    const QgsField &field = attributeFields[i];
+    out << field.name() << ( qint32 ) field.type() << field.typeName();
+  }
+
+  QList<qint64> subsetIndex;
+  foreach ( quintptr id, mSubsetIndex )
+    subsetIndex.append(( qint64 ) id );
+
+  out << attributeColumns << ( qint32 ) mFieldCount << ( qint64 ) mNumberFeatures
+  << ( qint64 ) mFile->recordCount() << ( qint32 ) mFile->maxFieldCount()
+  << mExtent.xMinimum() << mExtent.yMinimum() << mExtent.xMaximum() << mExtent.yMaximum()
+  << ( qint32 ) mWkbType << ( qint32 ) mGeometryType << mWktHasPrefix << mWktHasZM
+  << mUseSubsetIndex << subsetIndex << mFile->lineOffsets()
+  << warnings << mInvalidLines << ( qint32 ) mNExtraInvalidLines;
+
+  out << ( qint32 ) spatialIndexEntries.size();
+  for ( int i = 0; i < spatialIndexEntries.size(); i++ )
+  {
+    const QgsRectangle &bbox = spatialIndexEntries[i].second;
+    out << ( qint64 ) spatialIndexEntries[i].first
+    << bbox.xMinimum() << bbox.yMinimum() << bbox.xMaximum() << bbox.yMaximum();
+  }
+
+  file.close();
+  if ( out.status() != QDataStream::Ok || file.error() != QFile::NoError )
+  {
+    QgsDebugMsg( "Could not write delimited text scan cache " + fileName );
+    file.remove();
+    return;
+  }
+  QFile::remove( fileName );
+  if ( ! file.rename( fileName ) ) file.remove();
+}
+
 // rescanFile.  Called if something has changed file definition, such as
 // selecting a subset, the file has been changed by another program, etc
 
@@ -888,11 +1203,11 @@ bool QgsDelimitedTextProvider::recordIsEmpty( QStringList &record )
   return true;
 }
 
-void QgsDelimitedTextProvider::recordInvalidLine( QString message )
+void QgsDelimitedTextProvider::recordInvalidLine( QString message, long recordId )
 {
   if ( mInvalidLines.size() < mMaxInvalidLines )
   {
-    mInvalidLines.append( message.arg( mFile->recordId() ) );
+    mInvalidLines.append( message.arg( recordId ) );
   }
   else
   {
@@ -21,13 +21,14 @@
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
 #include "qgsdelimitedtextfile.h"
+#include "qgspoint.h"
 
 #include <QStringList>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
 class QgsGeometry;
-class QgsPoint;
 class QFile;
 class QTextStream;
 
@@ -225,8 +226,20 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     void resetCachedSubset();
     void resetIndexes();
     void clearInvalidLines();
-    void recordInvalidLine( QString message );
+    void recordInvalidLine( QString message, long recordId );
     void reportErrors( QStringList messages = QStringList(), bool showDialog = true );
+
+    /** Name of the file in the settings directory keeping the results of the scan of the data file */
+    QString scanCacheFileName() const;
+    /** Checksum of the layer definition, the data file and the .csvt file size and modification time,
+     *  or an empty array if the file is too small for the scan results to be kept */
+    QByteArray scanCacheKey() const;
+    /** Restores the results of an earlier scan if the cache file matches the key.
+     *  @return true if the layer is set up from the cache and the file doesn't need to be scanned */
+    bool loadScanCache( const QByteArray &key, bool buildIndexes );
+    /** Writes the results of a complete scan, with the bounding boxes of the spatial index entries */
+    void saveScanCache( const QByteArray &key, const QStringList &warnings,
+                        const QList< QPair<QgsFeatureId, QgsRectangle> > &spatialIndexEntries );
     static bool recordIsEmpty( QStringList &record );
     void setUriParameter( QString parameter, QString value );
 
@@ -235,6 +248,42 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     static bool pointFromXY( QString &sX, QString &sY, QgsPoint &point, const QString& decimalPoint, bool xyDms );
     static double dmsStringToDouble( const QString &sX, bool *xOk );
 
+    /** A record read during the scan of the file, with its geometry and
+     *  the types its values could be converted to */
+    struct ScanRecord
+    {
+      ScanRecord();
+
+      QgsDelimitedTextFile::Status status;
+      long recordId;
+      QStringList parts;
+      bool geometryEmpty;
+      QgsGeometry *geometry;
+      bool wktHasPrefix;
+      bool wktHasZM;
+      QgsPoint point;
+      bool pointOk;
+      QVector<bool> couldBeInt;
+      QVector<bool> couldBeDouble;
+    };
+
+    /** Parses a batch of scanned records on worker threads */
+    class ScanParser
+    {
+      public:
+        ScanParser( const QgsDelimitedTextProvider *provider, const QList<bool> &isEmpty, const QList<bool> &couldBeInt, const QList<bool> &couldBeDouble );
+        void operator()( ScanRecord &record ) const;
+
+      private:
+        const QgsDelimitedTextProvider *mProvider;
+        // Column types found in the previous batches
+        QList<bool> mIsEmpty;
+        QList<bool> mCouldBeInt;
+        QList<bool> mCouldBeDouble;
+        bool mWktHasPrefix;
+        bool mWktHasZM;
+    };
+
     // mLayerValid defines whether the layer has been loaded as a valid layer
     bool mLayerValid;
     // mValid defines whether the layer is currently valid (may differ from
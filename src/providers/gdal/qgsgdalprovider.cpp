@@ -19,6 +19,8 @@
 #include "qgslogger.h"
 #include "qgsgdalproviderbase.h"
 #include "qgsgdalprovider.h"
+#include "qgsgdalpyramidbuilder.h"
+#include "qgsgdalstatistics.h"
 #include "qgsconfig.h"
 
 #include "qgsapplication.h"
@@ -49,6 +51,8 @@
 #include <QTextDocument>
 #include <QDebug>
 
+#include <limits>
+
 #include "gdalwarper.h"
 #include "ogr_spatialref.h"
 #include "cpl_conv.h"
@@ -1617,10 +1621,23 @@ QString QgsGdalProvider::buildPyramids( const QList<QgsRasterPyramid> & theRaste
     QgsGdalProgress myProg;
     myProg.type = QgsRaster::ProgressPyramids;
     myProg.provider = this;
-    myError = GDALBuildOverviews( mGdalBaseDataset, theMethod,
-                                  myOverviewLevelsVector.size(), myOverviewLevelsVector.data(),
-                                  0, NULL,
-                                  progressCallback, &myProg ); //this is the arg for the gdal progress callback
+    // GDAL_NUM_THREADS (config option) > 1 computes the levels in parallel tiles
+    int myThreads = QgsGdalPyramidBuilder::threadCountFromConfig();
+    if ( myThreads > 1 && theFormat != QgsRaster::PyramidsErdas &&
+         QgsGdalPyramidBuilder::supportsMethod( theResamplingMethod ) )
+    {
+      QgsDebugMsg( QString( "Building overviews on %1 threads" ).arg( myThreads ) );
+      QgsGdalPyramidBuilder myBuilder( mGdalBaseDataset );
+      myBuilder.setThreadCount( myThreads );
+      myError = myBuilder.build( theResamplingMethod, myOverviewLevelsVector, progressCallback, &myProg );
+    }
+    else
+    {
+      myError = GDALBuildOverviews( mGdalBaseDataset, theMethod,
+                                    myOverviewLevelsVector.size(), myOverviewLevelsVector.data(),
+                                    0, NULL,
+                                    progressCallback, &myProg ); //this is the arg for the gdal progress callback
+    }
 
     if ( myError == CE_Failure || CPLGetLastErrorNo() == CPLE_NotSupported )
     {
@@ -2215,6 +2232,7 @@ bool QgsGdalProvider::hasStatistics( int theBandNo,
   QgsRasterBandStats myRasterBandStats;
   initStatistics( myRasterBandStats, theBandNo, theStats, theExtent, theSampleSize );
 
+  // Neither stored nor GDAL statistics know about custom no data values
   if (( srcHasNoDataValue( theBandNo ) && !useSrcNoDataValue( theBandNo ) ) ||
       userNoDataValues( theBandNo ).size() > 0 )
   {
@@ -2222,6 +2240,19 @@ bool QgsGdalProvider::hasStatistics( int theBandNo,
     return false;
   }
 
+  // Exact statistics stored by a previous calculation with the same source no data value
+  if ( myRasterBandStats.extent == extent() && !approximateStatistics( theSampleSize ) )
+  {
+    QgsGdalStatisticsAccumulator myAccumulator;
+    GDALRasterBandH myBaseBand = GDALGetRasterBand( mGdalBaseDataset, theBandNo );
+    if ( myBaseBand && QgsGdalStatisticsCalculator::readPersisted( myBaseBand, srcHasNoDataValue( theBandNo ) && useSrcNoDataValue( theBandNo ),
+         srcNoDataValue( theBandNo ), myAccumulator ) )
+    {
+      QgsDebugMsg( "Has persisted exact statistics" );
+      return true;
+    }
+  }
+
   // If not cached, check if supported by GDAL
   int supportedStats = QgsRasterBandStats::Min | QgsRasterBandStats::Max
                        | QgsRasterBandStats::Range | QgsRasterBandStats::Mean
@@ -2242,14 +2273,7 @@ bool QgsGdalProvider::hasStatistics( int theBandNo,
     return false;
   }
 
-  int bApproxOK = false;
-  if ( theSampleSize > 0 )
-  {
-    if ((( double )xSize() * ( double )ySize() / theSampleSize ) > 2 )  // not perfect
-    {
-      bApproxOK = true;
-    }
-  }
+  int bApproxOK = approximateStatistics( theSampleSize );
 
   // Params in GDALGetRasterStatistics must not be NULL otherwise GDAL returns
   // without error even if stats are not cached
@@ -2309,12 +2333,8 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
 
   // We cannot use GDAL stats if user disabled src no data value or set
   // custom  no data values
-  if (( srcHasNoDataValue( theBandNo ) && !useSrcNoDataValue( theBandNo ) ) ||
-      userNoDataValues( theBandNo ).size() > 0 )
-  {
-    QgsDebugMsg( "Custom no data values, using generic statistics." );
-    return QgsRasterDataProvider::bandStatistics( theBandNo, theStats, theExtent, theSampleSize );
-  }
+  bool myCustomNoData = ( srcHasNoDataValue( theBandNo ) && !useSrcNoDataValue( theBandNo ) ) ||
+                        userNoDataValues( theBandNo ).size() > 0;
 
   int supportedStats = QgsRasterBandStats::Min | QgsRasterBandStats::Max
                        | QgsRasterBandStats::Range | QgsRasterBandStats::Mean
@@ -2322,6 +2342,55 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
 
   QgsDebugMsg( QString( "theStats = %1 supportedStats = %2" ).arg( theStats, 0, 2 ).arg( supportedStats, 0, 2 ) );
 
+  // The statistics calculator opens its own dataset handles, which is not possible for warped datasets
+  if ( myRasterBandStats.extent == extent() && mGdalDataset == mGdalBaseDataset )
+  {
+    GDALRasterBandH myBaseBand = GDALGetRasterBand( mGdalBaseDataset, theBandNo );
+    if ( !approximateStatistics( theSampleSize ) )
+    {
+      // exact statistics are computed in parallel tiles and stored (PAM) so that they are never recomputed
+      QgsGdalStatisticsAccumulator myAccumulator;
+      bool myUseSrcNoData = srcHasNoDataValue( theBandNo ) && useSrcNoDataValue( theBandNo );
+      if ( !myCustomNoData && QgsGdalStatisticsCalculator::readPersisted( myBaseBand, myUseSrcNoData, srcNoDataValue( theBandNo ), myAccumulator ) )
+      {
+        QgsDebugMsg( "Using persisted exact statistics." );
+        setStatistics( myRasterBandStats, myAccumulator );
+        mStatistics.append( myRasterBandStats );
+        return myRasterBandStats;
+      }
+
+      if ( calculateStatistics( myAccumulator, theBandNo, -1 ) )
+      {
+        if ( !myCustomNoData )
+        {
+          QgsGdalStatisticsCalculator::persist( myBaseBand, myUseSrcNoData, srcNoDataValue( theBandNo ), myAccumulator );
+        }
+        setStatistics( myRasterBandStats, myAccumulator );
+        mStatistics.append( myRasterBandStats );
+        return myRasterBandStats;
+      }
+    }
+    else if ( myCustomNoData || ( theStats & ( ~supportedStats ) ) )
+    {
+      // approximate statistics from the smallest overview which has enough pixels
+      int myOverview = QgsGdalStatisticsCalculator::overviewForSampleSize( myBaseBand, theSampleSize );
+      QgsGdalStatisticsAccumulator myAccumulator;
+      if ( myOverview >= 0 && calculateStatistics( myAccumulator, theBandNo, myOverview ) )
+      {
+        QgsDebugMsg( QString( "Using statistics of overview %1." ).arg( myOverview ) );
+        setStatistics( myRasterBandStats, myAccumulator );
+        mStatistics.append( myRasterBandStats );
+        return myRasterBandStats;
+      }
+    }
+  }
+
+  if ( myCustomNoData )
+  {
+    QgsDebugMsg( "Custom no data values, using generic statistics." );
+    return QgsRasterDataProvider::bandStatistics( theBandNo, theStats, theExtent, theSampleSize );
+  }
+
   if ( myRasterBandStats.extent != extent() ||
        ( theStats & ( ~supportedStats ) ) )
   {
@@ -2336,14 +2405,7 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
   // GDAL does not have sample size parameter in API, just bApproxOK or not,
   // we decide if approximation should be used according to
   // total size / sample size ration
-  int bApproxOK = false;
-  if ( theSampleSize > 0 )
-  {
-    if ((( double )xSize() * ( double )ySize() / theSampleSize ) > 2 )  // not perfect
-    {
-      bApproxOK = true;
-    }
-  }
+  int bApproxOK = approximateStatistics( theSampleSize );
 
   QgsDebugMsg( QString( "bApproxOK = %1" ).arg( bApproxOK ) );
 
@@ -2441,6 +2503,73 @@ QgsRasterBandStats QgsGdalProvider::bandStatistics( int theBandNo, int theStats,
 
 } // QgsGdalProvider::bandStatistics
 
+bool QgsGdalProvider::approximateStatistics( int theSampleSize ) const
+{
+  // GDAL does not have sample size parameter in API, just bApproxOK or not,
+  // we decide if approximation should be used according to
+  // total size / sample size ration
+  if ( theSampleSize > 0 )
+  {
+    if ((( double )xSize() * ( double )ySize() / theSampleSize ) > 2 )  // not perfect
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool QgsGdalProvider::calculateStatistics( QgsGdalStatisticsAccumulator &theAccumulator, int theBandNo, int theOverview )
+{
+  QgsGdalStatisticsCalculator myCalculator( dataSourceUri(), theBandNo );
+  myCalculator.setOverview( theOverview );
+  myCalculator.setNoData( srcHasNoDataValue( theBandNo ) && useSrcNoDataValue( theBandNo ),
+                          srcNoDataValue( theBandNo ), userNoDataValues( theBandNo ) );
+  if ( !myCalculator.calculate( theAccumulator ) )
+  {
+    QgsDebugMsg( "Statistics calculator failed." );
+    return false;
+  }
+  return true;
+}
+
+void QgsGdalProvider::setStatistics( QgsRasterBandStats &theStats, const QgsGdalStatisticsAccumulator &theAccumulator )
+{
+  double myScale = bandScale( theStats.bandNumber );
+  double myOffset = bandOffset( theStats.bandNumber );
+
+  theStats.statsGathered = QgsRasterBandStats::All;
+  theStats.elementCount = theAccumulator.count;
+  if ( theAccumulator.count == 0 )
+  {
+    // no valid pixels, there is no minimum and maximum
+    QgsDebugMsg( QString( "Band %1 has no valid pixels." ).arg( theStats.bandNumber ) );
+    theStats.sum = 0.0;
+    theStats.sumOfSquares = 0.0;
+    theStats.mean = std::numeric_limits<double>::quiet_NaN();
+    theStats.stdDev = std::numeric_limits<double>::quiet_NaN();
+    theStats.minimumValue = std::numeric_limits<double>::quiet_NaN();
+    theStats.maximumValue = std::numeric_limits<double>::quiet_NaN();
+    theStats.range = std::numeric_limits<double>::quiet_NaN();
+    return;
+  }
+
+  theStats.sum = theAccumulator.sum * myScale + theAccumulator.count * myOffset;
+  theStats.mean = theAccumulator.mean * myScale + myOffset;
+  theStats.sumOfSquares = theAccumulator.sumOfSquares * myScale * myScale;
+  theStats.stdDev = theAccumulator.stdDev() * qAbs( myScale );
+  if ( myScale < 0.0 )
+  {
+    theStats.minimumValue = theAccumulator.maximum * myScale + myOffset;
+    theStats.maximumValue = theAccumulator.minimum * myScale + myOffset;
+  }
+  else
+  {
+    theStats.minimumValue = theAccumulator.minimum * myScale + myOffset;
+    theStats.maximumValue = theAccumulator.maximum * myScale + myOffset;
+  }
+  theStats.range = theStats.maximumValue - theStats.minimumValue;
+}
+
 void QgsGdalProvider::initBaseDataset()
 {
 #if 0
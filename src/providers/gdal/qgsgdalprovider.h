@@ -34,6 +34,7 @@
 #include <QVector>
 
 class QgsRasterPyramid;
+class QgsGdalStatisticsAccumulator;
 
 /** \ingroup core
  * A call back function for showing progress of gdal operations.
@@ -260,6 +261,16 @@ class QgsGdalProvider : public QgsRasterDataProvider, QgsGdalProviderBase
     /**Do some initialisation on the dataset (e.g. handling of south-up datasets)*/
     void initBaseDataset();
 
+    /** Whether GDAL approximate statistics are good enough for the sample size */
+    bool approximateStatistics( int theSampleSize ) const;
+
+    /** Calculates statistics in parallel tiles, theOverview -1 means full resolution
+      @return false if the calculation failed */
+    bool calculateStatistics( QgsGdalStatisticsAccumulator &theAccumulator, int theBandNo, int theOverview );
+
+    /** Fills statistics from the accumulated raw values, applying band scale and offset */
+    void setStatistics( QgsRasterBandStats &theStats, const QgsGdalStatisticsAccumulator &theAccumulator );
+
     /**
     * Flag indicating if the layer data source is a valid layer
     */
@@ -0,0 +1,382 @@
+/***************************************************************************
+      qgsgdalpyramidbuilder.cpp  -  Parallel overview building for GDAL provider
+                             -------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgdalpyramidbuilder.h"
+#include "qgis.h"
+#include "qgslogger.h"
+
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <limits>
+
+#include "cpl_conv.h"
+
+// number of source pixels read at once by a worker, bounds the memory of each worker (32 MB of doubles)
+static const int TILE_SOURCE_PIXELS = 4 * 1024 * 1024;
+
+/** Shared state of the worker threads resampling one band */
+struct QgsGdalPyramidBuilder::Job
+{
+  GDALRasterBandH srcBand;
+  GDALRasterBandH dstBand;
+  int factor;
+  bool average;
+  bool hasNoData;
+  double noData;
+
+  int srcXSize;
+  int srcYSize;
+  int dstXSize;
+  int dstYSize;
+  // tiles are split into column blocks, so that wide rasters do not need wide buffers
+  int tileRows;
+  int tileCols;
+  int tileCount;
+
+  // GDAL dataset handles must not be accessed concurrently
+  QMutex ioMutex;
+
+  QAtomicInt nextTile;
+  QAtomicInt failed;
+  QAtomicInt canceled;
+
+  // guards rowsDone and wakes up the thread reporting progress
+  QMutex progressMutex;
+  QWaitCondition progressCondition;
+  int rowsDone;
+  int activeWorkers;
+};
+
+QgsGdalPyramidBuilder::QgsGdalPyramidBuilder( GDALDatasetH theDataset )
+    : mDataset( theDataset )
+    , mThreadCount( 0 )
+{
+}
+
+bool QgsGdalPyramidBuilder::supportsMethod( const QString &theResamplingMethod )
+{
+  QString method = theResamplingMethod.toUpper();
+  return method == "NEAREST" || method == "AVERAGE";
+}
+
+int QgsGdalPyramidBuilder::threadCountFromConfig()
+{
+  QString threads = QString( CPLGetConfigOption( "GDAL_NUM_THREADS", "1" ) ).toUpper();
+  if ( threads == "ALL_CPUS" )
+  {
+    return QThread::idealThreadCount();
+  }
+  bool ok;
+  int count = threads.toInt( &ok );
+  return ok && count > 0 ? count : 1;
+}
+
+GDALRasterBandH QgsGdalPyramidBuilder::overviewForLevel( GDALRasterBandH theBand, int theLevel )
+{
+  // same rounding as GDAL uses when creating overviews
+  int xSize = ( GDALGetRasterBandXSize( theBand ) + theLevel - 1 ) / theLevel;
+  int ySize = ( GDALGetRasterBandYSize( theBand ) + theLevel - 1 ) / theLevel;
+
+  for ( int i = 0; i < GDALGetOverviewCount( theBand ); ++i )
+  {
+    GDALRasterBandH overview = GDALGetOverview( theBand, i );
+    if ( overview &&
+         qAbs( GDALGetRasterBandXSize( overview ) - xSize ) <= 1 &&
+         qAbs( GDALGetRasterBandYSize( overview ) - ySize ) <= 1 )
+    {
+      return overview;
+    }
+  }
+  return 0;
+}
+
+CPLErr QgsGdalPyramidBuilder::build( const QString &theResamplingMethod, const QVector<int> &theLevels,
+                                     GDALProgressFunc theProgress, void *theProgressArg )
+{
+  if ( !supportsMethod( theResamplingMethod ) )
+  {
+    CPLError( CE_Failure, CPLE_NotSupported, "Resampling method %s not supported for parallel overviews", theResamplingMethod.toLocal8Bit().data() );
+    return CE_Failure;
+  }
+  bool average = theResamplingMethod.toUpper() == "AVERAGE";
+
+  QVector<int> levels;
+  foreach ( int level, theLevels )
+  {
+    if ( level > 1 && !levels.contains( level ) )
+    {
+      levels << level;
+    }
+  }
+  qSort( levels );
+  if ( levels.isEmpty() )
+  {
+    return CE_None;
+  }
+
+  // let GDAL create the (empty) overview bands in the requested format
+  CPLErr err = GDALBuildOverviews( mDataset, "NONE", levels.size(), levels.data(), 0, NULL, NULL, NULL );
+  if ( err != CE_None )
+  {
+    return err;
+  }
+
+  // progress is weighted by the number of pixels of each level
+  double totalWeight = 0;
+  foreach ( int level, levels )
+  {
+    totalWeight += 1.0 / ( ( double ) level * level );
+  }
+  int bandCount = GDALGetRasterCount( mDataset );
+  totalWeight *= bandCount;
+
+  double progress = 0;
+  for ( int bandNo = 1; bandNo <= bandCount; ++bandNo )
+  {
+    GDALRasterBandH band = GDALGetRasterBand( mDataset, bandNo );
+    GDALRasterBandH srcBand = band;
+    int srcLevel = 1;
+
+    foreach ( int level, levels )
+    {
+      GDALRasterBandH dstBand = overviewForLevel( band, level );
+      if ( !dstBand )
+      {
+        CPLError( CE_Failure, CPLE_AppDefined, "Overview for level %d not found", level );
+        return CE_Failure;
+      }
+
+      // cascade from the previous level if the factors allow it
+      if ( level % srcLevel != 0 )
+      {
+        srcBand = band;
+        srcLevel = 1;
+      }
+
+      QgsDebugMsg( QString( "band %1: computing level %2 from level %3" ).arg( bandNo ).arg( level ).arg( srcLevel ) );
+
+      double weight = 1.0 / ( ( double ) level * level ) / totalWeight;
+      if ( !resampleBand( srcBand, dstBand, level / srcLevel, average, progress, progress + weight, theProgress, theProgressArg ) )
+      {
+        return CE_Failure;
+      }
+      progress += weight;
+
+      srcBand = dstBand;
+      srcLevel = level;
+    }
+  }
+
+  GDALFlushCache( mDataset );
+  if ( theProgress )
+  {
+    theProgress( 1.0, NULL, theProgressArg );
+  }
+  return CE_None;
+}
+
+bool QgsGdalPyramidBuilder::resampleBand( GDALRasterBandH theSrcBand, GDALRasterBandH theDstBand, int theFactor, bool theAverage,
+    double theProgressStart, double theProgressEnd, GDALProgressFunc theProgress, void *theProgressArg )
+{
+  Job job;
+  job.srcBand = theSrcBand;
+  job.dstBand = theDstBand;
+  job.factor = theFactor;
+  job.average = theAverage;
+  int hasNoData = 0;
+  job.noData = GDALGetRasterNoDataValue( theSrcBand, &hasNoData );
+  job.hasNoData = hasNoData;
+  job.srcXSize = GDALGetRasterBandXSize( theSrcBand );
+  job.srcYSize = GDALGetRasterBandYSize( theSrcBand );
+  job.dstXSize = GDALGetRasterBandXSize( theDstBand );
+  job.dstYSize = GDALGetRasterBandYSize( theDstBand );
+  job.rowsDone = 0;
+
+  // align tiles to the blocks of the overview, so that compressed blocks are written once
+  int blockXSize, blockYSize;
+  GDALGetBlockSize( theDstBand, &blockXSize, &blockYSize );
+  blockXSize = qMax( blockXSize, 1 );
+  blockYSize = qMax( blockYSize, 1 );
+  int tileRows = qMax( TILE_SOURCE_PIXELS / ( job.srcXSize * theFactor ), 1 );
+  job.tileRows = qMin( qMax(( tileRows / blockYSize ) * blockYSize, blockYSize ), job.dstYSize );
+  int tileCols = qMax( TILE_SOURCE_PIXELS / ( job.tileRows * theFactor * theFactor ), 1 );
+  if ( tileCols >= blockXSize )
+  {
+    tileCols = ( tileCols / blockXSize ) * blockXSize;
+  }
+  job.tileCols = qMin( tileCols, job.dstXSize );
+  job.tileCount = ( job.dstYSize + job.tileRows - 1 ) / job.tileRows;
+
+  int threads = mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount();
+  threads = qBound( 1, threads, job.tileCount );
+  job.activeWorkers = threads;
+
+  QList< QFuture<void> > workers;
+  for ( int i = 0; i < threads; ++i )
+  {
+    workers << QtConcurrent::run( &QgsGdalPyramidBuilder::resampleTiles, &job );
+  }
+
+  // report progress while the workers are busy
+  job.progressMutex.lock();
+  while ( job.activeWorkers > 0 )
+  {
+    job.progressCondition.wait( &job.progressMutex, 100 );
+    if ( theProgress )
+    {
+      double complete = theProgressStart + ( theProgressEnd - theProgressStart ) * job.rowsDone / job.dstYSize;
+      job.progressMutex.unlock();
+      if ( !theProgress( complete, NULL, theProgressArg ) )
+      {
+        job.canceled = 1;
+      }
+      job.progressMutex.lock();
+    }
+  }
+  job.progressMutex.unlock();
+
+  for ( int i = 0; i < workers.size(); ++i )
+  {
+    workers[i].waitForFinished();
+  }
+
+  return !job.failed && !job.canceled;
+}
+
+bool QgsGdalPyramidBuilder::resampleBlock( Job *job, int srcFirstRow, int srcRows, int srcFirstCol, int srcCols,
+    int dstFirstRow, int dstRows, int dstFirstCol, int dstCols, double *srcBuffer, double *dstBuffer )
+{
+  int factor = job->factor;
+
+  CPLErr err;
+  {
+    QMutexLocker locker( &job->ioMutex );
+    err = GDALRasterIO( job->srcBand, GF_Read, srcFirstCol, srcFirstRow, srcCols, srcRows, srcBuffer, srcCols, srcRows, GDT_Float64, 0, 0 );
+  }
+  if ( err != CE_None )
+  {
+    return false;
+  }
+
+  for ( int row = 0; row < dstRows; ++row )
+  {
+    int srcRow = qMin( row * factor, srcRows - 1 );
+    int srcRowEnd = qMin( srcRow + factor, srcRows );
+    double *dstLine = dstBuffer + ( qgssize ) row * dstCols;
+
+    for ( int col = 0; col < dstCols; ++col )
+    {
+      int srcCol = qMin( col * factor, srcCols - 1 );
+      int srcColEnd = qMin( srcCol + factor, srcCols );
+
+      if ( !job->average )
+      {
+        // the pixel closest to the center of the window, like GDAL does
+        int y = qMin( srcRow + factor / 2, srcRowEnd - 1 );
+        int x = qMin( srcCol + factor / 2, srcColEnd - 1 );
+        dstLine[col] = srcBuffer[( qgssize ) y * srcCols + x];
+        continue;
+      }
+
+      double sum = 0;
+      int count = 0;
+      for ( int y = srcRow; y < srcRowEnd; ++y )
+      {
+        const double *srcLine = srcBuffer + ( qgssize ) y * srcCols;
+        for ( int x = srcCol; x < srcColEnd; ++x )
+        {
+          double value = srcLine[x];
+          if ( qIsNaN( value ) || ( job->hasNoData && value == job->noData ) )
+          {
+            continue;
+          }
+          sum += value;
+          count++;
+        }
+      }
+      dstLine[col] = count > 0 ? sum / count : ( job->hasNoData ? job->noData : std::numeric_limits<double>::quiet_NaN() );
+    }
+  }
+
+  QMutexLocker locker( &job->ioMutex );
+  return GDALRasterIO( job->dstBand, GF_Write, dstFirstCol, dstFirstRow, dstCols, dstRows, dstBuffer, dstCols, dstRows, GDT_Float64, 0, 0 ) == CE_None;
+}
+
+void QgsGdalPyramidBuilder::resampleTiles( Job *job )
+{
+  int factor = job->factor;
+  double *srcBuffer = ( double * ) CPLMalloc( sizeof( double ) * job->tileCols * factor * job->tileRows * factor );
+  double *dstBuffer = ( double * ) CPLMalloc( sizeof( double ) * job->tileCols * job->tileRows );
+
+  while ( !job->failed && !job->canceled )
+  {
+    int tile = job->nextTile.fetchAndAddOrdered( 1 );
+    if ( tile >= job->tileCount )
+    {
+      break;
+    }
+
+    int dstFirstRow = tile * job->tileRows;
+    int dstRows = qMin( job->tileRows, job->dstYSize - dstFirstRow );
+    int srcFirstRow = dstFirstRow * factor;
+    int srcRows = qMin( dstRows * factor, job->srcYSize - srcFirstRow );
+    if ( srcRows <= 0 )
+    {
+      // overview rounded up beyond the source
+      srcFirstRow = job->srcYSize - 1;
+      srcRows = 1;
+    }
+
+    for ( int dstFirstCol = 0; dstFirstCol < job->dstXSize && !job->failed && !job->canceled; dstFirstCol += job->tileCols )
+    {
+      int dstCols = qMin( job->tileCols, job->dstXSize - dstFirstCol );
+      int srcFirstCol = dstFirstCol * factor;
+      int srcCols = qMin( dstCols * factor, job->srcXSize - srcFirstCol );
+      if ( srcCols <= 0 )
+      {
+        srcFirstCol = job->srcXSize - 1;
+        srcCols = 1;
+      }
+
+      if ( !resampleBlock( job, srcFirstRow, srcRows, srcFirstCol, srcCols, dstFirstRow, dstRows, dstFirstCol, dstCols, srcBuffer, dstBuffer ) )
+      {
+        job->failed = 1;
+      }
+    }
+    if ( job->failed )
+    {
+      break;
+    }
+
+    QMutexLocker locker( &job->progressMutex );
+    job->rowsDone += dstRows;
+    job->progressCondition.wakeAll();
+  }
+
+  CPLFree( srcBuffer );
+  CPLFree( dstBuffer );
+
+  QMutexLocker locker( &job->progressMutex );
+  job->activeWorkers--;
+  job->progressCondition.wakeAll();
+}
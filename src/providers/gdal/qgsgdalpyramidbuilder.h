@@ -0,0 +1,78 @@
+/***************************************************************************
+      qgsgdalpyramidbuilder.h  -  Parallel overview building for GDAL provider
+                             -------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGDALPYRAMIDBUILDER_H
+#define QGSGDALPYRAMIDBUILDER_H
+
+#include <QString>
+#include <QVector>
+
+#define CPL_SUPRESS_CPLUSPLUS
+#include <gdal.h>
+
+/**
+  \brief Builds overviews of a GDAL dataset in parallel tiles.
+
+  The overview bands are created by GDAL (internal or external .ovr, according to the dataset
+  and configuration options, including compression), then the pixels are computed
+  by a pool of threads. Each level is computed from the previous (smaller factor) level instead
+  of the full resolution band. Reading and writing through the dataset handle is serialised,
+  the resampling of the tiles runs concurrently.
+
+  Only NEAREST and AVERAGE resampling are supported, see supportsMethod(). Erdas Imagine .rrd
+  overviews are not built with this class, the provider uses GDALBuildOverviews() for them.
+*/
+class QgsGdalPyramidBuilder
+{
+  public:
+    QgsGdalPyramidBuilder( GDALDatasetH theDataset );
+
+    /** Number of worker threads, 0 uses QThread::idealThreadCount() */
+    void setThreadCount( int count ) { mThreadCount = count; }
+    int threadCount() const { return mThreadCount; }
+
+    /** Builds overviews for all bands with the given decimation factors */
+    CPLErr build( const QString &theResamplingMethod, const QVector<int> &theLevels,
+                  GDALProgressFunc theProgress = 0, void *theProgressArg = 0 );
+
+    /** Whether the resampling method can be computed by the builder */
+    static bool supportsMethod( const QString &theResamplingMethod );
+
+    /** Number of threads requested with the GDAL_NUM_THREADS configuration option
+      (a number or ALL_CPUS), 1 if the option is not set */
+    static int threadCountFromConfig();
+
+  private:
+    struct Job;
+    static void resampleTiles( Job *job );
+    /** Resamples one column block of a tile, the buffers must hold the source and destination block */
+    static bool resampleBlock( Job *job, int srcFirstRow, int srcRows, int srcFirstCol, int srcCols,
+                               int dstFirstRow, int dstRows, int dstFirstCol, int dstCols, double *srcBuffer, double *dstBuffer );
+
+    /** Returns the overview of theBand created for theLevel, 0 if not found */
+    static GDALRasterBandH overviewForLevel( GDALRasterBandH theBand, int theLevel );
+
+    /** Computes theDstBand from theSrcBand decimated by theFactor
+      @return false if reading or writing failed or the process was canceled */
+    bool resampleBand( GDALRasterBandH theSrcBand, GDALRasterBandH theDstBand, int theFactor, bool theAverage,
+                       double theProgressStart, double theProgressEnd, GDALProgressFunc theProgress, void *theProgressArg );
+
+    GDALDatasetH mDataset;
+    int mThreadCount;
+};
+
+#endif // QGSGDALPYRAMIDBUILDER_H
@@ -0,0 +1,413 @@
+/***************************************************************************
+      qgsgdalstatistics.cpp  -  Parallel band statistics for GDAL provider
+                             -------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsgdalstatistics.h"
+#include "qgsgdalproviderbase.h"
+#include "qgslogger.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <limits>
+
+#include "cpl_conv.h"
+
+// metadata domain of the statistics written by QgsGdalStatisticsCalculator::persist()
+static const char *STATISTICS_DOMAIN = "QGIS";
+
+// number of pixels read at once by a worker
+static const int TILE_PIXELS = 1024 * 1024;
+
+QgsGdalStatisticsAccumulator::QgsGdalStatisticsAccumulator()
+    : count( 0 )
+    , sum( 0.0 )
+    , mean( 0.0 )
+    , sumOfSquares( 0.0 )
+    , minimum( std::numeric_limits<double>::max() )
+    , maximum( -std::numeric_limits<double>::max() )
+{
+}
+
+void QgsGdalStatisticsAccumulator::add( double value )
+{
+  count++;
+  sum += value;
+  double delta = value - mean;
+  mean += delta / count;
+  sumOfSquares += delta * ( value - mean );
+  if ( value < minimum )
+  {
+    minimum = value;
+  }
+  if ( value > maximum )
+  {
+    maximum = value;
+  }
+}
+
+void QgsGdalStatisticsAccumulator::merge( const QgsGdalStatisticsAccumulator &other )
+{
+  if ( other.count == 0 )
+  {
+    return;
+  }
+  if ( count == 0 )
+  {
+    *this = other;
+    return;
+  }
+
+  double n = ( double ) count + ( double ) other.count;
+  double delta = other.mean - mean;
+  mean += delta * other.count / n;
+  sumOfSquares += other.sumOfSquares + delta * delta * ( double ) count * ( double ) other.count / n;
+  count += other.count;
+  sum += other.sum;
+  minimum = qMin( minimum, other.minimum );
+  maximum = qMax( maximum, other.maximum );
+}
+
+double QgsGdalStatisticsAccumulator::stdDev() const
+{
+  if ( count < 2 )
+  {
+    return 0.0;
+  }
+  return sqrt( sumOfSquares / ( count - 1 ) );
+}
+
+double QgsGdalStatisticsAccumulator::populationStdDev() const
+{
+  if ( count == 0 )
+  {
+    return 0.0;
+  }
+  return sqrt( sumOfSquares / count );
+}
+
+/** Shared state of the worker threads */
+struct QgsGdalStatisticsCalculator::Job
+{
+  QString uri;
+  int bandNo;
+  int overview;
+  bool useSrcNoData;
+  double srcNoData;
+  QgsRasterRangeList userNoData;
+
+  int tileRows;
+  int tileCols;
+  int tileColCount;
+  int tileCount;
+  QAtomicInt nextTile;
+  QAtomicInt failed;
+
+  QMutex mutex;
+  QgsGdalStatisticsAccumulator result;
+};
+
+QgsGdalStatisticsCalculator::QgsGdalStatisticsCalculator( const QString &uri, int bandNo )
+    : mUri( uri )
+    , mBandNo( bandNo )
+    , mOverview( -1 )
+    , mThreadCount( 0 )
+    , mUseSrcNoData( false )
+    , mSrcNoData( 0.0 )
+{
+}
+
+void QgsGdalStatisticsCalculator::setNoData( bool useSrcNoData, double srcNoData, const QgsRasterRangeList &userNoData )
+{
+  mUseSrcNoData = useSrcNoData;
+  mSrcNoData = srcNoData;
+  mUserNoData = userNoData;
+}
+
+static GDALRasterBandH statisticsBand( GDALDatasetH dataset, int bandNo, int overview )
+{
+  GDALRasterBandH band = GDALGetRasterBand( dataset, bandNo );
+  if ( band && overview >= 0 )
+  {
+    band = GDALGetOverview( band, overview );
+  }
+  return band;
+}
+
+bool QgsGdalStatisticsCalculator::calculate( QgsGdalStatisticsAccumulator &result )
+{
+  // the size of the band is needed to split it into tiles
+  GDALDatasetH dataset = QgsGdalProviderBase::gdalOpen( TO8F( mUri ), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return false;
+  }
+  GDALRasterBandH band = statisticsBand( dataset, mBandNo, mOverview );
+  if ( !band )
+  {
+    GDALClose( dataset );
+    return false;
+  }
+  int xSize = GDALGetRasterBandXSize( band );
+  int ySize = GDALGetRasterBandYSize( band );
+  int blockXSize, blockYSize;
+  GDALGetBlockSize( band, &blockXSize, &blockYSize );
+  GDALClose( dataset );
+
+  if ( xSize <= 0 || ySize <= 0 )
+  {
+    return false;
+  }
+
+  // tiles of whole blocks, so that no block is decoded twice. If a row of blocks is larger than a tile,
+  // windows of a part of a block are read, the buffer never exceeds TILE_PIXELS
+  blockXSize = qBound( 1, blockXSize, xSize );
+  blockYSize = qBound( 1, blockYSize, ySize );
+  int tileRows = qMax( TILE_PIXELS / xSize, 1 );
+  if ( tileRows >= blockYSize )
+  {
+    tileRows = ( tileRows / blockYSize ) * blockYSize;
+  }
+  int tileCols = qMin( TILE_PIXELS / tileRows, xSize );
+  if ( tileCols >= blockXSize )
+  {
+    tileCols = ( tileCols / blockXSize ) * blockXSize;
+  }
+
+  Job job;
+  job.uri = mUri;
+  job.bandNo = mBandNo;
+  job.overview = mOverview;
+  job.useSrcNoData = mUseSrcNoData;
+  job.srcNoData = mSrcNoData;
+  job.userNoData = mUserNoData;
+  job.tileRows = tileRows;
+  job.tileCols = tileCols;
+  job.tileColCount = ( xSize + tileCols - 1 ) / tileCols;
+  job.tileCount = (( ySize + tileRows - 1 ) / tileRows ) * job.tileColCount;
+
+  int threads = mThreadCount > 0 ? mThreadCount : QThread::idealThreadCount();
+  threads = qBound( 1, threads, job.tileCount );
+  if (( qgssize ) blockXSize * blockYSize > ( qgssize ) TILE_PIXELS )
+  {
+    // every dataset handle would decode the same large blocks, one thread reuses them from the block cache
+    threads = 1;
+  }
+
+  QgsDebugMsg( QString( "band %1 overview %2: %3 tiles on %4 threads" ).arg( mBandNo ).arg( mOverview ).arg( job.tileCount ).arg( threads ) );
+
+  QList< QFuture<void> > workers;
+  for ( int i = 0; i < threads; ++i )
+  {
+    workers << QtConcurrent::run( &QgsGdalStatisticsCalculator::calculateTiles, &job );
+  }
+  for ( int i = 0; i < workers.size(); ++i )
+  {
+    workers[i].waitForFinished();
+  }
+
+  if ( job.failed )
+  {
+    return false;
+  }
+
+  result = job.result;
+  return true;
+}
+
+void QgsGdalStatisticsCalculator::calculateTiles( Job *job )
+{
+  GDALDatasetH dataset = QgsGdalProviderBase::gdalOpen( TO8F( job->uri ), GA_ReadOnly );
+  GDALRasterBandH band = dataset ? statisticsBand( dataset, job->bandNo, job->overview ) : 0;
+  if ( !band )
+  {
+    job->failed = 1;
+    if ( dataset )
+    {
+      GDALClose( dataset );
+    }
+    return;
+  }
+
+  int xSize = GDALGetRasterBandXSize( band );
+  int ySize = GDALGetRasterBandYSize( band );
+  double *buffer = ( double * ) CPLMalloc( sizeof( double ) * job->tileCols * job->tileRows );
+  bool checkUserNoData = !job->userNoData.isEmpty();
+
+  QgsGdalStatisticsAccumulator stats;
+  while ( !job->failed )
+  {
+    int tile = job->nextTile.fetchAndAddOrdered( 1 );
+    if ( tile >= job->tileCount )
+    {
+      break;
+    }
+
+    int firstRow = ( tile / job->tileColCount ) * job->tileRows;
+    int firstCol = ( tile % job->tileColCount ) * job->tileCols;
+    int nRows = qMin( job->tileRows, ySize - firstRow );
+    int nCols = qMin( job->tileCols, xSize - firstCol );
+    if ( QgsGdalProviderBase::gdalRasterIO( band, GF_Read, firstCol, firstRow, nCols, nRows, buffer, nCols, nRows, GDT_Float64, 0, 0 ) != CE_None )
+    {
+      job->failed = 1;
+      break;
+    }
+
+    qgssize n = ( qgssize ) nCols * nRows;
+    for ( qgssize i = 0; i < n; ++i )
+    {
+      double value = buffer[i];
+      if ( qIsNaN( value ) ||
+           ( job->useSrcNoData && value == job->srcNoData ) ||
+           ( checkUserNoData && QgsRasterRange::contains( value, job->userNoData ) ) )
+      {
+        continue;
+      }
+      stats.add( value );
+    }
+  }
+
+  CPLFree( buffer );
+  GDALClose( dataset );
+
+  QMutexLocker locker( &job->mutex );
+  job->result.merge( stats );
+}
+
+int QgsGdalStatisticsCalculator::overviewForSampleSize( GDALRasterBandH theBand, qgssize theSampleSize )
+{
+  int overview = -1;
+  qgssize overviewPixels = ( qgssize ) GDALGetRasterBandXSize( theBand ) * GDALGetRasterBandYSize( theBand );
+  int count = QgsGdalProviderBase::gdalGetOverviewCount( theBand );
+  for ( int i = 0; i < count; ++i )
+  {
+    GDALRasterBandH overviewBand = GDALGetOverview( theBand, i );
+    if ( !overviewBand )
+    {
+      continue;
+    }
+    qgssize pixels = ( qgssize ) GDALGetRasterBandXSize( overviewBand ) * GDALGetRasterBandYSize( overviewBand );
+    // overviews are not necessarily ordered by size
+    if ( pixels >= theSampleSize && pixels < overviewPixels )
+    {
+      overview = i;
+      overviewPixels = pixels;
+    }
+  }
+  return overview;
+}
+
+// value of STATISTICS_NODATA, statistics stored before it was added are never used
+static QString noDataItem( bool useSrcNoData, double srcNoData )
+{
+  return useSrcNoData ? QString::number( srcNoData, 'g', 17 ) : QString( "NONE" );
+}
+
+// modification time (ms) and size of the source file of the band, false if it is not a local file
+static bool sourceFileVersion( GDALRasterBandH theBand, QString &lastModified, QString &size )
+{
+  GDALDatasetH dataset = GDALGetBandDataset( theBand );
+  if ( !dataset )
+  {
+    return false;
+  }
+  QFileInfo fileInfo( QString::fromUtf8( GDALGetDescription( dataset ) ) );
+  if ( !fileInfo.isFile() )
+  {
+    return false;
+  }
+  lastModified = QString::number( fileInfo.lastModified().toMSecsSinceEpoch() );
+  size = QString::number( fileInfo.size() );
+  return true;
+}
+
+bool QgsGdalStatisticsCalculator::readPersisted( GDALRasterBandH theBand, bool useSrcNoData, double srcNoData, QgsGdalStatisticsAccumulator &result )
+{
+  const char *exact = GDALGetMetadataItem( theBand, "STATISTICS_EXACT", STATISTICS_DOMAIN );
+  if ( !exact || QString( exact ) != "YES" )
+  {
+    return false;
+  }
+
+  const char *noData = GDALGetMetadataItem( theBand, "STATISTICS_NODATA", STATISTICS_DOMAIN );
+  if ( !noData || QString( noData ) != noDataItem( useSrcNoData, srcNoData ) )
+  {
+    QgsDebugMsg( "Stored statistics were calculated with another no data value." );
+    return false;
+  }
+
+  QString lastModified, size;
+  const char *storedLastModified = GDALGetMetadataItem( theBand, "STATISTICS_SOURCE_MTIME", STATISTICS_DOMAIN );
+  const char *storedSize = GDALGetMetadataItem( theBand, "STATISTICS_SOURCE_SIZE", STATISTICS_DOMAIN );
+  if ( !sourceFileVersion( theBand, lastModified, size ) || !storedLastModified || !storedSize ||
+       lastModified != storedLastModified || size != storedSize )
+  {
+    QgsDebugMsg( "Stored statistics were calculated for another version of the source file." );
+    return false;
+  }
+
+  const char *keys[] = { "STATISTICS_COUNT", "STATISTICS_SUM", "STATISTICS_MEAN", "STATISTICS_SUMOFSQUARES", "STATISTICS_MINIMUM", "STATISTICS_MAXIMUM" };
+  double values[6];
+  for ( int i = 0; i < 6; ++i )
+  {
+    const char *item = GDALGetMetadataItem( theBand, keys[i], STATISTICS_DOMAIN );
+    bool ok = false;
+    values[i] = item ? QString( item ).toDouble( &ok ) : 0.0;
+    if ( !ok )
+    {
+      return false;
+    }
+  }
+
+  result.count = ( qgssize ) values[0];
+  result.sum = values[1];
+  result.mean = values[2];
+  result.sumOfSquares = values[3];
+  result.minimum = values[4];
+  result.maximum = values[5];
+  return true;
+}
+
+void QgsGdalStatisticsCalculator::persist( GDALRasterBandH theBand, bool useSrcNoData, double srcNoData, const QgsGdalStatisticsAccumulator &stats )
+{
+  QString lastModified, size;
+  if ( stats.count == 0 || !sourceFileVersion( theBand, lastModified, size ) )
+  {
+    return;
+  }
+
+  GDALSetRasterStatistics( theBand, stats.minimum, stats.maximum, stats.mean, stats.populationStdDev() );
+
+  // cached GDAL statistics may be approximate (see https://trac.osgeo.org/gdal/ticket/4857),
+  // exact values are therefore kept in a separate domain
+  GDALSetMetadataItem( theBand, "STATISTICS_COUNT", QString::number( stats.count ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_SUM", QString::number( stats.sum, 'g', 17 ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_MEAN", QString::number( stats.mean, 'g', 17 ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_SUMOFSQUARES", QString::number( stats.sumOfSquares, 'g', 17 ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_MINIMUM", QString::number( stats.minimum, 'g', 17 ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_MAXIMUM", QString::number( stats.maximum, 'g', 17 ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_NODATA", noDataItem( useSrcNoData, srcNoData ).toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_SOURCE_MTIME", lastModified.toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_SOURCE_SIZE", size.toLatin1().constData(), STATISTICS_DOMAIN );
+  GDALSetMetadataItem( theBand, "STATISTICS_EXACT", "YES", STATISTICS_DOMAIN );
+}
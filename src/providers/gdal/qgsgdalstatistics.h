@@ -0,0 +1,109 @@
+/***************************************************************************
+      qgsgdalstatistics.h  -  Parallel band statistics for GDAL provider
+                             -------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSGDALSTATISTICS_H
+#define QGSGDALSTATISTICS_H
+
+#include "qgis.h"
+#include "qgsrasterrange.h"
+
+#include <QString>
+
+#define CPL_SUPRESS_CPLUSPLUS
+#include <gdal.h>
+
+/**
+  \brief Streaming accumulator of band statistics (Welford's single pass algorithm).
+  Partial results calculated for separate parts of a band are combined with merge().
+*/
+class QgsGdalStatisticsAccumulator
+{
+  public:
+    QgsGdalStatisticsAccumulator();
+
+    void add( double value );
+    /** Combines the statistics of another part of the band (Chan et al. pairwise update) */
+    void merge( const QgsGdalStatisticsAccumulator &other );
+
+    /** Sample standard deviation (n - 1), as calculated by QgsRasterInterface::bandStatistics() */
+    double stdDev() const;
+    /** Population standard deviation, as calculated by GDAL */
+    double populationStdDev() const;
+
+    qgssize count;
+    double sum;
+    double mean;
+    /** Sum of squared differences from the mean */
+    double sumOfSquares;
+    double minimum;
+    double maximum;
+};
+
+/**
+  \brief Calculates statistics of a GDAL raster band in parallel tiles.
+  Every worker thread opens its own dataset handle, GDAL handles are never shared between threads.
+  Tiles are made of whole blocks if possible. Bands with blocks larger than a tile (e.g. single strip images)
+  are read by one thread in windows of a part of a block, so that the buffer stays bounded.
+  The calculation may run on an overview of the band to get approximate statistics quickly.
+*/
+class QgsGdalStatisticsCalculator
+{
+  public:
+    QgsGdalStatisticsCalculator( const QString &uri, int bandNo );
+
+    /** Overview used for the calculation, -1 (the default) for full resolution */
+    void setOverview( int overview ) { mOverview = overview; }
+    int overview() const { return mOverview; }
+
+    /** Values skipped by the calculation in addition to NaN */
+    void setNoData( bool useSrcNoData, double srcNoData, const QgsRasterRangeList &userNoData );
+
+    /** Number of worker threads, 0 (the default) uses QThread::idealThreadCount() */
+    void setThreadCount( int count ) { mThreadCount = count; }
+
+    /** Calculates the statistics of raw (not scaled) band values
+      @return false if the dataset could not be read */
+    bool calculate( QgsGdalStatisticsAccumulator &result );
+
+    /** Returns the index of the smallest overview with at least theSampleSize pixels or -1 if full resolution is needed */
+    static int overviewForSampleSize( GDALRasterBandH theBand, qgssize theSampleSize );
+
+    /** Reads exact statistics previously stored by persist() (e.g. in the PAM .aux.xml file)
+      @return false if there are no stored statistics, they were calculated with another source no data value
+      or the source file has been modified since (modification time or size) */
+    static bool readPersisted( GDALRasterBandH theBand, bool useSrcNoData, double srcNoData, QgsGdalStatisticsAccumulator &result );
+
+    /** Stores exact statistics calculated without user no data values with the band, together with the
+      source no data value used and the modification time and size of the source file. They are also set
+      as GDAL statistics for other applications. Nothing is stored for datasets which are not local files */
+    static void persist( GDALRasterBandH theBand, bool useSrcNoData, double srcNoData, const QgsGdalStatisticsAccumulator &stats );
+
+  private:
+    struct Job;
+    static void calculateTiles( Job *job );
+
+    QString mUri;
+    int mBandNo;
+    int mOverview;
+    int mThreadCount;
+
+    bool mUseSrcNoData;
+    double mSrcNoData;
+    QgsRasterRangeList mUserNoData;
+};
+
+#endif // QGSGDALSTATISTICS_H
@@ -25,17 +25,21 @@
 QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
     , mSelectRectGeom( 0 )
+    , mTestGeometry( false )
+    , mSelectSlot( 0 )
     , mSubsetExpression( 0 )
 {
   if ( !mSource->mSubsetString.isEmpty() )
   {
     mSubsetExpression = new QgsExpression( mSource->mSubsetString );
     mSubsetExpression->prepare( mSource->mFields );
+    mTestGeometry = mSubsetExpression->needsGeometry();
   }
 
   if ( mRequest.filterType() == QgsFeatureRequest::FilterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
   {
     mSelectRectGeom = QgsGeometry::fromRect( request.filterRect() );
+    mTestGeometry = true;
   }
 
   // if there's spatial index, use it!
@@ -49,8 +53,7 @@ QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* sour
   else if ( mRequest.filterType() == QgsFeatureRequest::FilterFid )
   {
     mUsingFeatureIdList = true;
-    QgsFeatureMap::const_iterator it = mSource->mFeatures.find( mRequest.filterFid() );
-    if ( it != mSource->mFeatures.end() )
+    if ( mSource->mFeatures.slot( mRequest.filterFid() ) >= 0 )
       mFeatureIdList.append( mRequest.filterFid() );
   }
   else
@@ -90,36 +93,18 @@ bool QgsMemoryFeatureIterator::nextFeatureUsingList( QgsFeature& feature )
   // option 1: we have a list of features to traverse
   while ( mFeatureIdListIterator != mFeatureIdList.constEnd() )
   {
-    if ( mRequest.filterType() == QgsFeatureRequest::FilterRect && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
+    int slot = mSource->mFeatures.slot( *mFeatureIdListIterator );
+    ++mFeatureIdListIterator;
+    if ( slot >= 0 && acceptFeature( slot, feature ) )
     {
-      // do exact check in case we're doing intersection
-      if ( mSource->mFeatures[*mFeatureIdListIterator].geometry() && mSource->mFeatures[*mFeatureIdListIterator].geometry()->intersects( mSelectRectGeom ) )
-        hasFeature = true;
-    }
-    else
       hasFeature = true;
-
-    if ( mSubsetExpression && !mSubsetExpression->evaluate( mSource->mFeatures[*mFeatureIdListIterator] ).toBool() )
-        hasFeature = false;
-
-    if ( hasFeature )
       break;
-
-    ++mFeatureIdListIterator;
+    }
   }
 
-  // copy feature
-  if ( hasFeature )
-  {
-    feature = mSource->mFeatures[*mFeatureIdListIterator];
-    ++mFeatureIdListIterator;
-  }
-  else
+  if ( !hasFeature )
     close();
 
-  if ( hasFeature )
-    feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
-
   return hasFeature;
 }
 
@@ -129,50 +114,53 @@ bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
   bool hasFeature = false;
 
   // option 2: traversing the whole layer
-  while ( mSelectIterator != mSource->mFeatures.constEnd() )
+  const QgsMemoryFeatureStore& features = mSource->mFeatures;
+  while ( mSelectSlot < features.slotCount() )
   {
-    if ( mRequest.filterType() != QgsFeatureRequest::FilterRect )
+    int slot = mSelectSlot++;
+    if ( features.isDeleted( slot ) )
+      continue;
+
+    // check just bounding box against rect first, the geometry is only
+    // created if it passes or for the exact test
+    if ( mRequest.filterType() == QgsFeatureRequest::FilterRect &&
+         ( !features.hasGeometry( slot ) || !features.boundingBox( slot ).intersects( mRequest.filterRect() ) ) )
+      continue;
+
+    if ( acceptFeature( slot, feature ) )
     {
-      // selection rect empty => using all features
       hasFeature = true;
+      break;
     }
-    else
-    {
-      if ( mRequest.flags() & QgsFeatureRequest::ExactIntersect )
-      {
-        // using exact test when checking for intersection
-        if ( mSelectIterator->geometry() && mSelectIterator->geometry()->intersects( mSelectRectGeom ) )
-          hasFeature = true;
-      }
-      else
-      {
-        // check just bounding box against rect when not using intersection
-        if ( mSelectIterator->geometry() && mSelectIterator->geometry()->boundingBox().intersects( mRequest.filterRect() ) )
-          hasFeature = true;
-      }
-    }
+  }
 
-    if ( mSubsetExpression && !mSubsetExpression->evaluate( *mSelectIterator ).toBool() )
-        hasFeature = false;
+  if ( !hasFeature )
+    close();
 
-    if ( hasFeature )
-      break;
+  return hasFeature;
+}
 
-    ++mSelectIterator;
-  }
+bool QgsMemoryFeatureIterator::acceptFeature( int slot, QgsFeature& feature )
+{
+  bool fetchGeometry = mTestGeometry || !( mRequest.flags() & QgsFeatureRequest::NoGeometry );
+  mSource->mFeatures.feature( slot, feature, fetchGeometry );
+  feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
 
-  // copy feature
-  if ( hasFeature )
+  if ( mSelectRectGeom )
   {
-    feature = mSelectIterator.value();
-    ++mSelectIterator;
-    feature.setValid( true );
-    feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
+    // do exact check in case we're doing intersection
+    if ( !feature.geometry() || !feature.geometry()->intersects( mSelectRectGeom ) )
+      return false;
   }
-  else
-    close();
 
-  return hasFeature;
+  if ( mSubsetExpression && !mSubsetExpression->evaluate( feature ).toBool() )
+    return false;
+
+  if ( fetchGeometry && mRequest.flags() & QgsFeatureRequest::NoGeometry )
+    feature.setGeometry( 0 );
+
+  feature.setValid( true );
+  return true;
 }
 
 bool QgsMemoryFeatureIterator::rewind()
@@ -183,7 +171,7 @@ bool QgsMemoryFeatureIterator::rewind()
   if ( mUsingFeatureIdList )
     mFeatureIdListIterator = mFeatureIdList.constBegin();
   else
-    mSelectIterator = mSource->mFeatures.constBegin();
+    mSelectSlot = 0;
 
   return true;
 }
@@ -16,11 +16,10 @@
 #define QGSMEMORYFEATUREITERATOR_H
 
 #include "qgsfeatureiterator.h"
+#include "qgsmemoryfeaturestore.h"
 
 class QgsMemoryProvider;
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
-
 class QgsSpatialIndex;
 
 
@@ -34,7 +33,7 @@ class QgsMemoryFeatureSource : public QgsAbstractFeatureSource
 
   protected:
     QgsFields mFields;
-    QgsFeatureMap mFeatures;
+    QgsMemoryFeatureStore mFeatures;
     QgsSpatialIndex* mSpatialIndex;
     QString mSubsetString;
 
@@ -63,8 +62,13 @@ class QgsMemoryFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Qgs
     bool nextFeatureUsingList( QgsFeature& feature );
     bool nextFeatureTraverseAll( QgsFeature& feature );
 
+    //! fills the feature from the slot and returns whether it passes the exact intersection test and the subset expression
+    bool acceptFeature( int slot, QgsFeature& feature );
+
     QgsGeometry* mSelectRectGeom;
-    QgsFeatureMap::const_iterator mSelectIterator;
+    //! whether the subset expression or the exact intersection test need the geometry
+    bool mTestGeometry;
+    int mSelectSlot;
     bool mUsingFeatureIdList;
     QList<QgsFeatureId> mFeatureIdList;
     QList<QgsFeatureId>::const_iterator mFeatureIdListIterator;
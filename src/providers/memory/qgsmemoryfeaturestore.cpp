@@ -0,0 +1,208 @@
+/***************************************************************************
+    qgsmemoryfeaturestore.cpp
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsmemoryfeaturestore.h"
+
+#include "qgsgeometry.h"
+
+#include <string.h>
+
+// size of the chunks holding the WKB of the geometries
+static const int WKB_CHUNK_SIZE = 4 * 1024 * 1024;
+// the store is only compacted if it has at least this many deleted slots
+static const int MIN_COMPACT_SLOTS = 1024;
+
+QgsMemoryFeatureStore::QgsMemoryFeatureStore()
+    : mUnusedWkbSize( 0 )
+    , mWkbSize( 0 )
+{
+}
+
+QgsGeometry* QgsMemoryFeatureStore::geometry( int slot ) const
+{
+  const Slot& s = mSlots[slot];
+  if ( s.wkbSize <= 0 )
+    return 0;
+
+  // the geometry takes ownership of the copy
+  unsigned char* wkb = new unsigned char[s.wkbSize];
+  memcpy( wkb, mChunks[s.chunk].constData() + s.offset, s.wkbSize );
+
+  QgsGeometry* geom = new QgsGeometry();
+  geom->fromWkb( wkb, s.wkbSize );
+  return geom;
+}
+
+void QgsMemoryFeatureStore::feature( int slot, QgsFeature& feature, bool fetchGeometry ) const
+{
+  feature.setFeatureId( mSlots[slot].id );
+  feature.setAttributes( mAttributes[slot] );
+  feature.setGeometry( fetchGeometry ? geometry( slot ) : 0 );
+}
+
+void QgsMemoryFeatureStore::append( const QgsFeature& feature )
+{
+  Slot s;
+  s.id = feature.id();
+  s.deleted = false;
+  s.chunk = 0;
+  s.offset = 0;
+  s.wkbSize = 0;
+  storeWkb( s, feature.geometry() );
+
+  mSlotOfId.insert( s.id, mSlots.size() );
+  mSlots.append( s );
+  mAttributes.append( feature.attributes() );
+}
+
+bool QgsMemoryFeatureStore::remove( QgsFeatureId id )
+{
+  QHash<QgsFeatureId, int>::iterator it = mSlotOfId.find( id );
+  if ( it == mSlotOfId.end() )
+    return false;
+
+  Slot& s = mSlots[it.value()];
+  s.deleted = true;
+  mUnusedWkbSize += s.wkbSize;
+  s.wkbSize = 0;
+  s.boundingBox = QgsRectangle();
+  mAttributes[it.value()] = QgsAttributes();
+  mSlotOfId.erase( it );
+
+  compactIfNeeded();
+  return true;
+}
+
+void QgsMemoryFeatureStore::setGeometry( int slot, QgsGeometry* geometry )
+{
+  Slot& s = mSlots[slot];
+  mUnusedWkbSize += s.wkbSize;
+  storeWkb( s, geometry );
+
+  compactIfNeeded();
+}
+
+void QgsMemoryFeatureStore::setAttribute( int slot, int field, const QVariant& value )
+{
+  QgsAttributes& attrs = mAttributes[slot];
+  if ( field >= 0 && field < attrs.size() )
+    attrs[field] = value;
+}
+
+void QgsMemoryFeatureStore::appendAttribute()
+{
+  for ( int i = 0; i < mAttributes.size(); ++i )
+  {
+    if ( !mSlots[i].deleted )
+      mAttributes[i].append( QVariant() );
+  }
+}
+
+void QgsMemoryFeatureStore::removeAttribute( int field )
+{
+  for ( int i = 0; i < mAttributes.size(); ++i )
+  {
+    if ( !mSlots[i].deleted && field < mAttributes[i].size() )
+      mAttributes[i].remove( field );
+  }
+}
+
+QgsRectangle QgsMemoryFeatureStore::extent() const
+{
+  QgsRectangle rect;
+  rect.setMinimal();
+  for ( int i = 0; i < mSlots.size(); ++i )
+  {
+    if ( mSlots[i].wkbSize > 0 )
+      rect.unionRect( mSlots[i].boundingBox );
+  }
+  return rect;
+}
+
+void QgsMemoryFeatureStore::storeWkb( Slot& slot, QgsGeometry* geometry )
+{
+  const unsigned char* wkb = geometry ? geometry->asWkb() : 0;
+  int size = wkb ? ( int ) geometry->wkbSize() : 0;
+  if ( size <= 0 )
+  {
+    slot.wkbSize = 0;
+    slot.boundingBox = QgsRectangle();
+    return;
+  }
+
+  if ( mChunks.isEmpty() || mChunks.last().size() + size > WKB_CHUNK_SIZE )
+  {
+    QByteArray chunk;
+    chunk.reserve( qMax( size, WKB_CHUNK_SIZE ) );
+    mChunks.append( chunk );
+  }
+
+  QByteArray& chunk = mChunks.last();
+  slot.chunk = mChunks.size() - 1;
+  slot.offset = chunk.size();
+  slot.wkbSize = size;
+  slot.boundingBox = geometry->boundingBox();
+  chunk.append( reinterpret_cast<const char*>( wkb ), size );
+  mWkbSize += size;
+}
+
+void QgsMemoryFeatureStore::compactIfNeeded()
+{
+  int deletedSlots = mSlots.size() - mSlotOfId.count();
+  bool compactSlots = deletedSlots >= MIN_COMPACT_SLOTS && deletedSlots > mSlotOfId.count();
+  bool compactWkb = mUnusedWkbSize >= WKB_CHUNK_SIZE && mUnusedWkbSize > mWkbSize / 2;
+  if ( !compactSlots && !compactWkb )
+    return;
+
+  QVector<Slot> oldSlots = mSlots;
+  QVector<QgsAttributes> oldAttributes = mAttributes;
+  QList<QByteArray> oldChunks = mChunks;
+  int count = mSlotOfId.count();
+
+  mSlots.clear();
+  mSlots.reserve( count );
+  mAttributes.clear();
+  mAttributes.reserve( count );
+  mSlotOfId.clear();
+  mSlotOfId.reserve( count );
+  mChunks.clear();
+  mWkbSize = 0;
+  mUnusedWkbSize = 0;
+
+  for ( int i = 0; i < oldSlots.size(); ++i )
+  {
+    Slot s = oldSlots[i];
+    if ( s.deleted )
+      continue;
+
+    if ( s.wkbSize > 0 )
+    {
+      if ( mChunks.isEmpty() || mChunks.last().size() + s.wkbSize > WKB_CHUNK_SIZE )
+      {
+        QByteArray chunk;
+        chunk.reserve( qMax( s.wkbSize, WKB_CHUNK_SIZE ) );
+        mChunks.append( chunk );
+      }
+      QByteArray& chunk = mChunks.last();
+      chunk.append( oldChunks[s.chunk].constData() + s.offset, s.wkbSize );
+      s.chunk = mChunks.size() - 1;
+      s.offset = chunk.size() - s.wkbSize;
+      mWkbSize += s.wkbSize;
+    }
+
+    mSlotOfId.insert( s.id, mSlots.size() );
+    mSlots.append( s );
+    mAttributes.append( oldAttributes[i] );
+  }
+}
@@ -0,0 +1,131 @@
+/***************************************************************************
+    qgsmemoryfeaturestore.h
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSMEMORYFEATURESTORE_H
+#define QGSMEMORYFEATURESTORE_H
+
+#include "qgsfeature.h"
+#include "qgsrectangle.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+class QgsGeometry;
+
+/**
+ * Storage of the features of the memory provider.
+ *
+ * Features are kept in slots of contiguous arrays in the order they were added,
+ * with a hash from feature id to slot. The WKB of the geometries is packed into
+ * large shared chunks and the bounding box of every geometry is kept in its slot,
+ * so that features can be filtered by rectangle without creating their geometry.
+ *
+ * Copies are cheap (all members are implicitly shared), so the feature source
+ * takes a snapshot of the store and iterators are not affected by later edits.
+ * Slots of deleted features are reused only after compaction, which renumbers
+ * the slots: slot numbers are only valid until the store is modified.
+ */
+class QgsMemoryFeatureStore
+{
+  public:
+    QgsMemoryFeatureStore();
+
+    //! number of features
+    int count() const { return mSlotOfId.count(); }
+
+    //! number of slots, including the slots of deleted features
+    int slotCount() const { return mSlots.size(); }
+
+    //! slot of the feature with the id, -1 if there is no such feature
+    int slot( QgsFeatureId id ) const { return mSlotOfId.value( id, -1 ); }
+
+    //! true if the feature of the slot has been deleted
+    bool isDeleted( int slot ) const { return mSlots[slot].deleted; }
+
+    QgsFeatureId id( int slot ) const { return mSlots[slot].id; }
+
+    //! true if the feature of the slot has a geometry
+    bool hasGeometry( int slot ) const { return mSlots[slot].wkbSize > 0; }
+
+    //! bounding box of the geometry of the slot (empty if there is no geometry)
+    const QgsRectangle& boundingBox( int slot ) const { return mSlots[slot].boundingBox; }
+
+    //! returns a new geometry created from the stored WKB, 0 if the feature has no geometry
+    QgsGeometry* geometry( int slot ) const;
+
+    const QgsAttributes& attributes( int slot ) const { return mAttributes[slot]; }
+
+    /**
+     * Sets id, attributes and geometry of a feature
+     * @param slot slot of the feature
+     * @param feature feature to fill
+     * @param fetchGeometry false to leave the feature without geometry
+     */
+    void feature( int slot, QgsFeature& feature, bool fetchGeometry = true ) const;
+
+    //! adds a feature with its id, which must not be in the store yet
+    void append( const QgsFeature& feature );
+
+    //! removes a feature, returns false if there is no feature with the id
+    bool remove( QgsFeatureId id );
+
+    //! replaces the geometry of the feature in the slot
+    void setGeometry( int slot, QgsGeometry* geometry );
+
+    //! sets an attribute of the feature in the slot
+    void setAttribute( int slot, int field, const QVariant& value );
+
+    //! appends a null attribute to all features
+    void appendAttribute();
+
+    //! removes an attribute from all features
+    void removeAttribute( int field );
+
+    //! extent of all geometries
+    QgsRectangle extent() const;
+
+  private:
+    struct Slot
+    {
+      QgsFeatureId id;
+      bool deleted;
+      //! index of the chunk with the WKB
+      int chunk;
+      //! offset of the WKB in the chunk
+      int offset;
+      //! size of the WKB, 0 if there is no geometry
+      int wkbSize;
+      QgsRectangle boundingBox;
+    };
+
+    //! stores the WKB of a geometry in the last chunk or a new one
+    void storeWkb( Slot& slot, QgsGeometry* geometry );
+
+    //! drops the slots of deleted features and the unused WKB, if they make up more than half of the store
+    void compactIfNeeded();
+
+    QVector<Slot> mSlots;
+    QVector<QgsAttributes> mAttributes;
+    QHash<QgsFeatureId, int> mSlotOfId;
+    QList<QByteArray> mChunks;
+
+    //! bytes of WKB in the chunks which are not referenced by a slot anymore
+    qint64 mUnusedWkbSize;
+    //! total bytes of WKB in the chunks
+    qint64 mWkbSize;
+};
+
+#endif // QGSMEMORYFEATURESTORE_H
@@ -290,22 +290,29 @@ QgsCoordinateReferenceSystem QgsMemoryProvider::crs()
 
 bool QgsMemoryProvider::addFeatures( QgsFeatureList & flist )
 {
+  if ( mFeatures.count() == 0 )
+    mExtent.setMinimal();
+
   // TODO: sanity checks of fields and geometries
   for ( QgsFeatureList::iterator it = flist.begin(); it != flist.end(); ++it )
   {
-    mFeatures[mNextFeatureId] = *it;
-    QgsFeature& newfeat = mFeatures[mNextFeatureId];
-    newfeat.setFeatureId( mNextFeatureId );
     it->setFeatureId( mNextFeatureId );
+    mFeatures.append( *it );
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( newfeat );
+      mSpatialIndex->insertFeature( *it );
+
+    // extend the extent instead of recomputing it from all features
+    int slot = mFeatures.slotCount() - 1;
+    if ( mFeatures.hasGeometry( slot ) )
+      mExtent.unionRect( mFeatures.boundingBox( slot ) );
 
     mNextFeatureId++;
   }
 
-  updateExtent();
+  if ( mFeatures.count() == 0 )
+    mExtent = QgsRectangle();
 
   return true;
 }
@@ -314,17 +321,21 @@ bool QgsMemoryProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( *it );
+    int slot = mFeatures.slot( *it );
 
     // check whether such feature exists
-    if ( fit == mFeatures.end() )
+    if ( slot < 0 )
       continue;
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+    {
+      QgsFeature f;
+      mFeatures.feature( slot, f );
+      mSpatialIndex->deleteFeature( f );
+    }
 
-    mFeatures.erase( fit );
+    mFeatures.remove( *it );
   }
 
   updateExtent();
@@ -351,12 +362,7 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
     }
     // add new field as a last one
     mFields.append( *it );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      f.attributes().append( QVariant() );
-    }
+    mFeatures.appendAttribute();
   }
   return true;
 }
@@ -371,12 +377,7 @@ bool QgsMemoryProvider::deleteAttributes( const QgsAttributeIds& attributes )
   {
     int idx = *it;
     mFields.remove( idx );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      f.attributes().remove( idx );
-    }
+    mFeatures.removeAttribute( idx );
   }
   return true;
 }
@@ -385,13 +386,13 @@ bool QgsMemoryProvider::changeAttributeValues( const QgsChangedAttributesMap & a
 {
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    int slot = mFeatures.slot( it.key() );
+    if ( slot < 0 )
       continue;
 
     const QgsAttributeMap& attrs = it.value();
     for ( QgsAttributeMap::const_iterator it2 = attrs.begin(); it2 != attrs.end(); ++it2 )
-      fit->setAttribute( it2.key(), it2.value() );
+      mFeatures.setAttribute( slot, it2.key(), it2.value() );
   }
   return true;
 }
@@ -400,19 +401,28 @@ bool QgsMemoryProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
 {
   for ( QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    int slot = mFeatures.slot( it.key() );
+    if ( slot < 0 )
       continue;
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+    {
+      QgsFeature f;
+      mFeatures.feature( slot, f );
+      mSpatialIndex->deleteFeature( f );
+    }
 
-    fit->setGeometry( it.value() );
+    QgsGeometry geom( it.value() );
+    mFeatures.setGeometry( slot, &geom );
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( *fit );
+    {
+      QgsFeature f( it.key() );
+      f.setGeometry( geom );
+      mSpatialIndex->insertFeature( f );
+    }
   }
 
   updateExtent();
@@ -447,9 +457,14 @@ bool QgsMemoryProvider::createSpatialIndex()
     mSpatialIndex = new QgsSpatialIndex();
 
     // add existing features to index
-    for ( QgsFeatureMap::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
+    for ( int slot = 0; slot < mFeatures.slotCount(); ++slot )
     {
-      mSpatialIndex->insertFeature( *it );
+      if ( mFeatures.isDeleted( slot ) )
+        continue;
+
+      QgsFeature f;
+      mFeatures.feature( slot, f );
+      mSpatialIndex->insertFeature( f );
     }
   }
   return true;
@@ -471,12 +486,7 @@ void QgsMemoryProvider::updateExtent()
   }
   else
   {
-    mExtent.setMinimal();
-    Q_FOREACH ( const QgsFeature& feat, mFeatures )
-    {
-      if ( feat.geometry() )
-        mExtent.unionRect( feat.geometry()->boundingBox() );
-    }
+    mExtent = mFeatures.extent();
   }
 }
 
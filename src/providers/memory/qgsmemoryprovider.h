@@ -15,10 +15,9 @@
 
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
+#include "qgsmemoryfeaturestore.h"
 
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
-
 class QgsSpatialIndex;
 
 class QgsMemoryFeatureIterator;
@@ -172,7 +171,7 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     QgsRectangle mExtent;
 
     // features
-    QgsFeatureMap mFeatures;
+    QgsMemoryFeatureStore mFeatures;
     QgsFeatureId mNextFeatureId;
 
     // indexing
@@ -24,6 +24,10 @@
 
 #include <QTextCodec>
 #include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
 
 // using from provider:
 // - setRelevantFields(), mRelevantFieldsForNextFeature
@@ -32,12 +36,119 @@
 // - mAttributeFields
 // - mEncoding
 
+// maximum number of features read ahead of the caller
+static const int READ_AHEAD_FEATURES = 256;
+
+/**
+ * Reads and converts the features of an iterator on a background thread into
+ * a bounded queue, so that reading the next features from disk overlaps with
+ * the processing of the current one by the caller (e.g. rendering).
+ * The thread is the only user of the OGR layer of the iterator while it runs.
+ * A dedicated thread is used rather than the global thread pool, because the
+ * callers are often running in that pool themselves.
+ */
+class QgsOgrReadAheadThread : public QThread
+{
+  public:
+    QgsOgrReadAheadThread( QgsOgrFeatureIterator* iterator )
+        : mIterator( iterator )
+        , mAtEnd( false )
+        , mStopped( false )
+    {
+    }
+
+    ~QgsOgrReadAheadThread()
+    {
+      stop();
+      qDeleteAll( mQueue );
+    }
+
+    //! waits for the next feature, returns false at the end of the layer
+    bool nextFeature( QgsFeature& feature )
+    {
+      QMutexLocker locker( &mMutex );
+      while ( mQueue.isEmpty() && !mAtEnd )
+        mNotEmpty.wait( &mMutex );
+
+      if ( mQueue.isEmpty() )
+        return false;
+
+      QgsFeature* f = mQueue.dequeue();
+      mNotFull.wakeOne();
+      locker.unlock();
+
+      // take over the geometry instead of copying it
+      feature.setFeatureId( f->id() );
+      feature.setAttributes( f->attributes() );
+      feature.setGeometry( f->geometryAndOwnership() );
+      feature.setFields( &mIterator->mSource->mFields );
+      delete f;
+      return true;
+    }
+
+    //! stops reading and waits for the thread to finish
+    void stop()
+    {
+      mMutex.lock();
+      mStopped = true;
+      mNotFull.wakeOne();
+      mMutex.unlock();
+
+      wait();
+    }
+
+  protected:
+    void run()
+    {
+      OGRFeatureH fet;
+      while (( fet = OGR_L_GetNextFeature( mIterator->ogrLayer ) ) )
+      {
+        QgsFeature* feature = new QgsFeature();
+        bool accepted = mIterator->readFeature( fet, *feature );
+        if ( accepted )
+          OGR_F_Destroy( fet );
+
+        QMutexLocker locker( &mMutex );
+        while ( accepted && mQueue.size() >= READ_AHEAD_FEATURES && !mStopped )
+          mNotFull.wait( &mMutex );
+
+        if ( mStopped )
+        {
+          delete feature;
+          return;
+        }
+
+        if ( accepted )
+        {
+          mQueue.enqueue( feature );
+          mNotEmpty.wakeOne();
+        }
+        else
+          delete feature;
+      }
+
+      QMutexLocker locker( &mMutex );
+      mAtEnd = true;
+      mNotEmpty.wakeOne();
+    }
+
+  private:
+    QgsOgrFeatureIterator* mIterator;
+    QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QWaitCondition mNotFull;
+    QQueue<QgsFeature*> mQueue;
+    bool mAtEnd;
+    bool mStopped;
+};
+
 
 QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
     , ogrDataSource( 0 )
     , ogrLayer( 0 )
     , mSubsetStringSet( false )
+    , mReadAhead( 0 )
     , mGeometrySimplifier( NULL )
 {
   mFeatureFetched = false;
@@ -59,10 +170,12 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool
     mSubsetStringSet = true;
   }
 
-  // make sure we fetch just relevant fields
-  mFetchGeometry = ( mRequest.filterType() == QgsFeatureRequest::FilterRect ) || !( mRequest.flags() & QgsFeatureRequest::NoGeometry );
+  // make sure we fetch just relevant fields, the geometry is also read
+  // if it is needed by the spatial or the geometry type filter
+  mFetchGeometry = !( mRequest.flags() & QgsFeatureRequest::NoGeometry );
+  bool filterGeometry = mRequest.filterType() == QgsFeatureRequest::FilterRect || mSource->mOgrGeometryTypeFilter != wkbUnknown;
   QgsAttributeList attrs = ( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes ) ? mRequest.subsetOfAttributes() : mSource->mFields.allAttributesList();
-  QgsOgrUtils::setRelevantFields( ogrLayer, mSource->mFields.count(), mFetchGeometry, attrs );
+  QgsOgrUtils::setRelevantFields( ogrLayer, mSource->mFields.count(), mFetchGeometry || filterGeometry, attrs );
 
   // spatial query to select features
   if ( mRequest.filterType() == QgsFeatureRequest::FilterRect )
@@ -88,10 +201,11 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool
 
 QgsOgrFeatureIterator::~QgsOgrFeatureIterator()
 {
+  // the read-ahead thread uses the simplifier
+  close();
+
   delete mGeometrySimplifier;
   mGeometrySimplifier = NULL;
-
-  close();
 }
 
 bool QgsOgrFeatureIterator::prepareSimplification( const QgsSimplifyMethod& simplifyMethod )
@@ -172,19 +286,17 @@ bool QgsOgrFeatureIterator::fetchFeature( QgsFeature& feature )
     return true;
   }
 
-  OGRFeatureH fet;
-
-  while (( fet = OGR_L_GetNextFeature( ogrLayer ) ) )
+  if ( !mReadAhead )
   {
-    if ( !readFeature( fet, feature ) )
-      continue;
+    mReadAhead = new QgsOgrReadAheadThread( this );
+    mReadAhead->start();
+  }
 
-    // we have a feature, end this cycle
+  if ( mReadAhead->nextFeature( feature ) )
+  {
     feature.setValid( true );
-    OGR_F_Destroy( fet );
     return true;
-
-  } // while
+  }
 
   close();
   return false;
@@ -196,6 +308,7 @@ bool QgsOgrFeatureIterator::rewind()
   if ( mClosed )
     return false;
 
+  stopReadAhead();
   OGR_L_ResetReading( ogrLayer );
 
   return true;
@@ -209,6 +322,8 @@ bool QgsOgrFeatureIterator::close()
 
   iteratorClosed();
 
+  stopReadAhead();
+
   if ( mSubsetStringSet )
   {
     OGR_DS_ReleaseResultSet( ogrDataSource, ogrLayer );
@@ -222,6 +337,13 @@ bool QgsOgrFeatureIterator::close()
 }
 
 
+void QgsOgrFeatureIterator::stopReadAhead()
+{
+  delete mReadAhead;
+  mReadAhead = 0;
+}
+
+
 void QgsOgrFeatureIterator::getFeatureAttribute( OGRFeatureH ogrFet, QgsFeature & f, int attindex )
 {
   OGRFieldDefnH fldDef = OGR_F_GetFieldDefnRef( ogrFet, attindex );
@@ -278,7 +400,14 @@ bool QgsOgrFeatureIterator::readFeature( OGRFeatureH fet, QgsFeature& feature )
   {
     OGRGeometryH geom = OGR_F_GetGeometryRef( fet );
 
-    if ( geom )
+    // check the type before the geometry is converted
+    if ( geometryTypeFilter && ( !geom || QgsOgrProvider::ogrWkbSingleFlatten( OGR_G_GetGeometryType( geom ) ) != mSource->mOgrGeometryTypeFilter ) )
+    {
+      OGR_F_Destroy( fet );
+      return false;
+    }
+
+    if ( geom && ( mFetchGeometry || useIntersect ) )
     {
       if ( mGeometrySimplifier )
         mGeometrySimplifier->simplifyGeometry( geom );
@@ -294,8 +423,7 @@ bool QgsOgrFeatureIterator::readFeature( OGRFeatureH fet, QgsFeature& feature )
     else
       feature.setGeometry( 0 );
 
-    if (( useIntersect && ( !feature.geometry() || !feature.geometry()->intersects( mRequest.filterRect() ) ) )
-        || ( geometryTypeFilter && ( !feature.geometry() || QgsOgrProvider::ogrWkbSingleFlatten(( OGRwkbGeometryType )feature.geometry()->wkbType() ) != mSource->mOgrGeometryTypeFilter ) ) )
+    if ( useIntersect && ( !feature.geometry() || !feature.geometry()->intersects( mRequest.filterRect() ) ) )
     {
       OGR_F_Destroy( fet );
       return false;
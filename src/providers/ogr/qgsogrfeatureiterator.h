@@ -22,6 +22,7 @@
 class QgsOgrFeatureIterator;
 class QgsOgrProvider;
 class QgsOgrAbstractGeometrySimplifier;
+class QgsOgrReadAheadThread;
 
 class QgsOgrFeatureSource : public QgsAbstractFeatureSource
 {
@@ -68,6 +69,9 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIteratorFromSource<QgsOgr
     //! Get an attribute associated with a feature
     void getFeatureAttribute( OGRFeatureH ogrFet, QgsFeature & f, int attindex );
 
+    //! Stops the read-ahead thread, so that the layer may be used by the calling thread
+    void stopReadAhead();
+
     bool mFeatureFetched;
 
     OGRDataSourceH ogrDataSource;
@@ -79,11 +83,16 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIteratorFromSource<QgsOgr
     bool mFetchGeometry;
 
   private:
+    //! Thread reading and converting the next features, 0 until the first feature is fetched
+    QgsOgrReadAheadThread* mReadAhead;
+
     //! optional object to simplify OGR-geometries fecthed by this feature iterator
     QgsOgrAbstractGeometrySimplifier* mGeometrySimplifier;
 
     //! returns whether the iterator supports simplify geometries on provider side
     virtual bool providerCanSimplify( QgsSimplifyMethod::MethodType methodType ) const;
+
+    friend class QgsOgrReadAheadThread;
 };
 
 #endif // QGSOGRFEATUREITERATOR_H
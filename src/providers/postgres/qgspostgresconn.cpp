@@ -28,6 +28,7 @@
 #include <QThread>
 
 #include <climits>
+#include <cstring>
 
 // for htonl
 #ifdef Q_OS_WIN
@@ -814,7 +815,7 @@ PGresult *QgsPostgresConn::PQexec( QString query, bool logError )
   if ( res )
   {
     int errorStatus = PQresultStatus( res );
-    if ( errorStatus != PGRES_COMMAND_OK && errorStatus != PGRES_TUPLES_OK )
+    if ( errorStatus != PGRES_COMMAND_OK && errorStatus != PGRES_TUPLES_OK && errorStatus != PGRES_COPY_IN )
     {
       if ( logError )
       {
@@ -959,6 +960,18 @@ PGresult *QgsPostgresConn::PQexecPrepared( QString stmtName, const QStringList &
   return res;
 }
 
+int QgsPostgresConn::PQputCopyData( const QByteArray &data )
+{
+  Q_ASSERT( mConn );
+  return ::PQputCopyData( mConn, data.constData(), data.size() );
+}
+
+int QgsPostgresConn::PQputCopyEnd( QString errorMessage )
+{
+  Q_ASSERT( mConn );
+  return ::PQputCopyEnd( mConn, errorMessage.isNull() ? 0 : errorMessage.toUtf8().constData() );
+}
+
 void QgsPostgresConn::PQfinish()
 {
   Q_ASSERT( mConn );
@@ -1061,6 +1074,43 @@ qint64 QgsPostgresConn::getBinaryInt( QgsPostgresResult &queryResult, int row, i
   return oid;
 }
 
+double QgsPostgresConn::getBinaryDouble( QgsPostgresResult &queryResult, int row, int col )
+{
+  char *p = PQgetvalue( queryResult.result(), row, col );
+  size_t s = PQgetlength( queryResult.result(), row, col );
+
+  if ( s == 4 )
+  {
+    quint32 bits;
+    memcpy( &bits, p, sizeof( bits ) );
+    if ( mSwapEndian )
+      bits = ntohl( bits );
+
+    float value;
+    memcpy( &value, &bits, sizeof( value ) );
+    return value;
+  }
+
+  if ( s != 8 )
+  {
+    QgsDebugMsg( QString( "unexpected size %1" ).arg( s ) );
+    return 0.0;
+  }
+
+  quint32 bits[2];
+  memcpy( bits, p, sizeof( bits ) );
+  if ( mSwapEndian )
+  {
+    quint32 high = ntohl( bits[0] );
+    bits[0] = ntohl( bits[1] );
+    bits[1] = high;
+  }
+
+  double value;
+  memcpy( &value, bits, sizeof( value ) );
+  return value;
+}
+
 QString QgsPostgresConn::fieldExpression( const QgsField &fld )
 {
   const QString &type = fld.typeName();
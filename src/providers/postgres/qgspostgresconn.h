@@ -218,6 +218,8 @@ class QgsPostgresConn : public QObject
     PGresult *PQgetResult();
     PGresult *PQprepare( QString stmtName, QString query, int nParams, const Oid *paramTypes );
     PGresult *PQexecPrepared( QString stmtName, const QStringList &params );
+    int PQputCopyData( const QByteArray &data );
+    int PQputCopyEnd( QString errorMessage = QString::null );
 
     // cancel running query
     bool cancel();
@@ -242,6 +244,8 @@ class QgsPostgresConn : public QObject
     bool getTableInfo( bool searchGeometryColumnsOnly, bool searchPublicOnly, bool allowGeometrylessTables );
 
     qint64 getBinaryInt( QgsPostgresResult &queryResult, int row, int col );
+    //! returns a float4 or float8 value of a binary cursor
+    double getBinaryDouble( QgsPostgresResult &queryResult, int row, int col );
 
     QString fieldExpression( const QgsField &fld );
 
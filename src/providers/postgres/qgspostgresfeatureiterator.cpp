@@ -23,12 +23,16 @@
 #include <QObject>
 
 
+const int QgsPostgresFeatureIterator::sInitialFetchSize = 100;
 const int QgsPostgresFeatureIterator::sFeatureQueueSize = 2000;
 
 
 QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
-    , mFeatureQueueSize( sFeatureQueueSize )
+    , mResultRow( 0 )
+    , mFetchSize( sInitialFetchSize )
+    , mFetchPending( false )
+    , mCursorExhausted( false )
 {
   mConn = QgsPostgresConnPool::instance()->acquireConnection( mSource->mConnInfo );
 
@@ -87,70 +91,98 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
   if ( mClosed )
     return false;
 
-  if ( mFeatureQueue.empty() )
+  if ( !mResult.result() || mResultRow >= mResult.PQntuples() )
   {
-    QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( mCursorName );
-    QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 4 );
-    if ( mConn->PQsendQuery( fetch ) == 0 ) // fetch features asynchronously
+    if ( !fetchBatch() )
     {
-      QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
-    }
-
-    QgsPostgresResult queryResult;
-    for ( ;; )
-    {
-      queryResult = mConn->PQgetResult();
-      if ( !queryResult.result() )
-        break;
-
-      if ( queryResult.PQresultStatus() != PGRES_TUPLES_OK )
-      {
-        QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
-        break;
-      }
+      QgsDebugMsg( QString( "Finished after %1 features" ).arg( mFetched ) );
+      close();
 
-      int rows = queryResult.PQntuples();
-      if ( rows == 0 )
-        continue;
+      mSource->mShared->ensureFeaturesCountedAtLeast( mFetched );
 
-      for ( int row = 0; row < rows; row++ )
-      {
-        mFeatureQueue.enqueue( QgsFeature() );
-        getFeature( queryResult, row, mFeatureQueue.back() );
-      } // for each row in queue
+      return false;
     }
   }
 
-  if ( mFeatureQueue.empty() )
+  // read the next row of the batch directly into the feature
+  getFeature( mResult, mResultRow++, feature );
+  mFetched++;
+
+  feature.setValid( true );
+  feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
+
+  return true;
+}
+
+bool QgsPostgresFeatureIterator::sendFetch()
+{
+  QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFetchSize ).arg( mCursorName );
+  QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFetchSize ), 4 );
+  if ( mConn->PQsendQuery( fetch ) == 0 ) // fetch features asynchronously
   {
-    QgsDebugMsg( QString( "Finished after %1 features" ).arg( mFetched ) );
-    close();
+    QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
+    return false;
+  }
+  mFetchPending = true;
+  return true;
+}
 
-    mSource->mShared->ensureFeaturesCountedAtLeast( mFetched );
+bool QgsPostgresFeatureIterator::fetchBatch()
+{
+  mResult = 0;
+  mResultRow = 0;
 
+  if ( !mFetchPending && ( mCursorExhausted || !sendFetch() ) )
     return false;
+
+  mResult = mConn->PQgetResult();
+  mFetchPending = false;
+  bool ok = mResult.PQresultStatus() == PGRES_TUPLES_OK;
+  if ( !ok )
+  {
+    QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName ).arg( mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
   }
 
-  // Now return the next feature from the queue
-  if ( !mFetchGeometry )
+  // the connection is ready for the next query after all results have been read
+  for ( ;; )
   {
-    feature.setGeometryAndOwnership( 0, 0 );
+    QgsPostgresResult queryResult( mConn->PQgetResult() );
+    if ( !queryResult.result() )
+      break;
+  }
+
+  int rows = ok ? mResult.PQntuples() : 0;
+  if ( rows < mFetchSize )
+  {
+    mCursorExhausted = true;
   }
   else
   {
-    QgsGeometry* featureGeom = mFeatureQueue.front().geometryAndOwnership();
-    feature.setGeometry( featureGeom );
+    // let the server prepare the next (larger) batch while this one is read
+    mFetchSize = qMin( mFetchSize * 2, sFeatureQueueSize );
+    sendFetch();
   }
-  feature.setFeatureId( mFeatureQueue.front().id() );
-  feature.setAttributes( mFeatureQueue.front().attributes() );
 
-  mFeatureQueue.dequeue();
-  mFetched++;
+  if ( rows == 0 )
+  {
+    mResult = 0;
+    return false;
+  }
+  return true;
+}
 
-  feature.setValid( true );
-  feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
+void QgsPostgresFeatureIterator::discardPendingFetch()
+{
+  if ( !mFetchPending )
+    return;
 
-  return true;
+  for ( ;; )
+  {
+    QgsPostgresResult queryResult( mConn->PQgetResult() );
+    if ( !queryResult.result() )
+      break;
+  }
+  mFetchPending = false;
 }
 
 bool QgsPostgresFeatureIterator::prepareSimplification( const QgsSimplifyMethod& simplifyMethod )
@@ -185,8 +217,12 @@ bool QgsPostgresFeatureIterator::rewind()
     return false;
 
   // move cursor to first record
+  discardPendingFetch();
   mConn->PQexecNR( QString( "move absolute 0 in %1" ).arg( mCursorName ) );
-  mFeatureQueue.clear();
+  mResult = 0;
+  mResultRow = 0;
+  mFetchSize = sInitialFetchSize;
+  mCursorExhausted = false;
   mFetched = 0;
 
   return true;
@@ -197,15 +233,13 @@ bool QgsPostgresFeatureIterator::close()
   if ( mClosed )
     return false;
 
+  discardPendingFetch();
   mConn->closeCursor( mCursorName );
 
   QgsPostgresConnPool::instance()->releaseConnection( mConn );
   mConn = 0;
 
-  while ( !mFeatureQueue.empty() )
-  {
-    mFeatureQueue.dequeue();
-  }
+  mResult = 0;
 
   iteratorClosed();
 
@@ -299,18 +333,23 @@ bool QgsPostgresFeatureIterator::declareCursor( const QString& whereClause )
     if ( mSource->mSpatialColType == sctGeography )
       geom += "::geometry";
 
-    if ( mSource->mForce2d )
+    bool simplify = !mRequest.simplifyMethod().forceLocalOptimization() &&
+                    mRequest.simplifyMethod().methodType() != QgsSimplifyMethod::NoSimplification &&
+                    QGis::flatType( QGis::singleType( mSource->mRequestedGeomType != QGis::WKBUnknown
+                                                      ? mSource->mRequestedGeomType
+                                                      : mSource->mDetectedGeomType ) ) != QGis::WKBPoint;
+
+    // geometries simplified for rendering don't need z and m values, dropping them
+    // shrinks the transferred wkb by a third or a half
+    if ( mSource->mForce2d ||
+         ( simplify && mRequest.simplifyMethod().methodType() == QgsSimplifyMethod::OptimizeForRendering ) )
     {
       geom = QString( "%1(%2)" )
              .arg( mConn->majorVersion() < 2 ? "force_2d" : "st_force_2d" )
              .arg( geom );
     }
 
-    if ( !mRequest.simplifyMethod().forceLocalOptimization() &&
-         mRequest.simplifyMethod().methodType() != QgsSimplifyMethod::NoSimplification &&
-         QGis::flatType( QGis::singleType( mSource->mRequestedGeomType != QGis::WKBUnknown
-                                           ? mSource->mRequestedGeomType
-                                           : mSource->mDetectedGeomType ) ) != QGis::WKBPoint )
+    if ( simplify )
     {
       geom = QString( "%1(%2,%3)" )
              .arg( mRequest.simplifyMethod().methodType() == QgsSimplifyMethod::OptimizeForRendering
@@ -360,13 +399,37 @@ bool QgsPostgresFeatureIterator::declareCursor( const QString& whereClause )
       break;
   }
 
+  // integer and floating point columns are read in binary format, the others as text
+  mAttributeFormats.fill( TextFormat, mSource->mFields.count() );
   bool subsetOfAttributes = mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes;
   foreach ( int idx, subsetOfAttributes ? mRequest.subsetOfAttributes() : mSource->mFields.allAttributesList() )
   {
     if ( mSource->mPrimaryKeyAttrs.contains( idx ) )
       continue;
 
-    query += delim + mConn->fieldExpression( mSource->mFields[idx] );
+    const QgsField &fld = mSource->mFields[idx];
+    const QString &typeName = fld.typeName();
+    if ( typeName == "int2" && fld.type() == QVariant::Int )
+    {
+      mAttributeFormats[idx] = Int2Format;
+    }
+    else if ( typeName == "int4" && fld.type() == QVariant::Int )
+    {
+      mAttributeFormats[idx] = Int4Format;
+    }
+    else if ( typeName == "int8" && fld.type() == QVariant::LongLong )
+    {
+      mAttributeFormats[idx] = Int8Format;
+    }
+    else if (( typeName == "float4" || typeName == "float8" ) && fld.type() == QVariant::Double )
+    {
+      mAttributeFormats[idx] = DoubleFormat;
+    }
+
+    if ( mAttributeFormats[idx] == TextFormat )
+      query += delim + mConn->fieldExpression( fld );
+    else
+      query += delim + QgsPostgresConn::quotedIdentifier( fld.name() );
   }
 
   query += " FROM " + mSource->mQuery;
@@ -465,6 +528,10 @@ bool QgsPostgresFeatureIterator::getFeature( QgsPostgresResult &queryResult, int
 
     col++;
   }
+  else
+  {
+    feature.setGeometryAndOwnership( 0, 0 );
+  }
 
   QgsFeatureId fid = 0;
 
@@ -532,7 +599,35 @@ void QgsPostgresFeatureIterator::getFeatureAttribute( int idx, QgsPostgresResult
   if ( mSource->mPrimaryKeyAttrs.contains( idx ) )
     return;
 
-  QVariant v = QgsPostgresProvider::convertValue( mSource->mFields[idx].type(), queryResult.PQgetvalue( row, col ) );
+  const QgsField &fld = mSource->mFields[idx];
+  QVariant v;
+  if ( mAttributeFormats.at( idx ) == TextFormat )
+  {
+    v = QgsPostgresProvider::convertValue( fld.type(), queryResult.PQgetvalue( row, col ) );
+  }
+  else if ( queryResult.PQgetisnull( row, col ) )
+  {
+    v = QVariant( fld.type() );
+  }
+  else
+  {
+    // getBinaryInt doesn't extend the sign of short values
+    switch ( mAttributeFormats.at( idx ) )
+    {
+      case Int2Format:
+        v = QVariant(( int )( qint16 ) mConn->getBinaryInt( queryResult, row, col ) );
+        break;
+      case Int4Format:
+        v = QVariant(( int )( qint32 ) mConn->getBinaryInt( queryResult, row, col ) );
+        break;
+      case Int8Format:
+        v = QVariant( mConn->getBinaryInt( queryResult, row, col ) );
+        break;
+      default:
+        v = QVariant( mConn->getBinaryDouble( queryResult, row, col ) );
+        break;
+    }
+  }
   feature.setAttribute( idx, v );
 
   col++;
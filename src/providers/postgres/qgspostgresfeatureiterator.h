@@ -17,7 +17,7 @@
 
 #include "qgsfeatureiterator.h"
 
-#include <QQueue>
+#include <QVector>
 
 #include "qgspostgresprovider.h"
 
@@ -81,21 +81,40 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
     QgsPostgresConn* mConn;
 
 
+    //! format of an attribute column in the binary cursor
+    enum AttributeFormat
+    {
+      TextFormat,   //!< text representation converted by QgsVectorDataProvider::convertValue
+      Int2Format,   //!< binary int2
+      Int4Format,   //!< binary int4
+      Int8Format,   //!< binary int8
+      DoubleFormat  //!< binary float4 and float8
+    };
+
     QString whereClauseRect();
     bool getFeature( QgsPostgresResult &queryResult, int row, QgsFeature &feature );
     void getFeatureAttribute( int idx, QgsPostgresResult& queryResult, int row, int& col, QgsFeature& feature );
     bool declareCursor( const QString& whereClause );
 
+    //! sends the FETCH of the next batch of mFetchSize rows without waiting for the result
+    bool sendFetch();
+    //! reads the result of the pending FETCH into mResult and prefetches the following batch
+    bool fetchBatch();
+    //! reads and discards the result of a pending FETCH, the connection can't run other queries before
+    void discardPendingFetch();
+
     QString mCursorName;
 
-    /**
-     * Feature queue that GetNextFeature will retrieve from
-     * before the next fetch from PostgreSQL
-     */
-    QQueue<QgsFeature> mFeatureQueue;
+    //! Rows of the current batch, returned by fetchFeature() starting at mResultRow
+    QgsPostgresResult mResult;
+    int mResultRow;
 
-    //! Maximal size of the feature queue
-    int mFeatureQueueSize;
+    //! Number of rows of the pending or last FETCH
+    int mFetchSize;
+    //! A FETCH was sent whose result has not been read yet
+    bool mFetchPending;
+    //! The last FETCH returned less rows than requested
+    bool mCursorExhausted;
 
     //! Number of retrieved features
     int mFetched;
@@ -103,6 +122,12 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
     //! Set to true, if geometry is in the requested columns
     bool mFetchGeometry;
 
+    //! Formats of the attribute columns (by field index)
+    QVector<AttributeFormat> mAttributeFormats;
+
+    //! Size of the first batch, the batch size is doubled with every FETCH up to sFeatureQueueSize
+    static const int sInitialFetchSize;
+    //! Maximal number of rows fetched at once
     static const int sFeatureQueueSize;
 
   private:
@@ -25,6 +25,7 @@
 #include <qgscoordinatereferencesystem.h>
 
 #include <QMessageBox>
+#include <QtEndian>
 
 #include "qgsvectorlayerimport.h"
 #include "qgsprovidercountcalcevent.h"
@@ -39,6 +40,11 @@
 const QString POSTGRES_KEY = "postgres";
 const QString POSTGRES_DESCRIPTION = "PostgreSQL/PostGIS data provider";
 
+// smallest batch of new features that is inserted with COPY instead of single INSERTs
+static const int COPY_MIN_FEATURES = 100;
+// size of the chunks sent to the server during a COPY
+static const int COPY_BUFFER_SIZE = 1024 * 1024;
+
 
 QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
     : QgsVectorDataProvider( uri )
@@ -124,6 +130,11 @@ QgsPostgresProvider::QgsPostgresProvider( QString const & uri )
     return;
   }
 
+  if ( mSpatialColType != sctGeometry && mSpatialColType != sctGeography )
+  {
+    mEnabledCapabilities &= ~QgsVectorDataProvider::CreateSpatialIndex;
+  }
+
   if ( mSpatialColType == sctTopoGeometry )
   {
     if ( !getTopoLayerInfo() ) // gets topology name and layer id
@@ -950,7 +961,7 @@ bool QgsPostgresProvider::hasSufficientPermsAndCapabilities()
       testAccess = mConnectionRO->PQexec( sql );
       if ( testAccess.PQresultStatus() == PGRES_TUPLES_OK && testAccess.PQntuples() == 1 )
       {
-        mEnabledCapabilities |= QgsVectorDataProvider::AddAttributes | QgsVectorDataProvider::DeleteAttributes;
+        mEnabledCapabilities |= QgsVectorDataProvider::AddAttributes | QgsVectorDataProvider::DeleteAttributes | QgsVectorDataProvider::CreateSpatialIndex;
       }
     }
   }
@@ -1571,6 +1582,16 @@ bool QgsPostgresProvider::addFeatures( QgsFeatureList &flist )
   if ( !connectRW() )
     return false;
 
+  // COPY cannot return the oids of the new rows nor call the functions converting topogeometries
+  if ( flist.size() >= COPY_MIN_FEATURES &&
+       mPrimaryKeyType != pktOid &&
+       ( mSpatialColType == sctNone || mSpatialColType == sctGeometry ) &&
+       mConnectionRW->useWkbHex() &&
+       canCopyFeatures() )
+  {
+    return copyFeatures( flist );
+  }
+
   bool returnvalue = true;
 
   try
@@ -1761,33 +1782,259 @@ bool QgsPostgresProvider::addFeatures( QgsFeatureList &flist )
       }
     }
 
-    // update feature ids
+    setPrimaryKeyFeatureIds( flist );
+
+    mConnectionRW->PQexecNR( "DEALLOCATE addfeatures" );
+    mConnectionRW->PQexecNR( "COMMIT" );
+
+    mShared->addFeaturesCounted( flist.size() );
+  }
+  catch ( PGException &e )
+  {
+    pushError( tr( "PostGIS error while adding features: %1" ).arg( e.errorMessage() ) );
+    mConnectionRW->PQexecNR( "ROLLBACK" );
+    mConnectionRW->PQexecNR( "DEALLOCATE addfeatures" );
+    returnvalue = false;
+  }
+
+  return returnvalue;
+}
+
+bool QgsPostgresProvider::canCopyFeatures()
+{
+  // views need their INSERT rules or triggers and COPY does not apply the rules of tables
+  QString sql = QString( "SELECT c.relkind='r' AND NOT EXISTS (SELECT 1 FROM pg_rewrite r WHERE r.ev_class=c.oid AND r.ev_type='3') "
+                         "FROM pg_class c WHERE c.oid=regclass(%1)::oid" ).arg( quotedValue( mQuery ) );
+  QgsPostgresResult result = mConnectionRW->PQexec( sql );
+  return result.PQresultStatus() == PGRES_TUPLES_OK && result.PQntuples() == 1 && result.PQgetvalue( 0, 0 ) == "t";
+}
+
+void QgsPostgresProvider::setPrimaryKeyFeatureIds( QgsFeatureList &flist )
+{
+  if ( mPrimaryKeyType != pktInt && mPrimaryKeyType != pktFidMap )
+    return;
+
+  for ( QgsFeatureList::iterator features = flist.begin(); features != flist.end(); ++features )
+  {
+    const QgsAttributes &attrs = features->attributes();
+
+    if ( mPrimaryKeyType == pktInt )
+    {
+      features->setFeatureId( STRING_TO_FID( attrs[ mPrimaryKeyAttrs[0] ] ) );
+    }
+    else
+    {
+      QList<QVariant> primaryKeyVals;
+
+      foreach ( int idx, mPrimaryKeyAttrs )
+      {
+        primaryKeyVals << attrs[ idx ];
+      }
+
+      features->setFeatureId( mShared->lookupFid( QVariant( primaryKeyVals ) ) );
+    }
+    QgsDebugMsgLevel( QString( "new fid=%1" ).arg( features->id() ), 4 );
+  }
+}
+
+// escapes a value for the text format of COPY
+static QByteArray copyValue( const QString &value )
+{
+  if ( value.isNull() )
+    return "\\N";
+
+  QByteArray v = value.toUtf8();
+  v.replace( '\\', "\\\\" );
+  v.replace( '\t', "\\t" );
+  v.replace( '\n', "\\n" );
+  v.replace( '\r', "\\r" );
+  return v;
+}
+
+QByteArray QgsPostgresProvider::copyGeometry( QgsGeometry *geom, bool forceMulti, int srid ) const
+{
+  if ( !geom || !geom->asWkb() )
+    return "\\N";
+
+  QgsGeometry multiGeom;
+  if ( forceMulti && !QGis::isMultiType( geom->wkbType() ) )
+  {
+    multiGeom = *geom;
+    if ( multiGeom.convertToMultiType() )
+      geom = &multiGeom;
+  }
+
+  QByteArray wkb( reinterpret_cast<const char *>( geom->asWkb() ), geom->wkbSize() );
+  if ( srid > 0 && wkb.size() >= 5 )
+  {
+    // turn the WKB into EWKB with the srid following the geometry type
+    bool littleEndian = wkb[0] == 1;
+    const uchar *typePtr = reinterpret_cast<const uchar *>( wkb.constData() + 1 );
+    quint32 type = littleEndian ? qFromLittleEndian<quint32>( typePtr ) : qFromBigEndian<quint32>( typePtr );
+    type |= 0x20000000;
+
+    uchar header[8];
+    if ( littleEndian )
+    {
+      qToLittleEndian<quint32>( type, header );
+      qToLittleEndian<quint32>( srid, header + 4 );
+    }
+    else
+    {
+      qToBigEndian<quint32>( type, header );
+      qToBigEndian<quint32>( srid, header + 4 );
+    }
+    wkb.replace( 1, 4, reinterpret_cast<const char *>( header ), 8 );
+  }
+
+  return wkb.toHex();
+}
+
+bool QgsPostgresProvider::copyFeatures( QgsFeatureList &flist )
+{
+  bool returnvalue = true;
+
+  try
+  {
+    mConnectionRW->PQexecNR( "BEGIN" );
+
+    QStringList columns;
+    QList<int> fieldId;
+    QStringList defaultValues;
+
+    if ( !mGeometryColumn.isNull() )
+    {
+      columns << quotedIdentifier( mGeometryColumn );
+    }
+
     if ( mPrimaryKeyType == pktInt || mPrimaryKeyType == pktFidMap )
     {
-      for ( QgsFeatureList::iterator features = flist.begin(); features != flist.end(); ++features )
+      fieldId << mPrimaryKeyAttrs;
+    }
+
+    // columns that no feature has a value for are left to the table defaults
+    for ( int idx = 0; idx < mAttributeFields.count(); ++idx )
+    {
+      if ( fieldId.contains( idx ) )
+        continue;
+
+      QString fieldname = mAttributeFields[idx].name();
+      if ( fieldname.isEmpty() || fieldname == mGeometryColumn )
+        continue;
+
+      for ( QgsFeatureList::const_iterator features = flist.constBegin(); features != flist.constEnd(); ++features )
       {
         const QgsAttributes &attrs = features->attributes();
-
-        if ( mPrimaryKeyType == pktInt )
+        if ( idx < attrs.count() && attrs[idx].isValid() )
         {
-          features->setFeatureId( STRING_TO_FID( attrs[ mPrimaryKeyAttrs[0] ] ) );
+          fieldId << idx;
+          break;
         }
-        else
+      }
+    }
+
+    foreach ( int idx, fieldId )
+    {
+      columns << quotedIdentifier( field( idx ).name() );
+      defaultValues << defaultValue( idx ).toString();
+    }
+
+    // evaluate the defaults (e.g. nextval() of the primary key) with one query per column,
+    // so that the features get the values stored in the table
+    for ( int i = 0; i < fieldId.size(); i++ )
+    {
+      const QString &defVal = defaultValues[i];
+      const QgsField &fld = field( fieldId[i] );
+
+      QList<QgsFeature *> defaultFeatures;
+      for ( QgsFeatureList::iterator features = flist.begin(); features != flist.end(); ++features )
+      {
+        const QgsAttributes &attrs = features->attributes();
+        QVariant value = fieldId[i] < attrs.count() ? attrs[ fieldId[i] ] : QVariant();
+        if ( !value.isValid() || ( !defVal.isNull() && value.toString() == defVal ) )
         {
-          QList<QVariant> primaryKeyVals;
+          defaultFeatures << &*features;
+        }
+      }
 
-          foreach ( int idx, mPrimaryKeyAttrs )
-          {
-            primaryKeyVals << attrs[ idx ];
-          }
+      if ( defaultFeatures.isEmpty() )
+        continue;
 
-          features->setFeatureId( mShared->lookupFid( QVariant( primaryKeyVals ) ) );
+      if ( defVal.isNull() )
+      {
+        foreach ( QgsFeature *feature, defaultFeatures )
+        {
+          feature->setAttribute( fieldId[i], convertValue( fld.type(), QString::null ) );
         }
-        QgsDebugMsgLevel( QString( "new fid=%1" ).arg( features->id() ), 4 );
+        continue;
+      }
+
+      QgsPostgresResult result = mConnectionRW->PQexec( QString( "SELECT %1 FROM generate_series(1,%2)" ).arg( defVal ).arg( defaultFeatures.size() ) );
+      if ( result.PQresultStatus() != PGRES_TUPLES_OK || result.PQntuples() != defaultFeatures.size() )
+        throw PGException( result );
+
+      for ( int row = 0; row < defaultFeatures.size(); row++ )
+      {
+        defaultFeatures[row]->setAttribute( fieldId[i], convertValue( fld.type(), result.PQgetisnull( row, 0 ) ? QString::null : result.PQgetvalue( row, 0 ) ) );
       }
     }
 
-    mConnectionRW->PQexecNR( "DEALLOCATE addfeatures" );
+    QString copy = QString( "COPY %1(%2) FROM STDIN" ).arg( mQuery ).arg( columns.join( "," ) );
+    QgsDebugMsg( QString( "copy addfeatures: %1" ).arg( copy ) );
+
+    QgsPostgresResult result = mConnectionRW->PQexec( copy );
+    if ( result.PQresultStatus() != PGRES_COPY_IN )
+      throw PGException( result );
+
+    bool forceMulti = QGis::isMultiType( geometryType() );
+    int srid = ( mRequestedSrid.isEmpty() ? mDetectedSrid : mRequestedSrid ).toInt();
+
+    QByteArray buffer;
+    bool copyOk = true;
+    for ( QgsFeatureList::iterator features = flist.begin(); copyOk && features != flist.end(); ++features )
+    {
+      const QgsAttributes &attrs = features->attributes();
+
+      QByteArray delim;
+      if ( !mGeometryColumn.isNull() )
+      {
+        buffer += copyGeometry( features->geometry(), forceMulti, srid );
+        delim = "\t";
+      }
+
+      for ( int i = 0; i < fieldId.size(); i++ )
+      {
+        QVariant value = fieldId[i] < attrs.count() ? attrs[ fieldId[i] ] : QVariant();
+        buffer += delim + copyValue( value.isNull() ? QString::null : value.toString() );
+        delim = "\t";
+      }
+      buffer += '\n';
+
+      if ( buffer.size() >= COPY_BUFFER_SIZE )
+      {
+        copyOk = mConnectionRW->PQputCopyData( buffer ) == 1;
+        buffer.clear();
+      }
+    }
+
+    if ( copyOk && !buffer.isEmpty() )
+    {
+      copyOk = mConnectionRW->PQputCopyData( buffer ) == 1;
+    }
+
+    mConnectionRW->PQputCopyEnd( copyOk ? QString::null : mConnectionRW->PQerrorMessage() );
+
+    // the result of the COPY, the server might still reject the data
+    result = mConnectionRW->PQgetResult();
+    QgsPostgresResult pending( mConnectionRW->PQgetResult() );
+    while ( pending.result() )
+      pending = mConnectionRW->PQgetResult();
+
+    if ( result.PQresultStatus() != PGRES_COMMAND_OK )
+      throw PGException( result );
+
+    setPrimaryKeyFeatureIds( flist );
+
     mConnectionRW->PQexecNR( "COMMIT" );
 
     mShared->addFeaturesCounted( flist.size() );
@@ -1796,7 +2043,6 @@ bool QgsPostgresProvider::addFeatures( QgsFeatureList &flist )
   {
     pushError( tr( "PostGIS error while adding features: %1" ).arg( e.errorMessage() ) );
     mConnectionRW->PQexecNR( "ROLLBACK" );
-    mConnectionRW->PQexecNR( "DEALLOCATE addfeatures" );
     returnvalue = false;
   }
 
@@ -2270,6 +2516,43 @@ bool QgsPostgresProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
   return returnvalue;
 }
 
+bool QgsPostgresProvider::createSpatialIndex()
+{
+  if ( mIsQuery || ( mSpatialColType != sctGeometry && mSpatialColType != sctGeography ) )
+    return false;
+
+  if ( !connectRW() )
+    return false;
+
+  // layer import calls this once all features are copied, existing indexes are kept
+  QString sql = QString( "SELECT 1 FROM pg_index i JOIN pg_attribute a ON a.attrelid=i.indrelid AND a.attnum=ANY(i.indkey) "
+                         "WHERE i.indrelid=%1::regclass AND a.attname=%2" )
+                .arg( quotedValue( mQuery ) )
+                .arg( quotedValue( mGeometryColumn ) );
+  QgsPostgresResult result = mConnectionRW->PQexec( sql );
+  if ( result.PQresultStatus() != PGRES_TUPLES_OK )
+  {
+    pushError( tr( "PostGIS error while creating spatial index: %1" ).arg( result.PQresultErrorMessage() ) );
+    return false;
+  }
+
+  if ( result.PQntuples() > 0 )
+    return true;
+
+  // PostgreSQL chooses an index name that does not collide with existing relations
+  sql = QString( "CREATE INDEX ON %1 USING GIST (%2)" )
+        .arg( mQuery )
+        .arg( quotedIdentifier( mGeometryColumn ) );
+  result = mConnectionRW->PQexec( sql );
+  if ( result.PQresultStatus() != PGRES_COMMAND_OK )
+  {
+    pushError( tr( "PostGIS error while creating spatial index: %1" ).arg( result.PQresultErrorMessage() ) );
+    return false;
+  }
+
+  return true;
+}
+
 QgsAttributeList QgsPostgresProvider::attributeIndexes()
 {
   QgsAttributeList lst;
@@ -187,7 +187,7 @@ class QgsPostgresProvider : public QgsVectorDataProvider
     /**Returns the default value for field specified by @c fieldId */
     QVariant defaultValue( int fieldId );
 
-    /**Adds a list of features
+    /**Adds a list of features. Large lists are inserted with COPY
       @return true in case of success and false in case of failure*/
     bool addFeatures( QgsFeatureList & flist );
 
@@ -220,6 +220,10 @@ class QgsPostgresProvider : public QgsVectorDataProvider
      */
     bool changeGeometryValues( QgsGeometryMap & geometry_map );
 
+    /**Creates a GiST index on the geometry column unless it is already indexed
+      @note added in 2.6 */
+    bool createSpatialIndex();
+
     //! Get the postgres connection
     PGconn * pgConnection();
 
@@ -311,6 +315,15 @@ class QgsPostgresProvider : public QgsVectorDataProvider
                      const QgsAttributeList &fetchAttributes );
 
     QString geomParam( int offset ) const;
+
+    /** True if the relation is a plain table without INSERT rules, which COPY would bypass */
+    bool canCopyFeatures();
+    /** Inserts the features with COPY ... FROM STDIN in text format in its own transaction */
+    bool copyFeatures( QgsFeatureList &flist );
+    /** Hex encoded EWKB of a geometry for COPY, \N if the geometry is null */
+    QByteArray copyGeometry( QgsGeometry *geom, bool forceMulti, int srid ) const;
+    /** Sets the ids of new features from their primary key attributes */
+    void setPrimaryKeyFeatureIds( QgsFeatureList &flist );
     /** Get parametrized primary key clause
      * @param offset specifies offset to use for the pk value parameter
      * @param alias specifies an optional alias given to the subject table
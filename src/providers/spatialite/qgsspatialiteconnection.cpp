@@ -763,6 +763,15 @@ QgsSqliteHandle* QgsSqliteHandle::openDb( const QString & dbPath, bool shared )
   // activating Foreign Key constraints
   sqlite3_exec( sqlite_handle, "PRAGMA foreign_keys = 1", NULL, 0, NULL );
 
+  // optional write-ahead log: commits only append to the log and readers are not
+  // blocked by writers. The journal mode is stored in the database file, so that
+  // it is only changed on request.
+  if ( shared && QSettings().value( "/SpatiaLite/walJournalMode", false ).toBool() )
+  {
+    sqlite3_exec( sqlite_handle, "PRAGMA journal_mode = WAL", NULL, 0, NULL );
+    sqlite3_exec( sqlite_handle, "PRAGMA synchronous = NORMAL", NULL, 0, NULL );
+  }
+
   QgsDebugMsg( "Connection to the database was successful" );
 
   QgsSqliteHandle *handle = new QgsSqliteHandle( sqlite_handle, dbPath, shared );
@@ -40,6 +40,10 @@ email                : a.furieri@lqt.it
 #endif
 
 const QString SPATIALITE_KEY = "spatialite";
+
+// minimum number of edits for which the R*Tree spatial index is rebuilt instead
+// of being updated by its triggers for every row
+static const int RTREE_REBUILD_MIN_FEATURES = 10000;
 const QString SPATIALITE_DESCRIPTION = "SpatiaLite data provider";
 
 
@@ -704,6 +708,9 @@ QString QgsSpatiaLiteProvider::spatialiteVersion()
 
 void QgsSpatiaLiteProvider::loadFields()
 {
+  // the cached statements may refer to old columns
+  finalizeCachedStatements();
+
   int ret;
   int i;
   sqlite3_stmt *stmt = NULL;
@@ -3553,6 +3560,7 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
   if ( ret == SQLITE_OK )
   {
     toCommit = true;
+    bool rebuildIndex = deferSpatialIndex( flist.size() );
 
     sql = QString( "INSERT INTO %1(" ).arg( quotedIdentifier( mTableName ) );
     values = QString( ") VALUES (" );
@@ -3585,8 +3593,9 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
     sql += values;
     sql += ")";
 
-    // SQLite prepared statement
-    ret = sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL );
+    // SQLite prepared statement, reused by following calls
+    stmt = cachedStatement( sql );
+    ret = stmt ? SQLITE_OK : sqlite3_errcode( sqliteHandle );
     if ( ret == SQLITE_OK )
     {
       for ( QgsFeatureList::iterator feature = flist.begin(); feature != flist.end(); ++feature )
@@ -3690,7 +3699,11 @@ bool QgsSpatiaLiteProvider::addFeatures( QgsFeatureList & flist )
           break;
         }
       }
-      if ( ret == SQLITE_DONE || ret == SQLITE_ROW )
+      if (( ret == SQLITE_DONE || ret == SQLITE_ROW ) && rebuildIndex )
+      {
+        ret = rebuildSpatialIndex( &errMsg );
+      }
+      if ( ret == SQLITE_DONE || ret == SQLITE_ROW || ret == SQLITE_OK )
       {
         ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
       }
@@ -3720,6 +3733,7 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
   sqlite3_stmt *stmt = NULL;
   char *errMsg = NULL;
   bool toCommit = false;
+  bool rebuildIndex = false;
   QString sql;
 
   int ret = sqlite3_exec( sqliteHandle, "BEGIN", NULL, NULL, &errMsg );
@@ -3729,15 +3743,17 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
     goto abort;
   }
   toCommit = true;
+  rebuildIndex = deferSpatialIndex( id.size() );
 
   sql = QString( "DELETE FROM %1 WHERE ROWID=?" ).arg( quotedIdentifier( mTableName ) );
 
-  // SQLite prepared statement
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  // SQLite prepared statement, reused by following calls
+  stmt = cachedStatement( sql );
+  if ( !stmt )
   {
     // some error occurred
-    pushError( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ) );
-    return false;
+    errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( sqliteHandle ) );
+    goto abort;
   }
 
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
@@ -3766,7 +3782,12 @@ bool QgsSpatiaLiteProvider::deleteFeatures( const QgsFeatureIds &id )
       goto abort;
     }
   }
-  sqlite3_finalize( stmt );
+
+  if ( rebuildIndex && rebuildSpatialIndex( &errMsg ) != SQLITE_OK )
+  {
+    // some error occurred
+    goto abort;
+  }
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
   if ( ret != SQLITE_OK )
@@ -3883,11 +3904,14 @@ bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap
     if ( FID_IS_NEW( fid ) )
       continue;
 
-    QString sql = QString( "UPDATE %1 SET " ).arg( quotedIdentifier( mTableName ) );
-    bool first = true;
-
     const QgsAttributeMap & attrs = iter.value();
 
+    // the values are bound to a prepared statement, which is shared by all
+    // the features with the same changed columns
+    sql = QString( "UPDATE %1 SET " ).arg( quotedIdentifier( mTableName ) );
+    QList<QgsField> fields;
+    QList<QVariant> values;
+
     // cycle through the changed attributes of the feature
     for ( QgsAttributeMap::const_iterator siter = attrs.begin(); siter != attrs.end(); ++siter )
     {
@@ -3895,42 +3919,68 @@ bool QgsSpatiaLiteProvider::changeAttributeValues( const QgsChangedAttributesMap
       try
       {
         const QgsField& fld = field( siter.key() );
-        const QVariant& val = siter.value();
 
-        if ( !first )
+        if ( !fields.isEmpty() )
           sql += ",";
-        else
-          first = false;
 
-        QVariant::Type type = fld.type();
-
-        if ( val.isNull() || !val.isValid() )
-        {
-          // binding a NULL value
-          sql += QString( "%1=NULL" ).arg( quotedIdentifier( fld.name() ) );
-        }
-        else if ( type == QVariant::Int || type == QVariant::LongLong || type == QVariant::Double )
-        {
-          // binding a NUMERIC value
-          sql += QString( "%1=%2" ).arg( quotedIdentifier( fld.name() ) ).arg( val.toString() );
-        }
-        else
-        {
-          // binding a TEXT value
-          sql += QString( "%1=%2" ).arg( quotedIdentifier( fld.name() ) ).arg( quotedValue( val.toString() ) );
-        }
+        sql += QString( "%1=?" ).arg( quotedIdentifier( fld.name() ) );
+        fields << fld;
+        values << siter.value();
       }
       catch ( SLFieldNotFound )
       {
         // Field was missing - shouldn't happen
       }
     }
-    sql += QString( " WHERE ROWID=%1" ).arg( fid );
 
-    ret = sqlite3_exec( sqliteHandle, sql.toUtf8().constData(), NULL, NULL, &errMsg );
-    if ( ret != SQLITE_OK )
+    if ( fields.isEmpty() )
+      continue;
+
+    sql += " WHERE ROWID=?";
+
+    sqlite3_stmt *stmt = cachedStatement( sql );
+    if ( !stmt )
     {
       // some error occurred
+      errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( sqliteHandle ) );
+      goto abort;
+    }
+
+    int ia = 0;
+    for ( int i = 0; i < fields.size(); ++i )
+    {
+      const QVariant& val = values[i];
+      QVariant::Type type = fields[i].type();
+
+      if ( val.isNull() || !val.isValid() )
+      {
+        // binding a NULL value
+        sqlite3_bind_null( stmt, ++ia );
+      }
+      else if ( type == QVariant::Int || type == QVariant::LongLong )
+      {
+        // binding an INTEGER value
+        sqlite3_bind_int64( stmt, ++ia, val.toLongLong() );
+      }
+      else if ( type == QVariant::Double )
+      {
+        // binding a DOUBLE value
+        sqlite3_bind_double( stmt, ++ia, val.toDouble() );
+      }
+      else
+      {
+        // binding a TEXT value
+        QByteArray ba = val.toString().toUtf8();
+        sqlite3_bind_text( stmt, ++ia, ba.constData(), ba.size(), SQLITE_TRANSIENT );
+      }
+    }
+    sqlite3_bind_int64( stmt, ++ia, FID_TO_NUMBER( fid ) );
+
+    ret = sqlite3_step( stmt );
+    if ( ret != SQLITE_DONE && ret != SQLITE_ROW )
+    {
+      // some error occurred
+      errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( sqliteHandle ) );
       goto abort;
     }
   }
@@ -3965,6 +4015,7 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
   sqlite3_stmt *stmt = NULL;
   char *errMsg = NULL;
   bool toCommit = false;
+  bool rebuildIndex = false;
   QString sql;
 
   int ret = sqlite3_exec( sqliteHandle, "BEGIN", NULL, NULL, &errMsg );
@@ -3974,6 +4025,7 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
     goto abort;
   }
   toCommit = true;
+  rebuildIndex = deferSpatialIndex( geometry_map.size() );
 
   sql =
     QString( "UPDATE %1 SET %2=GeomFromWKB(?, %3) WHERE ROWID = ?" )
@@ -3981,12 +4033,13 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
     .arg( quotedIdentifier( mGeometryColumn ) )
     .arg( mSrid );
 
-  // SQLite prepared statement
-  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+  // SQLite prepared statement, reused by following calls
+  stmt = cachedStatement( sql );
+  if ( !stmt )
   {
     // some error occurred
-    QgsMessageLog::logMessage( tr( "SQLite error: %2\nSQL: %1" ).arg( sql ).arg( sqlite3_errmsg( sqliteHandle ) ), tr( "SpatiaLite" ) );
-    return false;
+    errMsg = sqlite3_mprintf( "%s", sqlite3_errmsg( sqliteHandle ) );
+    goto abort;
   }
 
   for ( QgsGeometryMap::iterator iter = geometry_map.begin(); iter != geometry_map.end(); ++iter )
@@ -4020,7 +4073,12 @@ bool QgsSpatiaLiteProvider::changeGeometryValues( QgsGeometryMap & geometry_map
       goto abort;
     }
   }
-  sqlite3_finalize( stmt );
+
+  if ( rebuildIndex && rebuildSpatialIndex( &errMsg ) != SQLITE_OK )
+  {
+    // some error occurred
+    goto abort;
+  }
 
   ret = sqlite3_exec( sqliteHandle, "COMMIT", NULL, NULL, &errMsg );
   if ( ret != SQLITE_OK )
@@ -4053,6 +4111,9 @@ int QgsSpatiaLiteProvider::capabilities() const
 
 void QgsSpatiaLiteProvider::closeDb()
 {
+  // statements must be finalized before the handle can be closed
+  finalizeCachedStatements();
+
 // trying to close the SQLite DB
   if ( handle )
   {
@@ -4060,6 +4121,77 @@ void QgsSpatiaLiteProvider::closeDb()
   }
 }
 
+sqlite3_stmt *QgsSpatiaLiteProvider::cachedStatement( const QString &sql )
+{
+  sqlite3_stmt *stmt = mCachedStatements.value( sql );
+  if ( stmt )
+  {
+    sqlite3_reset( stmt );
+    sqlite3_clear_bindings( stmt );
+    return stmt;
+  }
+
+  if ( sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL ) != SQLITE_OK )
+    return NULL;
+
+  mCachedStatements.insert( sql, stmt );
+  return stmt;
+}
+
+void QgsSpatiaLiteProvider::finalizeCachedStatements()
+{
+  foreach ( sqlite3_stmt *stmt, mCachedStatements )
+  {
+    sqlite3_finalize( stmt );
+  }
+  mCachedStatements.clear();
+}
+
+bool QgsSpatiaLiteProvider::deferSpatialIndex( int count )
+{
+  if ( !mTableBased || !spatialIndexRTree || count < RTREE_REBUILD_MIN_FEATURES || count < numberFeatures / 4 )
+    return false;
+
+  // removes the triggers, but keeps the index table
+  QString sql = QString( "SELECT DisableSpatialIndex(%1, %2)" )
+                .arg( quotedValue( mTableName ) )
+                .arg( quotedValue( mGeometryColumn ) );
+  if ( sqlite3_exec( sqliteHandle, sql.toUtf8().constData(), NULL, NULL, NULL ) != SQLITE_OK )
+  {
+    QgsDebugMsg( QString( "Could not disable the spatial index: %1" ).arg( QString::fromUtf8( sqlite3_errmsg( sqliteHandle ) ) ) );
+    return false;
+  }
+
+  QgsDebugMsg( QString( "Spatial index of %1 will be rebuilt after %2 edits" ).arg( mTableName ).arg( count ) );
+  return true;
+}
+
+int QgsSpatiaLiteProvider::rebuildSpatialIndex( char **errMsg )
+{
+  QString idxName = QString( "idx_%1_%2" ).arg( mTableName ).arg( mGeometryColumn );
+  QString sql = QString( "DROP TABLE IF EXISTS %1" ).arg( quotedIdentifier( idxName ) );
+  int ret = sqlite3_exec( sqliteHandle, sql.toUtf8().constData(), NULL, NULL, errMsg );
+  if ( ret != SQLITE_OK )
+    return ret;
+
+  // creates the triggers and the index table and fills it from the table
+  sqlite3_stmt *stmt = NULL;
+  sql = QString( "SELECT CreateSpatialIndex(%1, %2)" )
+        .arg( quotedValue( mTableName ) )
+        .arg( quotedValue( mGeometryColumn ) );
+  ret = sqlite3_prepare_v2( sqliteHandle, sql.toUtf8().constData(), -1, &stmt, NULL );
+  if ( ret == SQLITE_OK )
+  {
+    ret = sqlite3_step( stmt ) == SQLITE_ROW && sqlite3_column_int( stmt, 0 ) == 1 ? SQLITE_OK : SQLITE_ERROR;
+  }
+  if ( ret != SQLITE_OK )
+  {
+    *errMsg = sqlite3_mprintf( "could not rebuild the spatial index: %s", sqlite3_errmsg( sqliteHandle ) );
+  }
+  sqlite3_finalize( stmt );
+  return ret;
+}
+
 QString QgsSpatiaLiteProvider::quotedIdentifier( QString id )
 {
   id.replace( "\"", "\"\"" );
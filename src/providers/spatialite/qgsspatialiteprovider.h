@@ -391,11 +391,26 @@ class QgsSpatiaLiteProvider: public QgsVectorDataProvider
     //! SpatiaLite minor version
     int mSpatialiteVersionMinor;
 
+    //! prepared statements reused by the edits, by SQL
+    QMap<QString, sqlite3_stmt *> mCachedStatements;
+
     /**
     * internal utility functions used to handle common SQLite tasks
     */
     //void sqliteOpen();
     void closeDb();
+
+    /** Returns a prepared statement for the SQL, reset and without bindings, or NULL if it
+     *  cannot be prepared. Statements are kept until the fields are reloaded or the database is closed */
+    sqlite3_stmt *cachedStatement( const QString &sql );
+    void finalizeCachedStatements();
+
+    /** Drops the triggers of the R*Tree spatial index if a batch of edits is large enough
+     *  for rebuilding the index afterwards to be faster than updating it for every row
+     *  @return true if the index has to be rebuilt with rebuildSpatialIndex() */
+    bool deferSpatialIndex( int count );
+    /** Recreates the R*Tree spatial index and its triggers */
+    int rebuildSpatialIndex( char **errMsg );
     bool checkLayerType();
     bool getGeometryDetails();
     bool getTableGeometryDetails();
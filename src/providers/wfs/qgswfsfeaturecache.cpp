@@ -0,0 +1,186 @@
+/***************************************************************************
+    qgswfsfeaturecache.cpp
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgswfsfeaturecache.h"
+
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QTemporaryFile>
+
+#include <string.h>
+
+static bool _readRecord( QIODevice* device, qint64 offset, QgsFeature& feature, bool fetchGeometry )
+{
+  if ( !device->seek( offset ) )
+    return false;
+
+  QDataStream in( device );
+  in.setVersion( QDataStream::Qt_4_6 );
+
+  qint64 id;
+  QgsAttributes attributes;
+  QByteArray wkb;
+  in >> id >> attributes;
+  if ( fetchGeometry )
+    in >> wkb;
+  if ( in.status() != QDataStream::Ok )
+    return false;
+
+  feature.setFeatureId( id );
+  feature.setAttributes( attributes );
+  if ( !wkb.isEmpty() )
+  {
+    unsigned char* geom = new unsigned char[wkb.size()];
+    memcpy( geom, wkb.constData(), wkb.size() );
+    feature.setGeometryAndOwnership( geom, wkb.size() );
+  }
+  else
+  {
+    feature.setGeometry( 0 );
+  }
+  return true;
+}
+
+QgsWFSFeatureCache::QgsWFSFeatureCache()
+    : mNextFeatureId( 0 )
+{
+}
+
+QString QgsWFSFeatureCache::fileName() const
+{
+  return mFile.isNull() ? QString() : mFile->fileName();
+}
+
+bool QgsWFSFeatureCache::addFeature( const QgsFeature& feature )
+{
+  if ( mFile.isNull() )
+  {
+    mFile = QSharedPointer<QTemporaryFile>( new QTemporaryFile( QDir::tempPath() + "/qgis_wfs_XXXXXX.cache" ) );
+    if ( !mFile->open() )
+    {
+      QgsDebugMsg( "Could not create the feature cache file " + mFile->fileTemplate() );
+      mFile.clear();
+      return false;
+    }
+  }
+
+  QByteArray wkb;
+  QgsGeometry* geometry = feature.geometry();
+  if ( geometry && geometry->asWkb() )
+    wkb = QByteArray( reinterpret_cast<const char*>( geometry->asWkb() ), geometry->wkbSize() );
+
+  Entry entry;
+  entry.offset = mFile->size();
+  entry.hasGeometry = !wkb.isEmpty();
+  if ( entry.hasGeometry )
+    entry.boundingBox = geometry->boundingBox();
+
+  mFile->seek( entry.offset );
+  QDataStream out( mFile.data() );
+  out.setVersion( QDataStream::Qt_4_6 );
+  out << ( qint64 ) feature.id() << feature.attributes() << wkb;
+  if ( out.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( "Could not write to the feature cache file " + mFile->fileName() );
+    return false;
+  }
+
+  QHash<QgsFeatureId, Entry>::const_iterator it = mEntries.constFind( feature.id() );
+  if ( it != mEntries.constEnd() )
+    unindex( feature.id(), it.value() );
+
+  mEntries.insert( feature.id(), entry );
+  if ( entry.hasGeometry )
+    mSpatialIndex.insertFeature( feature );
+
+  mNextFeatureId = qMax( mNextFeatureId, feature.id() + 1 );
+  return true;
+}
+
+bool QgsWFSFeatureCache::removeFeature( QgsFeatureId id )
+{
+  QHash<QgsFeatureId, Entry>::iterator it = mEntries.find( id );
+  if ( it == mEntries.end() )
+    return false;
+
+  unindex( id, it.value() );
+  mEntries.erase( it );
+  return true;
+}
+
+bool QgsWFSFeatureCache::feature( QgsFeatureId id, QgsFeature& feature ) const
+{
+  QHash<QgsFeatureId, Entry>::const_iterator it = mEntries.constFind( id );
+  if ( it == mEntries.constEnd() )
+    return false;
+
+  mFile->flush();
+  return _readRecord( mFile.data(), it.value().offset, feature, true );
+}
+
+void QgsWFSFeatureCache::flush() const
+{
+  if ( !mFile.isNull() )
+    mFile->flush();
+}
+
+void QgsWFSFeatureCache::clear()
+{
+  // snapshots keep the old file
+  mFile.clear();
+  mEntries.clear();
+  mSpatialIndex = QgsSpatialIndex();
+  mNextFeatureId = 0;
+}
+
+void QgsWFSFeatureCache::unindex( QgsFeatureId id, const Entry& entry )
+{
+  if ( !entry.hasGeometry )
+    return;
+
+  // the spatial index only needs the id and the bounding box
+  QgsFeature f( id );
+  f.setGeometry( QgsGeometry::fromRect( entry.boundingBox ) );
+  mSpatialIndex.deleteFeature( f );
+}
+
+
+// -------------------------
+
+QgsWFSFeatureCacheReader::QgsWFSFeatureCacheReader( const QgsWFSFeatureCache& cache )
+    : mCache( cache )
+{
+}
+
+bool QgsWFSFeatureCacheReader::feature( QgsFeatureId id, QgsFeature& feature, bool fetchGeometry )
+{
+  QHash<QgsFeatureId, QgsWFSFeatureCache::Entry>::const_iterator it = mCache.mEntries.constFind( id );
+  if ( it == mCache.mEntries.constEnd() )
+    return false;
+
+  if ( !mFile.isOpen() )
+  {
+    mFile.setFileName( mCache.fileName() );
+    if ( !mFile.open( QIODevice::ReadOnly ) )
+    {
+      QgsDebugMsg( "Could not open the feature cache file " + mFile.fileName() );
+      return false;
+    }
+  }
+
+  return _readRecord( &mFile, it.value().offset, feature, fetchGeometry );
+}
@@ -0,0 +1,111 @@
+/***************************************************************************
+    qgswfsfeaturecache.h
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSWFSFEATURECACHE_H
+#define QGSWFSFEATURECACHE_H
+
+#include "qgsfeature.h"
+#include "qgsrectangle.h"
+#include "qgsspatialindex.h"
+
+#include <QFile>
+#include <QHash>
+#include <QSharedPointer>
+
+class QTemporaryFile;
+
+/**
+ * Disk cache of the features downloaded from a WFS server.
+ *
+ * The attributes and geometries of the features are appended to a temporary file,
+ * only the file offsets, bounding boxes and the spatial index are kept in memory.
+ * Changed features are appended again, so the records of the file are never
+ * overwritten: copies of the cache are snapshots which the feature sources
+ * read with a QgsWFSFeatureCacheReader, while the provider keeps adding features.
+ * A copy shares the offsets and the spatial index with the cache until the next
+ * change, which copies them (implicit sharing). The file is removed when the
+ * last snapshot using it is deleted.
+ */
+class QgsWFSFeatureCache
+{
+  public:
+    QgsWFSFeatureCache();
+
+    //! number of features
+    int count() const { return mEntries.count(); }
+
+    bool contains( QgsFeatureId id ) const { return mEntries.contains( id ); }
+
+    QList<QgsFeatureId> ids() const { return mEntries.keys(); }
+
+    //! ids of the features whose bounding box intersects the rectangle
+    QList<QgsFeatureId> intersects( const QgsRectangle& rect ) const { return mSpatialIndex.intersects( rect ); }
+
+    //! an id larger than the ids of all features added so far
+    QgsFeatureId nextFeatureId() const { return mNextFeatureId; }
+
+    //! name of the file with the features, empty if no feature has been added yet
+    QString fileName() const;
+
+    //! adds or replaces a feature
+    bool addFeature( const QgsFeature& feature );
+
+    bool removeFeature( QgsFeatureId id );
+
+    //! reads a feature, from the provider thread
+    bool feature( QgsFeatureId id, QgsFeature& feature ) const;
+
+    //! writes the buffered features to the file, for the readers of the snapshots
+    void flush() const;
+
+    //! removes all features and starts a new file
+    void clear();
+
+  private:
+    struct Entry
+    {
+      qint64 offset;
+      QgsRectangle boundingBox;
+      bool hasGeometry;
+    };
+
+    //! removes the feature from the spatial index
+    void unindex( QgsFeatureId id, const Entry& entry );
+
+    QSharedPointer<QTemporaryFile> mFile;
+    QHash<QgsFeatureId, Entry> mEntries;
+    QgsSpatialIndex mSpatialIndex;
+    QgsFeatureId mNextFeatureId;
+
+    friend class QgsWFSFeatureCacheReader;
+};
+
+/** Reads the features of a snapshot of the cache through its own file handle */
+class QgsWFSFeatureCacheReader
+{
+  public:
+    QgsWFSFeatureCacheReader( const QgsWFSFeatureCache& cache );
+
+    /**
+     * Reads a feature
+     * @return false if the feature is not in the snapshot or could not be read
+     */
+    bool feature( QgsFeatureId id, QgsFeature& feature, bool fetchGeometry = true );
+
+  private:
+    QgsWFSFeatureCache mCache;
+    QFile mFile;
+};
+
+#endif // QGSWFSFEATURECACHE_H
@@ -13,28 +13,26 @@
  *                                                                         *
  ***************************************************************************/
 #include "qgswfsfeatureiterator.h"
-#include "qgsspatialindex.h"
 #include "qgswfsprovider.h"
 #include "qgsmessagelog.h"
 #include "qgsgeometry.h"
 
 QgsWFSFeatureIterator::QgsWFSFeatureIterator( QgsWFSFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource( source, ownSource, request )
+    , mReader( source->mFeatureCache )
 {
   switch ( request.filterType() )
   {
     case QgsFeatureRequest::FilterRect:
-      if ( mSource->mSpatialIndex )
-      {
-        mSelectedFeatures = mSource->mSpatialIndex->intersects( request.filterRect() );
-      }
+      mSelectedFeatures = mSource->mFeatureCache.intersects( request.filterRect() );
       break;
     case QgsFeatureRequest::FilterFid:
       mSelectedFeatures.push_back( request.filterFid() );
       break;
     case QgsFeatureRequest::FilterNone:
     default:
-      mSelectedFeatures = mSource->mFeatures.keys();
+      mSelectedFeatures = mSource->mFeatureCache.ids();
+      qSort( mSelectedFeatures );
   }
 
   mFeatureIterator = mSelectedFeatures.constBegin();
@@ -55,30 +53,30 @@ bool QgsWFSFeatureIterator::fetchFeature( QgsFeature& f )
     return false;
   }
 
-  const QgsFeature *fet = 0;
+  bool exactIntersect = ( mRequest.flags() & QgsFeatureRequest::ExactIntersect ) != 0;
+  bool fetchGeometry = exactIntersect || !( mRequest.flags() & QgsFeatureRequest::NoGeometry );
 
   for ( ;; )
   {
     if ( mFeatureIterator == mSelectedFeatures.constEnd() )
       return false;
 
-    QgsFeaturePtrMap::const_iterator it = mSource->mFeatures.constFind( *mFeatureIterator );
-    if ( it == mSource->mFeatures.constEnd() )
+    if ( !mReader.feature( *mFeatureIterator, f, fetchGeometry ) )
       return false;
 
-    fet = it.value();
-    if (( mRequest.flags() & QgsFeatureRequest::ExactIntersect ) == 0 )
-      break;
+    ++mFeatureIterator;
 
-    if ( fet->geometry() && fet->geometry()->intersects( mRequest.filterRect() ) )
+    if ( !exactIntersect )
       break;
 
-    ++mFeatureIterator;
+    if ( f.geometry() && f.geometry()->intersects( mRequest.filterRect() ) )
+      break;
   }
 
+  if ( mRequest.flags() & QgsFeatureRequest::NoGeometry )
+    f.setGeometry( 0 );
 
-  copyFeature( fet, f, !( mRequest.flags() & QgsFeatureRequest::NoGeometry ) );
-  ++mFeatureIterator;
+  convertAttributes( f );
   return true;
 }
 
@@ -105,44 +103,20 @@ bool QgsWFSFeatureIterator::close()
 
 
 
-void QgsWFSFeatureIterator::copyFeature( const QgsFeature* f, QgsFeature& feature, bool fetchGeometry )
+void QgsWFSFeatureIterator::convertAttributes( QgsFeature& feature )
 {
-  Q_UNUSED( fetchGeometry );
-
-  if ( !f )
-  {
-    return;
-  }
-
-  //copy the geometry
-  QgsGeometry* geometry = f->geometry();
-  if ( geometry && fetchGeometry )
-  {
-    const unsigned char *geom = geometry->asWkb();
-    int geomSize = geometry->wkbSize();
-    unsigned char* copiedGeom = new unsigned char[geomSize];
-    memcpy( copiedGeom, geom, geomSize );
-    feature.setGeometryAndOwnership( copiedGeom, geomSize );
-  }
-  else
-  {
-    feature.setGeometry( 0 );
-  }
-
-  //and the attributes
-  feature.initAttributes( mSource->mFields.size() );
+  QgsAttributes attributes = feature.attributes();
+  attributes.resize( mSource->mFields.size() );
   for ( int i = 0; i < mSource->mFields.size(); i++ )
   {
-    const QVariant &v = f->attributes().value( i );
+    const QVariant &v = attributes.at( i );
     if ( v.type() != mSource->mFields[i].type() )
-      feature.setAttribute( i, QgsVectorDataProvider::convertValue( mSource->mFields[i].type(), v.toString() ) );
-    else
-      feature.setAttribute( i, v );
+      attributes[i] = QgsVectorDataProvider::convertValue( mSource->mFields[i].type(), v.toString() );
   }
+  feature.setAttributes( attributes );
 
-  //id and valid
+  //valid and fields
   feature.setValid( true );
-  feature.setFeatureId( f->id() );
   feature.setFields( &mSource->mFields ); // allow name-based attribute lookups
 }
 
@@ -152,14 +126,12 @@ void QgsWFSFeatureIterator::copyFeature( const QgsFeature* f, QgsFeature& featur
 QgsWFSFeatureSource::QgsWFSFeatureSource( const QgsWFSProvider* p )
     : QObject(( QgsWFSProvider* ) p )
     , mFields( p->mFields )
-    , mFeatures( p->mFeatures )
-    , mSpatialIndex( p->mSpatialIndex ? new QgsSpatialIndex( *p->mSpatialIndex ) : 0 )  // just shallow copy
+    , mFeatureCache( p->mFeatureCache )  // just shallow copy
 {
 }
 
 QgsWFSFeatureSource::~QgsWFSFeatureSource()
 {
-  delete mSpatialIndex;
 }
 
 QgsFeatureIterator QgsWFSFeatureSource::getFeatures( const QgsFeatureRequest& request )
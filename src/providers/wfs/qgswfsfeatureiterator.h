@@ -16,10 +16,9 @@
 #define QGSWFSFEATUREITERATOR_H
 
 #include "qgsfeatureiterator.h"
+#include "qgswfsfeaturecache.h"
 
 class QgsWFSProvider;
-class QgsSpatialIndex;
-typedef QMap<QgsFeatureId, QgsFeature*> QgsFeaturePtrMap;
 
 
 class QgsWFSFeatureSource : public QObject, public QgsAbstractFeatureSource
@@ -38,8 +37,8 @@ class QgsWFSFeatureSource : public QObject, public QgsAbstractFeatureSource
   protected:
 
     QgsFields mFields;
-    QgsFeaturePtrMap mFeatures;
-    QgsSpatialIndex* mSpatialIndex;
+    //! snapshot of the features of the provider
+    QgsWFSFeatureCache mFeatureCache;
 
     friend class QgsWFSFeatureIterator;
 };
@@ -56,12 +55,13 @@ class QgsWFSFeatureIterator : public QgsAbstractFeatureIteratorFromSource<QgsWFS
   protected:
     bool fetchFeature( QgsFeature& f );
 
-    /**Copies feature attributes / geometry from f to feature*/
-    void copyFeature( const QgsFeature* f, QgsFeature& feature, bool fetchGeometry );
+    /**Converts the attributes of a feature read from the cache to the field types*/
+    void convertAttributes( QgsFeature& feature );
 
   private:
     QList<QgsFeatureId> mSelectedFeatures;
     QList<QgsFeatureId>::const_iterator mFeatureIterator;
+    QgsWFSFeatureCacheReader mReader;
 };
 
 #endif // QGSWFSFEATUREITERATOR_H
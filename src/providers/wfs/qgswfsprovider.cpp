@@ -17,6 +17,9 @@
 
 #define WFS_THRESHOLD 200
 
+//uncovered parts of requested extents are merged if there are more
+#define WFS_MAX_EXTENT_REQUESTS 4
+
 #include "qgis.h"
 #include "qgsapplication.h"
 #include "qgsmaplayerregistry.h"
@@ -28,12 +31,12 @@
 #include "qgswfsfeatureiterator.h"
 #include "qgswfsprovider.h"
 #include "qgsdatasourceuri.h"
-#include "qgsspatialindex.h"
 #include "qgslogger.h"
 #include "qgsmessagelog.h"
 #include "qgsnetworkaccessmanager.h"
 #include "qgsogcutils.h"
 
+#include <QCryptographicHash>
 #include <QDomDocument>
 #include <QMessageBox>
 #include <QDomNodeList>
@@ -43,6 +46,7 @@
 #include <QUrl>
 #include <QWidget>
 #include <QPair>
+#include <QSettings>
 #include <QTimer>
 
 #include <cfloat>
@@ -64,6 +68,7 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
     , mSourceCRS( 0 )
     , mFeatureCount( 0 )
     , mValid( true )
+    , mCached( false )
     , mPendingRetrieval( false )
 #if 0
     , mLayer( 0 )
@@ -71,7 +76,9 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
     , mInitGro( false )
 #endif
 {
-  mSpatialIndex = 0;
+  QSettings settings;
+  mPageSize = settings.value( "/qgis/wfsPageSize", 1000 ).toInt();
+
   if ( uri.isEmpty() )
   {
     mValid = false;
@@ -111,13 +118,11 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
   //Failed to detect feature type from describeFeatureType -> get first feature from layer to detect type
   if ( mWKBType == QGis::WKBUnknown )
   {
-    QString bkUri = dataSourceUri();
     QUrl typeDetectionUri( uri );
     typeDetectionUri.removeQueryItem( "BBOX" );
     typeDetectionUri.addQueryItem( "MAXFEATURES", "1" );
-    setDataSourceUri( typeDetectionUri.toString() );
-    reloadData();
-    setDataSourceUri( bkUri );
+    getFeature( typeDetectionUri.toString() );
+    deleteData();
   }
 
   mCached = !uri.contains( "BBOX=" );
@@ -137,11 +142,12 @@ QgsWFSProvider::QgsWFSProvider( const QString& uri )
 QgsWFSProvider::~QgsWFSProvider()
 {
   deleteData();
-  delete mSpatialIndex;
 }
 
 QgsAbstractFeatureSource* QgsWFSProvider::featureSource() const
 {
+  //the snapshot reads the file through its own handle, also while a download is in progress
+  mFeatureCache.flush();
   QgsWFSFeatureSource *fs = new QgsWFSFeatureSource( this );
   connect( fs, SIGNAL( extentRequested( const QgsRectangle & ) ),
            this, SLOT( extendExtent( const QgsRectangle & ) ) );
@@ -150,24 +156,29 @@ QgsAbstractFeatureSource* QgsWFSProvider::featureSource() const
 
 void QgsWFSProvider::reloadData()
 {
-  mPendingRetrieval = false;
-  deleteData();
-  delete mSpatialIndex;
-  mSpatialIndex = new QgsSpatialIndex();
-  mValid = !getFeature( dataSourceUri() );
-
-  if ( !mCached )
-    emit dataChanged();
+  if ( mCached )
+  {
+    mPendingRetrieval = false;
+    deleteData();
+    mValid = !getFeature( dataSourceUri() );
+  }
+  else
+  {
+    //download the features of all extents requested so far again
+    mPendingExtents << mDownloadedExtents;
+    deleteData();
+    downloadPendingExtents();
+  }
 }
 
 void QgsWFSProvider::deleteData()
 {
   mSelectedFeatures.clear();
-  for ( int i = 0; i < mFeatures.size(); i++ )
-  {
-    delete mFeatures[i];
-  }
-  mFeatures.clear();
+  mFeatureCache.clear();
+  mIdMap.clear();
+  mWfsIdMap.clear();
+  mDownloadedExtents.clear();
+  mFeatureCount = 0;
 }
 
 
@@ -354,23 +365,21 @@ bool QgsWFSProvider::addFeatures( QgsFeatureList &flist )
 
   if ( transactionSuccess( serverResponse ) )
   {
-    //transaction successful. Add the features to mSpatialIndex
-    if ( mSpatialIndex )
-    {
-      QStringList idList = insertedFeatureIds( serverResponse );
-      QStringList::const_iterator idIt = idList.constBegin();
-      featureIt = flist.begin();
+    //transaction successful. Add the features to the cache
+    QStringList idList = insertedFeatureIds( serverResponse );
+    QStringList::const_iterator idIt = idList.constBegin();
+    featureIt = flist.begin();
 
-      for ( ; idIt != idList.constEnd() && featureIt != flist.end(); ++idIt, ++featureIt )
-      {
-        QgsFeatureId newId = findNewKey();
-        featureIt->setFeatureId( newId );
-        mFeatures.insert( newId, new QgsFeature( *featureIt ) );
-        mIdMap.insert( newId, *idIt );
-        mSpatialIndex->insertFeature( *featureIt );
-        mFeatureCount = mFeatures.size();
-      }
+    for ( ; idIt != idList.constEnd() && featureIt != flist.end(); ++idIt, ++featureIt )
+    {
+      QgsFeatureId newId = findNewKey();
+      featureIt->setFeatureId( newId );
+      mFeatureCache.addFeature( *featureIt );
+      mIdMap.insert( newId, *idIt );
+      mWfsIdMap.insert( *idIt, newId );
     }
+    mFeatureCache.flush();
+    mFeatureCount = mFeatureCache.count();
     return true;
   }
   else
@@ -433,17 +442,10 @@ bool QgsWFSProvider::deleteFeatures( const QgsFeatureIds &id )
     idIt = id.constBegin();
     for ( ; idIt != id.constEnd(); ++idIt )
     {
-      QMap<QgsFeatureId, QgsFeature* >::iterator fIt = mFeatures.find( *idIt );
-      if ( fIt != mFeatures.end() )
-      {
-        if ( mSpatialIndex )
-        {
-          mSpatialIndex->deleteFeature( *fIt.value() );
-        }
-        delete fIt.value();
-        mFeatures.remove( *idIt );
-      }
+      mFeatureCache.removeFeature( *idIt );
+      mWfsIdMap.remove( mIdMap.take( *idIt ) );
     }
+    mFeatureCount = mFeatureCache.count();
     return true;
   }
   else
@@ -514,24 +516,16 @@ bool QgsWFSProvider::changeGeometryValues( QgsGeometryMap & geometry_map )
     geomIt = geometry_map.begin();
     for ( ; geomIt != geometry_map.end(); ++geomIt )
     {
-      QMap<QgsFeatureId, QgsFeature* >::iterator fIt = mFeatures.find( geomIt.key() );
-      if ( fIt == mFeatures.end() )
-      {
-        continue;
-      }
-      QgsFeature* currentFeature = fIt.value();
-      if ( !currentFeature )
+      QgsFeature currentFeature;
+      if ( !mFeatureCache.feature( geomIt.key(), currentFeature ) )
       {
         continue;
       }
 
-      if ( mSpatialIndex )
-      {
-        mSpatialIndex->deleteFeature( *currentFeature );
-        fIt.value()->setGeometry( geomIt.value() );
-        mSpatialIndex->insertFeature( *currentFeature );
-      }
+      currentFeature.setGeometry( geomIt.value() );
+      mFeatureCache.addFeature( currentFeature );
     }
+    mFeatureCache.flush();
     return true;
   }
   else
@@ -606,18 +600,12 @@ bool QgsWFSProvider::changeAttributeValues( const QgsChangedAttributesMap &attr_
 
   if ( transactionSuccess( serverResponse ) )
   {
-    //change attributes in mFeatures
+    //change attributes in the cache
     attIt = attr_map.constBegin();
     for ( ; attIt != attr_map.constEnd(); ++attIt )
     {
-      QMap<QgsFeatureId, QgsFeature*>::iterator fIt = mFeatures.find( attIt.key() );
-      if ( fIt == mFeatures.end() )
-      {
-        continue;
-      }
-
-      QgsFeature* currentFeature = fIt.value();
-      if ( !currentFeature )
+      QgsFeature currentFeature;
+      if ( !mFeatureCache.feature( attIt.key(), currentFeature ) )
       {
         continue;
       }
@@ -625,9 +613,11 @@ bool QgsWFSProvider::changeAttributeValues( const QgsChangedAttributesMap &attr_
       QgsAttributeMap::const_iterator attMapIt = attIt.value().constBegin();
       for ( ; attMapIt != attIt.value().constEnd(); ++attMapIt )
       {
-        currentFeature->setAttribute( attMapIt.key(), attMapIt.value() );
+        currentFeature.setAttribute( attMapIt.key(), attMapIt.value() );
       }
+      mFeatureCache.addFeature( currentFeature );
     }
+    mFeatureCache.flush();
     return true;
   }
   else
@@ -673,9 +663,6 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
   }
 
   QString typeName = parameterFromUrl( "typename" );
-  QgsGml dataReader( typeName, geometryAttribute, mFields );
-
-  connect( &dataReader, SIGNAL( dataProgressAndSteps( int , int ) ), this, SLOT( handleWFSProgressMessage( int, int ) ) );
 
   //also connect to statusChanged signal of qgisapp (if it exists)
   QWidget* mainWindow = 0;
@@ -692,35 +679,132 @@ int QgsWFSProvider::getFeatureGET( const QString& uri, const QString& geometryAt
 
   if ( mainWindow )
   {
-    connect( this, SIGNAL( dataReadProgressMessage( QString ) ), mainWindow, SLOT( showStatusMessage( QString ) ) );
+    connect( this, SIGNAL( dataReadProgressMessage( QString ) ), mainWindow, SLOT( showStatusMessage( QString ) ), Qt::UniqueConnection );
   }
 
-  //if ( dataReader.getWFSData() != 0 )
   QUrl getFeatureUrl( uri );
   getFeatureUrl.removeQueryItem( "username" );
   getFeatureUrl.removeQueryItem( "password" );
-  QgsRectangle extent;
-  if ( dataReader.getFeatures( getFeatureUrl.toString(), &mWKBType, mCached ? &mExtent : &extent, mAuth.mUserName, mAuth.mPassword ) != 0 )
+
+  //with a page size, the features are requested in pages with STARTINDEX and MAXFEATURES,
+  //so only one page of features is held by the parser at a time. MAXFEATURES of the uri limits the total
+  int maxFeatures = getFeatureUrl.queryItemValue( "MAXFEATURES" ).toInt();
+  int startIndex = 0;
+  bool paging = mPageSize > 0;
+  QSet<QString> previousPageIds;
+  for ( ;; )
   {
-    QgsDebugMsg( "getWFSData returned with error" );
-    return 1;
+    int pageSize = paging ? mPageSize : 0;
+    if ( maxFeatures > 0 && pageSize > maxFeatures - startIndex )
+    {
+      pageSize = maxFeatures - startIndex;
+    }
+
+    QUrl pageUrl( getFeatureUrl );
+    if ( pageSize > 0 )
+    {
+      pageUrl.removeQueryItem( "STARTINDEX" );
+      pageUrl.removeQueryItem( "MAXFEATURES" );
+      pageUrl.addQueryItem( "STARTINDEX", QString::number( startIndex ) );
+      pageUrl.addQueryItem( "MAXFEATURES", QString::number( pageSize ) );
+    }
+
+    QgsGml dataReader( typeName, geometryAttribute, mFields );
+    connect( &dataReader, SIGNAL( dataProgressAndSteps( int , int ) ), this, SLOT( handleWFSProgressMessage( int, int ) ) );
+
+    QgsRectangle extent;
+    if ( dataReader.getFeatures( pageUrl.toString(), &mWKBType, &extent, mAuth.mUserName, mAuth.mPassword ) != 0 )
+    {
+      QgsDebugMsg( "getWFSData returned with error" );
+      mFeatureCache.flush();
+      return 1;
+    }
+
+    if ( mCached )
+    {
+      if ( startIndex == 0 )
+        mExtent = extent;
+      else
+        mExtent.combineExtentWith( &extent );
+    }
+
+    QSet<QString> pageIds;
+    int readFeatures = addFeaturesFromGml( dataReader, pageIds, previousPageIds );
+    startIndex += readFeatures;
+    mFeatureCache.flush();
+
+    QgsDebugMsg( QString( "%1 features read, feature count after request is: %2" ).arg( readFeatures ).arg( mFeatureCache.count() ) );
+
+    if ( pageSize > 0 && readFeatures == pageSize && pageIds == previousPageIds )
+    {
+      //the server ignores STARTINDEX and returned the first page again: request all features at once
+      QgsDebugMsg( "STARTINDEX ignored by the server, requesting the features without paging" );
+      paging = false;
+      startIndex = 0;
+      continue;
+    }
+
+    //stop after the last page, or if the server ignores MAXFEATURES and returned everything.
+    //Pages of features which are all cached already (e.g. from a neighbouring extent) are no reason to stop
+    if ( pageSize <= 0 || readFeatures != pageSize || pageIds == previousPageIds ||
+         ( maxFeatures > 0 && startIndex >= maxFeatures ) )
+    {
+      break;
+    }
+    previousPageIds = pageIds;
   }
-  mFeatures = dataReader.featuresMap();
-  mIdMap = dataReader.idsMap();
 
-  QgsDebugMsg( QString( "feature count after request is: %1" ).arg( mFeatures.size() ) );
+  mFeatureCache.flush();
+  mFeatureCount = mFeatureCache.count();
 
-  if ( mWKBType != QGis::WKBNoGeometry )
+  return 0;
+}
+
+int QgsWFSProvider::addFeaturesFromGml( QgsGml& dataReader, QSet<QString>& pageIds, const QSet<QString>& previousPageIds )
+{
+  QMap<QgsFeatureId, QgsFeature* > features = dataReader.featuresMap();
+  QMap<QgsFeatureId, QString > ids = dataReader.idsMap();
+
+  for ( QMap<QgsFeatureId, QgsFeature*>::iterator it = features.begin(); it != features.end(); ++it )
   {
-    for ( QMap<QgsFeatureId, QgsFeature*>::iterator it = mFeatures.begin(); it != mFeatures.end(); ++it )
+    QgsFeature* f = it.value();
+    QString wfsId = ids.value( it.key() );
+    QString pageId = wfsId;
+
+    if ( pageId.isEmpty() )
     {
-      QgsDebugMsg( "feature " + FID_TO_STRING(( *it )->id() ) );
-      mSpatialIndex->insertFeature( *( it.value() ) );
+      QCryptographicHash hash( QCryptographicHash::Md5 );
+      foreach ( const QVariant& attribute, f->attributes() )
+      {
+        hash.addData( attribute.toString().toUtf8() + '\0' );
+      }
+      if ( f->geometry() && f->geometry()->asWkb() )
+      {
+        hash.addData( reinterpret_cast<const char*>( f->geometry()->asWkb() ), f->geometry()->wkbSize() );
+      }
+      pageId = hash.result().toHex();
+    }
+    pageIds.insert( pageId );
+
+    //features crossing the border of a downloaded extent are returned again. Features without id
+    //can only be recognized if the server returns the previous page again
+    bool cached = wfsId.isEmpty() ? previousPageIds.contains( pageId ) : mWfsIdMap.contains( wfsId );
+    if ( !cached )
+    {
+      QgsFeatureId id = findNewKey();
+      f->setFeatureId( id );
+      mFeatureCache.addFeature( *f );
+      if ( !wfsId.isEmpty() )
+      {
+        mIdMap.insert( id, wfsId );
+        mWfsIdMap.insert( wfsId, id );
+      }
     }
+
+    delete f;
   }
-  mFeatureCount = mFeatures.size();
 
-  return 0;
+  return features.size();
 }
 
 int QgsWFSProvider::getFeatureFILE( const QString& uri, const QString& geometryAttribute )
@@ -1175,14 +1259,11 @@ int QgsWFSProvider::getFeaturesFromGML2( const QDomElement& wfsCollectionElement
   QDomElement layerNameElem;
   QDomNode currentAttributeChild;
   QDomElement currentAttributeElement;
-  QgsFeature* f = 0;
-  unsigned char* wkb = 0;
-  int wkbSize = 0;
   mFeatureCount = 0;
 
   for ( int i = 0; i < featureTypeNodeList.size(); ++i )
   {
-    f = new QgsFeature( fields(), mFeatureCount );
+    QgsFeature f( fields(), mFeatureCount );
     currentFeatureMemberElem = featureTypeNodeList.at( i ).toElement();
     //the first child element is always <namespace:layer>
     layerNameElem = currentFeatureMemberElem.firstChild().toElement();
@@ -1207,24 +1288,20 @@ int QgsWFSProvider::getFeaturesFromGML2( const QDomElement& wfsCollectionElement
 
           const QgsField &fld = mFields[attr];
           QgsDebugMsg( QString( "set attribute %1: type=%2 value=%3" ).arg( attr ).arg( QVariant::typeToName( fld.type() ) ).arg( currentAttributeElement.text() ) );
-          f->setAttribute( attr, convertValue( fld.type(), currentAttributeElement.text() ) );
+          f.setAttribute( attr, convertValue( fld.type(), currentAttributeElement.text() ) );
         }
         else //a geometry attribute
         {
-          f->setGeometry( QgsOgcUtils::geometryFromGML( currentAttributeElement ) );
+          f.setGeometry( QgsOgcUtils::geometryFromGML( currentAttributeElement ) );
         }
       }
       currentAttributeChild = currentAttributeChild.nextSibling();
     }
-    if ( wkb && wkbSize > 0 )
-    {
-      //insert bbox and pointer to feature into search tree
-      mSpatialIndex->insertFeature( *f );
-    }
 
-    mFeatures.insert( f->id(), f );
+    mFeatureCache.addFeature( f );
     ++mFeatureCount;
   }
+  mFeatureCache.flush();
   return 0;
 }
 
@@ -1474,16 +1551,7 @@ QStringList QgsWFSProvider::insertedFeatureIds( const QDomDocument& serverRespon
 
 QgsFeatureId QgsWFSProvider::findNewKey() const
 {
-  if ( mFeatures.isEmpty() )
-  {
-    return 0;
-  }
-
-  //else return highest key + 1
-  QMap<QgsFeatureId, QgsFeature*>::const_iterator lastIt = mFeatures.end();
-  --lastIt;
-  QgsFeatureId id = lastIt.key();
-  return ++id;
+  return mFeatureCache.nextFeatureId();
 }
 
 void QgsWFSProvider::getLayerCapabilities()
@@ -1690,39 +1758,110 @@ void QgsWFSProvider::extendExtent( const QgsRectangle &extent )
   if ( mCached )
     return;
 
-  QgsRectangle r( mExtent.intersect( &extent ) );
+  QgsRectangle r( mExtent.isEmpty() ? extent : mExtent.intersect( &extent ) );
+  if ( r.isEmpty() )
+    return;
 
-  if ( mGetExtent.contains( r ) )
+  //only request the parts which have not been downloaded or requested yet
+  QList<QgsRectangle> parts = uncoveredParts( r, mDownloadedExtents + mPendingExtents );
+  if ( parts.isEmpty() )
     return;
 
-  if ( mGetExtent.isEmpty() )
+  mPendingExtents << parts;
+
+  if ( !mPendingRetrieval )
   {
-    mGetExtent = r;
+    mPendingRetrieval = true;
+    QTimer::singleShot( 100, this, SLOT( downloadPendingExtents() ) );
   }
-  else if ( qgsDoubleNear( mGetExtent.xMinimum(), r.xMinimum() ) &&
-            qgsDoubleNear( mGetExtent.yMinimum(), r.yMinimum() ) &&
-            qgsDoubleNear( mGetExtent.xMaximum(), r.xMaximum() ) &&
-            qgsDoubleNear( mGetExtent.yMaximum(), r.yMaximum() ) )
+}
+
+void QgsWFSProvider::downloadPendingExtents()
+{
+  mPendingRetrieval = false;
+
+  QList<QgsRectangle> extents = mPendingExtents;
+  mPendingExtents.clear();
+
+  //avoid many small requests
+  if ( extents.size() > WFS_MAX_EXTENT_REQUESTS )
   {
-    return;
+    QgsRectangle r = extents.first();
+    for ( int i = 1; i < extents.size(); ++i )
+    {
+      r.combineExtentWith( &extents[i] );
+    }
+    extents.clear();
+    extents << r;
   }
-  else
+
+  for ( int i = 0; i < extents.size(); ++i )
   {
-    mGetExtent.combineExtentWith( &r );
+    const QgsRectangle& r = extents.at( i );
+    QgsDebugMsg( "downloading extent " + r.toString() );
+
+    QString uri = dataSourceUri();
+    uri.replace( QRegExp( "BBOX=[^&]*" ),
+                 QString( "BBOX=%1,%2,%3,%4" )
+                 .arg( qgsDoubleToString( r.xMinimum() ) )
+                 .arg( qgsDoubleToString( r.yMinimum() ) )
+                 .arg( qgsDoubleToString( r.xMaximum() ) )
+                 .arg( qgsDoubleToString( r.yMaximum() ) ) );
+
+    if ( getFeature( uri ) != 0 )
+    {
+      QgsMessageLog::logMessage( tr( "GetFeature failed for extent %1" ).arg( r.toString() ), tr( "WFS" ) );
+      continue;
+    }
+
+    mDownloadedExtents << r;
   }
 
-  setDataSourceUri( dataSourceUri().replace( QRegExp( "BBOX=[^&]*" ),
-                    QString( "BBOX=%1,%2,%3,%4" )
-                    .arg( qgsDoubleToString( mGetExtent.xMinimum() ) )
-                    .arg( qgsDoubleToString( mGetExtent.yMinimum() ) )
-                    .arg( qgsDoubleToString( mGetExtent.xMaximum() ) )
-                    .arg( qgsDoubleToString( mGetExtent.yMaximum() ) ) ) );
+  emit dataChanged();
+}
 
-  if ( !mPendingRetrieval )
+QList<QgsRectangle> QgsWFSProvider::uncoveredParts( const QgsRectangle& rect, const QList<QgsRectangle>& covered )
+{
+  QList<QgsRectangle> parts;
+  parts << rect;
+
+  foreach ( const QgsRectangle& c, covered )
   {
-    mPendingRetrieval = true;
-    QTimer::singleShot( 100, this, SLOT( reloadData() ) );
+    QList<QgsRectangle> remaining;
+    foreach ( const QgsRectangle& p, parts )
+    {
+      if ( !p.intersects( c ) )
+      {
+        remaining << p;
+        continue;
+      }
+
+      //the parts of p left and right of c, and below and above c between them
+      if ( p.xMinimum() < c.xMinimum() )
+        remaining << QgsRectangle( p.xMinimum(), p.yMinimum(), c.xMinimum(), p.yMaximum() );
+      if ( p.xMaximum() > c.xMaximum() )
+        remaining << QgsRectangle( c.xMaximum(), p.yMinimum(), p.xMaximum(), p.yMaximum() );
+
+      double xMin = qMax( p.xMinimum(), c.xMinimum() );
+      double xMax = qMin( p.xMaximum(), c.xMaximum() );
+      if ( p.yMinimum() < c.yMinimum() )
+        remaining << QgsRectangle( xMin, p.yMinimum(), xMax, c.yMinimum() );
+      if ( p.yMaximum() > c.yMaximum() )
+        remaining << QgsRectangle( xMin, c.yMaximum(), xMax, p.yMaximum() );
+    }
+    parts = remaining;
+  }
+
+  //drop slivers left by rounding errors of the canvas extents
+  double minWidth = rect.width() * 1e-6;
+  double minHeight = rect.height() * 1e-6;
+  QList<QgsRectangle> result;
+  foreach ( const QgsRectangle& p, parts )
+  {
+    if ( p.width() > minWidth && p.height() > minHeight )
+      result << p;
   }
+  return result;
 }
 
 QGISEXTERN QgsWFSProvider* classFactory( const QString *uri )
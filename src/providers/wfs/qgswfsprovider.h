@@ -25,12 +25,13 @@
 #include "qgsvectordataprovider.h"
 #include "qgsmaplayer.h"
 #include "qgsvectorlayer.h"
+#include "qgswfsfeaturecache.h"
 #include "qgswfsfeatureiterator.h"
 
 #include <QNetworkRequest>
 
+class QgsGml;
 class QgsRectangle;
-class QgsSpatialIndex;
 
 // TODO: merge with QgsWmsAuthorization?
 struct QgsWFSAuthorization
@@ -155,9 +156,13 @@ class QgsWFSProvider : public QgsVectorDataProvider
 
     void extendExtent( const QgsRectangle & );
 
+    /**Downloads the features of the extents requested since the last download*/
+    void downloadPendingExtents();
+
   private:
     bool mNetworkRequestFinished;
     friend class QgsWFSFeatureSource;
+    friend class TestQgsWfsProvider;
 
     //! http authorization details
     QgsWFSAuthorization mAuth;
@@ -175,16 +180,22 @@ class QgsWFSProvider : public QgsVectorDataProvider
     QgsRectangle mSpatialFilter;
     /**Flag if precise intersection test is needed. Otherwise, every feature is returned (even if a filter is set)*/
     bool mUseIntersect;
-    /**A spatial index for fast access to a feature subset*/
-    QgsSpatialIndex *mSpatialIndex;
     /**Vector where the ids of the selected features are inserted*/
     QList<QgsFeatureId> mSelectedFeatures;
     /**Iterator on the feature vector for use in rewind(), nextFeature(), etc...*/
     QList<QgsFeatureId>::iterator mFeatureIterator;
-    /**Map <feature Id / feature> */
-    QMap<QgsFeatureId, QgsFeature* > mFeatures;
+    /**Downloaded features, kept on disk with a spatial index*/
+    QgsWFSFeatureCache mFeatureCache;
     /**Stores the relation between provider ids and WFS server ids*/
     QMap<QgsFeatureId, QString > mIdMap;
+    /**Provider ids of the features by WFS server id, to skip features which are downloaded again*/
+    QHash<QString, QgsFeatureId> mWfsIdMap;
+    /**Extents whose features have been downloaded (if features are retrieved by extent)*/
+    QList<QgsRectangle> mDownloadedExtents;
+    /**Requested extents not covered by the downloaded extents*/
+    QList<QgsRectangle> mPendingExtents;
+    /**Number of features requested at once with STARTINDEX/MAXFEATURES (/qgis/wfsPageSize, 1000 by default), 0 to request all features at once*/
+    int mPageSize;
     /**Geometry type of the features in this layer*/
     mutable QGis::WkbType mWKBType;
     /**Source CRS*/
@@ -209,6 +220,14 @@ class QgsWFSProvider : public QgsVectorDataProvider
     /**if GetRenderedOnly, extent specified in WFS getFeatures; else empty (no constraint)*/
     QgsRectangle mGetExtent;
 
+    /**Adds the features read by the GML parser to the cache, skipping features which are already cached.
+      @param pageIds returns the WFS ids of the features read (attributes and geometry of features without id)
+      @param previousPageIds ids of the previous page, features without WFS id contained in it are skipped
+      @return number of features read by the parser*/
+    int addFeaturesFromGml( QgsGml& dataReader, QSet<QString>& pageIds, const QSet<QString>& previousPageIds = QSet<QString>() );
+    /**Parts of a rectangle not covered by a list of rectangles*/
+    static QList<QgsRectangle> uncoveredParts( const QgsRectangle& rect, const QList<QgsRectangle>& covered );
+
     //encoding specific methods of getFeature
     int getFeatureGET( const QString& uri, const QString& geometryAttribute );
     int getFeaturePOST( const QString& uri, const QString& geometryAttribute );
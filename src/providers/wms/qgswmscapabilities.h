@@ -412,6 +412,7 @@ enum QgsWmsTileAttribute
   TileIndex = QNetworkRequest::User + 1,
   TileRect  = QNetworkRequest::User + 2,
   TileRetry = QNetworkRequest::User + 3,
+  TileCacheKey = QNetworkRequest::User + 4,
 };
 
 enum QgsWmsDpiMode
@@ -42,6 +42,7 @@
 #include "qgsgml.h"
 #include "qgsgmlschema.h"
 #include "qgswmscapabilities.h"
+#include "qgswmstilecache.h"
 
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -446,6 +447,14 @@ void QgsWmsProvider::setFormatQueryItem( QUrl &url )
     setQueryItem( url, "FORMAT", mSettings.mImageMimeType );
 }
 
+QString QgsWmsProvider::tileCacheKey( const QString &serviceUrl, const QString &tileMatrix, int row, int col ) const
+{
+  if ( tileMatrix.isEmpty() )
+    return QString();
+
+  return QgsWmsTileCache::tileKey( serviceUrl, mSettings.mActiveSubLayers.join( "," ), mSettings.mActiveSubStyles.join( "," ), tileMatrix, row, col );
+}
+
 QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, int pixelHeight )
 {
   QgsDebugMsg( "Entering." );
@@ -680,6 +689,12 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
 
     QList<QgsWmsTiledImageDownloadHandler::TileRequest> requests;
 
+    // only the tiles of the tile matrices of tiled layers are kept in the tile cache,
+    // the tiles of split requests have arbitrary resolutions
+    QString tileMatrix;
+    if ( mSettings.mTiled )
+      tileMatrix = mTileMatrixSet->identifier + ":" + tm->identifier + ":" + qgsDoubleToString( tres );
+
     switch ( tileMode )
     {
       case WMSC:
@@ -734,7 +749,7 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
 
             QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
             QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-            requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
+            requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i, tileCacheKey( url.toString(), tileMatrix, row, col ) );
           }
         }
       }
@@ -776,7 +791,7 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
 
               QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
               QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
+              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i, tileCacheKey( url.toString(), tileMatrix, row, col ) );
             }
           }
         }
@@ -806,7 +821,7 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
 
               QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
               QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
+              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i, tileCacheKey( url, tileMatrix, row, col ) );
             }
           }
         }
@@ -3310,12 +3325,54 @@ QgsWmsTiledImageDownloadHandler::QgsWmsTiledImageDownloadHandler( const QString&
 {
   mNAM->setupDefaultProxyAndCache();
 
+  QgsWmsTileCache *tileCache = QgsWmsTileCache::instance();
+
   foreach ( const TileRequest& r, requests )
   {
+    bool useTileCache = tileCache->isEnabled() && !r.cacheKey.isEmpty();
+
+    QgsWmsTileCache::Tile cachedTile;
+    if ( useTileCache )
+    {
+      cachedTile = tileCache->tile( r.cacheKey );
+      if ( tileCache->isUsable( cachedTile ) )
+      {
+        QImage image = QImage::fromData( cachedTile.data );
+        if ( !image.isNull() )
+        {
+#if defined(QGISDEBUG)
+          QgsWmsStatistics::statForUri( mProviderUri ).cacheHits++;
+#endif
+          drawTile( r.rect, image );
+          continue;
+        }
+      }
+
+      if ( tileCache->isOffline() )
+      {
+        QgsDebugMsg( QString( "tile %1 not in the tile cache, not requested in offline mode" ).arg( r.index ) );
+        continue;
+      }
+    }
+
     QNetworkRequest request( r.url );
     auth.setAuthorization( request );
-    request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
-    request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+    if ( useTileCache )
+    {
+      // the tile cache replaces the network cache, expired tiles are revalidated
+      request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork );
+      request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, false );
+      request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileCacheKey ), r.cacheKey );
+      if ( !cachedTile.eTag.isEmpty() )
+        request.setRawHeader( "If-None-Match", cachedTile.eTag );
+      if ( !cachedTile.lastModified.isEmpty() )
+        request.setRawHeader( "If-Modified-Since", cachedTile.lastModified );
+    }
+    else
+    {
+      request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+      request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+    }
     request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileReqNo ), mTileReqNo );
     request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileIndex ), r.index );
     request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileRect ), r.rect );
@@ -3326,6 +3383,10 @@ QgsWmsTiledImageDownloadHandler::QgsWmsTiledImageDownloadHandler( const QString&
 
     mReplies << reply;
   }
+
+  // all tiles were taken from the tile cache
+  if ( mReplies.isEmpty() )
+    finish();
 }
 
 QgsWmsTiledImageDownloadHandler::~QgsWmsTiledImageDownloadHandler()
@@ -3364,7 +3425,9 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
   }
 #endif
 
-  if ( mNAM->cache() )
+  QString cacheKey = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( TileCacheKey ) ).toString();
+
+  if ( mNAM->cache() && cacheKey.isEmpty() )
   {
     QNetworkCacheMetaData cmd = mNAM->cache()->metaData( reply->request().url() );
 
@@ -3408,8 +3471,17 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
     {
       QNetworkRequest request( redirect.toUrl() );
       mAuth.setAuthorization( request );
-      request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
-      request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+      if ( !cacheKey.isEmpty() )
+      {
+        request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork );
+        request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, false );
+        request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileCacheKey ), cacheKey );
+      }
+      else
+      {
+        request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+        request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+      }
       request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileReqNo ), tileReqNo );
       request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileIndex ), tileNo );
       request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileRect ), r );
@@ -3428,6 +3500,33 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
     }
 
     QVariant status = reply->attribute( QNetworkRequest::HttpStatusCodeAttribute );
+    if ( !status.isNull() && status.toInt() == 304 && !cacheKey.isEmpty() )
+    {
+      // tile in the tile cache not modified
+      QgsWmsTileCache::Tile cachedTile = QgsWmsTileCache::instance()->revalidateTile( cacheKey, reply );
+      QImage image = QImage::fromData( cachedTile.data );
+      if ( image.isNull() )
+      {
+        // the tile was removed from the tile cache in the meantime, request it again
+        QNetworkRequest request( reply->request() );
+        request.setRawHeader( "If-None-Match", QByteArray() );
+        request.setRawHeader( "If-Modified-Since", QByteArray() );
+        repeatTileRequest( request );
+      }
+      else if ( mTileReqNo == tileReqNo )
+      {
+        drawTile( r, image );
+      }
+
+      mReplies.removeOne( reply );
+      reply->deleteLater();
+
+      if ( mReplies.isEmpty() )
+        finish();
+
+      return;
+    }
+
     if ( !status.isNull() && status.toInt() >= 400 )
     {
       QVariant phrase = reply->attribute( QNetworkRequest::HttpReasonPhraseAttribute );
@@ -3485,32 +3584,19 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
     // only take results from current request number
     if ( mTileReqNo == tileReqNo )
     {
-      double cr = mCachedViewExtent.width() / mCachedImage->width();
-
-      QRectF dst(( r.left() - mCachedViewExtent.xMinimum() ) / cr,
-                 ( mCachedViewExtent.yMaximum() - r.bottom() ) / cr,
-                 r.width() / cr,
-                 r.height() / cr );
-
       QgsDebugMsg( QString( "tile reply: length %1" ).arg( reply->bytesAvailable() ) );
 
-      QImage myLocalImage = QImage::fromData( reply->readAll() );
+      QByteArray data = reply->readAll();
+      QImage myLocalImage = QImage::fromData( data );
 
       if ( !myLocalImage.isNull() )
       {
-        QPainter p( mCachedImage );
-        if ( mSmoothPixmapTransform )
-          p.setRenderHint( QPainter::SmoothPixmapTransform, true );
-        p.drawImage( dst, myLocalImage );
+        drawTile( r, myLocalImage );
 #if 0
         myLocalImage.save( QString( "%1/%2-tile-%3.png" ).arg( QDir::tempPath() ).arg( mTileReqNo ).arg( tileNo ) );
-        p.drawRect( dst ); // show tile bounds
-        p.drawText( dst, Qt::AlignCenter, QString( "(%1)\n%2,%3\n%4,%5\n%6x%7" )
-                    .arg( tileNo )
-                    .arg( r.left() ).arg( r.bottom() )
-                    .arg( r.right() ).arg( r.top() )
-                    .arg( r.width() ).arg( r.height() ) );
 #endif
+
+        QgsWmsTileCache::instance()->insertTile( cacheKey, data, reply );
       }
       else
       {
@@ -3557,6 +3643,28 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
 }
 
 
+void QgsWmsTiledImageDownloadHandler::drawTile( const QRectF &rect, const QImage &image )
+{
+  double cr = mCachedViewExtent.width() / mCachedImage->width();
+
+  QRectF dst(( rect.left() - mCachedViewExtent.xMinimum() ) / cr,
+             ( mCachedViewExtent.yMaximum() - rect.bottom() ) / cr,
+             rect.width() / cr,
+             rect.height() / cr );
+
+  QPainter p( mCachedImage );
+  if ( mSmoothPixmapTransform )
+    p.setRenderHint( QPainter::SmoothPixmapTransform, true );
+  p.drawImage( dst, image );
+#if 0
+  p.drawRect( dst ); // show tile bounds
+  p.drawText( dst, Qt::AlignCenter, QString( "%1,%2\n%3,%4\n%5x%6" )
+              .arg( rect.left() ).arg( rect.bottom() )
+              .arg( rect.right() ).arg( rect.top() )
+              .arg( rect.width() ).arg( rect.height() ) );
+#endif
+}
+
 void QgsWmsTiledImageDownloadHandler::repeatTileRequest( QNetworkRequest const &oldRequest )
 {
   QgsWmsStatistics::Stat& stat = QgsWmsStatistics::statForUri( mProviderUri );
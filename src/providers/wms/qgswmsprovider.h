@@ -367,6 +367,9 @@ class QgsWmsProvider : public QgsRasterDataProvider
     //! add image FORMAT parameter to url
     void setFormatQueryItem( QUrl &url );
 
+    //! key of a tile in the tile cache, empty if the tile matrix is empty
+    QString tileCacheKey( const QString &serviceUrl, const QString &tileMatrix, int row, int col ) const;
+
     //! Name of the stored connection
     QString mConnectionName;
 
@@ -523,10 +526,12 @@ class QgsWmsTiledImageDownloadHandler : public QObject
 
     struct TileRequest
     {
-      TileRequest( const QUrl& u, const QRectF& r, int i ) : url( u ), rect( r ), index( i ) {}
+      TileRequest( const QUrl& u, const QRectF& r, int i, const QString& k = QString() ) : url( u ), rect( r ), index( i ), cacheKey( k ) {}
       QUrl url;
       QRectF rect;
       int index;
+      //! key of the tile in the tile cache, empty if the tile is not cached
+      QString cacheKey;
     };
 
     QgsWmsTiledImageDownloadHandler( const QString& providerUri, const QgsWmsAuthorization& auth, int reqNo, const QList<TileRequest>& requests, QImage* cachedImage, const QgsRectangle& cachedViewExtent, bool smoothPixmapTransform );
@@ -547,6 +552,9 @@ class QgsWmsTiledImageDownloadHandler : public QObject
      */
     void repeatTileRequest( QNetworkRequest const &oldRequest );
 
+    //! draws a tile into the cached image
+    void drawTile( const QRectF &rect, const QImage &image );
+
     void finish() { QMetaObject::invokeMethod( mEventLoop, "quit", Qt::QueuedConnection ); }
 
     QString mProviderUri;
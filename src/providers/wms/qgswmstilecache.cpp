@@ -0,0 +1,315 @@
+/***************************************************************************
+    qgswmstilecache.cpp
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgswmstilecache.h"
+
+#include "qgsapplication.h"
+#include "qgslogger.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMultiMap>
+#include <QMutexLocker>
+#include <QNetworkReply>
+#include <QSettings>
+#include <QTemporaryFile>
+#include <QtConcurrentRun>
+
+// header of the tile files
+static const quint32 TILE_FILE_MAGIC = 0x51575443;
+static const qint32 TILE_FILE_VERSION = 1;
+
+QgsWmsTileCache* QgsWmsTileCache::instance()
+{
+  static QgsWmsTileCache sInstance;
+  return &sInstance;
+}
+
+QgsWmsTileCache::QgsWmsTileCache()
+    : mEnabled( false )
+    , mOffline( false )
+    , mMaxSize( 0 )
+    , mCurrentSize( -1 )
+    , mTrimming( false )
+    , mSizeChange( 0 )
+{
+  readSettings();
+}
+
+QgsWmsTileCache::QgsWmsTileCache( const QString& directory, qint64 maxSize, bool offline )
+    : mEnabled( true )
+    , mOffline( offline )
+    , mDirectory( directory )
+    , mMaxSize( maxSize )
+    , mCurrentSize( -1 )
+    , mTrimming( false )
+    , mSizeChange( 0 )
+{
+}
+
+QgsWmsTileCache::~QgsWmsTileCache()
+{
+  mTrimFuture.waitForFinished();
+}
+
+void QgsWmsTileCache::readSettings()
+{
+  QMutexLocker locker( &mMutex );
+
+  QSettings s;
+  mEnabled = s.value( "/qgis/wmsTileCache/enabled", true ).toBool();
+  mOffline = s.value( "/qgis/wmsTileCache/offline", false ).toBool();
+  mMaxSize = s.value( "/qgis/wmsTileCache/size", 256 ).toLongLong() * 1024 * 1024;
+
+  QString directory = s.value( "/qgis/wmsTileCache/directory", QgsApplication::qgisSettingsDirPath() + "cache/wmstiles" ).toString();
+  if ( QDir().mkpath( directory ) )
+  {
+    directory = QDir( directory ).absolutePath();
+    if ( directory != mDirectory )
+    {
+      mDirectory = directory;
+      mCurrentSize = -1;
+      mLastUsed.clear();
+    }
+  }
+  else
+  {
+    QgsDebugMsg( "Could not create the tile cache directory " + directory );
+    mDirectory.clear();
+  }
+}
+
+QString QgsWmsTileCache::tileKey( const QString& serviceUrl, const QString& layer, const QString& style, const QString& tileMatrix, int row, int col )
+{
+  QString key = QString( "%1|%2|%3|%4|%5|%6" ).arg( serviceUrl ).arg( layer ).arg( style ).arg( tileMatrix ).arg( row ).arg( col );
+  return QCryptographicHash::hash( key.toUtf8(), QCryptographicHash::Md5 ).toHex();
+}
+
+QString QgsWmsTileCache::tilePath( const QString& key ) const
+{
+  // spread the tiles in subdirectories to keep directories small
+  return mDirectory + "/" + key.left( 2 ) + "/" + key;
+}
+
+QgsWmsTileCache::Tile QgsWmsTileCache::tile( const QString& key )
+{
+  Tile tile;
+  if ( !isEnabled() || key.isEmpty() )
+    return tile;
+
+  QFile file( tilePath( key ) );
+  if ( !file.open( QIODevice::ReadOnly ) )
+    return tile;
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_6 );
+  quint32 magic;
+  qint32 version;
+  in >> magic >> version;
+  if ( magic != TILE_FILE_MAGIC || version != TILE_FILE_VERSION )
+    return tile;
+
+  in >> tile.eTag >> tile.lastModified >> tile.expiry >> tile.data;
+  if ( in.status() != QDataStream::Ok )
+    return Tile();
+
+  QMutexLocker locker( &mMutex );
+  mLastUsed.insert( key, QDateTime::currentDateTime() );
+  return tile;
+}
+
+void QgsWmsTileCache::insertTile( const QString& key, const QByteArray& data, const QNetworkReply* reply )
+{
+  if ( !isEnabled() || key.isEmpty() || data.isEmpty() )
+    return;
+
+  QByteArray cacheControl = reply->rawHeader( "Cache-Control" ).toLower();
+  if ( cacheControl.contains( "no-store" ) )
+    return;
+
+  Tile tile;
+  tile.data = data;
+  tile.eTag = reply->rawHeader( "ETag" );
+  tile.lastModified = reply->rawHeader( "Last-Modified" );
+  tile.expiry = expiryDate( reply );
+
+  QMutexLocker locker( &mMutex );
+  if ( !writeTile( key, tile ) )
+    return;
+
+  mLastUsed.insert( key, QDateTime::currentDateTime() );
+  if ( mCurrentSize < 0 || mCurrentSize > mMaxSize )
+    startTrim();
+}
+
+QgsWmsTileCache::Tile QgsWmsTileCache::revalidateTile( const QString& key, const QNetworkReply* reply )
+{
+  Tile cached = tile( key );
+  if ( !cached.isValid() )
+    return cached;
+
+  cached.expiry = expiryDate( reply );
+  if ( reply->hasRawHeader( "ETag" ) )
+    cached.eTag = reply->rawHeader( "ETag" );
+
+  QMutexLocker locker( &mMutex );
+  writeTile( key, cached );
+  return cached;
+}
+
+bool QgsWmsTileCache::writeTile( const QString& key, const Tile& tile )
+{
+  QString path = tilePath( key );
+  QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+  // write to a temporary file first, other processes may read the cache at the same time
+  QTemporaryFile file( path + ".XXXXXX" );
+  file.setAutoRemove( false );
+  if ( !file.open() )
+  {
+    QgsDebugMsg( "Could not write tile " + path );
+    return false;
+  }
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_6 );
+  out << TILE_FILE_MAGIC << TILE_FILE_VERSION;
+  out << tile.eTag << tile.lastModified << tile.expiry << tile.data;
+  if ( out.status() != QDataStream::Ok )
+  {
+    QgsDebugMsg( "Could not write tile " + path );
+    file.remove();
+    return false;
+  }
+  file.close();
+
+  qint64 oldSize = QFileInfo( path ).exists() ? QFileInfo( path ).size() : 0;
+  QFile::remove( path );
+  if ( !file.rename( path ) )
+  {
+    file.remove();
+    return false;
+  }
+
+  if ( mCurrentSize >= 0 )
+    mCurrentSize += file.size() - oldSize;
+  if ( mTrimming )
+    mSizeChange += file.size() - oldSize;
+  return true;
+}
+
+void QgsWmsTileCache::startTrim()
+{
+  if ( mTrimming )
+    return;
+
+  mTrimming = true;
+  mSizeChange = 0;
+  mTrimFuture = QtConcurrent::run( this, &QgsWmsTileCache::trim );
+}
+
+void QgsWmsTileCache::trim()
+{
+  // the directory is scanned without the mutex, tiles are read and written meanwhile
+  mMutex.lock();
+  QString directory = mDirectory;
+  qint64 maxSize = mMaxSize;
+  QHash<QString, QDateTime> lastUsedTiles = mLastUsed;
+  mMutex.unlock();
+
+  QMultiMap<QDateTime, QPair<QString, qint64> > tiles;
+  qint64 size = 0;
+
+  QDirIterator it( directory, QDir::Files, QDirIterator::Subdirectories );
+  while ( it.hasNext() )
+  {
+    it.next();
+    QFileInfo info = it.fileInfo();
+
+    // tiles used in this session count from their last use, the others from their last download
+    QDateTime lastUsed = lastUsedTiles.value( info.fileName() );
+    if ( lastUsed.isNull() || lastUsed < info.lastModified() )
+      lastUsed = info.lastModified();
+
+    tiles.insert( lastUsed, qMakePair( info.absoluteFilePath(), info.size() ) );
+    size += info.size();
+  }
+
+  QStringList removed;
+  if ( size > maxSize )
+  {
+    QgsDebugMsg( QString( "Tile cache size %1 exceeds %2, removing the least recently used tiles" ).arg( size ).arg( maxSize ) );
+    qint64 targetSize = maxSize / 10 * 9;
+    QMultiMap<QDateTime, QPair<QString, qint64> >::const_iterator tileIt = tiles.constBegin();
+    for ( ; tileIt != tiles.constEnd() && size > targetSize; ++tileIt )
+    {
+      if ( QFile::remove( tileIt.value().first ) )
+      {
+        size -= tileIt.value().second;
+        removed << QFileInfo( tileIt.value().first ).fileName();
+      }
+    }
+  }
+
+  QMutexLocker locker( &mMutex );
+  foreach ( const QString& key, removed )
+    mLastUsed.remove( key );
+
+  // tiles written during the scan may be counted twice, the next trim corrects the size
+  if ( directory == mDirectory )
+    mCurrentSize = size + mSizeChange;
+  mTrimming = false;
+}
+
+QDateTime QgsWmsTileCache::expiryDate( const QNetworkReply* reply )
+{
+  QDateTime now = QDateTime::currentDateTime().toUTC();
+
+  QList<QByteArray> directives = reply->rawHeader( "Cache-Control" ).toLower().split( ',' );
+  foreach ( QByteArray directive, directives )
+  {
+    directive = directive.trimmed();
+    if ( directive == "no-cache" )
+      return now;
+
+    if ( directive.startsWith( "max-age=" ) )
+    {
+      bool ok;
+      int maxAge = directive.mid( 8 ).toInt( &ok );
+      if ( ok )
+        return now.addSecs( maxAge );
+    }
+  }
+
+  if ( reply->hasRawHeader( "Expires" ) )
+  {
+    // RFC 1123 date, eg. "Sun, 06 Nov 1994 08:49:37 GMT"
+    QDateTime expires = QLocale::c().toDateTime( QString::fromLatin1( reply->rawHeader( "Expires" ).trimmed() ), "ddd, dd MMM yyyy hh:mm:ss 'GMT'" );
+    if ( expires.isValid() )
+    {
+      expires.setTimeSpec( Qt::UTC );
+      return expires;
+    }
+    // invalid dates (eg. "0") mean already expired
+    return now;
+  }
+
+  QSettings s;
+  return now.addSecs( s.value( "/qgis/defaultTileExpiry", "24" ).toInt() * 60 * 60 );
+}
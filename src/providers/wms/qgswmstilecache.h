@@ -0,0 +1,129 @@
+/***************************************************************************
+    qgswmstilecache.h
+    ---------------------
+    begin                : October 2014
+    copyright            : (C) 2014 by The QGIS Project
+    email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSWMSTILECACHE_H
+#define QGSWMSTILECACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+class QNetworkReply;
+
+/**
+ * A disk cache for the tiles of WMTS and tiled WMS (WMS-C) layers.
+ *
+ * Tiles are stored by a key derived from the service URL, layer, style,
+ * tile matrix, row and column, together with the ETag, Last-Modified date
+ * and expiry date sent by the server. Fresh tiles are drawn without any
+ * request, expired tiles are revalidated with a conditional request and in
+ * offline mode cached tiles are always used and missing tiles are not requested.
+ *
+ * The cache is configured in the settings:
+ *  - /qgis/wmsTileCache/enabled (default true)
+ *  - /qgis/wmsTileCache/directory (default cache/wmstiles in the settings directory)
+ *  - /qgis/wmsTileCache/size maximum size in MB (default 256)
+ *  - /qgis/wmsTileCache/offline (default false)
+ *
+ * If the cache grows over its maximum size, the least recently used tiles are removed.
+ * The size of the cache directory is determined and the tiles are removed in a
+ * background thread, so that drawing is not blocked by the directory scan.
+ */
+class QgsWmsTileCache
+{
+  public:
+    struct Tile
+    {
+      Tile() {}
+
+      bool isValid() const { return !data.isEmpty(); }
+      bool isExpired() const { return expiry.isNull() || expiry < QDateTime::currentDateTime().toUTC(); }
+
+      //! encoded image
+      QByteArray data;
+      //! ETag header of the response, used to revalidate the tile
+      QByteArray eTag;
+      //! Last-Modified header of the response, used to revalidate the tile
+      QByteArray lastModified;
+      //! date after which the tile has to be revalidated (UTC)
+      QDateTime expiry;
+    };
+
+    static QgsWmsTileCache* instance();
+
+    ~QgsWmsTileCache();
+
+    bool isEnabled() const { return mEnabled && !mDirectory.isEmpty(); }
+    //! true if tiles are only taken from the cache
+    bool isOffline() const { return mOffline; }
+    //! true if a cached tile can be drawn without a request, expired tiles are only used offline
+    bool isUsable( const Tile& tile ) const { return tile.isValid() && ( !tile.isExpired() || mOffline ); }
+
+    /**
+     * Key of a tile
+     * @param serviceUrl URL of the service with all request parameters which are the same for every tile
+     * @param layer layer identifier
+     * @param style style identifier
+     * @param tileMatrix tile matrix set and tile matrix identifier or resolution
+     */
+    static QString tileKey( const QString& serviceUrl, const QString& layer, const QString& style, const QString& tileMatrix, int row, int col );
+
+    //! returns the cached tile, or an invalid tile if it is not in the cache
+    Tile tile( const QString& key );
+
+    //! stores the tile data of a reply, with the validators and expiry date of the reply headers
+    void insertTile( const QString& key, const QByteArray& data, const QNetworkReply* reply );
+
+    //! updates the expiry date of a cached tile after a "304 Not Modified" reply
+    Tile revalidateTile( const QString& key, const QNetworkReply* reply );
+
+  private:
+    QgsWmsTileCache();
+    //! cache in the given directory, independent of the settings (for tests)
+    QgsWmsTileCache( const QString& directory, qint64 maxSize, bool offline );
+
+    void readSettings();
+
+    //! path of the file storing the tile
+    QString tilePath( const QString& key ) const;
+    bool writeTile( const QString& key, const Tile& tile );
+    //! starts trim() in a background thread unless it is already running, called with the mutex locked
+    void startTrim();
+    //! determines the cache size and removes the least recently used tiles until the cache is below 90% of its maximum size
+    void trim();
+
+    static QDateTime expiryDate( const QNetworkReply* reply );
+
+    QMutex mMutex;
+    bool mEnabled;
+    bool mOffline;
+    QString mDirectory;
+    qint64 mMaxSize;
+    //! size of the cached tiles, -1 until the cache directory has been scanned
+    qint64 mCurrentSize;
+    //! true while trim() is running
+    bool mTrimming;
+    //! size of the tiles written while trim() is running
+    qint64 mSizeChange;
+    QFuture<void> mTrimFuture;
+    //! tiles used in this session, with the time of last use
+    QHash<QString, QDateTime> mLastUsed;
+
+    friend class TestQgsWmsTileCache;
+};
+
+#endif // QGSWMSTILECACHE_H
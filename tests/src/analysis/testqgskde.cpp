@@ -0,0 +1,184 @@
+/***************************************************************************
+     testqgskde.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include "qgsapplication.h"
+#include "qgskde.h"
+#include "qgspoint.h"
+
+#include "gdal.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the kernel density estimation
+ */
+class TestQgsKernelDensityEstimation: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void singlePoint();
+    void pointAtCorner();
+    void threadsMatchSerial();
+    void benchmarkPoints();
+
+  private:
+    /**Reads band 1 of a raster into a float array*/
+    QVector<float> readRaster( const QString& fileName, int& xSize, int& ySize );
+
+    QString mTempPath;
+};
+
+void TestQgsKernelDensityEstimation::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+
+  mTempPath = QDir::tempPath() + QDir::separator();
+}
+
+void TestQgsKernelDensityEstimation::cleanupTestCase()
+{
+  QFile::remove( mTempPath + "kde_single.tif" );
+  QFile::remove( mTempPath + "kde_corner.tif" );
+  QFile::remove( mTempPath + "kde_serial.tif" );
+  QFile::remove( mTempPath + "kde_threads.tif" );
+  QFile::remove( mTempPath + "kde_benchmark.tif" );
+}
+
+QVector<float> TestQgsKernelDensityEstimation::readRaster( const QString& fileName, int& xSize, int& ySize )
+{
+  QVector<float> values;
+  GDALDatasetH dataset = GDALOpen( fileName.toLocal8Bit().data(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return values;
+  }
+  xSize = GDALGetRasterXSize( dataset );
+  ySize = GDALGetRasterYSize( dataset );
+  values.resize( xSize * ySize );
+  if ( GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, xSize, ySize, values.data(), xSize, ySize, GDT_Float32, 0, 0 ) != CE_None )
+  {
+    values.clear();
+  }
+  GDALClose( dataset );
+  return values;
+}
+
+void TestQgsKernelDensityEstimation::singlePoint()
+{
+  // 101 x 101 cells of size 1, point in the center cell with a radius of 20 cells
+  QgsKernelDensityEstimation kde( QgsRectangle( 0, 0, 101, 101 ), 1.0, 101, 101 );
+  kde.setKernelShape( QgsKernelDensityEstimation::Quartic );
+  QVERIFY( kde.addPoint( QgsPoint( 50.5, 50.5 ), 20.0, 2.0 ) );
+  QVERIFY( !kde.addPoint( QgsPoint( 200, 50 ), 20.0 ) );
+  QCOMPARE( kde.pointCount(), 1 );
+  QCOMPARE( kde.writeRaster( mTempPath + "kde_single.tif", "GTiff", QString() ), 0 );
+
+  int xSize, ySize;
+  QVector<float> values = readRaster( mTempPath + "kde_single.tif", xSize, ySize );
+  QCOMPARE( values.size(), 101 * 101 );
+
+  double expectedCenter = 2.0 * QgsKernelDensityEstimation::kernelValue( QgsKernelDensityEstimation::Quartic, 0, 20, 0 );
+  QVERIFY( qAbs( values[50 * 101 + 50] - expectedCenter ) < 1E-6 );
+
+  // the kernel is normalized, the sum of the cells is close to the weight
+  double sum = 0;
+  for ( int i = 0; i < values.size(); ++i )
+  {
+    if ( values[i] != -9999 )
+    {
+      sum += values[i];
+    }
+  }
+  QVERIFY( qAbs( sum - 2.0 ) < 0.05 );
+
+  // out of reach of the point
+  QCOMPARE( values[0], -9999.0f );
+  QCOMPARE( values[50 * 101 + 71], -9999.0f );
+  QVERIFY( values[50 * 101 + 70] != -9999.0f );
+}
+
+void TestQgsKernelDensityEstimation::pointAtCorner()
+{
+  // kernels are clipped at the raster border instead of dropping the point
+  QgsKernelDensityEstimation kde( QgsRectangle( 0, 0, 50, 50 ), 1.0, 50, 50 );
+  QVERIFY( kde.addPoint( QgsPoint( 0.5, 0.5 ), 10.0 ) );
+  QCOMPARE( kde.writeRaster( mTempPath + "kde_corner.tif", "GTiff", QString() ), 0 );
+
+  int xSize, ySize;
+  QVector<float> values = readRaster( mTempPath + "kde_corner.tif", xSize, ySize );
+  QCOMPARE( values.size(), 50 * 50 );
+  QVERIFY( values[0] > 0 );
+  QVERIFY( values[5 * 50 + 5] > 0 );
+  QCOMPARE( values[49 * 50 + 49], -9999.0f );
+}
+
+void TestQgsKernelDensityEstimation::threadsMatchSerial()
+{
+  // several stripes, with kernels reaching over stripe borders
+  QgsRectangle extent( 0, 0, 2000, 2000 );
+  QgsKernelDensityEstimation serial( extent, 1.0, 2000, 2000 );
+  serial.setThreadCount( 1 );
+  serial.setKernelShape( QgsKernelDensityEstimation::Triangular );
+  serial.setDecayRatio( 0.2 );
+  QgsKernelDensityEstimation threaded( extent, 1.0, 2000, 2000 );
+  threaded.setThreadCount( 4 );
+  threaded.setKernelShape( QgsKernelDensityEstimation::Triangular );
+  threaded.setDecayRatio( 0.2 );
+
+  qsrand( 1 );
+  for ( int i = 0; i < 5000; ++i )
+  {
+    QgsPoint point( qrand() % 200000 / 100.0, qrand() % 200000 / 100.0 );
+    double radius = 5 + qrand() % 60;
+    double weight = 1 + qrand() % 5;
+    serial.addPoint( point, radius, weight );
+    threaded.addPoint( point, radius, weight );
+  }
+
+  QCOMPARE( serial.writeRaster( mTempPath + "kde_serial.tif", "GTiff", QString() ), 0 );
+  QCOMPARE( threaded.writeRaster( mTempPath + "kde_threads.tif", "GTiff", QString() ), 0 );
+
+  int xSize, ySize;
+  QVector<float> serialValues = readRaster( mTempPath + "kde_serial.tif", xSize, ySize );
+  QVector<float> threadedValues = readRaster( mTempPath + "kde_threads.tif", xSize, ySize );
+  QCOMPARE( serialValues.size(), 2000 * 2000 );
+  QVERIFY( serialValues == threadedValues );
+}
+
+void TestQgsKernelDensityEstimation::benchmarkPoints()
+{
+  QgsKernelDensityEstimation kde( QgsRectangle( 0, 0, 4000, 4000 ), 1.0, 4000, 4000 );
+  qsrand( 2 );
+  for ( int i = 0; i < 1000000; ++i )
+  {
+    kde.addPoint( QgsPoint( qrand() % 400000 / 100.0, qrand() % 400000 / 100.0 ), 10.0 );
+  }
+
+  QBENCHMARK_ONCE
+  {
+    QCOMPARE( kde.writeRaster( mTempPath + "kde_benchmark.tif", "GTiff", QString() ), 0 );
+  }
+}
+
+QTEST_MAIN( TestQgsKernelDensityEstimation )
+#include "moc_testqgskde.cxx"
@@ -0,0 +1,218 @@
+/***************************************************************************
+     testqgsninecellfilter.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QDir>
+#include <QtTest>
+
+#include <cmath>
+#include <stdlib.h>
+
+#include "qgsapplication.h"
+#include "qgsaspectfilter.h"
+#include "qgsruggednessfilter.h"
+#include "qgsslopefilter.h"
+
+#include "gdal.h"
+#include "cpl_string.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the serial and tiled execution of the nine cell filters
+ */
+class TestQgsNineCellFilter: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init() {};
+    void cleanup() {};
+
+    void tiledMatchesSerial();
+    void compressedTiledOutput();
+    void benchmarkSlope_data();
+    void benchmarkSlope();
+
+  private:
+    /**Writes a synthetic DEM (smooth hills with a nodata hole) to a GeoTIFF*/
+    bool createDem( const QString& fileName, int xSize, int ySize );
+    /**Reads band 1 of a raster into a float array*/
+    QVector<float> readRaster( const QString& fileName );
+
+    QString mTempPath;
+    QString mSmallDem;
+    QString mLargeDem;
+};
+
+void TestQgsNineCellFilter::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+
+  mTempPath = QDir::tempPath() + QDir::separator();
+  mSmallDem = mTempPath + "ninecell_small_dem.tif";
+  mLargeDem = mTempPath + "ninecell_large_dem.tif";
+  QVERIFY( createDem( mSmallDem, 317, 211 ) );
+}
+
+void TestQgsNineCellFilter::cleanupTestCase()
+{
+  QFile::remove( mSmallDem );
+  QFile::remove( mLargeDem );
+}
+
+bool TestQgsNineCellFilter::createDem( const QString& fileName, int xSize, int ySize )
+{
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  if ( !driver )
+  {
+    return false;
+  }
+
+  GDALDatasetH dataset = GDALCreate( driver, fileName.toLocal8Bit().data(), xSize, ySize, 1, GDT_Float32, NULL );
+  if ( !dataset )
+  {
+    return false;
+  }
+
+  double geoTransform[6] = { 600000, 10, 0, 200000, 0, -10 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, -9999 );
+
+  QVector<float> row( xSize );
+  for ( int i = 0; i < ySize; ++i )
+  {
+    for ( int j = 0; j < xSize; ++j )
+    {
+      if ( i > ySize / 3 && i < ySize / 3 + 5 && j > xSize / 2 && j < xSize / 2 + 7 )
+      {
+        row[j] = -9999;
+      }
+      else
+      {
+        row[j] = 500 + 100 * sin( j / 37.0 ) * cos( i / 23.0 ) + 0.01 * i * j / ( xSize + ySize );
+      }
+    }
+    GDALRasterIO( band, GF_Write, 0, i, xSize, 1, row.data(), xSize, 1, GDT_Float32, 0, 0 );
+  }
+  GDALClose( dataset );
+  return true;
+}
+
+QVector<float> TestQgsNineCellFilter::readRaster( const QString& fileName )
+{
+  QVector<float> values;
+  GDALDatasetH dataset = GDALOpen( fileName.toLocal8Bit().data(), GA_ReadOnly );
+  if ( !dataset )
+  {
+    return values;
+  }
+  int xSize = GDALGetRasterXSize( dataset );
+  int ySize = GDALGetRasterYSize( dataset );
+  values.resize( xSize * ySize );
+  GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, xSize, ySize, values.data(), xSize, ySize, GDT_Float32, 0, 0 );
+  GDALClose( dataset );
+  return values;
+}
+
+void TestQgsNineCellFilter::tiledMatchesSerial()
+{
+  QString serialFile = mTempPath + "ninecell_serial.tif";
+  QString tiledFile = mTempPath + "ninecell_tiled.tif";
+
+  QgsSlopeFilter serial( mSmallDem, serialFile, "GTiff" );
+  QCOMPARE( serial.processRaster( 0 ), 0 );
+
+  //small tiles on an unaligned raster to exercise the halo rows
+  QgsSlopeFilter tiled( mSmallDem, tiledFile, "GTiff" );
+  tiled.setThreadCount( 4 );
+  tiled.setTileRows( 7 );
+  QCOMPARE( tiled.processRaster( 0 ), 0 );
+  QVERIFY( readRaster( serialFile ) == readRaster( tiledFile ) );
+
+  QgsRuggednessFilter serialRuggedness( mSmallDem, serialFile, "GTiff" );
+  QCOMPARE( serialRuggedness.processRaster( 0 ), 0 );
+  QgsRuggednessFilter tiledRuggedness( mSmallDem, tiledFile, "GTiff" );
+  tiledRuggedness.setThreadCount( 3 );
+  tiledRuggedness.setTileRows( 1 );
+  QCOMPARE( tiledRuggedness.processRaster( 0 ), 0 );
+  QVERIFY( readRaster( serialFile ) == readRaster( tiledFile ) );
+
+  QFile::remove( serialFile );
+  QFile::remove( tiledFile );
+}
+
+void TestQgsNineCellFilter::compressedTiledOutput()
+{
+  QString outputFile = mTempPath + "ninecell_compressed.tif";
+
+  QgsAspectFilter aspect( mSmallDem, outputFile, "GTiff" );
+  aspect.setThreadCount( 0 );
+  aspect.setCreationOptions( QStringList() << "TILED=YES" << "COMPRESS=DEFLATE" << "BLOCKXSIZE=64" << "BLOCKYSIZE=64" );
+  QCOMPARE( aspect.processRaster( 0 ), 0 );
+
+  GDALDatasetH dataset = GDALOpen( outputFile.toLocal8Bit().data(), GA_ReadOnly );
+  QVERIFY( dataset );
+  QCOMPARE( QString( GDALGetMetadataItem( dataset, "COMPRESSION", "IMAGE_STRUCTURE" ) ), QString( "DEFLATE" ) );
+  int blockXSize, blockYSize;
+  GDALGetBlockSize( GDALGetRasterBand( dataset, 1 ), &blockXSize, &blockYSize );
+  QCOMPARE( blockXSize, 64 );
+  QCOMPARE( blockYSize, 64 );
+  GDALClose( dataset );
+
+  QgsAspectFilter serial( mSmallDem, mTempPath + "ninecell_serial.tif", "GTiff" );
+  QCOMPARE( serial.processRaster( 0 ), 0 );
+  QVERIFY( readRaster( mTempPath + "ninecell_serial.tif" ) == readRaster( outputFile ) );
+
+  QFile::remove( outputFile );
+  QFile::remove( mTempPath + "ninecell_serial.tif" );
+}
+
+void TestQgsNineCellFilter::benchmarkSlope_data()
+{
+  QTest::addColumn<int>( "threads" );
+  QTest::newRow( "serial" ) << 1;
+  QTest::newRow( "tiled" ) << 0;
+}
+
+void TestQgsNineCellFilter::benchmarkSlope()
+{
+  //the benchmark takes too long for every test run
+  if ( !getenv( "QGIS_TEST_BENCHMARK" ) )
+  {
+    QSKIP( "Set QGIS_TEST_BENCHMARK to run the benchmark", SkipAll );
+  }
+
+  QFETCH( int, threads );
+  QString outputFile = mTempPath + "ninecell_benchmark.tif";
+
+  //the benchmark DEM is only written if the benchmark runs
+  if ( !QFile::exists( mLargeDem ) )
+  {
+    QVERIFY( createDem( mLargeDem, 2000, 2000 ) );
+  }
+
+  QgsSlopeFilter slope( mLargeDem, outputFile, "GTiff" );
+  slope.setThreadCount( threads );
+  QBENCHMARK_ONCE
+  {
+    QCOMPARE( slope.processRaster( 0 ), 0 );
+  }
+  QFile::remove( outputFile );
+}
+
+QTEST_MAIN( TestQgsNineCellFilter )
+#include "moc_testqgsninecellfilter.cxx"
@@ -33,6 +33,8 @@ class TestQgsZonalStatistics: public QObject
     void cleanup() {};
 
     void testStatistics();
+    void testAdditionalStatistics();
+    void testExactCoverage();
 
   private:
     QgsVectorLayer* mVectorLayer;
@@ -116,5 +118,75 @@ void TestQgsZonalStatistics::testStatistics()
   QCOMPARE( f.attribute( "myqgis2_me" ).toDouble(), 0.833333333333333 );
 }
 
+void TestQgsZonalStatistics::testAdditionalStatistics()
+{
+  QgsZonalStatistics zs( mVectorLayer, mRasterPath, "all_", 1 );
+  zs.setStatistics( QgsZonalStatistics::All );
+  zs.setThreadCount( 2 );
+  QCOMPARE( zs.calculateStatistics( NULL ), 0 );
+
+  QgsFeature f;
+  QgsFeatureRequest request;
+  request.setFilterFid( 0 );
+  bool fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "all_count" ).toDouble(), 12.0 );
+  QCOMPARE( f.attribute( "all_mean" ).toDouble(), 0.666666666666667 );
+  QCOMPARE( f.attribute( "all_median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_stdev" ).toDouble(), 0.471404520791032 );
+  QCOMPARE( f.attribute( "all_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "all_max" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_majori" ).toDouble(), 1.0 );
+
+  request.setFilterFid( 1 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "all_count" ).toDouble(), 9.0 );
+  QCOMPARE( f.attribute( "all_median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_stdev" ).toDouble(), 0.496903994999953 );
+  QCOMPARE( f.attribute( "all_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "all_max" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_majori" ).toDouble(), 1.0 );
+
+  request.setFilterFid( 2 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "all_count" ).toDouble(), 6.0 );
+  QCOMPARE( f.attribute( "all_median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_stdev" ).toDouble(), 0.372677996249965 );
+  QCOMPARE( f.attribute( "all_min" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "all_max" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "all_majori" ).toDouble(), 1.0 );
+}
+
+void TestQgsZonalStatistics::testExactCoverage()
+{
+  QgsZonalStatistics zs( mVectorLayer, mRasterPath, "ex_", 1 );
+  zs.setStatistics( QgsZonalStatistics::Count | QgsZonalStatistics::Sum );
+  zs.setExactCoverage( true );
+  QCOMPARE( zs.calculateStatistics( NULL ), 0 );
+
+  // cells are weighted by the covered fraction of their area
+  QgsFeature f;
+  QgsFeatureRequest request;
+  request.setFilterFid( 0 );
+  bool fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_count" ).toDouble(), 12.0, 1E-6 ) );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_sum" ).toDouble(), 8.0, 1E-6 ) );
+
+  request.setFilterFid( 1 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_count" ).toDouble(), 7.996179, 1E-6 ) );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_sum" ).toDouble(), 3.996179, 1E-6 ) );
+
+  request.setFilterFid( 2 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_count" ).toDouble(), 4.250380, 1E-6 ) );
+  QVERIFY( qgsDoubleNear( f.attribute( "ex_sum" ).toDouble(), 3.286560, 1E-6 ) );
+}
+
 QTEST_MAIN( TestQgsZonalStatistics )
 #include "moc_testqgszonalstatistics.cxx"
@@ -50,6 +50,8 @@ class TestQgsGeometry: public QObject
     void simplifyCheck1();
     void intersectionCheck1();
     void intersectionCheck2();
+    void intersectsRectCheck();
+    void intersectsRectBenchmark();
     void unionCheck1();
     void unionCheck2();
     void differenceCheck1();
@@ -242,6 +244,53 @@ void TestQgsGeometry::intersectionCheck2()
   QVERIFY( !mpPolygonGeometryA->intersects( mpPolygonGeometryC ) );
 }
 
+void TestQgsGeometry::intersectsRectCheck()
+{
+  //bounding box inside of the rectangle
+  QVERIFY( mpPolygonGeometryA->intersects( QgsRectangle( 0, 0, 100, 100 ) ) );
+  //bounding box outside of the rectangle
+  QVERIFY( !mpPolygonGeometryA->intersects( QgsRectangle( 150, 150, 300, 300 ) ) );
+  //rectangle inside of the polygon
+  QVERIFY( mpPolygonGeometryA->intersects( QgsRectangle( 40, 40, 50, 50 ) ) );
+  //rectangle overlapping the polygon
+  QVERIFY( mpPolygonGeometryA->intersects( QgsRectangle( 70, 70, 90, 90 ) ) );
+
+  //rectangle inside of the bounding box but not touching the line
+  QgsRectangle lineBox = mpPolylineGeometryD->boundingBox();
+  QVERIFY( mpPolylineGeometryD->intersects( lineBox ) );
+  QVERIFY( !mpPolylineGeometryD->intersects( QgsRectangle( 100, 37.5, 101, 37.8 ) ) );
+
+  QgsGeometry* point = QgsGeometry::fromPoint( mPointA );
+  QVERIFY( point->intersects( QgsRectangle( 39, 39, 41, 41 ) ) );
+  QVERIFY( !point->intersects( QgsRectangle( 41, 41, 42, 42 ) ) );
+  delete point;
+}
+
+void TestQgsGeometry::intersectsRectBenchmark()
+{
+  //identify like requests with small rectangles around points of a grid
+  QList<QgsGeometry*> points;
+  for ( int i = 0; i < 1000; ++i )
+  {
+    points << QgsGeometry::fromPoint( QgsPoint( i % 100, i / 100 ) );
+  }
+
+  int hits = 0;
+  QBENCHMARK
+  {
+    hits = 0;
+    for ( int i = 0; i < points.size(); ++i )
+    {
+      if ( points.at( i )->intersects( QgsRectangle( 9.5, 4.5, 30.5, 5.5 ) ) )
+      {
+        ++hits;
+      }
+    }
+  }
+  QCOMPARE( hits, 21 );
+  qDeleteAll( points );
+}
+
 void TestQgsGeometry::unionCheck1()
 {
   // should be a multipolygon with 2 parts as A does not intersect C
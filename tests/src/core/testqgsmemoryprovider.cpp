@@ -0,0 +1,246 @@
+/***************************************************************************
+    testqgsmemoryprovider.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <QtTest>
+#include <QObject>
+
+//qgis includes...
+#include <qgsapplication.h>
+#include <qgsfeatureiterator.h>
+#include <qgsgeometry.h>
+#include <qgsvectordataprovider.h>
+#include <qgsvectorlayer.h>
+
+static const int BENCHMARK_FEATURES = 100000;
+
+static QgsFeatureList _pointFeatures( const QgsFields& fields, int count )
+{
+  QgsFeatureList features;
+  for ( int i = 0; i < count; ++i )
+  {
+    QgsFeature f( fields );
+    f.setAttribute( 0, i );
+    f.setAttribute( 1, QString( "feature %1" ).arg( i ) );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( i % 1000, i / 1000 ) ) );
+    features << f;
+  }
+  return features;
+}
+
+/** @ingroup UnitTests
+ * This is a unit test and benchmark for the storage of the memory provider
+ */
+class TestQgsMemoryProvider: public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase();      // will be called before the first testfunction is executed.
+    void cleanupTestCase();   // will be called after the last testfunction was executed.
+    void init();              // will be called before each testfunction is executed.
+    void cleanup();           // will be called after every testfunction.
+
+    void addDelete();
+    void changeValues();
+    void attributes();
+    void iteratorSnapshot();
+
+    void benchmarkInsert();
+    void benchmarkIterate();
+    void benchmarkFilterRect();
+
+  private:
+    QgsVectorLayer* mLayer;
+};
+
+void TestQgsMemoryProvider::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+}
+
+void TestQgsMemoryProvider::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+void TestQgsMemoryProvider::init()
+{
+  mLayer = new QgsVectorLayer( "Point?field=id:integer&field=name:string", "test", "memory" );
+  QVERIFY( mLayer->isValid() );
+}
+
+void TestQgsMemoryProvider::cleanup()
+{
+  delete mLayer;
+}
+
+void TestQgsMemoryProvider::addDelete()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), 5000 );
+  QVERIFY( provider->addFeatures( features ) );
+  QCOMPARE( provider->featureCount(), 5000L );
+  QCOMPARE( features.first().id(), QgsFeatureId( 1 ) );
+  QCOMPARE( provider->extent(), QgsRectangle( 0, 0, 999, 4 ) );
+
+  // delete enough features to compact the storage
+  QgsFeatureIds ids;
+  for ( int i = 1; i <= 4000; ++i )
+    ids << i;
+  QVERIFY( provider->deleteFeatures( ids ) );
+  QCOMPARE( provider->featureCount(), 1000L );
+  QCOMPARE( provider->extent(), QgsRectangle( 0, 4, 999, 4 ) );
+
+  QgsFeature f;
+  QVERIFY( !provider->getFeatures( QgsFeatureRequest( 4000 ) ).nextFeature( f ) );
+  QVERIFY( provider->getFeatures( QgsFeatureRequest( 4001 ) ).nextFeature( f ) );
+  QCOMPARE( f.id(), QgsFeatureId( 4001 ) );
+  QCOMPARE( f.attribute( "id" ).toInt(), 4000 );
+  QCOMPARE( f.geometry()->asPoint(), QgsPoint( 0, 4 ) );
+
+  // features are returned in the order they were added
+  QgsFeatureIterator it = provider->getFeatures();
+  QgsFeatureId expectedId = 4001;
+  while ( it.nextFeature( f ) )
+    QCOMPARE( f.id(), expectedId++ );
+  QCOMPARE( expectedId, QgsFeatureId( 5001 ) );
+
+  // new ids continue after the deleted ones
+  QgsFeatureList more = _pointFeatures( provider->fields(), 1 );
+  QVERIFY( provider->addFeatures( more ) );
+  QCOMPARE( more.first().id(), QgsFeatureId( 5001 ) );
+}
+
+void TestQgsMemoryProvider::changeValues()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), 10 );
+  QVERIFY( provider->addFeatures( features ) );
+  QVERIFY( provider->createSpatialIndex() );
+
+  QgsGeometry* geom = QgsGeometry::fromPoint( QgsPoint( 100, 100 ) );
+  QgsGeometryMap geometries;
+  geometries.insert( 3, *geom );
+  delete geom;
+  QVERIFY( provider->changeGeometryValues( geometries ) );
+  QgsAttributeMap values;
+  values.insert( 1, "changed" );
+  QgsChangedAttributesMap changed;
+  changed.insert( 3, values );
+  QVERIFY( provider->changeAttributeValues( changed ) );
+  QCOMPARE( provider->extent(), QgsRectangle( 0, 0, 100, 100 ) );
+
+  QgsFeature f;
+  QgsFeatureIterator it = provider->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 99, 99, 101, 101 ) ) );
+  QVERIFY( it.nextFeature( f ) );
+  QCOMPARE( f.id(), QgsFeatureId( 3 ) );
+  QCOMPARE( f.attribute( "name" ).toString(), QString( "changed" ) );
+  QVERIFY( !it.nextFeature( f ) );
+
+  // the old position is not in the spatial index anymore
+  it = provider->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 1.5, -0.5, 2.5, 0.5 ) ) );
+  QVERIFY( !it.nextFeature( f ) );
+}
+
+void TestQgsMemoryProvider::attributes()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), 10 );
+  QVERIFY( provider->addFeatures( features ) );
+
+  QVERIFY( provider->addAttributes( QList<QgsField>() << QgsField( "value", QVariant::Double ) ) );
+  QgsAttributeIds deleted;
+  deleted << 0;
+  QVERIFY( provider->deleteAttributes( deleted ) );
+
+  QgsFeature f;
+  QVERIFY( provider->getFeatures( QgsFeatureRequest( 5 ) ).nextFeature( f ) );
+  QCOMPARE( f.attributes().size(), 2 );
+  QCOMPARE( f.attribute( 0 ).toString(), QString( "feature 4" ) );
+  QVERIFY( f.attribute( 1 ).isNull() );
+}
+
+void TestQgsMemoryProvider::iteratorSnapshot()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), 10 );
+  QVERIFY( provider->addFeatures( features ) );
+
+  // changes after the creation of the iterator are not visible to it
+  QgsFeatureIterator it = provider->getFeatures( QgsFeatureRequest().setFlags( QgsFeatureRequest::NoGeometry ) );
+  QgsFeatureIds ids;
+  ids << 1 << 2;
+  QVERIFY( provider->deleteFeatures( ids ) );
+
+  QgsFeature f;
+  int count = 0;
+  while ( it.nextFeature( f ) )
+  {
+    QVERIFY( !f.geometry() );
+    count++;
+  }
+  QCOMPARE( count, 10 );
+}
+
+void TestQgsMemoryProvider::benchmarkInsert()
+{
+  QgsFeatureList features = _pointFeatures( mLayer->dataProvider()->fields(), BENCHMARK_FEATURES );
+
+  QBENCHMARK
+  {
+    QgsVectorLayer layer( "Point?field=id:integer&field=name:string", "test", "memory" );
+    QgsFeatureList batch = features;
+    layer.dataProvider()->addFeatures( batch );
+  }
+}
+
+void TestQgsMemoryProvider::benchmarkIterate()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), BENCHMARK_FEATURES );
+  provider->addFeatures( features );
+
+  QBENCHMARK
+  {
+    QgsFeatureIterator it = provider->getFeatures();
+    QgsFeature f;
+    int count = 0;
+    while ( it.nextFeature( f ) )
+      count++;
+    QCOMPARE( count, BENCHMARK_FEATURES );
+  }
+}
+
+void TestQgsMemoryProvider::benchmarkFilterRect()
+{
+  QgsVectorDataProvider* provider = mLayer->dataProvider();
+  QgsFeatureList features = _pointFeatures( provider->fields(), BENCHMARK_FEATURES );
+  provider->addFeatures( features );
+
+  QBENCHMARK
+  {
+    QgsFeatureIterator it = provider->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( 0, 0, 99.5, 9.5 ) ) );
+    QgsFeature f;
+    int count = 0;
+    while ( it.nextFeature( f ) )
+      count++;
+    QCOMPARE( count, 1000 );
+  }
+}
+
+QTEST_MAIN( TestQgsMemoryProvider )
+#include "moc_testqgsmemoryprovider.cxx"
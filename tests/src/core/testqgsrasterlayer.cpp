@@ -26,6 +26,7 @@
 #include <QDesktopServices>
 
 #include "cpl_conv.h"
+#include "gdal.h"
 
 //qgis includes...
 #include <qgsrasterlayer.h>
@@ -68,7 +69,9 @@ class TestQgsRasterLayer: public QObject
     void checkDimensions();
     void checkStats();
     void checkScaleOffset();
+    void persistedStatistics();
     void buildExternalOverviews();
+    void buildParallelOverviews();
     void registry();
     void transparency();
     void setRenderer();
@@ -431,6 +434,73 @@ void TestQgsRasterLayer::checkScaleOffset()
   delete myRasterLayer;
 }
 
+void TestQgsRasterLayer::persistedStatistics()
+{
+  mReport += "<h2>Check persisted exact statistics</h2>\n";
+  // statistics are stored in the .aux.xml
+  CPLSetConfigOption( "GDAL_PAM_ENABLED", "YES" );
+
+  QString myTempPath = QDir::tempPath() + QDir::separator();
+  QFile::remove( myTempPath + "tenbytenraster.asc" );
+  QFile::remove( myTempPath + "tenbytenraster.asc.aux.xml" );
+  QVERIFY( QFile::copy( mTestDataDir + "tenbytenraster.asc", myTempPath + "tenbytenraster.asc" ) );
+
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myTempPath + "tenbytenraster.asc", "tenbytenraster" );
+  QVERIFY( mypLayer->isValid() );
+  QVERIFY( !mypLayer->dataProvider()->hasStatistics( 1 ) );
+  QgsRasterBandStats myStatistics = mypLayer->dataProvider()->bandStatistics( 1 );
+  QVERIFY( myStatistics.elementCount == 100 );
+  QVERIFY( myStatistics.minimumValue == 0 );
+  QVERIFY( myStatistics.maximumValue == 9 );
+  QVERIFY( myStatistics.mean == 4.5 );
+  QVERIFY( myStatistics.sum == 450 );
+  delete mypLayer;
+
+  QVERIFY( QFile::exists( myTempPath + "tenbytenraster.asc.aux.xml" ) );
+
+  // a new layer uses the stored statistics
+  mypLayer = new QgsRasterLayer( myTempPath + "tenbytenraster.asc", "tenbytenraster" );
+  QVERIFY( mypLayer->dataProvider()->hasStatistics( 1 ) );
+  QgsRasterBandStats myPersistedStatistics = mypLayer->dataProvider()->bandStatistics( 1 );
+  QVERIFY( myPersistedStatistics.elementCount == 100 );
+  QVERIFY( myPersistedStatistics.mean == 4.5 );
+  QVERIFY( fabs( myPersistedStatistics.stdDev - myStatistics.stdDev ) < 0.0000001 );
+  // sample standard deviation, like the generic statistics: 10 * ( 4.5^2 + 3.5^2 + ... + 0.5^2 ) * 2 / 99
+  QVERIFY( fabs( myPersistedStatistics.stdDev - sqrt( 825.0 / 99.0 ) ) < 0.0000001 );
+
+  // stored statistics are not used with user no data values
+  QgsRasterRangeList myNoData;
+  myNoData << QgsRasterRange( 0, 0 );
+  mypLayer->dataProvider()->setUserNoDataValue( 1, myNoData );
+  QVERIFY( !mypLayer->dataProvider()->hasStatistics( 1 ) );
+  myStatistics = mypLayer->dataProvider()->bandStatistics( 1 );
+  QVERIFY( myStatistics.elementCount < 100 );
+  QVERIFY( myStatistics.minimumValue > 0 );
+
+  // without valid pixels there is no minimum and maximum
+  myNoData.clear();
+  myNoData << QgsRasterRange( 0, 9 );
+  mypLayer->dataProvider()->setUserNoDataValue( 1, myNoData );
+  myStatistics = mypLayer->dataProvider()->bandStatistics( 1 );
+  QVERIFY( myStatistics.elementCount == 0 );
+  QVERIFY( qIsNaN( myStatistics.minimumValue ) );
+  QVERIFY( qIsNaN( myStatistics.maximumValue ) );
+  delete mypLayer;
+
+  // stored statistics of a modified file are not used
+  QFile myFile( myTempPath + "tenbytenraster.asc" );
+  QVERIFY( myFile.open( QIODevice::Append ) );
+  myFile.write( "\n" );
+  myFile.close();
+  mypLayer = new QgsRasterLayer( myTempPath + "tenbytenraster.asc", "tenbytenraster" );
+  QVERIFY( !mypLayer->dataProvider()->hasStatistics( 1 ) );
+  QVERIFY( mypLayer->dataProvider()->bandStatistics( 1 ).elementCount == 100 );
+  delete mypLayer;
+
+  CPLSetConfigOption( "GDAL_PAM_ENABLED", "NO" );
+  mReport += "<p>Passed</p>";
+}
+
 void TestQgsRasterLayer::buildExternalOverviews()
 {
   //before we begin delete any old ovr file (if it exists)
@@ -481,6 +551,50 @@ void TestQgsRasterLayer::buildExternalOverviews()
 }
 
 
+void TestQgsRasterLayer::buildParallelOverviews()
+{
+  QString myTempPath = QDir::tempPath() + QDir::separator();
+  QFile::remove( myTempPath + "landsat.tif.ovr" );
+  QFile::remove( myTempPath + "landsat.tif" );
+  QVERIFY( QFile::copy( mTestDataDir + "landsat.tif", myTempPath + "landsat.tif" ) );
+  QFileInfo myRasterFileInfo( myTempPath + "landsat.tif" );
+  QgsRasterLayer * mypLayer = new QgsRasterLayer( myRasterFileInfo.filePath(),
+      myRasterFileInfo.completeBaseName() );
+  QVERIFY( mypLayer->isValid() );
+
+  QList< QgsRasterPyramid > myPyramidList = mypLayer->dataProvider()->buildPyramidList();
+  QVERIFY( myPyramidList.count() > 0 );
+  for ( int myCounterInt = 0; myCounterInt < myPyramidList.count(); myCounterInt++ )
+  {
+    myPyramidList[myCounterInt].build = true;
+  }
+  // GDAL_NUM_THREADS computes the levels in parallel tiles
+  QString myResult = mypLayer->dataProvider()->buildPyramids( myPyramidList, "AVERAGE", QgsRaster::PyramidsGTiff,
+                     QStringList() << "GDAL_NUM_THREADS=4" << "COMPRESS_OVERVIEW=DEFLATE" );
+  QVERIFY( myResult.isEmpty() );
+
+  myPyramidList = mypLayer->dataProvider()->buildPyramidList();
+  for ( int myCounterInt = 0; myCounterInt < myPyramidList.count(); myCounterInt++ )
+  {
+    QVERIFY( myPyramidList.at( myCounterInt ).exists );
+  }
+  QVERIFY( QFile::exists( myTempPath + "landsat.tif.ovr" ) );
+
+  // overview pixels are averages of the full resolution pixels, the statistics must be close
+  QgsRasterBandStats myFullStats = mypLayer->dataProvider()->bandStatistics( 1, QgsRasterBandStats::Mean );
+  GDALDatasetH myOverviews = GDALOpen( QString( myTempPath + "landsat.tif.ovr" ).toLocal8Bit().data(), GA_ReadOnly );
+  QVERIFY( myOverviews );
+  QCOMPARE( QString( GDALGetMetadataItem( myOverviews, "COMPRESSION", "IMAGE_STRUCTURE" ) ), QString( "DEFLATE" ) );
+  double myMin, myMax, myMean, myStdDev;
+  GDALComputeRasterStatistics( GDALGetRasterBand( myOverviews, 1 ), false, &myMin, &myMax, &myMean, &myStdDev, NULL, NULL );
+  QVERIFY( fabs( myMean - myFullStats.mean ) < 1.0 );
+  GDALClose( myOverviews );
+
+  delete mypLayer;
+  mReport += "<h2>Check Parallel Overviews</h2>\n";
+  mReport += "<p>Passed</p>";
+}
+
 void TestQgsRasterLayer::registry()
 {
   QString myTempPath = QDir::tempPath() + QDir::separator();
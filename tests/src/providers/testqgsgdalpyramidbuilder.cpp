@@ -0,0 +1,199 @@
+/***************************************************************************
+     testqgsgdalpyramidbuilder.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QVector>
+
+#include <qgsapplication.h>
+#include "qgsgdalpyramidbuilder.h"
+
+#include "cpl_conv.h"
+
+// the first level is computed in several tiles of the builder
+static const int RASTER_XSIZE = 2400;
+static const int RASTER_YSIZE = 1600;
+
+/** \ingroup UnitTests
+ * This is a unit test comparing the overviews of the parallel pyramid builder of the GDAL provider
+ * with the overviews built by GDALBuildOverviews()
+ */
+class TestQgsGdalPyramidBuilder: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void supportedMethods();
+    void average();
+    void nearest();
+
+  private:
+    /** Writes a Float32 GeoTIFF with two bands, with values constant in blocks of blockSize pixels */
+    bool createRaster( const QString& fileName, int blockSize );
+    /** Builds the overviews with GDAL and with the builder and compares all levels of all bands */
+    void compareOverviews( const QString& method, int blockSize, double tolerance );
+    /** Reads the overview of a band with the size of the given level */
+    static QVector<float> readOverview( GDALDatasetH dataset, int bandNo, int level );
+
+    QString mTempPath;
+};
+
+void TestQgsGdalPyramidBuilder::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  GDALAllRegister();
+  mTempPath = QDir::tempPath() + QDir::separator();
+}
+
+void TestQgsGdalPyramidBuilder::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+bool TestQgsGdalPyramidBuilder::createRaster( const QString& fileName, int blockSize )
+{
+  GDALDriverH driver = GDALGetDriverByName( "GTiff" );
+  if ( !driver )
+  {
+    return false;
+  }
+
+  GDALDatasetH dataset = GDALCreate( driver, fileName.toLocal8Bit().data(), RASTER_XSIZE, RASTER_YSIZE, 2, GDT_Float32, NULL );
+  if ( !dataset )
+  {
+    return false;
+  }
+
+  QVector<float> row( RASTER_XSIZE );
+  for ( int bandNo = 1; bandNo <= 2; ++bandNo )
+  {
+    GDALRasterBandH band = GDALGetRasterBand( dataset, bandNo );
+    for ( int i = 0; i < RASTER_YSIZE; ++i )
+    {
+      for ( int j = 0; j < RASTER_XSIZE; ++j )
+      {
+        int x = j / blockSize;
+        int y = i / blockSize;
+        row[j] = ( x * 7 + y * 13 * bandNo ) % 101 + 0.25 * ( x % 4 );
+      }
+      GDALRasterIO( band, GF_Write, 0, i, RASTER_XSIZE, 1, row.data(), RASTER_XSIZE, 1, GDT_Float32, 0, 0 );
+    }
+  }
+  GDALClose( dataset );
+  return true;
+}
+
+QVector<float> TestQgsGdalPyramidBuilder::readOverview( GDALDatasetH dataset, int bandNo, int level )
+{
+  QVector<float> values;
+  GDALRasterBandH band = GDALGetRasterBand( dataset, bandNo );
+  int xSize = ( RASTER_XSIZE + level - 1 ) / level;
+  int ySize = ( RASTER_YSIZE + level - 1 ) / level;
+  for ( int i = 0; i < GDALGetOverviewCount( band ); ++i )
+  {
+    GDALRasterBandH overview = GDALGetOverview( band, i );
+    if ( GDALGetRasterBandXSize( overview ) == xSize && GDALGetRasterBandYSize( overview ) == ySize )
+    {
+      values.resize( xSize * ySize );
+      if ( GDALRasterIO( overview, GF_Read, 0, 0, xSize, ySize, values.data(), xSize, ySize, GDT_Float32, 0, 0 ) != CE_None )
+      {
+        values.clear();
+      }
+      break;
+    }
+  }
+  return values;
+}
+
+void TestQgsGdalPyramidBuilder::compareOverviews( const QString& method, int blockSize, double tolerance )
+{
+  QString gdalFile = mTempPath + "pyramidbuilder_gdal.tif";
+  QString builderFile = mTempPath + "pyramidbuilder_parallel.tif";
+  QVERIFY( createRaster( gdalFile, blockSize ) );
+  QVERIFY( createRaster( builderFile, blockSize ) );
+
+  QVector<int> levels;
+  levels << 2 << 4 << 8;
+
+  GDALDatasetH gdalDataset = GDALOpen( gdalFile.toLocal8Bit().data(), GA_Update );
+  QVERIFY( gdalDataset );
+  QCOMPARE( GDALBuildOverviews( gdalDataset, method.toLocal8Bit().data(), levels.size(), levels.data(), 0, NULL, NULL, NULL ), CE_None );
+
+  GDALDatasetH builderDataset = GDALOpen( builderFile.toLocal8Bit().data(), GA_Update );
+  QVERIFY( builderDataset );
+  QgsGdalPyramidBuilder builder( builderDataset );
+  builder.setThreadCount( 4 );
+  QCOMPARE( builder.build( method, levels ), CE_None );
+
+  for ( int bandNo = 1; bandNo <= 2; ++bandNo )
+  {
+    foreach ( int level, levels )
+    {
+      QVector<float> expected = readOverview( gdalDataset, bandNo, level );
+      QVector<float> values = readOverview( builderDataset, bandNo, level );
+      QVERIFY( !expected.isEmpty() );
+      QCOMPARE( values.size(), expected.size() );
+
+      int differences = 0;
+      for ( int i = 0; i < values.size(); ++i )
+      {
+        if ( qAbs( values[i] - expected[i] ) > tolerance )
+        {
+          differences++;
+        }
+      }
+      if ( differences > 0 )
+      {
+        QFAIL( QString( "%1 pixels of band %2 level %3 differ" ).arg( differences ).arg( bandNo ).arg( level ).toLocal8Bit().data() );
+      }
+    }
+  }
+
+  GDALClose( gdalDataset );
+  GDALClose( builderDataset );
+  QFile::remove( gdalFile );
+  QFile::remove( builderFile );
+}
+
+void TestQgsGdalPyramidBuilder::supportedMethods()
+{
+  QVERIFY( QgsGdalPyramidBuilder::supportsMethod( "NEAREST" ) );
+  QVERIFY( QgsGdalPyramidBuilder::supportsMethod( "average" ) );
+  QVERIFY( !QgsGdalPyramidBuilder::supportsMethod( "GAUSS" ) );
+
+  CPLSetConfigOption( "GDAL_NUM_THREADS", "3" );
+  QCOMPARE( QgsGdalPyramidBuilder::threadCountFromConfig(), 3 );
+  CPLSetConfigOption( "GDAL_NUM_THREADS", NULL );
+  QCOMPARE( QgsGdalPyramidBuilder::threadCountFromConfig(), 1 );
+}
+
+void TestQgsGdalPyramidBuilder::average()
+{
+  // the levels cascade from the previous level, the windows are complete so the averages are the same
+  compareOverviews( "AVERAGE", 1, 1e-3 );
+}
+
+void TestQgsGdalPyramidBuilder::nearest()
+{
+  // the pixel picked within the window differs between GDAL versions, the values are constant within
+  // the windows of the largest level so that the placement of the tiles, levels and bands is compared
+  compareOverviews( "NEAREST", 8, 0 );
+}
+
+QTEST_MAIN( TestQgsGdalPyramidBuilder )
+#include "moc_testqgsgdalpyramidbuilder.cxx"
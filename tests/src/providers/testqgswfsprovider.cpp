@@ -0,0 +1,271 @@
+/***************************************************************************
+     testqgswfsprovider.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QUrl>
+
+#include <qgsapplication.h>
+#include <qgsfeatureiterator.h>
+#include <qgsfeaturerequest.h>
+#include <qgsgeometry.h>
+#include <qgsgml.h>
+#include "qgswfsprovider.h"
+
+/** \ingroup UnitTests
+ * This is a unit test for the paging and the feature cache of the WFS provider
+ */
+class TestQgsWfsProvider: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void uncoveredParts();
+    void duplicateFeatures();
+    void pagingIgnored();
+    void cacheReadBack();
+
+  private:
+    /** Features with the names "feature <i>" at (x + i, -i), with WFS ids "test.<i>" if withIds */
+    static QByteArray gml( int first, int count, bool withIds, double x = 0 );
+    /** Provider without server, the features are added by the test */
+    QgsWFSProvider* provider();
+    /** Adds the features of GML data to the provider, returns the number of features read */
+    int addFeatures( QgsWFSProvider* p, const QByteArray& data, QSet<QString>& pageIds, const QSet<QString>& previousPageIds = QSet<QString>() );
+    /** Names of the features returned by a request, sorted */
+    static QStringList names( QgsFeatureIterator it );
+
+    QString mGmlFile;
+};
+
+void TestQgsWfsProvider::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+  mGmlFile = QDir::tempPath() + "/qgis_wfsprovider_test.gml";
+}
+
+void TestQgsWfsProvider::cleanupTestCase()
+{
+  QFile::remove( mGmlFile );
+  QgsApplication::exitQgis();
+}
+
+QByteArray TestQgsWfsProvider::gml( int first, int count, bool withIds, double x )
+{
+  QString data = "<wfs:FeatureCollection xmlns:wfs=\"http://www.opengis.net/wfs\" xmlns:gml=\"http://www.opengis.net/gml\" xmlns:qgs=\"http://www.qgis.org/gml\">\n";
+  for ( int i = first; i < first + count; i++ )
+  {
+    data += "<gml:featureMember>";
+    data += withIds ? QString( "<qgs:test fid=\"test.%1\">" ).arg( i ) : QString( "<qgs:test>" );
+    data += QString( "<qgs:geometry><gml:Point><gml:coordinates cs=\",\" ts=\" \">%1,%2</gml:coordinates></gml:Point></qgs:geometry>" ).arg( x + i ).arg( -i );
+    data += QString( "<qgs:name>feature %1</qgs:name>" ).arg( i );
+    data += "</qgs:test></gml:featureMember>\n";
+  }
+  data += "</wfs:FeatureCollection>\n";
+  return data.toUtf8();
+}
+
+QgsWFSProvider* TestQgsWfsProvider::provider()
+{
+  QgsWFSProvider* p = new QgsWFSProvider( QString() );
+  p->setDataSourceUri( "http://localhost/wfs?SERVICE=WFS&REQUEST=GetFeature&TYPENAME=test" );
+  p->mFields.append( QgsField( "name", QVariant::String, "string" ) );
+  p->mGeometryAttribute = "geometry";
+  return p;
+}
+
+int TestQgsWfsProvider::addFeatures( QgsWFSProvider* p, const QByteArray& data, QSet<QString>& pageIds, const QSet<QString>& previousPageIds )
+{
+  QgsGml reader( "test", p->mGeometryAttribute, p->mFields );
+  QGis::WkbType wkbType;
+  if ( reader.getFeatures( data, &wkbType ) != 0 )
+    return -1;
+  return p->addFeaturesFromGml( reader, pageIds, previousPageIds );
+}
+
+QStringList TestQgsWfsProvider::names( QgsFeatureIterator it )
+{
+  QStringList names;
+  QgsFeature f;
+  while ( it.nextFeature( f ) )
+  {
+    names << f.attribute( "name" ).toString();
+  }
+  names.sort();
+  return names;
+}
+
+void TestQgsWfsProvider::uncoveredParts()
+{
+  QgsRectangle rect( 0, 0, 10, 10 );
+
+  // nothing covered
+  QList<QgsRectangle> parts = QgsWFSProvider::uncoveredParts( rect, QList<QgsRectangle>() );
+  QCOMPARE( parts.size(), 1 );
+  QCOMPARE( parts.at( 0 ), rect );
+
+  // completely covered
+  QVERIFY( QgsWFSProvider::uncoveredParts( rect, QList<QgsRectangle>() << QgsRectangle( -1, -1, 11, 11 ) ).isEmpty() );
+
+  // slivers left by rounding errors are dropped
+  QVERIFY( QgsWFSProvider::uncoveredParts( rect, QList<QgsRectangle>() << QgsRectangle( 0, 0, 10, 10 - 1e-9 ) ).isEmpty() );
+
+  // not intersecting
+  parts = QgsWFSProvider::uncoveredParts( rect, QList<QgsRectangle>() << QgsRectangle( 20, 20, 30, 30 ) );
+  QCOMPARE( parts.size(), 1 );
+  QCOMPARE( parts.at( 0 ), rect );
+
+  // hole in the middle: left, right, below and above
+  parts = QgsWFSProvider::uncoveredParts( rect, QList<QgsRectangle>() << QgsRectangle( 4, 4, 6, 6 ) );
+  QCOMPARE( parts.size(), 4 );
+  QVERIFY( parts.contains( QgsRectangle( 0, 0, 4, 10 ) ) );
+  QVERIFY( parts.contains( QgsRectangle( 6, 0, 10, 10 ) ) );
+  QVERIFY( parts.contains( QgsRectangle( 4, 0, 6, 4 ) ) );
+  QVERIFY( parts.contains( QgsRectangle( 4, 6, 6, 10 ) ) );
+
+  // the parts do not overlap and cover the rectangle except the covered extents
+  QList<QgsRectangle> covered;
+  covered << QgsRectangle( -5, -5, 5, 5 ) << QgsRectangle( 3, 3, 8, 12 );
+  parts = QgsWFSProvider::uncoveredParts( rect, covered );
+  double area = 0;
+  for ( int i = 0; i < parts.size(); i++ )
+  {
+    area += parts.at( i ).width() * parts.at( i ).height();
+    QVERIFY( parts.at( i ).width() > 0 && parts.at( i ).height() > 0 );
+    for ( int j = 0; j < covered.size(); j++ )
+    {
+      QgsRectangle overlap = parts.at( i ).intersect( &covered[j] );
+      QVERIFY( overlap.isEmpty() || overlap.width() * overlap.height() == 0 );
+    }
+  }
+  // 100 - 25 (first) - 5 * 7 (second, within rect) + 2 * 2 (both)
+  QCOMPARE( area, 44.0 );
+}
+
+void TestQgsWfsProvider::duplicateFeatures()
+{
+  QgsWFSProvider* p = provider();
+
+  QSet<QString> pageIds;
+  QCOMPARE( addFeatures( p, gml( 0, 3, true ), pageIds ), 3 );
+  QCOMPARE( p->mFeatureCache.count(), 3 );
+  QCOMPARE( pageIds, QSet<QString>() << "test.0" << "test.1" << "test.2" );
+
+  // features crossing the border of a downloaded extent are returned again
+  QSet<QString> nextPageIds;
+  QCOMPARE( addFeatures( p, gml( 1, 3, true ), nextPageIds ), 3 );
+  QCOMPARE( p->mFeatureCache.count(), 4 );
+  QCOMPARE( p->mWfsIdMap.size(), 4 );
+
+  // features without id are compared with the previous page only
+  QgsWFSProvider* noIds = provider();
+  QSet<QString> previousPageIds;
+  QCOMPARE( addFeatures( noIds, gml( 0, 3, false ), previousPageIds ), 3 );
+  QCOMPARE( previousPageIds.size(), 3 );
+  pageIds.clear();
+  QCOMPARE( addFeatures( noIds, gml( 0, 3, false ), pageIds, previousPageIds ), 3 );
+  QCOMPARE( pageIds, previousPageIds );
+  QCOMPARE( noIds->mFeatureCache.count(), 3 );
+  pageIds.clear();
+  QCOMPARE( addFeatures( noIds, gml( 2, 2, false ), pageIds ), 2 );
+  QCOMPARE( noIds->mFeatureCache.count(), 5 );
+
+  delete noIds;
+  delete p;
+}
+
+void TestQgsWfsProvider::pagingIgnored()
+{
+  // a local file ignores STARTINDEX and MAXFEATURES like a server not supporting paging
+  QString url = QUrl::fromLocalFile( mGmlFile ).toString();
+
+  for ( int withIds = 0; withIds < 2; withIds++ )
+  {
+    QFile file( mGmlFile );
+    QVERIFY( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    file.write( gml( 0, 3, withIds ) );
+    file.close();
+
+    // the last page is shorter than the page size, the server returned everything
+    int pageSizes[] = { 2, 3, 10 };
+    for ( int i = 0; i < 3; i++ )
+    {
+      QgsWFSProvider* p = provider();
+      p->mPageSize = pageSizes[i];
+      QCOMPARE( p->getFeatureGET( url, "geometry" ), 0 );
+      // with a page size of 3, the first page is returned again and all features are requested at once
+      QCOMPARE( p->mFeatureCache.count(), 3 );
+      QCOMPARE( p->featureCount(), 3L );
+      delete p;
+    }
+  }
+}
+
+void TestQgsWfsProvider::cacheReadBack()
+{
+  QgsWFSProvider* p = provider();
+  // no downloads of requested extents
+  p->mCached = true;
+
+  QSet<QString> pageIds;
+  QCOMPARE( addFeatures( p, gml( 0, 3, true, -10 ), pageIds ), 3 );
+
+  QgsAbstractFeatureSource* snapshot = p->featureSource();
+
+  // added after the snapshot, which keeps its features and spatial index
+  pageIds.clear();
+  QCOMPARE( addFeatures( p, gml( 3, 2, true, -10 ), pageIds ), 2 );
+
+  QgsFeatureIterator it = snapshot->getFeatures( QgsFeatureRequest() );
+  QgsFeature f;
+  QVERIFY( it.nextFeature( f ) );
+  QCOMPARE( f.attribute( "name" ).toString(), QString( "feature 0" ) );
+  QVERIFY( f.geometry() );
+  QCOMPARE( f.geometry()->asPoint(), QgsPoint( -10, 0 ) );
+  it.close();
+
+  QgsRectangle negative( -20, -20, -8.5, 0.5 );
+  QCOMPARE( names( snapshot->getFeatures( QgsFeatureRequest().setFilterRect( negative ) ) ),
+            QStringList() << "feature 0" << "feature 1" );
+  QCOMPARE( names( snapshot->getFeatures( QgsFeatureRequest() ) ).size(), 3 );
+
+  // the spatial index of the provider is a copy of the shared one, including negative coordinates
+  QgsAbstractFeatureSource* current = p->featureSource();
+  QCOMPARE( names( current->getFeatures( QgsFeatureRequest().setFilterRect( negative ) ) ),
+            QStringList() << "feature 0" << "feature 1" );
+  QCOMPARE( names( current->getFeatures( QgsFeatureRequest().setFilterRect( QgsRectangle( -20, -20, 0, 0 ) ) ) ).size(), 5 );
+
+  // changed features are appended, the snapshot keeps the old version
+  QgsFeature changed;
+  QVERIFY( p->mFeatureCache.feature( p->mWfsIdMap.value( "test.0" ), changed ) );
+  changed.setAttribute( 0, "changed" );
+  QVERIFY( p->mFeatureCache.addFeature( changed ) );
+  QVERIFY( names( snapshot->getFeatures( QgsFeatureRequest() ) ).contains( "feature 0" ) );
+  delete current;
+  current = p->featureSource();
+  QStringList currentNames = names( current->getFeatures( QgsFeatureRequest() ) );
+  QVERIFY( currentNames.contains( "changed" ) );
+  QVERIFY( !currentNames.contains( "feature 0" ) );
+
+  delete current;
+  delete snapshot;
+  delete p;
+}
+
+QTEST_MAIN( TestQgsWfsProvider )
+#include "moc_testqgswfsprovider.cxx"
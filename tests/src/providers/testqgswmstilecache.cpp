@@ -0,0 +1,251 @@
+/***************************************************************************
+     testqgswmstilecache.cpp
+     --------------------------------------
+    Date                 : October 2014
+    Copyright            : (C) 2014 by The QGIS Project
+    Email                : qgis-developer at lists dot osgeo dot org
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QSettings>
+
+#include <qgsapplication.h>
+#include "qgswmstilecache.h"
+
+/** Reply with the headers set by the test, no data is read from it */
+class TestReply : public QNetworkReply
+{
+  public:
+    TestReply() { open( QIODevice::ReadOnly ); }
+
+    void setTestHeader( const QByteArray& name, const QByteArray& value ) { setRawHeader( name, value ); }
+    void abort() {}
+
+  protected:
+    qint64 readData( char*, qint64 ) { return -1; }
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the tile cache of the WMS provider
+ */
+class TestQgsWmsTileCache: public QObject
+{
+    Q_OBJECT;
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+    void cleanup();
+
+    void expiryDate();
+    void insertTile();
+    void revalidateTile();
+    void offline();
+    void trim();
+
+  private:
+    static QString key( int i ) { return QgsWmsTileCache::tileKey( "http://localhost/wmts", "layer", "style", "matrix", i, i ); }
+    bool hasTile( QgsWmsTileCache& cache, int i ) { return QFileInfo( cache.tilePath( key( i ) ) ).exists(); }
+
+    QString mDirectory;
+};
+
+void TestQgsWmsTileCache::initTestCase()
+{
+  // settings of the tests only
+  QCoreApplication::setOrganizationName( "QGIS" );
+  QCoreApplication::setOrganizationDomain( "qgis.org" );
+  QCoreApplication::setApplicationName( "QGIS-TEST" );
+
+  QgsApplication::init();
+  QSettings().setValue( "/qgis/defaultTileExpiry", 24 );
+
+  mDirectory = QDir::tempPath() + "/qgis_wmstilecache_test";
+}
+
+void TestQgsWmsTileCache::cleanupTestCase()
+{
+  QSettings().remove( "/qgis/defaultTileExpiry" );
+}
+
+void TestQgsWmsTileCache::init()
+{
+  QVERIFY( QDir().mkpath( mDirectory ) );
+}
+
+void TestQgsWmsTileCache::cleanup()
+{
+  // remove the tiles of the test
+  QDirIterator it( mDirectory, QDir::Files, QDirIterator::Subdirectories );
+  while ( it.hasNext() )
+    QFile::remove( it.next() );
+  for ( int i = 0; i < 10; i++ )
+    QDir( mDirectory ).rmdir( key( i ).left( 2 ) );
+  QDir().rmdir( mDirectory );
+}
+
+void TestQgsWmsTileCache::expiryDate()
+{
+  QDateTime now = QDateTime::currentDateTime().toUTC();
+
+  // default expiry
+  TestReply noHeaders;
+  QDateTime expiry = QgsWmsTileCache::expiryDate( &noHeaders );
+  QVERIFY( qAbs( now.secsTo( expiry ) - 24 * 60 * 60 ) <= 1 );
+
+  TestReply maxAge;
+  maxAge.setTestHeader( "Cache-Control", "public, max-age=3600" );
+  maxAge.setTestHeader( "Expires", "Sun, 06 Nov 1994 08:49:37 GMT" );
+  expiry = QgsWmsTileCache::expiryDate( &maxAge );
+  QVERIFY( qAbs( now.secsTo( expiry ) - 3600 ) <= 1 );
+
+  TestReply noCache;
+  noCache.setTestHeader( "Cache-Control", "No-Cache" );
+  noCache.setTestHeader( "Expires", "Thu, 01 Dec 2044 16:00:00 GMT" );
+  QVERIFY( qAbs( now.secsTo( QgsWmsTileCache::expiryDate( &noCache ) ) ) <= 1 );
+
+  TestReply expires;
+  expires.setTestHeader( "Expires", "Sun, 06 Nov 1994 08:49:37 GMT" );
+  QCOMPARE( QgsWmsTileCache::expiryDate( &expires ), QDateTime( QDate( 1994, 11, 6 ), QTime( 8, 49, 37 ), Qt::UTC ) );
+
+  TestReply invalidExpires;
+  invalidExpires.setTestHeader( "Expires", "0" );
+  QVERIFY( qAbs( now.secsTo( QgsWmsTileCache::expiryDate( &invalidExpires ) ) ) <= 1 );
+}
+
+void TestQgsWmsTileCache::insertTile()
+{
+  QgsWmsTileCache cache( mDirectory, 1024 * 1024, false );
+
+  TestReply reply;
+  reply.setTestHeader( "ETag", "\"a\"" );
+  reply.setTestHeader( "Last-Modified", "Sun, 06 Nov 1994 08:49:37 GMT" );
+  reply.setTestHeader( "Cache-Control", "max-age=3600" );
+  cache.insertTile( key( 0 ), "tile 0", &reply );
+
+  QgsWmsTileCache::Tile tile = cache.tile( key( 0 ) );
+  QVERIFY( tile.isValid() );
+  QVERIFY( !tile.isExpired() );
+  QCOMPARE( tile.data, QByteArray( "tile 0" ) );
+  QCOMPARE( tile.eTag, QByteArray( "\"a\"" ) );
+  QCOMPARE( tile.lastModified, QByteArray( "Sun, 06 Nov 1994 08:49:37 GMT" ) );
+
+  // the size of the cache is determined in the background
+  cache.mTrimFuture.waitForFinished();
+  QCOMPARE( cache.mCurrentSize, QFileInfo( cache.tilePath( key( 0 ) ) ).size() );
+
+  TestReply noStore;
+  noStore.setTestHeader( "Cache-Control", "no-store" );
+  cache.insertTile( key( 1 ), "tile 1", &noStore );
+  QVERIFY( !cache.tile( key( 1 ) ).isValid() );
+}
+
+void TestQgsWmsTileCache::revalidateTile()
+{
+  QgsWmsTileCache cache( mDirectory, 1024 * 1024, false );
+
+  TestReply reply;
+  reply.setTestHeader( "ETag", "\"a\"" );
+  reply.setTestHeader( "Cache-Control", "no-cache" );
+  cache.insertTile( key( 0 ), "tile 0", &reply );
+  QVERIFY( cache.tile( key( 0 ) ).isExpired() );
+
+  // "304 Not Modified" with a new expiry date and ETag
+  TestReply notModified;
+  notModified.setTestHeader( "ETag", "\"b\"" );
+  notModified.setTestHeader( "Cache-Control", "max-age=60" );
+  QgsWmsTileCache::Tile tile = cache.revalidateTile( key( 0 ), &notModified );
+  QVERIFY( !tile.isExpired() );
+  QCOMPARE( tile.data, QByteArray( "tile 0" ) );
+  QCOMPARE( tile.eTag, QByteArray( "\"b\"" ) );
+
+  // stored in the cache
+  tile = cache.tile( key( 0 ) );
+  QVERIFY( !tile.isExpired() );
+  QCOMPARE( tile.eTag, QByteArray( "\"b\"" ) );
+
+  // tiles removed from the cache meanwhile are not revalidated
+  QVERIFY( !cache.revalidateTile( key( 1 ), &notModified ).isValid() );
+  QVERIFY( !hasTile( cache, 1 ) );
+}
+
+void TestQgsWmsTileCache::offline()
+{
+  QgsWmsTileCache online( mDirectory, 1024 * 1024, false );
+
+  TestReply expired;
+  expired.setTestHeader( "Expires", "0" );
+  online.insertTile( key( 0 ), "tile 0", &expired );
+  QgsWmsTileCache::Tile tile = online.tile( key( 0 ) );
+  QVERIFY( tile.isValid() );
+  QVERIFY( !online.isUsable( tile ) );
+
+  // expired tiles are used offline, missing tiles are not
+  QgsWmsTileCache offline( mDirectory, 1024 * 1024, true );
+  QVERIFY( offline.isOffline() );
+  QVERIFY( offline.isUsable( offline.tile( key( 0 ) ) ) );
+  QVERIFY( !offline.isUsable( offline.tile( key( 1 ) ) ) );
+}
+
+void TestQgsWmsTileCache::trim()
+{
+  QgsWmsTileCache cache( mDirectory, 1024 * 1024, false );
+
+  TestReply reply;
+  QByteArray data( 1000, 'x' );
+  // the tiles are inserted once the size of the cache is known, so that none is counted twice
+  cache.insertTile( key( 0 ), data, &reply );
+  cache.mTrimFuture.waitForFinished();
+  for ( int i = 1; i < 6; i++ )
+  {
+    cache.insertTile( key( i ), data, &reply );
+  }
+  qint64 tileSize = QFileInfo( cache.tilePath( key( 0 ) ) ).size();
+  QCOMPARE( cache.mCurrentSize, 6 * tileSize );
+
+  // tiles 0 and 1 are the least recently used, tile 5 the most recently used
+  QDateTime lastUse = QDateTime::currentDateTime().addSecs( 60 );
+  int order[] = { 1, 0, 4, 2, 3, 5 };
+  for ( int i = 0; i < 6; i++ )
+  {
+    cache.mLastUsed.insert( key( order[i] ), lastUse.addSecs( i ) );
+  }
+
+  // removes tiles until the cache is below 90% of the maximum size
+  cache.mMaxSize = 5 * tileSize;
+  cache.trim();
+  QCOMPARE( cache.mCurrentSize, 4 * tileSize );
+  QVERIFY( !hasTile( cache, 0 ) );
+  QVERIFY( !hasTile( cache, 1 ) );
+  for ( int i = 2; i < 6; i++ )
+  {
+    QVERIFY( hasTile( cache, i ) );
+  }
+  QVERIFY( !cache.mLastUsed.contains( key( 0 ) ) );
+  QVERIFY( !cache.mTrimming );
+
+  // inserting over the maximum size trims in the background
+  cache.insertTile( key( 6 ), data, &reply );
+  cache.insertTile( key( 7 ), data, &reply );
+  cache.mTrimFuture.waitForFinished();
+  QCOMPARE( cache.mCurrentSize, 4 * tileSize );
+  int tiles = 0;
+  for ( int i = 0; i < 8; i++ )
+  {
+    tiles += hasTile( cache, i ) ? 1 : 0;
+  }
+  QCOMPARE( tiles, 4 );
+}
+
+QTEST_MAIN( TestQgsWmsTileCache )
+#include "moc_testqgswmstilecache.cxx"
@@ -128,6 +128,9 @@ class ServerProcess(object):
             running = self._process.poll() is None
         return running
 
+    def startenv(self):
+        return self._startenv
+
     def set_startenv(self, env):
         self._startenv = env
 
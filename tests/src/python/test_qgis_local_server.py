@@ -24,6 +24,7 @@ import datetime
 import urllib2
 import StringIO
 import tempfile
+import shutil
 
 from qgis.core import (
     QgsRectangle,
@@ -129,6 +130,53 @@ class TestQgisLocalServer(TestCase):
         msg = '\nRender check failed for "{0}"'.format(test_name)
         assert res, msg
 
+    # @unittest.skip('')
+    def test_getmap_tile_cache(self):
+        tile_dir = tempfile.mkdtemp()
+        fcgi = MAPSERV.fcgi_server_process()
+        orig_env = fcgi.startenv()
+        env = dict(orig_env or {})
+        env['QGIS_SERVER_TILE_CACHE_DIR'] = tile_dir
+        env['QGIS_SERVER_METATILE'] = '2'
+        fcgi.stop()
+        fcgi.set_startenv(env)
+        try:
+            fcgi.start()
+            # a tile of a 500 m grid with the origin at 0/0
+            params = self.getmap_params()
+            params['BBOX'] = '606500,4823000,607000,4823500'
+            params['WIDTH'] = '256'
+            params['HEIGHT'] = '256'
+            success, img_path, url = MAPSERV.get_map(params)
+            assert success, '\nLocal server get_map failed'
+
+            # the 2x2 tiles of the metatile are cached at once
+            msg = '\nMetatile was not cached'
+            assert self.count_files(tile_dir) == 4, msg
+
+            success, cached_path, url = MAPSERV.get_map(params)
+            assert success, '\nLocal server get_map failed'
+            msg = '\nCached tile differs from the rendered tile'
+            assert (open(img_path, 'rb').read() ==
+                    open(cached_path, 'rb').read()), msg
+
+            # maps larger than tiles are not cached, even if aligned to a grid
+            params['BBOX'] = '606000,4824000,608000,4826000'
+            params['WIDTH'] = '1000'
+            params['HEIGHT'] = '1000'
+            success, img_path, url = MAPSERV.get_map(params)
+            assert success, '\nLocal server get_map failed'
+            msg = '\nMap larger than a tile was cached'
+            assert self.count_files(tile_dir) == 4, msg
+        finally:
+            fcgi.stop()
+            fcgi.set_startenv(orig_env)
+            shutil.rmtree(tile_dir, True)
+
+    @staticmethod
+    def count_files(directory):
+        return sum(len(files) for root, dirs, files in os.walk(directory))
+
     def getmap_params(self):
         return {
             'SERVICE': 'WMS',
@@ -189,7 +237,8 @@ def run_suite(module, tests):
 if __name__ == '__main__':
     # NOTE: unless QGIS_TEST_SUITE env var is set all tests will be run
     test_suite = [
-        'TestQgisLocalServer.test_getmap'
+        'TestQgisLocalServer.test_getmap',
+        'TestQgisLocalServer.test_getmap_tile_cache'
     ]
     test_res = run_suite(sys.modules[__name__], test_suite)
     sys.exit(not test_res.wasSuccessful())
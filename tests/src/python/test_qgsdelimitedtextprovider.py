@@ -26,6 +26,7 @@ __revision__ = '$Format:%H$'
 import os
 import os.path
 import re
+import hashlib
 import tempfile
 import inspect
 import time
@@ -42,6 +43,7 @@ from PyQt4.QtCore import (QVariant,
                         )
 
 from qgis.core import (QGis,
+                        QgsApplication,
                         QgsProviderRegistry,
                         QgsVectorLayer,
                         QgsFeature,
@@ -655,5 +657,114 @@ class TestQgsDelimitedTextProvider(TestCase):
         runTest(filename,requests,**params)
 
 
+    def test_038_scan_cache(self):
+        # Scan results of large files are cached in the settings directory
+        (filehandle,filename) = tempfile.mkstemp(suffix='.csv')
+        # records are padded so that the file exceeds the 10 MB threshold of the cache
+        padding = 'x' * 80
+        nrecords = 120000
+        with os.fdopen(filehandle,"w") as f:
+            f.write("id,x,y,name\n")
+            for i in range(1,nrecords):
+                f.write("%d,%d,%d,%s\n" % (i,i%1000,i/1000,padding))
+            f.write("%d,%d,%d,%s,extra\n" % (nrecords,nrecords%1000,nrecords/1000,padding))
+        os.path.getsize(filename) > 10*1024*1024 or self.fail("Test file too small for the scan cache")
+        cachefile = os.path.join(unicode(QgsApplication.qgisSettingsDirPath()),'cache','delimitedtext',
+                                 hashlib.md5(os.path.abspath(filename)).hexdigest())
+        if os.path.exists(cachefile):
+            os.remove(cachefile)
+
+        url = QUrl.fromLocalFile(filename)
+        for k,v in (('type','csv'),('xField','x'),('yField','y'),('spatialIndex','yes'),('subsetIndex','yes')):
+            url.addQueryItem(k,v)
+        def loadLayer():
+            layer = QgsVectorLayer(url.toString(),'test','delimitedtext')
+            self.assertTrue(layer.isValid())
+            return layer
+        def layerSummary(layer):
+            provider = layer.dataProvider()
+            return ([f.name() for f in provider.fields()], provider.featureCount(), provider.extent().toString())
+
+        try:
+            scanned = loadLayer()
+            self.assertTrue(os.path.exists(cachefile),"Scan cache not written")
+            wanted = layerSummary(scanned)
+            self.assertEqual(wanted[0],['id','x','y','name','field_5'])
+            self.assertEqual(wanted[1],nrecords)
+
+            # Loaded from the cache
+            cached = loadLayer()
+            self.assertEqual(layerSummary(cached),wanted)
+            f = cached.getFeatures(QgsFeatureRequest(nrecords)).next()
+            self.assertEqual(f['name'],padding)
+            self.assertEqual(f['field_5'],'extra')
+            request = QgsFeatureRequest().setFilterRect(QgsRectangle(99.5,9.5,100.5,10.5))
+            self.assertEqual([f.id() for f in cached.getFeatures(request)],[10100])
+            cached.dataProvider().setSubsetString("id < 100",True)
+            self.assertEqual(cached.dataProvider().featureCount(),99)
+            self.assertEqual(len([f for f in cached.getFeatures()]),99)
+
+            # Changes with the same size and modification time are not detected,
+            # which shows that the scan results come from the cache
+            stat = os.stat(filename)
+            with open(filename,'r+') as f:
+                # invalid x coordinate of the first record
+                f.seek(len("id,x,y,name\n1,"))
+                f.write('-')
+            os.utime(filename,(stat.st_atime,stat.st_mtime))
+            self.assertEqual(layerSummary(loadLayer()),wanted)
+
+            # A new modification time invalidates the cache
+            os.utime(filename,(stat.st_atime,stat.st_mtime+10))
+            rescanned = layerSummary(loadLayer())
+            self.assertEqual(rescanned[1],nrecords-1)
+        finally:
+            os.remove(filename)
+            if os.path.exists(cachefile):
+                os.remove(cachefile)
+
+    def test_039_seek_multiline_records(self):
+        # Feature id requests after a scan jump to the line offsets recorded every 64 lines,
+        # records with quoted fields spanning several lines cross these offsets
+        (filehandle,filename) = tempfile.mkstemp(suffix='.csv')
+        nrecords = 200
+        with os.fdopen(filehandle,"w") as f:
+            f.write("id,description\n")
+            for i in range(1,nrecords+1):
+                # one to three lines per record, non ASCII characters make byte and character offsets differ
+                lines = ["record %d \xc3\xa9t\xc3\xa9 line %d" % (i,l) for l in range(i%3+1)]
+                f.write('%d,"%s"\n' % (i,"\n".join(lines)))
+
+        url = QUrl.fromLocalFile(filename)
+        url.addQueryItem('type','csv')
+        url.addQueryItem('geomType','none')
+        url.addQueryItem('encoding','UTF-8')
+        url.addQueryItem('subsetIndex','yes')
+        try:
+            layer = QgsVectorLayer(url.toString(),'test','delimitedtext')
+            self.assertTrue(layer.isValid())
+            scanned = dict((f.id(),(f['id'],f['description'])) for f in layer.getFeatures())
+            self.assertEqual(len(scanned),nrecords)
+            # the record ids are the line numbers of the first lines of the records
+            self.assertTrue(max(scanned.keys()) > 5*64)
+
+            fids = sorted(scanned.keys())
+            # records starting just before and after the offsets, forwards and backwards
+            wanted = [fid for fid in fids if fid % 64 in (62,63,0,1,2)]
+            wanted += list(reversed(wanted)) + [fids[-1],fids[0],fids[len(fids)/2]]
+            for fid in wanted:
+                f = layer.getFeatures(QgsFeatureRequest(fid)).next()
+                self.assertEqual(f.id(),fid)
+                self.assertEqual((f['id'],f['description']),scanned[fid])
+
+            # the subset index makes one iterator jump from record to record
+            provider = layer.dataProvider()
+            provider.setSubsetString("id % 7 = 0",True)
+            self.assertEqual(provider.featureCount(),nrecords/7)
+            self.assertEqual(dict((f.id(),(f['id'],f['description'])) for f in layer.getFeatures()),
+                             dict((fid,value) for fid,value in scanned.items() if value[0] % 7 == 0))
+        finally:
+            os.remove(filename)
+
 if __name__ == '__main__':
     unittest.main()
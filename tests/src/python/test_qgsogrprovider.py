@@ -0,0 +1,135 @@
+# -*- coding: utf-8 -*-
+"""QGIS Unit tests for the feature iterator of QgsOgrProvider
+
+The features are read ahead on a background thread, the tests cover
+rewinding and closing iterators while this thread is running and the
+filters applied to features read without geometry.
+
+.. note:: This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+"""
+__author__ = 'The QGIS Project'
+__date__ = '19/10/2014'
+__copyright__ = 'Copyright 2014, The QGIS Project'
+# This will get replaced with a git SHA1 when you do a git archive
+__revision__ = '$Format:%H$'
+
+import os
+import shutil
+import tempfile
+import time
+
+from qgis.core import (QgsVectorLayer,
+                       QgsFeature,
+                       QgsFeatureRequest,
+                       QgsRectangle)
+
+from utilities import (getQgisTestApp,
+                       TestCase,
+                       unittest
+                       )
+
+# Convenience instances in case you may need them
+QGISAPP, CANVAS, IFACE, PARENT = getQgisTestApp()
+
+# more features than the read-ahead queue holds (256)
+FEATURE_COUNT = 1000
+
+
+class TestQgsOgrProvider(TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        """Run before all tests"""
+        # points at (i, i) for even ids, vertical lines from (i, 0) to (i, 1) for odd ids
+        cls.basetestpath = tempfile.mkdtemp()
+        cls.filename = os.path.join(cls.basetestpath, 'mixed.geojson')
+        features = []
+        for i in range(FEATURE_COUNT):
+            if i % 2 == 0:
+                geometry = '{"type":"Point","coordinates":[%d,%d]}' % (i, i)
+            else:
+                geometry = '{"type":"LineString","coordinates":[[%d,0],[%d,1]]}' % (i, i)
+            features.append('{"type":"Feature","properties":{"id":%d},"geometry":%s}' % (i, geometry))
+        with open(cls.filename, 'w') as f:
+            f.write('{"type":"FeatureCollection","features":[\n%s\n]}\n' % ',\n'.join(features))
+
+    @classmethod
+    def tearDownClass(cls):
+        """Run after all tests"""
+        shutil.rmtree(cls.basetestpath, True)
+
+    def layer(self, geometryType=None):
+        uri = self.filename
+        if geometryType:
+            uri += '|geometrytype=' + geometryType
+        layer = QgsVectorLayer(uri, 'mixed', 'ogr')
+        assert(layer.isValid())
+        return layer
+
+    def ids(self, iterator):
+        return [f['id'] for f in iterator]
+
+    def test_RewindMidIteration(self):
+        """Rewinding stops the read-ahead thread and restarts from the first feature"""
+        layer = self.layer()
+        it = layer.getFeatures()
+        first = [it.next()['id'] for i in range(10)]
+        self.assertEqual(first, range(10))
+        # let the thread fill its queue
+        time.sleep(0.2)
+        self.assertTrue(it.rewind())
+        self.assertEqual(self.ids(it), range(FEATURE_COUNT))
+
+        # rewinding after the end of the features is not possible, the iterator is closed
+        self.assertFalse(it.rewind())
+
+    def test_CloseWithFullQueue(self):
+        """Closing or destroying an iterator does not wait for the remaining features"""
+        layer = self.layer()
+        it = layer.getFeatures()
+        self.assertEqual(it.next()['id'], 0)
+        time.sleep(0.2)
+        self.assertTrue(it.close())
+        self.assertTrue(it.isClosed())
+        f = QgsFeature()
+        self.assertFalse(it.nextFeature(f))
+
+        it = layer.getFeatures()
+        self.assertEqual(it.next()['id'], 0)
+        time.sleep(0.2)
+        del it
+
+        # the layer is still usable
+        self.assertEqual(len(self.ids(layer.getFeatures())), FEATURE_COUNT)
+
+    def test_NoGeometryWithGeometryTypeFilter(self):
+        """The geometry type is checked although the geometry is not returned"""
+        layer = self.layer('Point')
+        request = QgsFeatureRequest().setFlags(QgsFeatureRequest.NoGeometry)
+        features = [f for f in layer.getFeatures(request)]
+        self.assertEqual([f['id'] for f in features], range(0, FEATURE_COUNT, 2))
+        for f in features:
+            self.assertFalse(f.geometry())
+
+        # with geometry
+        self.assertEqual(self.ids(layer.getFeatures()), range(0, FEATURE_COUNT, 2))
+        self.assertEqual(self.ids(self.layer('LineString').getFeatures(request)), range(1, FEATURE_COUNT, 2))
+
+    def test_NoGeometryWithFilterRect(self):
+        """The spatial filter is applied although the geometry is not returned"""
+        rect = QgsRectangle(99.5, -1, 110.5, 200)
+        for flags in (QgsFeatureRequest.NoGeometry, QgsFeatureRequest.NoGeometry | QgsFeatureRequest.ExactIntersect):
+            request = QgsFeatureRequest().setFilterRect(rect).setFlags(flags)
+            features = [f for f in self.layer().getFeatures(request)]
+            self.assertEqual(sorted([f['id'] for f in features]), range(100, 111))
+            for f in features:
+                self.assertFalse(f.geometry())
+
+            # combined with the geometry type filter
+            self.assertEqual(sorted(self.ids(self.layer('Point').getFeatures(request))), range(100, 111, 2))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,167 @@
+# -*- coding: utf-8 -*-
+"""QGIS Unit tests for QgsPostgresProvider
+
+The tests need a PostGIS enabled database given by the connection string in
+the QGIS_PGTEST_DB environment variable (e.g. "dbname=qgis_test"), they are
+skipped otherwise. The tables are created in the schema qgis_test.
+
+.. note:: This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+"""
+__author__ = 'The QGIS Project'
+__date__ = '19/10/2014'
+__copyright__ = 'Copyright 2014, The QGIS Project'
+# This will get replaced with a git SHA1 when you do a git archive
+__revision__ = '$Format:%H$'
+
+import os
+import sys
+
+from qgis.core import *
+
+from utilities import (getQgisTestApp,
+                       TestCase,
+                       unittest
+                       )
+
+DBCONN = os.environ.get('QGIS_PGTEST_DB')
+if not DBCONN:
+    print "Set QGIS_PGTEST_DB to a PostGIS database to run the tests"
+    sys.exit(0)
+
+try:
+    import psycopg2
+except ImportError:
+    print "You should install psycopg2 to run the tests"
+    sys.exit(0)
+
+# Convenience instances in case you may need them
+QGISAPP, CANVAS, IFACE, PARENT = getQgisTestApp()
+
+# enough features for addFeatures to use COPY
+FEATURE_COUNT = 150
+
+
+def die(error_message):
+    raise Exception(error_message)
+
+
+class TestQgsPostgresProvider(TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        """Run before all tests"""
+        cls.con = psycopg2.connect(DBCONN)
+        cls.con.autocommit = True
+        cur = cls.con.cursor()
+        cur.execute("DROP SCHEMA IF EXISTS qgis_test CASCADE")
+        cur.execute("CREATE SCHEMA qgis_test")
+
+        # plain table, inserted with COPY
+        cur.execute("CREATE TABLE qgis_test.copy_table (pk serial PRIMARY KEY, name text DEFAULT 'unnamed', value integer, geom geometry(Point,4326))")
+
+        # updatable view on it, has to use INSERT
+        cur.execute("CREATE VIEW qgis_test.copy_view AS SELECT * FROM qgis_test.copy_table")
+        cur.execute("ALTER VIEW qgis_test.copy_view ALTER COLUMN pk SET DEFAULT nextval('qgis_test.copy_table_pk_seq')")
+
+        # table with an INSERT rule, which COPY would not apply
+        cur.execute("CREATE TABLE qgis_test.rule_table (pk serial PRIMARY KEY, name text, geom geometry(Point,4326))")
+        cur.execute("CREATE TABLE qgis_test.rule_log (name text)")
+        cur.execute("CREATE RULE rule_table_log AS ON INSERT TO qgis_test.rule_table DO ALSO INSERT INTO qgis_test.rule_log VALUES (NEW.name)")
+
+        # table whose conventional index name is already taken
+        cur.execute("CREATE TABLE qgis_test.index_table (pk serial PRIMARY KEY, geom geometry(Point,4326))")
+        cur.execute("CREATE TABLE qgis_test.index_table_geom_idx (id integer)")
+
+    @classmethod
+    def tearDownClass(cls):
+        """Run after all tests"""
+        cls.con.cursor().execute("DROP SCHEMA qgis_test CASCADE")
+        cls.con.close()
+
+    def layer(self, table, key='pk'):
+        uri = QgsDataSourceURI(DBCONN)
+        uri.setDataSource('qgis_test', table, 'geom', '', key)
+        layer = QgsVectorLayer(uri.uri(), table, 'postgres')
+        assert(layer.isValid())
+        return layer
+
+    def features(self, layer, count, defaultName=False):
+        """Features with unset primary keys, every other one with the default name"""
+        provider = layer.dataProvider()
+        nameIdx = provider.fieldNameIndex('name')
+        features = []
+        for i in range(count):
+            f = QgsFeature(provider.fields())
+            if defaultName and i % 2:
+                f.setAttribute(nameIdx, provider.defaultValue(nameIdx))
+            else:
+                f.setAttribute(nameIdx, 'feature %d' % i)
+            f.setGeometry(QgsGeometry.fromPoint(QgsPoint(i, -i)))
+            features.append(f)
+        return features
+
+    def count(self, table):
+        cur = self.con.cursor()
+        cur.execute("SELECT count(*) FROM qgis_test.%s" % table)
+        return cur.fetchone()[0]
+
+    def test_CopyFeatures(self):
+        """Large batches are copied, defaults evaluated and feature ids set"""
+        layer = self.layer('copy_table')
+        provider = layer.dataProvider()
+        features = self.features(layer, FEATURE_COUNT, True)
+        for f in features:
+            f.setAttribute(provider.fieldNameIndex('value'), 7)
+        res, added = provider.addFeatures(features)
+        res or die("adding features should work: %s" % provider.errors())
+        len(added) == FEATURE_COUNT or die("wrong number of added features")
+
+        ids = set()
+        for i, f in enumerate(added):
+            f.attribute('pk') is not None or die("primary key default not evaluated")
+            f.id() == f.attribute('pk') or die("feature id is not the primary key")
+            f.attribute('name') == ('unnamed' if i % 2 else 'feature %d' % i) or die("wrong name %s" % f.attribute('name'))
+            ids.add(f.id())
+        len(ids) == FEATURE_COUNT or die("feature ids are not unique")
+
+        # the features read back match the ones returned
+        for f in added:
+            stored = layer.getFeatures(QgsFeatureRequest(f.id())).next()
+            stored.attribute('name') == f.attribute('name') or die("wrong name stored")
+            stored.attribute('value') == 7 or die("wrong value stored")
+            stored.geometry().asPoint() == f.geometry().asPoint() or die("wrong geometry stored")
+
+    def test_InsertIntoView(self):
+        """Views are inserted into with INSERT"""
+        before = self.count('copy_table')
+        layer = self.layer('copy_view')
+        res, added = layer.dataProvider().addFeatures(self.features(layer, FEATURE_COUNT))
+        res or die("adding features to a view should work: %s" % layer.dataProvider().errors())
+        self.count('copy_table') == before + FEATURE_COUNT or die("features not added through the view")
+
+    def test_InsertRules(self):
+        """INSERT rules are applied to large batches"""
+        layer = self.layer('rule_table')
+        res, added = layer.dataProvider().addFeatures(self.features(layer, FEATURE_COUNT))
+        res or die("adding features should work: %s" % layer.dataProvider().errors())
+        self.count('rule_table') == FEATURE_COUNT or die("wrong number of features")
+        self.count('rule_log') == FEATURE_COUNT or die("INSERT rule not applied")
+
+    def test_CreateSpatialIndex(self):
+        """The index is created although its conventional name is taken"""
+        layer = self.layer('index_table')
+        provider = layer.dataProvider()
+        provider.capabilities() & QgsVectorDataProvider.CreateSpatialIndex or die("spatial index not supported")
+        provider.createSpatialIndex() or die("creating the spatial index should work: %s" % provider.errors())
+        # a second call keeps the existing index
+        provider.createSpatialIndex() or die("existing spatial index not detected")
+
+        cur = self.con.cursor()
+        cur.execute("SELECT count(*) FROM pg_indexes WHERE schemaname='qgis_test' AND tablename='index_table' AND indexdef LIKE '%gist%'")
+        cur.fetchone()[0] == 1 or die("wrong number of spatial indexes")
+
+if __name__ == '__main__':
+    unittest.main()
@@ -59,3 +59,27 @@ class TestQgsSpatialIndex(unittest.TestCase):
         myMessage = ('Expected: %s\nGot: %s\n' %
                      ([0, 1, 5], fids))
         assert fids == [0, 1, 5], myMessage
+
+    def testCopyNegativeCoordinates(self):
+        idx = QgsSpatialIndex()
+        for fid, (x, y) in enumerate([(-10, -10), (-10, 10), (10, -10), (10, 10)]):
+            ft = QgsFeature()
+            ft.setFeatureId(fid)
+            ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(x, y)))
+            idx.insertFeature(ft)
+
+        # the copy shares the tree until it is changed
+        copy = QgsSpatialIndex(idx)
+        ft = QgsFeature()
+        ft.setFeatureId(4)
+        ft.setGeometry(QgsGeometry.fromPoint(QgsPoint(0, 0)))
+        copy.insertFeature(ft)
+
+        fids = copy.intersects(QgsRectangle(-20, -20, 20, 20))
+        fids.sort()
+        myMessage = ('Expected: %s\nGot: %s\n' %
+                     ([0, 1, 2, 3, 4], fids))
+        assert fids == [0, 1, 2, 3, 4], myMessage
+
+        fids = idx.intersects(QgsRectangle(-20, -20, 20, 20))
+        assert len(fids) == 4, 'The original index was changed'
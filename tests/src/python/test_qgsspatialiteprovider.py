@@ -14,6 +14,7 @@ __revision__ = '$Format:%H$'
 
 import os
 import tempfile
+import time
 import qgis
 import sys
 
@@ -70,6 +71,14 @@ class TestQgsSpatialiteProvider(TestCase):
         sql +=    "VALUES (1, 'toto', GeomFromText('POLYGON((0 0,1 0,1 1,0 1,0 0))', 4326))"
         cur.execute(sql)
 
+        # table with a spatial index for the commit benchmark
+        sql = "CREATE TABLE test_bench (id INTEGER NOT NULL PRIMARY KEY, name TEXT, value REAL)"
+        cur.execute(sql)
+        sql = "SELECT AddGeometryColumn('test_bench', 'geometry', 4326, 'POINT', 'XY')"
+        cur.execute(sql)
+        sql = "SELECT CreateSpatialIndex('test_bench', 'geometry')"
+        cur.execute(sql)
+
         cur.execute( "COMMIT" )
         con.close()
 
@@ -122,5 +131,46 @@ class TestQgsSpatialiteProvider(TestCase):
                 for c1, c2 in zip(p1, p2):
                     c1 == c2 or die("polygon has been altered by failed edition")
 
+    def test_CommitThroughput(self):
+        """Commit large edit buffers, the number of edits is set by QGIS_SPATIALITE_BENCHMARK_EDITS"""
+        count = int(os.environ.get('QGIS_SPATIALITE_BENCHMARK_EDITS', 20000))
+        layer = QgsVectorLayer("dbname=%s table=test_bench (geometry)" % self.dbname, "test_bench", "spatialite")
+        assert(layer.isValid())
+
+        features = []
+        for i in range(count):
+            f = QgsFeature(layer.pendingFields())
+            f.setAttribute('name', 'feature %d' % i)
+            f.setAttribute('value', i * 0.5)
+            f.setGeometry(QgsGeometry.fromPoint(QgsPoint(i % 1000, i / 1000)))
+            features.append(f)
+        layer.startEditing()
+        layer.addFeatures(features, False)
+        start = time.time()
+        layer.commitChanges() or die("adding features should work")
+        print "added %d features/s" % (count / max(time.time() - start, 0.001))
+        layer.featureCount() == count or die("wrong feature count after adding")
+
+        layer.startEditing()
+        nameIdx = layer.fieldNameIndex('name')
+        for f in layer.getFeatures():
+            layer.changeAttributeValue(f.id(), nameIdx, 'changed %d' % f.id())
+            layer.changeGeometry(f.id(), QgsGeometry.fromPoint(QgsPoint(f.geometry().asPoint().x() + 2000, 0)))
+        start = time.time()
+        layer.commitChanges() or die("changing features should work")
+        print "changed %d features/s" % (count / max(time.time() - start, 0.001))
+
+        # the spatial index has to be up to date
+        request = QgsFeatureRequest().setFilterRect(QgsRectangle(1999.5, -0.5, 2000.5, 0.5))
+        ids = [f.id() for f in layer.getFeatures(request)]
+        len(ids) == count / 1000 + (count % 1000 > 0) or die("wrong number of features in the spatial index")
+        f = layer.getFeatures(QgsFeatureRequest(ids[0])).next()
+        f['name'] == 'changed %d' % ids[0] or die("attribute not changed")
+
+        con = sqlite3.connect(self.dbname)
+        enabled = con.execute("SELECT spatial_index_enabled FROM geometry_columns WHERE f_table_name='test_bench'").fetchone()[0]
+        con.close()
+        enabled == 1 or die("spatial index not enabled")
+
 if __name__ == '__main__':
     unittest.main()